@@ -0,0 +1,99 @@
+#!/usr/bin/env bash
+# Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+#
+# Records the order the cooked Linux game opens its files in, from boot to first shot, and packages the game again with
+# its pak laid out in that order, so that startup reads the pak front to back instead of seeking all over it.
+#
+#   UE4_ROOT=/path/to/UnrealEngine Build/Scripts/ProfileStartup.sh [--runs N] [--cold]
+#
+# 1. Packages a Development build without an open order and boots it N times with -MechStartupProfile, which loads
+#    the default map, fires the first shot, appends a row labelled Unordered to Saved/Benchmark/Startup.csv and exits.
+# 2. Boots it once more with -fileopenlog and copies the open order to Build/LinuxNoEditor/FileOpenOrder/GameOpenOrder.log,
+#    where BuildCookRun passes it on to UnrealPak as the pak order. Commit that file so that every build uses it.
+# 3. Packages again, boots it N times labelled Ordered, and prints the rows of both builds.
+#
+# --cold drops the page cache before every boot (needs sudo), which is what the pak order is for; without it the
+# later boots read from memory and the two builds time about the same.
+#
+# -fileopenlog is not compiled into Shipping builds, hence Development.
+
+set -euo pipefail
+
+RUNS=3
+COLD=0
+while [[ $# -gt 0 ]]; do
+	case "$1" in
+		--runs) RUNS="$2"; shift 2 ;;
+		--cold) COLD=1; shift ;;
+		*) echo "Unknown option $1" >&2; exit 2 ;;
+	esac
+done
+
+if [[ -z "${UE4_ROOT:-}" ]]; then
+	echo "Set UE4_ROOT to the engine to package with" >&2
+	exit 2
+fi
+
+PROJECT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+PROJECT="$PROJECT_DIR/MechSurvival.uproject"
+ARCHIVE_DIR="$PROJECT_DIR/Saved/StartupProfile"
+ORDER_DIR="$PROJECT_DIR/Build/LinuxNoEditor/FileOpenOrder"
+ORDER_FILE="$ORDER_DIR/GameOpenOrder.log"
+
+package() {
+	local Label="$1"
+	rm -rf "${ARCHIVE_DIR:?}/$Label"
+	"$UE4_ROOT/Engine/Build/BatchFiles/RunUAT.sh" BuildCookRun -project="$PROJECT" -noP4 -utf8output -unattended \
+		-platform=Linux -clientconfig=Development -build -cook -stage -pak -archive -archivedirectory="$ARCHIVE_DIR/$Label"
+}
+
+game_dir() {
+	echo "$ARCHIVE_DIR/$1/LinuxNoEditor"
+}
+
+# boot <build> <label> [game arguments]
+boot() {
+	local Build="$1"
+	local Label="$2"
+	shift 2
+	if [[ $COLD -eq 1 ]]; then
+		sync
+		echo 3 | sudo tee /proc/sys/vm/drop_caches > /dev/null
+	fi
+	"$(game_dir "$Build")/MechSurvival.sh" -MechStartupProfile -MechStartupLabel="$Label" -nullrhi -nosound -unattended "$@"
+}
+
+# The unordered build must not pick up an order recorded earlier; it is put back if the run fails
+if [[ -f "$ORDER_FILE" ]]; then
+	mv "$ORDER_FILE" "$ORDER_FILE.previous"
+	trap '[[ -f "$ORDER_FILE.previous" ]] && mv "$ORDER_FILE.previous" "$ORDER_FILE"' EXIT
+fi
+
+package Unordered
+for ((Run = 0; Run < RUNS; ++Run)); do
+	boot Unordered Unordered
+done
+
+# Labelled apart, as logging every open slows the boot down
+boot Unordered Recording -fileopenlog
+RECORDED="$(find "$(game_dir Unordered)" -path '*FileOpenOrder/GameOpenOrder.log' -print -quit)"
+if [[ -z "$RECORDED" ]]; then
+	echo "The game wrote no GameOpenOrder.log" >&2
+	exit 1
+fi
+mkdir -p "$ORDER_DIR"
+cp "$RECORDED" "$ORDER_FILE"
+rm -f "$ORDER_FILE.previous"
+echo "Recorded $(wc -l < "$ORDER_FILE") file opens to $ORDER_FILE"
+
+package Ordered
+for ((Run = 0; Run < RUNS; ++Run)); do
+	boot Ordered Ordered
+done
+
+for Label in Unordered Ordered; do
+	echo "== $Label"
+	REPORT="$(game_dir "$Label")/MechSurvival/Saved/Benchmark/Startup.csv"
+	head -n 1 "$REPORT"
+	grep ",$Label\$" "$REPORT" || true
+done
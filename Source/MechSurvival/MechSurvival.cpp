@@ -1,7 +1,112 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "MechSurvival.h"
+#include "MechSurvivalReplicationGraph.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Level.h"
+#include "GameFramework/Actor.h"
 #include "Modules/ModuleManager.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, MechSurvival, "MechSurvival" );
- 
\ No newline at end of file
+class FMechSurvivalModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		// Servers pick the MechSurvival replication graph for game worlds; everything else keeps the default driver
+		UReplicationDriver::CreateReplicationDriverDelegate().BindStatic(&UMechSurvivalReplicationGraph::CreateForNetDriver);
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+		MechSurvivalMemory::RegisterTags();
+#endif
+	}
+
+	virtual void ShutdownModule() override
+	{
+		UReplicationDriver::CreateReplicationDriverDelegate().Unbind();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FMechSurvivalModule, MechSurvival, "MechSurvival" );
+
+DEFINE_STAT(STAT_MechSurvival_OnFire);
+DEFINE_STAT(STAT_MechSurvival_ProjectileHit);
+DEFINE_STAT(STAT_MechSurvival_PoolAcquire);
+DEFINE_STAT(STAT_MechSurvival_BallisticsStep);
+DEFINE_STAT(STAT_MechSurvival_DrawHUD);
+DEFINE_STAT(STAT_MechSurvival_MovementInput);
+DEFINE_STAT(STAT_MechSurvival_RewindQuery);
+DEFINE_STAT(STAT_MechSurvival_HordeStep);
+DEFINE_STAT(STAT_MechSurvival_WaveSpawn);
+DEFINE_STAT(STAT_MechSurvival_WeaponFire);
+DEFINE_STAT(STAT_MechSurvival_SignificanceUpdate);
+DEFINE_STAT(STAT_MechSurvival_ImpulseFlush);
+DEFINE_STAT(STAT_MechSurvival_LevelStreamingUpdate);
+DEFINE_STAT(STAT_MechSurvival_ServerMove);
+DEFINE_STAT(STAT_MechSurvival_SpatialHashUpdate);
+DEFINE_STAT(STAT_MechSurvival_AreaQuery);
+DEFINE_STAT(STAT_MechSurvival_SnapshotCapture);
+
+DEFINE_STAT(STAT_MechSurvival_Spawns);
+DEFINE_STAT(STAT_MechSurvival_Hits);
+DEFINE_STAT(STAT_MechSurvival_Impulses);
+DEFINE_STAT(STAT_MechSurvival_PoolMisses);
+DEFINE_STAT(STAT_MechSurvival_HUDDrawItems);
+DEFINE_STAT(STAT_MechSurvival_HUDDrawCalls);
+DEFINE_STAT(STAT_MechSurvival_InputEvents);
+DEFINE_STAT(STAT_MechSurvival_FireRequests);
+DEFINE_STAT(STAT_MechSurvival_ShotEventsReplicated);
+DEFINE_STAT(STAT_MechSurvival_RewindQueries);
+DEFINE_STAT(STAT_MechSurvival_MechSteeringUpdates);
+DEFINE_STAT(STAT_MechSurvival_MechsKilled);
+DEFINE_STAT(STAT_MechSurvival_WaveSpawns);
+DEFINE_STAT(STAT_MechSurvival_WaveBudgetOverruns);
+DEFINE_STAT(STAT_MechSurvival_WeaponRounds);
+DEFINE_STAT(STAT_MechSurvival_WeaponPellets);
+DEFINE_STAT(STAT_MechSurvival_FireSoundsPlayed);
+DEFINE_STAT(STAT_MechSurvival_FireSoundsCulled);
+DEFINE_STAT(STAT_MechSurvival_ImpulseWrites);
+DEFINE_STAT(STAT_MechSurvival_DebrisPutToSleep);
+DEFINE_STAT(STAT_MechSurvival_StreamingHitches);
+DEFINE_STAT(STAT_MechSurvival_ServerMoves);
+DEFINE_STAT(STAT_MechSurvival_MoveCorrections);
+DEFINE_STAT(STAT_MechSurvival_AreaQueries);
+DEFINE_STAT(STAT_MechSurvival_Explosions);
+
+DEFINE_STAT(STAT_MechSurvival_LiveProjectileActors);
+DEFINE_STAT(STAT_MechSurvival_LiveSimulatedRounds);
+DEFINE_STAT(STAT_MechSurvival_RewindQueriesPerSecond);
+DEFINE_STAT(STAT_MechSurvival_RewindHistoryBytes);
+DEFINE_STAT(STAT_MechSurvival_LiveMechs);
+DEFINE_STAT(STAT_MechSurvival_PromotedMechs);
+DEFINE_STAT(STAT_MechSurvival_WaveSpawnLatencyMs);
+DEFINE_STAT(STAT_MechSurvival_SignificantActors);
+DEFINE_STAT(STAT_MechSurvival_InsignificantActors);
+DEFINE_STAT(STAT_MechSurvival_AwakeDebris);
+DEFINE_STAT(STAT_MechSurvival_LoadedCells);
+DEFINE_STAT(STAT_MechSurvival_VRInputToSpawnMicroseconds);
+DEFINE_STAT(STAT_MechSurvival_AnimationGameThreadMicroseconds);
+DEFINE_STAT(STAT_MechSurvival_BudgetedMeshes);
+DEFINE_STAT(STAT_MechSurvival_ThrottledMeshes);
+DEFINE_STAT(STAT_MechSurvival_SpatialHashEntities);
+DEFINE_STAT(STAT_MechSurvival_SnapshotStallMicroseconds);
+DEFINE_STAT(STAT_MechSurvival_SnapshotBytes);
+DEFINE_STAT(STAT_MechSurvival_MemoryTagsOverBudget);
+
+CSV_DEFINE_CATEGORY(MechSurvival, true);
+
+void MechSurvivalProps::GetSimulatingProps(const ULevel* Level, TArray<UPrimitiveComponent*>& OutProps)
+{
+	if (Level == nullptr)
+	{
+		return;
+	}
+
+	for (AActor* Actor : Level->Actors)
+	{
+		UPrimitiveComponent* Root = Actor ? Cast<UPrimitiveComponent>(Actor->GetRootComponent()) : nullptr;
+		if (Root != nullptr && Actor->HasAnyFlags(RF_WasLoaded) && Root->BodyInstance.bSimulatePhysics && Root->Mobility == EComponentMobility::Movable)
+		{
+			OutProps.Add(Root);
+		}
+	}
+}
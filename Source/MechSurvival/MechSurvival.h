@@ -3,3 +3,164 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/** Project-specific profiling scopes and counters; none of it is compiled into Shipping builds */
+#define MECHSURVIVAL_PROFILING !UE_BUILD_SHIPPING
+
+DECLARE_STATS_GROUP(TEXT("MechSurvival"), STATGROUP_MechSurvival, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("OnFire"), STAT_MechSurvival_OnFire, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Projectile OnHit"), STAT_MechSurvival_ProjectileHit, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Projectile Pool Acquire"), STAT_MechSurvival_PoolAcquire, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Ballistics Step"), STAT_MechSurvival_BallisticsStep, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DrawHUD"), STAT_MechSurvival_DrawHUD, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Movement Input"), STAT_MechSurvival_MovementInput, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Rewind Query"), STAT_MechSurvival_RewindQuery, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Horde Step"), STAT_MechSurvival_HordeStep, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Wave Spawn"), STAT_MechSurvival_WaveSpawn, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Weapon Fire"), STAT_MechSurvival_WeaponFire, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Significance Update"), STAT_MechSurvival_SignificanceUpdate, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Impulse Flush"), STAT_MechSurvival_ImpulseFlush, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Level Streaming Update"), STAT_MechSurvival_LevelStreamingUpdate, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Server Move"), STAT_MechSurvival_ServerMove, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Spatial Hash Update"), STAT_MechSurvival_SpatialHashUpdate, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Area Query"), STAT_MechSurvival_AreaQuery, STATGROUP_MechSurvival, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Snapshot Capture"), STAT_MechSurvival_SnapshotCapture, STATGROUP_MechSurvival, );
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Projectile Spawns"), STAT_MechSurvival_Spawns, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Projectile Hits"), STAT_MechSurvival_Hits, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Impulses Applied"), STAT_MechSurvival_Impulses, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pool Misses"), STAT_MechSurvival_PoolMisses, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("HUD Draw Items"), STAT_MechSurvival_HUDDrawItems, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("HUD Draw Calls"), STAT_MechSurvival_HUDDrawCalls, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Input Events"), STAT_MechSurvival_InputEvents, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Fire Requests Received"), STAT_MechSurvival_FireRequests, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shot Events Replicated"), STAT_MechSurvival_ShotEventsReplicated, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Rewind Queries"), STAT_MechSurvival_RewindQueries, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Mech Steering Updates"), STAT_MechSurvival_MechSteeringUpdates, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Mechs Killed"), STAT_MechSurvival_MechsKilled, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Wave Spawns"), STAT_MechSurvival_WaveSpawns, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Wave Spawn Budget Overruns"), STAT_MechSurvival_WaveBudgetOverruns, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Weapon Rounds"), STAT_MechSurvival_WeaponRounds, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Weapon Pellets"), STAT_MechSurvival_WeaponPellets, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Fire Sounds Played"), STAT_MechSurvival_FireSoundsPlayed, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Fire Sounds Culled"), STAT_MechSurvival_FireSoundsCulled, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Impulse Writes"), STAT_MechSurvival_ImpulseWrites, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Debris Put To Sleep"), STAT_MechSurvival_DebrisPutToSleep, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Streaming Hitches"), STAT_MechSurvival_StreamingHitches, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Server Moves"), STAT_MechSurvival_ServerMoves, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Move Corrections"), STAT_MechSurvival_MoveCorrections, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Area Queries"), STAT_MechSurvival_AreaQueries, STATGROUP_MechSurvival, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Explosions"), STAT_MechSurvival_Explosions, STATGROUP_MechSurvival, );
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Live Projectile Actors"), STAT_MechSurvival_LiveProjectileActors, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Live Simulated Rounds"), STAT_MechSurvival_LiveSimulatedRounds, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Rewind Queries Per Second"), STAT_MechSurvival_RewindQueriesPerSecond, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Rewind History Bytes"), STAT_MechSurvival_RewindHistoryBytes, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Live Mechs"), STAT_MechSurvival_LiveMechs, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Promoted Mechs"), STAT_MechSurvival_PromotedMechs, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Wave Spawn Latency Ms"), STAT_MechSurvival_WaveSpawnLatencyMs, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Significant Actors"), STAT_MechSurvival_SignificantActors, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Insignificant Actors"), STAT_MechSurvival_InsignificantActors, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Awake Debris"), STAT_MechSurvival_AwakeDebris, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Loaded Cells"), STAT_MechSurvival_LoadedCells, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("VR Input To Spawn Us"), STAT_MechSurvival_VRInputToSpawnMicroseconds, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Anim Game Thread Us"), STAT_MechSurvival_AnimationGameThreadMicroseconds, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Budgeted Meshes"), STAT_MechSurvival_BudgetedMeshes, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Throttled Meshes"), STAT_MechSurvival_ThrottledMeshes, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Spatial Hash Entities"), STAT_MechSurvival_SpatialHashEntities, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Snapshot Stall Us"), STAT_MechSurvival_SnapshotStallMicroseconds, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Snapshot Bytes"), STAT_MechSurvival_SnapshotBytes, STATGROUP_MechSurvival, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Memory Tags Over Budget"), STAT_MechSurvival_MemoryTagsOverBudget, STATGROUP_MechSurvival, );
+
+CSV_DECLARE_CATEGORY_EXTERN(MechSurvival);
+
+class ULevel;
+class UPrimitiveComponent;
+
+namespace MechSurvivalProps
+{
+	/**
+	 * Adds the physics props placed in a level: actors loaded with it whose root is a movable primitive simulating
+	 * physics. Anything spawned at runtime belongs to the system that spawned it and is left out.
+	 */
+	void GetSimulatingProps(const ULevel* Level, TArray<UPrimitiveComponent*>& OutProps);
+}
+
+#if MECHSURVIVAL_PROFILING
+
+/**
+ * Times the enclosing scope for "stat MechSurvival", the CSV profiler and Unreal Insights.
+ * Declares scoped objects, so it has to stand at block scope, never as the body of an unbraced if or loop.
+ */
+#define MECHSURVIVAL_SCOPE_CYCLE_COUNTER(Name) \
+	SCOPE_CYCLE_COUNTER(STAT_MechSurvival_##Name); \
+	CSV_SCOPED_TIMING_STAT(MechSurvival, Name); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(MechSurvival_##Name)
+
+/** Adds to a per-frame counter in stats and in the CSV profile */
+#define MECHSURVIVAL_INC_COUNTER(Name, Amount) \
+	do \
+	{ \
+		INC_DWORD_STAT_BY(STAT_MechSurvival_##Name, Amount); \
+		CSV_CUSTOM_STAT(MechSurvival, Name, (int32)(Amount), ECsvCustomStatOp::Accumulate); \
+	} while (0)
+
+/** Sets a level that persists across frames in stats and records it in the CSV profile */
+#define MECHSURVIVAL_SET_LEVEL(Name, Value) \
+	do \
+	{ \
+		SET_DWORD_STAT(STAT_MechSurvival_##Name, Value); \
+		CSV_CUSTOM_STAT(MechSurvival, Name, (int32)(Value), ECsvCustomStatOp::Set); \
+	} while (0)
+
+#else
+
+#define MECHSURVIVAL_SCOPE_CYCLE_COUNTER(Name)
+#define MECHSURVIVAL_INC_COUNTER(Name, Amount) do { } while (0)
+#define MECHSURVIVAL_SET_LEVEL(Name, Value) do { } while (0)
+
+#endif
+
+/** Low level memory tracker tags of the game's systems, budgeted by UMechSurvivalMemoryBudget; append only */
+enum class EMechSurvivalMemoryTag : uint8
+{
+	/** Projectile actors and simulated rounds */
+	Projectiles,
+	Characters,
+	HUD,
+	/** Sounds and montages of characters firing */
+	FireEffects,
+	Horde,
+	Waves,
+
+	Num
+};
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+
+namespace MechSurvivalMemory
+{
+	/** Project tags come after the engine's and the platform's */
+	inline ELLMTag ToLLMTag(EMechSurvivalMemoryTag Tag)
+	{
+		return (ELLMTag)((int32)ELLMTag::ProjectTagStart + (int32)Tag);
+	}
+
+	/** Names the tags for LLM's stats and reports; called once when the module starts */
+	void RegisterTags();
+}
+
+/** Counts what the enclosing scope allocates towards a system's tag, when the game runs with -LLM */
+#define MECHSURVIVAL_LLM_SCOPE(Tag) \
+	LLM_SCOPE(MechSurvivalMemory::ToLLMTag(EMechSurvivalMemoryTag::Tag))
+
+#else
+
+#define MECHSURVIVAL_LLM_SCOPE(Tag)
+
+#endif
@@ -0,0 +1,178 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalAnimationBudget.h"
+#include "MechSurvival.h"
+#include "MechSurvivalSkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "HAL/IConsoleManager.h"
+#include "IAnimationBudgetAllocator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechAnimation, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpAnimationBudgetCmd(
+	TEXT("MechSurvival.Animation.Dump"),
+	TEXT("Logs the game thread time character animation took and how many meshes the animation budget throttled"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalAnimationBudget* AnimationBudget = UMechSurvivalAnimationBudget::Get(World))
+		{
+			AnimationBudget->DumpStats();
+		}
+	}));
+
+/** Sets an engine animation setting, if this engine has it */
+template<typename ValueType>
+static void SetAnimationVariable(const TCHAR* Name, ValueType Value)
+{
+	if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(Name))
+	{
+		Variable->Set(Value, ECVF_SetByGameSetting);
+	}
+	else
+	{
+		UE_LOG(LogMechAnimation, Warning, TEXT("%s does not exist, its animation setting is not applied"), Name);
+	}
+}
+
+/** True if a mesh is drawn for the local player at all; a mesh nobody sees is not animated whether throttled or not */
+static bool IsShownLocally(const USkeletalMeshComponent* Mesh)
+{
+	// Covers hidden meshes and hidden owners, e.g. pooled mechs
+	if (!Mesh->ShouldRender())
+	{
+		return false;
+	}
+
+	const APawn* OwnerPawn = Cast<APawn>(Mesh->GetOwner());
+	const bool bOwnerView = OwnerPawn != nullptr && OwnerPawn->IsLocallyControlled();
+	return bOwnerView ? !Mesh->bOwnerNoSee : !Mesh->bOnlyOwnerSee;
+}
+
+bool UMechSurvivalAnimationBudget::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalAnimationBudget::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	SetAnimationVariable(TEXT("a.ParallelAnimUpdate"), bParallelAnimation ? 1 : 0);
+	SetAnimationVariable(TEXT("a.ParallelAnimEvaluation"), bParallelAnimation ? 1 : 0);
+
+	SetAnimationVariable(TEXT("a.Budget.Enabled"), bEnableBudget ? 1 : 0);
+	if (bEnableBudget)
+	{
+		SetAnimationVariable(TEXT("a.Budget.BudgetMs"), FMath::Max(BudgetMilliseconds, 0.1f));
+		SetAnimationVariable(TEXT("a.Budget.MaxTickRate"), FMath::Max(MaxTickRate, 1));
+		SetAnimationVariable(TEXT("a.Budget.MaxInterpolatedComponents"), FMath::Max(MaxInterpolatedMeshes, 0));
+		SetAnimationVariable(TEXT("a.Budget.InterpolationMaxRate"), FMath::Max(InterpolationMaxRate, 1));
+	}
+}
+
+void UMechSurvivalAnimationBudget::Deinitialize()
+{
+	if (Stats.Frames > 0)
+	{
+		DumpStats();
+	}
+
+	Meshes.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalAnimationBudget* UMechSurvivalAnimationBudget::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalAnimationBudget>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalAnimationBudget::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalAnimationBudget::IsTickable() const
+{
+	return GetWorld() != nullptr && Meshes.Num() > 0;
+}
+
+TStatId UMechSurvivalAnimationBudget::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalAnimationBudget, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalAnimationBudget::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+bool UMechSurvivalAnimationBudget::IsBudgeting() const
+{
+	const IAnimationBudgetAllocator* Allocator = IAnimationBudgetAllocator::Get(GetWorld());
+	return Allocator != nullptr && Allocator->GetEnabled();
+}
+
+void UMechSurvivalAnimationBudget::RegisterMesh(UMechSurvivalSkeletalMeshComponent* Mesh)
+{
+	if (Mesh != nullptr)
+	{
+		Meshes.AddUnique(Mesh);
+	}
+}
+
+void UMechSurvivalAnimationBudget::UnregisterMesh(UMechSurvivalSkeletalMeshComponent* Mesh)
+{
+	Meshes.RemoveSwap(Mesh);
+}
+
+void UMechSurvivalAnimationBudget::Tick(float DeltaTime)
+{
+	// Tickables run after the tick groups, so every mesh that animates this frame has done so
+	double GameThreadSeconds = 0.0;
+	int32 NumThrottled = 0;
+	for (int32 Index = Meshes.Num() - 1; Index >= 0; --Index)
+	{
+		UMechSurvivalSkeletalMeshComponent* Mesh = Meshes[Index].Get();
+		if (Mesh == nullptr)
+		{
+			Meshes.RemoveAtSwap(Index, 1, false);
+			continue;
+		}
+
+		GameThreadSeconds += Mesh->ConsumeGameThreadSeconds();
+
+		// Meshes without a skeletal mesh or not shown here have nothing to animate, e.g. the arms in VR or other players' arms
+		if (Mesh->SkeletalMesh != nullptr && IsShownLocally(Mesh) && !Mesh->WasEvaluatedThisFrame())
+		{
+			++NumThrottled;
+		}
+	}
+
+	LastGameThreadSeconds = GameThreadSeconds;
+	LastThrottledMeshes = NumThrottled;
+
+	++Stats.Frames;
+	Stats.FramesOverBudget += GameThreadSeconds * 1000.0 > BudgetMilliseconds ? 1 : 0;
+	Stats.TotalGameThreadSeconds += GameThreadSeconds;
+	Stats.MaxGameThreadSeconds = FMath::Max(Stats.MaxGameThreadSeconds, GameThreadSeconds);
+	Stats.TotalThrottledMeshes += NumThrottled;
+	Stats.MaxThrottledMeshes = FMath::Max(Stats.MaxThrottledMeshes, NumThrottled);
+
+	MECHSURVIVAL_SET_LEVEL(AnimationGameThreadMicroseconds, (uint32)(GameThreadSeconds * 1000000.0));
+	MECHSURVIVAL_SET_LEVEL(BudgetedMeshes, Meshes.Num());
+	MECHSURVIVAL_SET_LEVEL(ThrottledMeshes, NumThrottled);
+}
+
+void UMechSurvivalAnimationBudget::DumpStats() const
+{
+	const int32 Frames = FMath::Max(Stats.Frames, 1);
+	UE_LOG(LogMechAnimation, Log, TEXT("%d character meshes, %s within %.2f ms; last frame %.3f ms, %d throttled"),
+		Meshes.Num(), IsBudgeting() ? TEXT("budgeted") : TEXT("not budgeted"), BudgetMilliseconds, LastGameThreadSeconds * 1000.0, LastThrottledMeshes);
+	UE_LOG(LogMechAnimation, Log, TEXT("Over %d frames: %.3f ms on average, %.3f ms at worst, %d frames over budget; %.1f meshes throttled on average, %d at most"),
+		Stats.Frames, Stats.TotalGameThreadSeconds * 1000.0 / Frames, Stats.MaxGameThreadSeconds * 1000.0, Stats.FramesOverBudget,
+		(double)Stats.TotalThrottledMeshes / Frames, Stats.MaxThrottledMeshes);
+}
@@ -0,0 +1,106 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalAnimationBudget.generated.h"
+
+class UMechSurvivalSkeletalMeshComponent;
+
+/** Counts since the world started, for the dump */
+struct FMechSurvivalAnimationBudgetStats
+{
+	int32 Frames = 0;
+	/** Frames whose animation took longer on the game thread than BudgetMilliseconds */
+	int32 FramesOverBudget = 0;
+	double TotalGameThreadSeconds = 0.0;
+	double MaxGameThreadSeconds = 0.0;
+	/** Summed over the frames, for the average */
+	int64 TotalThrottledMeshes = 0;
+	int32 MaxThrottledMeshes = 0;
+};
+
+/**
+ * Caps the time character animation takes each frame.
+ *
+ * Character meshes are UMechSurvivalSkeletalMeshComponents, which the engine's animation budget allocator ticks: every
+ * frame it ranks them by the significance score of their owner, animates the most significant ones at full rate and
+ * throttles the rest, up to MaxTickRate frames between updates, so that the game thread time of all of them stays
+ * within BudgetMilliseconds. Up to MaxInterpolatedMeshes of the throttled ones interpolate their skipped frames, no
+ * more than InterpolationMaxRate frames apart, the others hold their pose. Meshes nobody renders do not animate, and
+ * neither do the montages playing on them; the local players' own pawns are never throttled. With bParallelAnimation
+ * the poses are updated and evaluated on worker threads, for the animation blueprints that allow it.
+ *
+ * Game thread animation time and the number of meshes that did not evaluate a pose are kept per frame and shown by the
+ * Anim Game Thread Us and Throttled Meshes stats and MechSurvival.Animation.Dump.
+ */
+UCLASS(config=Game)
+class UMechSurvivalAnimationBudget : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the animation budget of the world the context object lives in, if any */
+	static UMechSurvivalAnimationBudget* Get(const UObject* WorldContextObject);
+
+	/** Whether the budget allocator paces the character meshes; if not, they animate at the rate their significance sets */
+	bool IsBudgeting() const;
+
+	/** Starts measuring a mesh */
+	void RegisterMesh(UMechSurvivalSkeletalMeshComponent* Mesh);
+
+	void UnregisterMesh(UMechSurvivalSkeletalMeshComponent* Mesh);
+
+	const FMechSurvivalAnimationBudgetStats& GetStats() const { return Stats; }
+
+	/** Writes the animation time and the throttled meshes to the log */
+	void DumpStats() const;
+
+protected:
+	UPROPERTY(config)
+	bool bEnableBudget = true;
+
+	/** Game thread time all the character meshes may take together each frame, in ms */
+	UPROPERTY(config)
+	float BudgetMilliseconds = 1.5f;
+
+	/** Most frames a throttled mesh goes without updating */
+	UPROPERTY(config)
+	int32 MaxTickRate = 10;
+
+	/** Throttled meshes that interpolate between their updates */
+	UPROPERTY(config)
+	int32 MaxInterpolatedMeshes = 16;
+
+	/** Most frames between the updates of an interpolated mesh */
+	UPROPERTY(config)
+	int32 InterpolationMaxRate = 6;
+
+	/** Updates and evaluates poses on worker threads */
+	UPROPERTY(config)
+	bool bParallelAnimation = true;
+
+private:
+	TArray<TWeakObjectPtr<UMechSurvivalSkeletalMeshComponent>> Meshes;
+
+	int32 LastThrottledMeshes = 0;
+	double LastGameThreadSeconds = 0.0;
+
+	FMechSurvivalAnimationBudgetStats Stats;
+};
@@ -0,0 +1,322 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalAssetPreloader.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalDeterminism.h"
+#include "MechSurvivalGameMode.h"
+#include "MechSurvivalHUD.h"
+#include "MechSurvivalWeaponComponent.h"
+#include "Containers/Ticker.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechPreload, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpStartupCmd(
+	TEXT("MechSurvival.Startup.Dump"),
+	TEXT("Logs the startup timings and the state of the asset preload"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (UMechSurvivalAssetPreloader* Preloader = UMechSurvivalAssetPreloader::Get(World))
+		{
+			Preloader->DumpStartupReport();
+		}
+	}));
+
+static double GetSecondsSinceStart()
+{
+	return FPlatformTime::Seconds() - GStartTime;
+}
+
+static double GetUsedPhysicalMB()
+{
+	return FPlatformMemory::GetStats().UsedPhysical / (1024.0 * 1024.0);
+}
+
+void UMechSurvivalAssetPreloader::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	InitializeSeconds = GetSecondsSinceStart();
+	UsedPhysicalAtInitialize = FPlatformMemory::GetStats().UsedPhysical;
+
+	PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddUObject(this, &UMechSurvivalAssetPreloader::OnPreLoadMap);
+	PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &UMechSurvivalAssetPreloader::OnPostLoadMap);
+
+	FParse::Value(FCommandLine::Get(), TEXT("MechStartupLabel="), StartupLabel);
+	bStartupProfile = FParse::Param(FCommandLine::Get(), TEXT("MechStartupProfile"));
+	if (bStartupProfile)
+	{
+		ProfileTickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UMechSurvivalAssetPreloader::TickStartupProfile));
+	}
+
+	// The game mode and HUD are native, so their defaults are there already; the pawn class they name comes first
+	TArray<FSoftObjectPath> Assets = PreloadAssets;
+	GetDefault<AMechSurvivalGameMode>()->GetPreloadAssets(Assets);
+	GetDefault<AMechSurvivalHUD>()->GetPreloadAssets(Assets);
+	Assets.RemoveAll([](const FSoftObjectPath& Path) { return Path.IsNull(); });
+
+	NumPreloadAssets = Assets.Num();
+	UE_LOG(LogMechPreload, Log, TEXT("Preloading %d assets, %.2f s after start"), Assets.Num(), InitializeSeconds);
+
+	ClassesHandle = StreamableManager.RequestAsyncLoad(Assets, FStreamableDelegate::CreateUObject(this, &UMechSurvivalAssetPreloader::OnClassesLoaded), FStreamableManager::AsyncLoadHighPriority, true, false, TEXT("MechSurvivalPreloadClasses"));
+	if (ClassesHandle.IsValid())
+	{
+		ClassesHandle->BindUpdateDelegate(FStreamableUpdateDelegate::CreateUObject(this, &UMechSurvivalAssetPreloader::OnPreloadUpdate));
+		WaitIfDeterministic(ClassesHandle);
+	}
+	else
+	{
+		OnClassesLoaded();
+	}
+}
+
+void UMechSurvivalAssetPreloader::Deinitialize()
+{
+	FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+	if (ProfileTickerHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(ProfileTickerHandle);
+		ProfileTickerHandle.Reset();
+	}
+
+	if (ClassesHandle.IsValid())
+	{
+		ClassesHandle->CancelHandle();
+	}
+	if (DependenciesHandle.IsValid())
+	{
+		DependenciesHandle->CancelHandle();
+	}
+	ClassesHandle.Reset();
+	DependenciesHandle.Reset();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalAssetPreloader* UMechSurvivalAssetPreloader::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	const UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+	return GameInstance ? GameInstance->GetSubsystem<UMechSurvivalAssetPreloader>() : nullptr;
+}
+
+TSharedPtr<FStreamableHandle> UMechSurvivalAssetPreloader::RequestAsyncLoad(const TArray<FSoftObjectPath>& Assets, FStreamableDelegate Callback, const FString& DebugName)
+{
+	TArray<FSoftObjectPath> ToLoad = Assets;
+	ToLoad.RemoveAll([](const FSoftObjectPath& Path) { return Path.IsNull(); });
+	if (ToLoad.Num() == 0)
+	{
+		Callback.ExecuteIfBound();
+		return nullptr;
+	}
+
+	TSharedPtr<FStreamableHandle> Handle = StreamableManager.RequestAsyncLoad(ToLoad, Callback, FStreamableManager::DefaultAsyncLoadPriority, false, false, DebugName);
+	WaitIfDeterministic(Handle);
+	return Handle;
+}
+
+void UMechSurvivalAssetPreloader::WaitIfDeterministic(const TSharedPtr<FStreamableHandle>& Handle)
+{
+	// Assets arriving a tick earlier or later would change what the simulation does
+	if (Handle.IsValid() && UMechSurvivalDeterminism::IsDeterministicRun())
+	{
+		Handle->WaitUntilComplete();
+	}
+}
+
+float UMechSurvivalAssetPreloader::GetPreloadProgress() const
+{
+	if (bPreloadComplete)
+	{
+		return 1.f;
+	}
+
+	// Each stage is half of the bar; how many assets the second one has is not known before the first is done
+	const float ClassesProgress = ClassesHandle.IsValid() ? ClassesHandle->GetProgress() : 1.f;
+	const float DependenciesProgress = DependenciesHandle.IsValid() ? DependenciesHandle->GetProgress() : 0.f;
+	return 0.5f * ClassesProgress + 0.5f * DependenciesProgress;
+}
+
+void UMechSurvivalAssetPreloader::OnPreloadUpdate(TSharedRef<FStreamableHandle> Handle)
+{
+	const float Progress = GetPreloadProgress();
+	UE_LOG(LogMechPreload, Verbose, TEXT("Preload %.0f%%"), Progress * 100.f);
+	OnPreloadProgress.Broadcast(Progress);
+}
+
+void UMechSurvivalAssetPreloader::OnClassesLoaded()
+{
+	// Characters list their own soft references; now that their classes are here, load those as well
+	TArray<FSoftObjectPath> Dependencies;
+	if (ClassesHandle.IsValid())
+	{
+		TArray<UObject*> LoadedAssets;
+		ClassesHandle->GetLoadedAssets(LoadedAssets);
+		for (UObject* Asset : LoadedAssets)
+		{
+			const UClass* Class = Cast<UClass>(Asset);
+			if (Class != nullptr && Class->IsChildOf(AMechSurvivalCharacter::StaticClass()))
+			{
+				Class->GetDefaultObject<AMechSurvivalCharacter>()->GetPreloadAssets(Dependencies);
+			}
+		}
+	}
+	Dependencies.RemoveAll([](const FSoftObjectPath& Path) { return Path.IsNull(); });
+
+	NumPreloadAssets += Dependencies.Num();
+	OnPreloadProgress.Broadcast(GetPreloadProgress());
+
+	DependenciesHandle = StreamableManager.RequestAsyncLoad(Dependencies, FStreamableDelegate::CreateUObject(this, &UMechSurvivalAssetPreloader::OnPreloadFinished), FStreamableManager::AsyncLoadHighPriority, true, false, TEXT("MechSurvivalPreloadDependencies"));
+	if (DependenciesHandle.IsValid())
+	{
+		DependenciesHandle->BindUpdateDelegate(FStreamableUpdateDelegate::CreateUObject(this, &UMechSurvivalAssetPreloader::OnPreloadUpdate));
+		WaitIfDeterministic(DependenciesHandle);
+	}
+	else
+	{
+		OnPreloadFinished();
+	}
+}
+
+void UMechSurvivalAssetPreloader::OnPreloadFinished()
+{
+	if (bPreloadComplete)
+	{
+		return;
+	}
+
+	bPreloadComplete = true;
+	PreloadDoneSeconds = GetSecondsSinceStart();
+	UE_LOG(LogMechPreload, Log, TEXT("Preloaded %d assets, %.2f s after start"), NumPreloadAssets, PreloadDoneSeconds);
+
+	OnPreloadProgress.Broadcast(1.f);
+	OnPreloadComplete.Broadcast();
+
+	TryWriteStartupReport();
+}
+
+void UMechSurvivalAssetPreloader::OnPreLoadMap(const FString& MapName)
+{
+	if (FirstMapName.IsEmpty())
+	{
+		MapLoadStartSeconds = GetSecondsSinceStart();
+	}
+}
+
+void UMechSurvivalAssetPreloader::OnPostLoadMap(UWorld* World)
+{
+	if (World == nullptr || !FirstMapName.IsEmpty())
+	{
+		return;
+	}
+
+	FirstMapReadySeconds = GetSecondsSinceStart();
+	FirstMapLoadSeconds = MapLoadStartSeconds > 0.0 ? FirstMapReadySeconds - MapLoadStartSeconds : 0.0;
+	FirstMapName = World->GetMapName();
+	World->RemovePIEPrefix(FirstMapName);
+
+	TryWriteStartupReport();
+}
+
+void UMechSurvivalAssetPreloader::NotifyShotFired()
+{
+	if (FirstShotSeconds > 0.0)
+	{
+		return;
+	}
+
+	FirstShotSeconds = GetSecondsSinceStart();
+	UE_LOG(LogMechPreload, Log, TEXT("First shot %.2f s after start"), FirstShotSeconds);
+
+	TryWriteStartupReport();
+}
+
+bool UMechSurvivalAssetPreloader::TickStartupProfile(float DeltaTime)
+{
+	if (bReportWritten)
+	{
+		if (AMechSurvivalCharacter* Character = ProfileCharacter.Get())
+		{
+			Character->GetWeaponComponent()->StopFire();
+		}
+
+		FPlatformMisc::RequestExitWithStatus(false, bStartupProfileTimedOut ? 1 : 0);
+		ProfileTickerHandle.Reset();
+		return false;
+	}
+
+	if (GetSecondsSinceStart() > StartupProfileTimeout)
+	{
+		UE_LOG(LogMechPreload, Error, TEXT("Startup profile: nothing fired %.0f s after start; preload %s, map %s"),
+			StartupProfileTimeout, bPreloadComplete ? TEXT("done") : TEXT("running"), FirstMapName.IsEmpty() ? TEXT("loading") : *FirstMapName);
+		bStartupProfileTimedOut = true;
+		TryWriteStartupReport();
+		return true;
+	}
+
+	// The trigger stays held until a round goes; the weapon's projectile class may still be on its way
+	if (bPreloadComplete && !FirstMapName.IsEmpty() && !ProfileCharacter.IsValid())
+	{
+		const UGameInstance* GameInstance = GetGameInstance();
+		const APlayerController* PlayerController = GameInstance ? GameInstance->GetFirstLocalPlayerController() : nullptr;
+		AMechSurvivalCharacter* Character = PlayerController ? Cast<AMechSurvivalCharacter>(PlayerController->GetPawn()) : nullptr;
+		if (Character != nullptr && Character->GetWeaponComponent() != nullptr)
+		{
+			ProfileCharacter = Character;
+			Character->GetWeaponComponent()->StartFire();
+		}
+	}
+	return true;
+}
+
+void UMechSurvivalAssetPreloader::TryWriteStartupReport()
+{
+	// A profile run also waits for its shot; one that timed out still leaves a row, so the failure shows next to the others
+	const bool bReady = bPreloadComplete && !FirstMapName.IsEmpty() && (!bStartupProfile || FirstShotSeconds > 0.0);
+	if (bReportWritten || (!bReady && !bStartupProfileTimedOut))
+	{
+		return;
+	}
+	bReportWritten = true;
+
+	DumpStartupReport();
+
+	if (!bWriteStartupReport)
+	{
+		return;
+	}
+
+	// New columns go at the end, so that rows of older runs still line up
+	const FString Line = FString::Printf(TEXT("%s,%s,%d,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f,%.3f,%s\n"),
+		*FDateTime::Now().ToString(), *FirstMapName, NumPreloadAssets,
+		InitializeSeconds, PreloadDoneSeconds, FirstMapLoadSeconds, FirstMapReadySeconds,
+		UsedPhysicalAtInitialize / (1024.0 * 1024.0), GetUsedPhysicalMB(), FirstShotSeconds, *StartupLabel);
+
+	// One file for all runs, so startup before and after a content change can be compared
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("Startup.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Map,PreloadAssets,GameInstanceSeconds,PreloadDoneSeconds,MapLoadSeconds,MapReadySeconds,GameInstanceUsedMB,MapReadyUsedMB,FirstShotSeconds,Label\n")), *ReportPath);
+	}
+	FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+}
+
+void UMechSurvivalAssetPreloader::DumpStartupReport() const
+{
+	UE_LOG(LogMechPreload, Display, TEXT("Startup: game instance %.2f s, preload %s %.2f s (%d assets, %.0f%%), map %s loaded in %.2f s, ready %.2f s"),
+		InitializeSeconds, bPreloadComplete ? TEXT("done") : TEXT("running"), bPreloadComplete ? PreloadDoneSeconds : GetSecondsSinceStart(),
+		NumPreloadAssets, GetPreloadProgress() * 100.f, FirstMapName.IsEmpty() ? TEXT("-") : *FirstMapName, FirstMapLoadSeconds, FirstMapReadySeconds);
+	UE_LOG(LogMechPreload, Display, TEXT("Startup: first shot %s, %.1f MB used at game instance, %.1f MB now"),
+		FirstShotSeconds > 0.0 ? *FString::Printf(TEXT("%.2f s"), FirstShotSeconds) : TEXT("-"), UsedPhysicalAtInitialize / (1024.0 * 1024.0), GetUsedPhysicalMB());
+}
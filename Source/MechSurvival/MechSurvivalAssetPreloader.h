@@ -0,0 +1,129 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Engine/StreamableManager.h"
+#include "MechSurvivalAssetPreloader.generated.h"
+
+/** Fraction of the startup preload that is done, 0 to 1 */
+DECLARE_MULTICAST_DELEGATE_OneParam(FMechSurvivalPreloadProgress, float);
+
+DECLARE_MULTICAST_DELEGATE(FMechSurvivalPreloadComplete);
+
+/**
+ * Loads the game's assets in the background instead of when classes are constructed.
+ * Game mode, HUD and characters refer to their assets through soft references and list them in GetPreloadAssets.
+ * When the game instance starts, the preloader loads the game mode's pawn class, the HUD's assets and PreloadAssets,
+ * then whatever the loaded character classes list in turn, reporting progress as it goes. It keeps all of it resident
+ * for the rest of the session. Once the first map is up it writes a startup report: time to game instance, time to
+ * preload done, map load time, time to the first shot and memory, to the log and to Saved/Benchmark/Startup.csv.
+ *
+ * Started with -MechStartupProfile the game boots, holds the trigger of the first local player's character until a
+ * round goes, writes the report and exits, so that a cooked build can be timed, and its file open order recorded with
+ * -fileopenlog, from boot to first shot; see Build/Scripts/ProfileStartup.sh. -MechStartupLabel=<label> tags the report
+ * rows, e.g. with the pak order the build was made with.
+ */
+UCLASS(config=Game)
+class UMechSurvivalAssetPreloader : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	/** Returns the preloader of the game instance the context object belongs to, if any */
+	static UMechSurvivalAssetPreloader* Get(const UObject* WorldContextObject);
+
+	/**
+	 * Loads assets in the background; Callback runs once all of them are in memory.
+	 * The assets stay loaded for as long as the returned handle is kept.
+	 */
+	TSharedPtr<FStreamableHandle> RequestAsyncLoad(const TArray<FSoftObjectPath>& Assets, FStreamableDelegate Callback, const FString& DebugName);
+
+	/** True once the startup preload has finished */
+	bool IsPreloadComplete() const { return bPreloadComplete; }
+
+	/** Fraction of the startup preload that is done */
+	float GetPreloadProgress() const;
+
+	/** Writes the startup timings to the log */
+	void DumpStartupReport() const;
+
+	/** Records the first round fired in the session, for the startup report */
+	void NotifyShotFired();
+
+	/** Called as the startup preload progresses */
+	FMechSurvivalPreloadProgress OnPreloadProgress;
+
+	/** Called once the startup preload has finished */
+	FMechSurvivalPreloadComplete OnPreloadComplete;
+
+protected:
+	/** Loaded at startup on top of what the game mode, HUD and characters list */
+	UPROPERTY(config)
+	TArray<FSoftObjectPath> PreloadAssets;
+
+	/** Appends the startup report to Saved/Benchmark/Startup.csv */
+	UPROPERTY(config)
+	bool bWriteStartupReport = true;
+
+	/** Seconds after start a -MechStartupProfile run gives up waiting for the first shot, and fails */
+	UPROPERTY(config)
+	float StartupProfileTimeout = 120.f;
+
+private:
+	/** First stage done: load what the loaded character classes refer to */
+	void OnClassesLoaded();
+
+	void OnPreloadFinished();
+	void OnPreloadUpdate(TSharedRef<FStreamableHandle> Handle);
+
+	/** In a deterministic run, finishes the load before returning */
+	static void WaitIfDeterministic(const TSharedPtr<FStreamableHandle>& Handle);
+
+	void OnPreLoadMap(const FString& MapName);
+	void OnPostLoadMap(UWorld* World);
+
+	/** Writes the report once both the preload and the first map are done, and in a profile run the first shot */
+	void TryWriteStartupReport();
+
+	/** Drives a -MechStartupProfile run: fires once everything is up, then exits with the report */
+	bool TickStartupProfile(float DeltaTime);
+
+	FStreamableManager StreamableManager;
+
+	/** The startup preload, in two stages; kept for the whole session so that the assets stay resident */
+	TSharedPtr<FStreamableHandle> ClassesHandle;
+	TSharedPtr<FStreamableHandle> DependenciesHandle;
+
+	int32 NumPreloadAssets = 0;
+	bool bPreloadComplete = false;
+	bool bReportWritten = false;
+
+	// Seconds since the process started
+	double InitializeSeconds = 0.0;
+	double PreloadDoneSeconds = 0.0;
+	double MapLoadStartSeconds = 0.0;
+	double FirstMapReadySeconds = 0.0;
+	double FirstShotSeconds = 0.0;
+
+	double FirstMapLoadSeconds = 0.0;
+	FString FirstMapName;
+	uint64 UsedPhysicalAtInitialize = 0;
+
+	bool bStartupProfile = false;
+	bool bStartupProfileTimedOut = false;
+	FString StartupLabel;
+
+	/** Character whose trigger the profile run holds */
+	TWeakObjectPtr<class AMechSurvivalCharacter> ProfileCharacter;
+
+	FDelegateHandle PreLoadMapHandle;
+	FDelegateHandle PostLoadMapHandle;
+	FDelegateHandle ProfileTickerHandle;
+};
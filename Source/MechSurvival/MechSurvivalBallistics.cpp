@@ -0,0 +1,735 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalBallistics.h"
+#include "MechSurvival.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvivalProjectile.h"
+#include "MechSurvivalSpatialHash.h"
+#include "MechSurvivalTelemetry.h"
+#include "MechSurvivalWeaponData.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/DamageType.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBallistics, Log, All);
+
+/** Collision profile from DefaultEngine.ini that projectile actors use */
+static const FName ProjectileProfileName(TEXT("Projectile"));
+
+static TAutoConsoleVariable<int32> CVarBallisticsChunkSize(
+	TEXT("MechSurvival.Ballistics.ChunkSize"),
+	64,
+	TEXT("Number of rounds stepped by one parallel task"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBallisticsForceSerial(
+	TEXT("MechSurvival.Ballistics.ForceSerial"),
+	0,
+	TEXT("1 steps every round on the game thread, for comparison with the parallel path"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorld GDumpBallisticsCmd(
+	TEXT("MechSurvival.Ballistics.Dump"),
+	TEXT("Logs the number of simulated rounds and how long the last step took"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalBallistics* Ballistics = UMechSurvivalBallistics::Get(World))
+		{
+			Ballistics->DumpStats();
+		}
+	}));
+
+FMechSurvivalBallisticParams FMechSurvivalBallisticParams::FromProjectileClass(TSubclassOf<AMechSurvivalProjectile> ProjectileClass)
+{
+	FMechSurvivalBallisticParams Params;
+
+	const AMechSurvivalProjectile* Defaults = ProjectileClass ? ProjectileClass->GetDefaultObject<AMechSurvivalProjectile>() : nullptr;
+	if (Defaults == nullptr)
+	{
+		return Params;
+	}
+
+	if (const UProjectileMovementComponent* Movement = Defaults->GetProjectileMovement())
+	{
+		Params.InitialSpeed = Movement->InitialSpeed;
+		Params.MaxSpeed = Movement->MaxSpeed;
+		Params.GravityScale = Movement->ProjectileGravityScale;
+		Params.bShouldBounce = Movement->bShouldBounce;
+		Params.Bounciness = Movement->Bounciness;
+		Params.Friction = Movement->Friction;
+		Params.MinFrictionFraction = Movement->MinFrictionFraction;
+		Params.bBounceAngleAffectsFriction = Movement->bBounceAngleAffectsFriction;
+		Params.BounceVelocityStopSimulatingThreshold = Movement->BounceVelocityStopSimulatingThreshold;
+	}
+
+	Params.Damage = Defaults->Damage;
+	Params.ExplosionRadius = Defaults->ExplosionRadius;
+
+	if (const USphereComponent* Collision = Defaults->GetCollisionComp())
+	{
+		Params.Radius = Collision->GetUnscaledSphereRadius();
+	}
+
+	// A zero lifespan means the actor lives until it hits something; the bounce limit still removes the round
+	Params.LifeSpan = Defaults->InitialLifeSpan > 0.f ? Defaults->InitialLifeSpan : BIG_NUMBER;
+
+	return Params;
+}
+
+FArchive& operator<<(FArchive& Ar, FMechSurvivalBallisticParams& Params)
+{
+	Ar << Params.InitialSpeed << Params.MaxSpeed << Params.GravityScale << Params.Radius << Params.LifeSpan;
+	Ar << Params.bShouldBounce << Params.Bounciness << Params.Friction << Params.MinFrictionFraction << Params.bBounceAngleAffectsFriction;
+	Ar << Params.BounceVelocityStopSimulatingThreshold << Params.Damage << Params.ExplosionRadius;
+	return Ar;
+}
+
+bool FMechSurvivalBallisticParams::operator==(const FMechSurvivalBallisticParams& Other) const
+{
+	return InitialSpeed == Other.InitialSpeed && MaxSpeed == Other.MaxSpeed && GravityScale == Other.GravityScale && Radius == Other.Radius
+		&& LifeSpan == Other.LifeSpan && bShouldBounce == Other.bShouldBounce && Bounciness == Other.Bounciness && Friction == Other.Friction
+		&& MinFrictionFraction == Other.MinFrictionFraction && bBounceAngleAffectsFriction == Other.bBounceAngleAffectsFriction
+		&& BounceVelocityStopSimulatingThreshold == Other.BounceVelocityStopSimulatingThreshold && Damage == Other.Damage
+		&& ExplosionRadius == Other.ExplosionRadius;
+}
+
+FMechSurvivalBallisticParams FMechSurvivalBallisticParams::FromWeapon(const UMechSurvivalWeaponData* Weapon, TSubclassOf<AMechSurvivalProjectile> ProjectileClass)
+{
+	FMechSurvivalBallisticParams Params = FromProjectileClass(ProjectileClass);
+	if (Weapon == nullptr)
+	{
+		return Params;
+	}
+
+	const FMechSurvivalWeaponStats& Stats = Weapon->Stats;
+	Params.InitialSpeed = Stats.InitialSpeed;
+	Params.MaxSpeed = Stats.MaxSpeed;
+	Params.GravityScale = Stats.GravityScale;
+	Params.bShouldBounce = Stats.bShouldBounce;
+	Params.Bounciness = Stats.Bounciness;
+	Params.LifeSpan = Stats.LifeSpan > 0.f ? Stats.LifeSpan : BIG_NUMBER;
+	Params.Damage = Stats.Damage;
+	Params.ExplosionRadius = Stats.ExplosionRadius;
+
+	return Params;
+}
+
+void FMechSurvivalBallisticParams::GetFlightAfter(const FVector& Location, const FRotator& Rotation, float Seconds, float GravityZ, FVector& OutLocation, FVector& OutVelocity) const
+{
+	const FVector Gravity(0.f, 0.f, GravityZ * GravityScale);
+	const FVector LaunchVelocity = Rotation.Vector() * InitialSpeed;
+	OutLocation = Location + LaunchVelocity * Seconds + Gravity * (0.5f * Seconds * Seconds);
+	OutVelocity = LaunchVelocity + Gravity * Seconds;
+}
+
+bool UMechSurvivalBallistics::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalBallistics::Deinitialize()
+{
+	Positions.Empty();
+	Velocities.Empty();
+	Lifetimes.Empty();
+	BounceCounts.Empty();
+	ParamIndices.Empty();
+	CosmeticFlags.Empty();
+	ShotIds.Empty();
+	Instigators.Empty();
+
+	ProxyActor = nullptr;
+	ProxyComponents.Empty();
+	ProxyTransforms.Empty();
+	bProxiesShown = false;
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalBallistics* UMechSurvivalBallistics::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalBallistics>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalBallistics::GetTickableTickType() const
+{
+	// The class default object is registered as a tickable too; it never has anything to do
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalBallistics::IsTickable() const
+{
+	// Proxies need one more update after the last round is gone so that they get cleared
+	return Positions.Num() > 0 || bProxiesShown;
+}
+
+TStatId UMechSurvivalBallistics::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalBallistics, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalBallistics::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+bool UMechSurvivalBallistics::Fire(TSubclassOf<AMechSurvivalProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, bool bCosmetic, uint16 ShotId)
+{
+	if (ProjectileClass == nullptr || Positions.Num() >= MaxRounds)
+	{
+		return false;
+	}
+
+	AddRound(FindOrAddParams(nullptr, ProjectileClass), Location, Rotation, bCosmetic, ShotId);
+
+	MECHSURVIVAL_INC_COUNTER(Spawns, 1);
+	return true;
+}
+
+int32 UMechSurvivalBallistics::FireBatch(const UMechSurvivalWeaponData* Weapon, TSubclassOf<AMechSurvivalProjectile> ProjectileClass, const FVector& Location, TArrayView<const FRotator> Rotations, bool bCosmetic, TArrayView<const uint16> InShotIds, float CatchUpSeconds, APawn* Instigator)
+{
+	MECHSURVIVAL_LLM_SCOPE(Projectiles);
+
+	const int32 Count = FMath::Min(Rotations.Num(), MaxRounds - Positions.Num());
+	if (ProjectileClass == nullptr || Count <= 0)
+	{
+		return 0;
+	}
+
+	check(InShotIds.Num() == 0 || InShotIds.Num() == Rotations.Num());
+
+	// One lookup and one allocation per array for the whole batch, however many pellets it holds
+	const int32 ParamIndex = FindOrAddParams(Weapon, ProjectileClass);
+	const int32 NewNum = Positions.Num() + Count;
+	Positions.Reserve(NewNum);
+	Velocities.Reserve(NewNum);
+	Lifetimes.Reserve(NewNum);
+	BounceCounts.Reserve(NewNum);
+	ParamIndices.Reserve(NewNum);
+	CosmeticFlags.Reserve(NewNum);
+	ShotIds.Reserve(NewNum);
+	Instigators.Reserve(NewNum);
+
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FRotator& Rotation = Rotations[Index];
+		AddRound(ParamIndex, Location, Rotation, bCosmetic, InShotIds.Num() > 0 ? InShotIds[Index] : 0, CatchUpSeconds, Instigator);
+	}
+
+	MECHSURVIVAL_INC_COUNTER(Spawns, Count);
+	return Count;
+}
+
+void UMechSurvivalBallistics::AddRound(int32 ParamIndex, const FVector& Location, const FRotator& Rotation, bool bCosmetic, uint16 ShotId, float CatchUpSeconds, APawn* Instigator)
+{
+	const FMechSurvivalBallisticParams& Params = ParamTable[ParamIndex];
+
+	// A round that has been flying already is as old as its flight, which is what reconciliation measures
+	FVector Position = Location;
+	FVector Velocity = Rotation.Vector() * Params.InitialSpeed;
+	if (CatchUpSeconds > 0.f && GetWorld() != nullptr)
+	{
+		Params.GetFlightAfter(Location, Rotation, CatchUpSeconds, GetWorld()->GetGravityZ(), Position, Velocity);
+	}
+
+	Positions.Add(Position);
+	Velocities.Add(Velocity);
+	Lifetimes.Add(Params.LifeSpan - FMath::Max(CatchUpSeconds, 0.f));
+	BounceCounts.Add(0);
+	ParamIndices.Add((uint8)ParamIndex);
+	CosmeticFlags.Add(bCosmetic);
+	ShotIds.Add(ShotId);
+	Instigators.Add(Instigator);
+}
+
+void UMechSurvivalBallistics::ReconcilePredictedRound(uint16 ShotId, const FVector& Location, const FRotator& Rotation)
+{
+	const int32 Index = ShotIds.IndexOfByKey(ShotId);
+	if (ShotId == 0 || Index == INDEX_NONE || !CosmeticFlags[Index])
+	{
+		// Already gone on our side
+		return;
+	}
+
+	// Only unbounced rounds can be put back on the server's path analytically; the rest are left alone
+	ShotIds[Index] = 0;
+	if (BounceCounts[Index] > 0 || GetWorld() == nullptr)
+	{
+		return;
+	}
+
+	const FMechSurvivalBallisticParams& Params = ParamTable[ParamIndices[Index]];
+	const float Age = Params.LifeSpan - Lifetimes[Index];
+	FVector ServerPosition;
+	FVector ServerVelocity;
+	Params.GetFlightAfter(Location, Rotation, Age, GetWorld()->GetGravityZ(), ServerPosition, ServerVelocity);
+
+	if (FVector::DistSquared(ServerPosition, Positions[Index]) > FMath::Square(ReconcileTolerance))
+	{
+		Positions[Index] = ServerPosition;
+		Velocities[Index] = ServerVelocity;
+	}
+}
+
+void UMechSurvivalBallistics::SerializeRounds(FArchive& Ar)
+{
+	if (!Ar.IsLoading())
+	{
+		int32 NumParams = ParamTable.Num();
+		Ar << NumParams;
+		for (FMechSurvivalBallisticParams& Params : ParamTable)
+		{
+			Ar << Params;
+		}
+
+		int32 NumSaved = 0;
+		for (const bool bCosmetic : CosmeticFlags)
+		{
+			NumSaved += bCosmetic ? 0 : 1;
+		}
+		Ar << NumSaved;
+		for (int32 Index = 0; Index < Positions.Num(); ++Index)
+		{
+			if (!CosmeticFlags[Index])
+			{
+				Ar << Positions[Index] << Velocities[Index] << Lifetimes[Index] << BounceCounts[Index] << ParamIndices[Index];
+			}
+		}
+		return;
+	}
+
+	int32 NumParams = 0;
+	Ar << NumParams;
+	if (Ar.IsError() || NumParams < 0 || NumParams > MAX_uint8)
+	{
+		UE_LOG(LogBallistics, Warning, TEXT("Saved rounds are damaged, not restored"));
+		return;
+	}
+
+	// Saved parameters reuse an identical entry, usually the one they were saved from; the others get entries of their
+	// own, without a weapon to be found by, so that restoring again and again does not grow the table
+	TArray<int32, TInlineAllocator<16>> ParamRemap;
+	for (int32 SavedIndex = 0; SavedIndex < NumParams; ++SavedIndex)
+	{
+		FMechSurvivalBallisticParams Params;
+		Ar << Params;
+		const int32 Existing = ParamTable.IndexOfByKey(Params);
+		ParamRemap.Add(Existing != INDEX_NONE ? Existing : ParamTable.Num() < MAX_uint8 ? ParamTable.Add(Params) : INDEX_NONE);
+	}
+
+	for (int32 Index = Positions.Num() - 1; Index >= 0; --Index)
+	{
+		RemoveRound(Index);
+	}
+
+	int32 NumSaved = 0;
+	Ar << NumSaved;
+	for (int32 SavedIndex = 0; SavedIndex < NumSaved && !Ar.IsError(); ++SavedIndex)
+	{
+		FVector Position;
+		FVector Velocity;
+		float Lifetime = 0.f;
+		uint16 BounceCount = 0;
+		uint8 ParamIndex = 0;
+		Ar << Position << Velocity << Lifetime << BounceCount << ParamIndex;
+		if (!ParamRemap.IsValidIndex(ParamIndex) || ParamRemap[ParamIndex] == INDEX_NONE || Positions.Num() >= MaxRounds)
+		{
+			continue;
+		}
+
+		Positions.Add(Position);
+		Velocities.Add(Velocity);
+		Lifetimes.Add(Lifetime);
+		BounceCounts.Add(BounceCount);
+		ParamIndices.Add((uint8)ParamRemap[ParamIndex]);
+		CosmeticFlags.Add(false);
+		ShotIds.Add(0);
+		Instigators.Add(nullptr);
+	}
+}
+
+void UMechSurvivalBallistics::DumpStats() const
+{
+	UE_LOG(LogBallistics, Log, TEXT("%d rounds, last step %.3f ms in %d chunk(s), %d worker threads, chunk size %d%s"),
+		Positions.Num(), LastStepSeconds * 1000.0, LastStepChunks, FTaskGraphInterface::Get().GetNumWorkerThreads(),
+		CVarBallisticsChunkSize.GetValueOnGameThread(), CVarBallisticsForceSerial.GetValueOnGameThread() ? TEXT(", forced serial") : TEXT(""));
+}
+
+void UMechSurvivalBallistics::Tick(float DeltaTime)
+{
+	StepRounds(DeltaTime);
+	UpdateProxies();
+
+	MECHSURVIVAL_SET_LEVEL(LiveSimulatedRounds, Positions.Num());
+}
+
+int32 UMechSurvivalBallistics::FindOrAddParams(const UMechSurvivalWeaponData* Weapon, UClass* ProjectileClass)
+{
+	const TPair<const UMechSurvivalWeaponData*, UClass*> Key(Weapon, ProjectileClass);
+	if (const int32* Existing = ParamLookup.Find(Key))
+	{
+		return *Existing;
+	}
+
+	// ParamIndices stores a byte per round
+	check(ParamTable.Num() < MAX_uint8);
+
+	const int32 NewIndex = ParamTable.Add(FMechSurvivalBallisticParams::FromWeapon(Weapon, ProjectileClass));
+	ParamLookup.Add(Key, NewIndex);
+	return NewIndex;
+}
+
+void UMechSurvivalBallistics::StepRounds(float DeltaTime)
+{
+	UWorld* World = GetWorld();
+	const int32 NumRounds = Positions.Num();
+	if (World == nullptr || DeltaTime <= 0.f || NumRounds == 0)
+	{
+		return;
+	}
+
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(BallisticsStep);
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	const float GravityZ = World->GetGravityZ();
+
+	// Mechs can only move while the horde steps, so tracing them from the workers is safe
+	UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(World);
+	const UMechSurvivalHorde* HordeToTrace = (Horde != nullptr && Horde->GetNumMechs() > 0) ? Horde : nullptr;
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MechSurvivalBallistics), false);
+	QueryParams.bReturnPhysicalMaterial = false;
+
+	RoundOutcomes.SetNumUninitialized(NumRounds, false);
+	RoundImpacts.SetNum(NumRounds, false);
+
+	// Integration and sweeps only touch the round's own slot, so chunks of rounds can run on any thread
+	const int32 ChunkSize = FMath::Max(1, CVarBallisticsChunkSize.GetValueOnGameThread());
+	const int32 NumChunks = FMath::DivideAndRoundUp(NumRounds, ChunkSize);
+	const bool bForceSerial = CVarBallisticsForceSerial.GetValueOnGameThread() != 0 || NumChunks == 1;
+
+	ParallelFor(NumChunks, [this, World, HordeToTrace, DeltaTime, GravityZ, ChunkSize, NumRounds, &QueryParams](int32 ChunkIndex)
+	{
+		const int32 EndIndex = FMath::Min((ChunkIndex + 1) * ChunkSize, NumRounds);
+		for (int32 Index = ChunkIndex * ChunkSize; Index < EndIndex; ++Index)
+		{
+			StepRound(World, HordeToTrace, Index, DeltaTime, GravityZ, QueryParams);
+		}
+	}, bForceSerial);
+
+	// Apply phase, on the game thread and in round order so the result does not depend on how chunks were scheduled
+	UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(World);
+	for (int32 Index = 0; Index < NumRounds; ++Index)
+	{
+		if (RoundOutcomes[Index] == ERoundOutcome::Contact)
+		{
+			// Physics state is safe to read here; a body that does not simulate is bounced off and the round flies on
+			const FMechSurvivalRoundImpact& Contact = RoundImpacts[Index];
+			const UPrimitiveComponent* Component = Contact.Hit.GetComponent();
+			if (IsValid(Component) && Component->IsSimulatingPhysics())
+			{
+				RoundOutcomes[Index] = ERoundOutcome::Absorbed;
+			}
+			else
+			{
+				RoundOutcomes[Index] = ERoundOutcome::InFlight;
+				FVector Velocity = Contact.Velocity;
+				const FHitResult Hit = Contact.Hit;
+				if (BounceRound(Index, ParamTable[ParamIndices[Index]], Hit, Velocity))
+				{
+					SweepRound(World, HordeToTrace, Index, Positions[Index], Velocity, Contact.RemainingTime, Contact.SweepsLeft, GravityZ, QueryParams, true);
+				}
+			}
+		}
+
+		if (RoundOutcomes[Index] == ERoundOutcome::Absorbed && !CosmeticFlags[Index])
+		{
+			MECHSURVIVAL_INC_COUNTER(Hits, 1);
+
+			const FMechSurvivalRoundImpact& Impact = RoundImpacts[Index];
+			UPrimitiveComponent* Component = Impact.Hit.GetComponent();
+			AActor* Actor = Impact.Hit.GetActor();
+			const FMechSurvivalBallisticParams& Params = ParamTable[ParamIndices[Index]];
+			APawn* Instigator = Instigators[Index].Get();
+			if (Params.ExplosionRadius > 0.f)
+			{
+				// Rounds that hit a mech stopped where they met it
+				if (SpatialHash != nullptr)
+				{
+					const FVector Location = Impact.MechIndex != INDEX_NONE ? Positions[Index] : Impact.Hit.Location;
+					SpatialHash->QueueExplosion(Location, Params.ExplosionRadius, Params.Damage, nullptr, Instigator);
+				}
+			}
+			else if (Impact.MechIndex != INDEX_NONE)
+			{
+				Horde->ApplyDamage(Impact.MechIndex, Params.Damage, Instigator);
+				UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, Positions[Index], Params.Damage);
+			}
+			else if (IsValid(Component) && Component->IsSimulatingPhysics())
+			{
+				UMechSurvivalImpulseBatcher::AddImpulseAtLocation(Component, Impact.Velocity * 100.0f, Impact.Hit.Location);
+				MECHSURVIVAL_INC_COUNTER(Impulses, 1);
+				UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Impulse, Impact.Hit.Location, Impact.Velocity.Size() * 100.0f);
+			}
+			else if (IsValid(Actor))
+			{
+				UGameplayStatics::ApplyPointDamage(Actor, Params.Damage, Impact.Velocity.GetSafeNormal(), Impact.Hit, Instigator ? Instigator->GetController() : nullptr, nullptr, UDamageType::StaticClass());
+				UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, Impact.Hit.Location, Params.Damage);
+			}
+		}
+	}
+
+	// Backwards, so that removing a round only moves an already handled one into its slot
+	for (int32 Index = NumRounds - 1; Index >= 0; --Index)
+	{
+		if (RoundOutcomes[Index] != ERoundOutcome::InFlight)
+		{
+			RemoveRound(Index);
+		}
+	}
+
+	LastStepSeconds = FPlatformTime::Seconds() - StartTime;
+	LastStepChunks = bForceSerial ? 1 : NumChunks;
+}
+
+void UMechSurvivalBallistics::StepRound(const UWorld* World, const UMechSurvivalHorde* Horde, int32 Index, float DeltaTime, float GravityZ, const FCollisionQueryParams& QueryParams)
+{
+	RoundOutcomes[Index] = ERoundOutcome::InFlight;
+
+	Lifetimes[Index] -= DeltaTime;
+	if (Lifetimes[Index] <= 0.f)
+	{
+		RoundOutcomes[Index] = ERoundOutcome::Expired;
+		return;
+	}
+
+	if (Velocities[Index].IsZero())
+	{
+		// Came to rest after bouncing, just like a projectile actor that stopped simulating
+		return;
+	}
+
+	SweepRound(World, Horde, Index, Positions[Index], Velocities[Index], DeltaTime, MaxSweepsPerStep, GravityZ, QueryParams, false);
+}
+
+void UMechSurvivalBallistics::SweepRound(const UWorld* World, const UMechSurvivalHorde* Horde, int32 Index, FVector Position, FVector Velocity, float RemainingTime, int32 SweepsLeft, float GravityZ, const FCollisionQueryParams& QueryParams, bool bOnGameThread)
+{
+	const FMechSurvivalBallisticParams& Params = ParamTable[ParamIndices[Index]];
+	const FCollisionShape Shape = FCollisionShape::MakeSphere(Params.Radius);
+
+	for (; SweepsLeft > 0 && RemainingTime > KINDA_SMALL_NUMBER && !Velocity.IsZero(); --SweepsLeft)
+	{
+		// Same integration as UProjectileMovementComponent::ComputeMoveDelta
+		const FVector NewVelocity = Velocity + FVector(0.f, 0.f, GravityZ * Params.GravityScale) * RemainingTime;
+		const FVector MoveDelta = (Velocity + NewVelocity) * (0.5f * RemainingTime);
+		Velocity = (Params.MaxSpeed > 0.f) ? NewVelocity.GetClampedToMaxSize(Params.MaxSpeed) : NewVelocity;
+
+		FHitResult Hit;
+		const bool bBlocked = World->SweepSingleByProfile(Hit, Position, Position + MoveDelta, FQuat::Identity, ProjectileProfileName, Shape, QueryParams);
+
+		// Horde mechs are not in the physics scene; a mech in front of whatever the sweep found takes the round
+		FMechSurvivalHordeHit HordeHit;
+		if (Horde != nullptr && Horde->TraceMechs(Position, bBlocked ? Hit.Location : Position + MoveDelta, Params.Radius, HordeHit))
+		{
+			RoundImpacts[Index].Hit = FHitResult();
+			RoundImpacts[Index].Velocity = Velocity;
+			RoundImpacts[Index].MechIndex = HordeHit.MechIndex;
+			RoundOutcomes[Index] = ERoundOutcome::Absorbed;
+			Positions[Index] = HordeHit.Location;
+			return;
+		}
+
+		if (!bBlocked)
+		{
+			Position += MoveDelta;
+			break;
+		}
+
+		Position = Hit.Location;
+		RemainingTime *= (1.f - Hit.Time);
+
+		// Same rules as AMechSurvivalProjectile::OnHit; impulses and damage are applied back on the game thread
+		const UPrimitiveComponent* OtherComp = Hit.GetComponent();
+		const AActor* OtherActor = Hit.GetActor();
+		if (OtherComp != nullptr && OtherActor != nullptr)
+		{
+			const bool bAbsorbs = Params.ExplosionRadius > 0.f || OtherActor->IsA<APawn>() || (bOnGameThread && OtherComp->IsSimulatingPhysics());
+			if (bAbsorbs || !bOnGameThread)
+			{
+				RoundImpacts[Index].Hit = Hit;
+				RoundImpacts[Index].Velocity = Velocity;
+				RoundImpacts[Index].MechIndex = INDEX_NONE;
+				RoundImpacts[Index].RemainingTime = RemainingTime;
+				RoundImpacts[Index].SweepsLeft = SweepsLeft - 1;
+				RoundOutcomes[Index] = bAbsorbs ? ERoundOutcome::Absorbed : ERoundOutcome::Contact;
+				Positions[Index] = Position;
+				Velocities[Index] = Velocity;
+				return;
+			}
+		}
+
+		if (!BounceRound(Index, Params, Hit, Velocity))
+		{
+			return;
+		}
+	}
+
+	Positions[Index] = Position;
+	Velocities[Index] = Velocity;
+}
+
+bool UMechSurvivalBallistics::BounceRound(int32 Index, const FMechSurvivalBallisticParams& Params, const FHitResult& Hit, FVector& Velocity)
+{
+	if (!Params.bShouldBounce)
+	{
+		// A non-bouncing projectile actor stops where it lands and waits out its lifespan
+		Velocity = FVector::ZeroVector;
+		return true;
+	}
+
+	if (++BounceCounts[Index] > MaxBounces)
+	{
+		RoundOutcomes[Index] = ERoundOutcome::Expired;
+		return false;
+	}
+
+	// Same response as UProjectileMovementComponent::ComputeBounceDelta
+	const FVector Normal = Hit.Normal;
+	const float VDotNormal = (Velocity | Normal);
+	if (VDotNormal <= 0.f)
+	{
+		const FVector ProjectedNormal = Normal * -VDotNormal;
+		Velocity += ProjectedNormal;
+
+		const float ScaledFriction = Params.bBounceAngleAffectsFriction
+			? FMath::Clamp(-VDotNormal / FMath::Max(Velocity.Size(), KINDA_SMALL_NUMBER), Params.MinFrictionFraction, 1.f) * Params.Friction
+			: Params.Friction;
+		Velocity *= FMath::Clamp(1.f - ScaledFriction, 0.f, 1.f);
+		Velocity += ProjectedNormal * FMath::Max(Params.Bounciness, 0.f);
+		if (Params.MaxSpeed > 0.f)
+		{
+			Velocity = Velocity.GetClampedToMaxSize(Params.MaxSpeed);
+		}
+	}
+
+	if (Velocity.SizeSquared() < FMath::Square(Params.BounceVelocityStopSimulatingThreshold))
+	{
+		Velocity = FVector::ZeroVector;
+	}
+	return true;
+}
+
+void UMechSurvivalBallistics::RemoveRound(int32 Index)
+{
+	Positions.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	Lifetimes.RemoveAtSwap(Index, 1, false);
+	BounceCounts.RemoveAtSwap(Index, 1, false);
+	ParamIndices.RemoveAtSwap(Index, 1, false);
+	CosmeticFlags.RemoveAtSwap(Index, 1, false);
+	ShotIds.RemoveAtSwap(Index, 1, false);
+	Instigators.RemoveAtSwap(Index, 1, false);
+}
+
+void UMechSurvivalBallistics::UpdateProxies()
+{
+	if (ProxyActor == nullptr)
+	{
+		CreateProxyActor();
+		if (ProxyActor == nullptr)
+		{
+			return;
+		}
+	}
+
+	ProxyTransforms.SetNum(ParamTable.Num());
+	for (TArray<FTransform>& Transforms : ProxyTransforms)
+	{
+		Transforms.Reset();
+	}
+
+	const FVector Scale(ProxyScale);
+	for (int32 Index = 0; Index < Positions.Num(); ++Index)
+	{
+		const FRotator Rotation = Velocities[Index].IsZero() ? FRotator::ZeroRotator : Velocities[Index].Rotation();
+		ProxyTransforms[ParamIndices[Index]].Emplace(Rotation, Positions[Index], Scale);
+	}
+
+	bProxiesShown = Positions.Num() > 0;
+
+	UStaticMesh* Mesh = ProxyMesh.Get();
+	for (int32 ParamIndex = 0; ParamIndex < ProxyTransforms.Num(); ++ParamIndex)
+	{
+		if (!ProxyComponents.IsValidIndex(ParamIndex))
+		{
+			UInstancedStaticMeshComponent* Component = NewObject<UInstancedStaticMeshComponent>(ProxyActor);
+			Component->SetMobility(EComponentMobility::Movable);
+			Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+			Component->SetCastShadow(false);
+			Component->SetStaticMesh(Mesh);
+			Component->InstanceEndCullDistance = FMath::RoundToInt(ProxyCullDistance);
+			Component->RegisterComponent();
+			ProxyComponents.Add(Component);
+		}
+
+		UInstancedStaticMeshComponent* Component = ProxyComponents[ParamIndex];
+		const TArray<FTransform>& Transforms = ProxyTransforms[ParamIndex];
+
+		// Grow or shrink at the end only, then move every instance in one batch
+		while (Component->GetInstanceCount() > Transforms.Num())
+		{
+			Component->RemoveInstance(Component->GetInstanceCount() - 1);
+		}
+		for (int32 Index = Component->GetInstanceCount(); Index < Transforms.Num(); ++Index)
+		{
+			Component->AddInstanceWorldSpace(Transforms[Index]);
+		}
+		if (Transforms.Num() > 0)
+		{
+			Component->BatchUpdateInstancesTransforms(0, Transforms, true, true, true);
+		}
+	}
+}
+
+void UMechSurvivalBallistics::CreateProxyActor()
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_DedicatedServer)
+	{
+		// Nobody is looking
+		return;
+	}
+
+	if (ProxyMesh.IsNull())
+	{
+		return;
+	}
+	if (ProxyMesh.Get() == nullptr)
+	{
+		UE_LOG(LogBallistics, Log, TEXT("Loading round proxy mesh %s"), *ProxyMesh.ToString());
+		ProxyMesh.LoadSynchronous();
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ProxyActor = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+	if (ProxyActor != nullptr)
+	{
+		ProxyActor->SetRootComponent(NewObject<USceneComponent>(ProxyActor, TEXT("Root")));
+		ProxyActor->GetRootComponent()->RegisterComponent();
+	}
+}
@@ -0,0 +1,257 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalBallistics.generated.h"
+
+class AMechSurvivalProjectile;
+class APawn;
+class UMechSurvivalWeaponData;
+class UInstancedStaticMeshComponent;
+class UPrimitiveComponent;
+class UStaticMesh;
+struct FCollisionQueryParams;
+
+/** How the character turns a trigger pull into a projectile */
+UENUM()
+enum class EMechSurvivalFireMode : uint8
+{
+	/** Launch an AMechSurvivalProjectile actor from the projectile pool */
+	PooledActor,
+	/** Add a round to the ballistic simulation; no actor is involved */
+	Simulated
+};
+
+/** Flight parameters shared by every round fired from the same projectile class, or the same weapon */
+struct FMechSurvivalBallisticParams
+{
+	float InitialSpeed = 3000.f;
+	float MaxSpeed = 3000.f;
+	float GravityScale = 1.f;
+	float Radius = 5.f;
+	float LifeSpan = 3.f;
+	bool bShouldBounce = true;
+	float Bounciness = 0.6f;
+	float Friction = 0.2f;
+	float MinFrictionFraction = 0.f;
+	bool bBounceAngleAffectsFriction = false;
+	float BounceVelocityStopSimulatingThreshold = 5.f;
+	float Damage = 20.f;
+	float ExplosionRadius = 0.f;
+
+	/** Reads the parameters off the class defaults so that simulated rounds fly like the actor would */
+	static FMechSurvivalBallisticParams FromProjectileClass(TSubclassOf<AMechSurvivalProjectile> ProjectileClass);
+
+	/** Takes collision and friction from the class defaults, and speed, bounce, lifespan, damage and explosion from the weapon */
+	static FMechSurvivalBallisticParams FromWeapon(const UMechSurvivalWeaponData* Weapon, TSubclassOf<AMechSurvivalProjectile> ProjectileClass);
+
+	/** Where a round launched from Location along Rotation is after Seconds of free flight under gravity, and its velocity there */
+	void GetFlightAfter(const FVector& Location, const FRotator& Rotation, float Seconds, float GravityZ, FVector& OutLocation, FVector& OutVelocity) const;
+
+	/** True if rounds would fly, bounce and hit exactly the same with either */
+	bool operator==(const FMechSurvivalBallisticParams& Other) const;
+};
+
+FArchive& operator<<(FArchive& Ar, FMechSurvivalBallisticParams& Params);
+
+/**
+ * Central ballistic simulation for projectiles that do not need to be actors.
+ * Rounds are kept in flat arrays and stepped together once per frame, with one sweep per round against the
+ * "Projectile" collision profile. Stepping is spread over task graph workers with ParallelFor, see the
+ * MechSurvival.Ballistics.ChunkSize and MechSurvival.Ballistics.ForceSerial console variables.
+ * Hits behave like AMechSurvivalProjectile::OnHit: simulating bodies receive an impulse and absorb the round,
+ * anything else makes it bounce, and explosive rounds explode on whatever they hit. Whether a body simulates is
+ * only read on the game thread, so a round that touches a non-pawn is finished there.
+ * Rounds are drawn through instanced static meshes, and not drawn at all on dedicated servers.
+ */
+UCLASS(config=Game)
+class UMechSurvivalBallistics : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the simulation for the world the context object lives in, if any */
+	static UMechSurvivalBallistics* Get(const UObject* WorldContextObject);
+
+	/**
+	 * Adds a round to the simulation.
+	 *
+	 * @param	ProjectileClass		Projectile whose flight parameters the round copies
+	 * @param	Location			Muzzle location
+	 * @param	Rotation			Launch direction
+	 * @param	bCosmetic			True for rounds that are only shown, such as another player's shots on a client; they never push anything
+	 * @param	ShotId				Non-zero for a shot a client predicted, so that the server's version can be reconciled with it
+	 * @returns false if the simulation is full.
+	 */
+	bool Fire(TSubclassOf<AMechSurvivalProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, bool bCosmetic = false, uint16 ShotId = 0);
+
+	/**
+	 * Adds every pellet a weapon fired this frame to the simulation at once.
+	 *
+	 * @param	Weapon				Weapon whose stats the rounds fly by; null for the class defaults
+	 * @param	ProjectileClass		Projectile the weapon fires
+	 * @param	Location			Muzzle location
+	 * @param	Rotations			Launch direction of each pellet
+	 * @param	ShotIds				Per pellet, non-zero for pellets a client predicted; empty if none were
+	 * @param	CatchUpSeconds		How long each pellet has been flying already, for shots fired earlier elsewhere; they start that far along their path
+	 * @param	Instigator			Pawn credited with what the pellets hit
+	 * @returns the number of pellets added, fewer than requested if the simulation filled up.
+	 */
+	int32 FireBatch(const UMechSurvivalWeaponData* Weapon, TSubclassOf<AMechSurvivalProjectile> ProjectileClass, const FVector& Location, TArrayView<const FRotator> Rotations, bool bCosmetic = false, TArrayView<const uint16> ShotIds = TArrayView<const uint16>(), float CatchUpSeconds = 0.f, APawn* Instigator = nullptr);
+
+	/**
+	 * Brings a predicted round in line with the server's version of the same shot.
+	 * The round is moved onto the server's trajectory if it strayed too far; whatever it hits is then up to our own simulation.
+	 */
+	void ReconcilePredictedRound(uint16 ShotId, const FVector& Location, const FRotator& Rotation);
+
+	/**
+	 * Saves the rounds in flight with the parameters they fly by, or replaces the rounds with the saved ones when
+	 * loading. Cosmetic rounds are only shown, so they are neither saved nor kept.
+	 */
+	void SerializeRounds(FArchive& Ar);
+
+	/** Number of rounds currently simulated */
+	int32 GetNumRounds() const { return Positions.Num(); }
+
+	/** Wall time of the last step, in seconds */
+	double GetLastStepSeconds() const { return LastStepSeconds; }
+
+	/** Writes the round count and step timing to the log */
+	void DumpStats() const;
+
+protected:
+	/** Upper bound on simultaneously simulated rounds */
+	UPROPERTY(config)
+	int32 MaxRounds = 4096;
+
+	/** Rounds are removed after this many bounces even if their lifespan has not run out */
+	UPROPERTY(config)
+	int32 MaxBounces = 8;
+
+	/** Number of sweeps a single round may perform in one frame, counting the one after each bounce */
+	UPROPERTY(config)
+	int32 MaxSweepsPerStep = 4;
+
+	/** Mesh used to draw rounds */
+	UPROPERTY(config)
+	TSoftObjectPtr<UStaticMesh> ProxyMesh;
+
+	/** Scale applied to ProxyMesh */
+	UPROPERTY(config)
+	float ProxyScale = 0.06f;
+
+	/** Predicted rounds further than this from the server's trajectory are moved onto it */
+	UPROPERTY(config)
+	float ReconcileTolerance = 10.f;
+
+	/** Rounds further than this from the camera are not drawn */
+	UPROPERTY(config)
+	float ProxyCullDistance = 15000.f;
+
+private:
+	/** Returns the index of the parameter table entry for a projectile class fired from a weapon, adding it if needed */
+	int32 FindOrAddParams(const UMechSurvivalWeaponData* Weapon, UClass* ProjectileClass);
+
+	/** Appends one round, CatchUpSeconds into its flight; the caller has checked there is room */
+	void AddRound(int32 ParamIndex, const FVector& Location, const FRotator& Rotation, bool bCosmetic, uint16 ShotId, float CatchUpSeconds = 0.f, APawn* Instigator = nullptr);
+
+	/** What happened to a round during the last step */
+	enum class ERoundOutcome : uint8
+	{
+		InFlight,
+		Expired,
+		Absorbed,
+		/** Touched something that may be simulating; decided and finished on the game thread */
+		Contact
+	};
+
+	/** Hit that absorbed a round, with the round's velocity at that moment; MechIndex is set instead of Hit when a horde mech took it */
+	struct FMechSurvivalRoundImpact
+	{
+		FHitResult Hit;
+		FVector Velocity;
+		int32 MechIndex = INDEX_NONE;
+		/** For a Contact, what is left of the step */
+		float RemainingTime = 0.f;
+		int32 SweepsLeft = 0;
+	};
+
+	/**
+	 * Moves every round forward by DeltaTime.
+	 * Integration and sweeps run in parallel over chunks of rounds; impulses and removals are applied afterwards on the game thread.
+	 */
+	void StepRounds(float DeltaTime);
+
+	/** Moves a single round; only writes to that round's slots, so it is safe to call from worker threads */
+	void StepRound(const UWorld* World, const class UMechSurvivalHorde* Horde, int32 Index, float DeltaTime, float GravityZ, const FCollisionQueryParams& QueryParams);
+
+	/**
+	 * Sweeps a round along its path for RemainingTime. Off the game thread a round stops with a Contact outcome at
+	 * anything whose physics state would decide between absorbing and bouncing; on it, that state is read directly.
+	 */
+	void SweepRound(const UWorld* World, const class UMechSurvivalHorde* Horde, int32 Index, FVector Position, FVector Velocity, float RemainingTime, int32 SweepsLeft, float GravityZ, const FCollisionQueryParams& QueryParams, bool bOnGameThread);
+
+	/** Bounces a round's velocity off a hit; returns false once the round has bounced too often and expired */
+	bool BounceRound(int32 Index, const FMechSurvivalBallisticParams& Params, const FHitResult& Hit, FVector& Velocity);
+
+	/** Removes a round; the last round takes its slot */
+	void RemoveRound(int32 Index);
+
+	/** Rebuilds the proxy instances from the current round positions */
+	void UpdateProxies();
+
+	/** Creates the actor that owns the proxy components, if rounds should be drawn in this world */
+	void CreateProxyActor();
+
+	// Rounds in flight, struct-of-arrays; all arrays share indices
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> Lifetimes;
+	TArray<uint16> BounceCounts;
+	TArray<uint8> ParamIndices;
+	TArray<bool> CosmeticFlags;
+	TArray<uint16> ShotIds;
+	TArray<TWeakObjectPtr<APawn>> Instigators;
+
+	/** Per-round results of the parallel phase, consumed by the apply phase */
+	TArray<ERoundOutcome> RoundOutcomes;
+	TArray<FMechSurvivalRoundImpact> RoundImpacts;
+
+	double LastStepSeconds = 0.0;
+	int32 LastStepChunks = 0;
+
+	/** Flight parameters, indexed by ParamIndices */
+	TArray<FMechSurvivalBallisticParams> ParamTable;
+	TMap<TPair<const UMechSurvivalWeaponData*, UClass*>, int32> ParamLookup;
+
+	/** Owner of the proxy components; null when rounds are not drawn */
+	UPROPERTY(Transient)
+	AActor* ProxyActor;
+
+	/** One instanced mesh per parameter table entry */
+	UPROPERTY(Transient)
+	TArray<UInstancedStaticMeshComponent*> ProxyComponents;
+
+	/** Scratch buffer for proxy transforms, kept to avoid reallocating every frame */
+	TArray<TArray<FTransform>> ProxyTransforms;
+
+	/** True while any proxy instance is drawn; the simulation ticks until they are cleared, then sleeps until the next round */
+	bool bProxiesShown = false;
+};
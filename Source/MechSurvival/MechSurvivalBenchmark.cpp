@@ -0,0 +1,565 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalBenchmark.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvivalMemoryBudget.h"
+#include "MechSurvivalProjectilePool.h"
+#include "MechSurvivalWeaponComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/GameModeBase.h"
+#include "HAL/PlatformMemory.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "Containers/Ticker.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechBenchmark, Log, All);
+
+/** Fails the run if the benchmark map has not begun its first stage in time; outlives the world that travelled */
+static FDelegateHandle GMapLoadTimeoutHandle;
+
+double FMechSurvivalBenchmarkResult::GetPercentileGameThreadMs(float Percentile) const
+{
+	if (GameThreadSamples.Num() == 0)
+	{
+		return 0.0;
+	}
+
+	TArray<float> Sorted = GameThreadSamples;
+	Sorted.Sort();
+	const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * Sorted.Num()) - 1, 0, Sorted.Num() - 1);
+	return Sorted[Index];
+}
+
+void FMechSurvivalPhysicsMarkerTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	LastTime = FPlatformTime::Seconds();
+}
+
+bool UMechSurvivalBenchmark::IsBenchmarkRun()
+{
+	return FParse::Param(FCommandLine::Get(), TEXT("MechBenchmark"));
+}
+
+bool UMechSurvivalBenchmark::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld() && IsBenchmarkRun();
+}
+
+void UMechSurvivalBenchmark::Deinitialize()
+{
+	if (PhysicsStartMarker.IsTickFunctionRegistered())
+	{
+		PhysicsStartMarker.UnRegisterTickFunction();
+	}
+	if (PhysicsEndMarker.IsTickFunctionRegistered())
+	{
+		PhysicsEndMarker.UnRegisterTickFunction();
+	}
+
+	Bots.Empty();
+	Props.Empty();
+
+	Super::Deinitialize();
+}
+
+ETickableTickType UMechSurvivalBenchmark::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UMechSurvivalBenchmark::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalBenchmark, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalBenchmark::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalBenchmark::Tick(float DeltaTime)
+{
+	UWorld* World = GetWorld();
+	if (bFinished || World == nullptr)
+	{
+		return;
+	}
+
+	if (StageIndex == INDEX_NONE)
+	{
+		if (!World->HasBegunPlay())
+		{
+			return;
+		}
+
+		// Started somewhere else: travel to the benchmark map and let the subsystem of that world take over
+		if (!BenchmarkMap.IsEmpty())
+		{
+			const FString MapPackage = FPackageName::ObjectPathToPackageName(BenchmarkMap);
+			if (UWorld::RemovePIEPrefix(World->GetOutermost()->GetName()) != MapPackage)
+			{
+				UE_LOG(LogMechBenchmark, Log, TEXT("Travelling to benchmark map %s"), *MapPackage);
+
+				// A map that fails to load sends the game back to the default map, which travels again; the first travel starts the clock
+				if (!GMapLoadTimeoutHandle.IsValid())
+				{
+					const double Deadline = FPlatformTime::Seconds() + MapLoadTimeout;
+					GMapLoadTimeoutHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Deadline, MapPackage](float)
+					{
+						if (FPlatformTime::Seconds() < Deadline)
+						{
+							return true;
+						}
+
+						UE_LOG(LogMechBenchmark, Error, TEXT("Benchmark FAILED, map %s did not load in time"), *MapPackage);
+						GMapLoadTimeoutHandle.Reset();
+						FPlatformMisc::RequestExitWithStatus(false, 1);
+						return false;
+					}));
+				}
+
+				UGameplayStatics::OpenLevel(World, FName(*MapPackage));
+				bFinished = true;
+				return;
+			}
+		}
+
+		if (GMapLoadTimeoutHandle.IsValid())
+		{
+			FTicker::GetCoreTicker().RemoveTicker(GMapLoadTimeoutHandle);
+			GMapLoadTimeoutHandle.Reset();
+		}
+
+		// Bracket the physics part of the frame: simulation is kicked off in TG_StartPhysics and waited for before TG_EndPhysics
+		PhysicsStartMarker.TickGroup = TG_StartPhysics;
+		PhysicsStartMarker.bCanEverTick = true;
+		PhysicsStartMarker.RegisterTickFunction(World->PersistentLevel);
+		PhysicsEndMarker.TickGroup = TG_EndPhysics;
+		PhysicsEndMarker.bCanEverTick = true;
+		PhysicsEndMarker.RegisterTickFunction(World->PersistentLevel);
+
+		BeginStage(0);
+		return;
+	}
+
+	StageTime += DeltaTime;
+	DriveBots(DeltaTime);
+	UpdateMechs();
+
+	if (StageTime > WarmupSeconds)
+	{
+		Sample(DeltaTime);
+	}
+
+	if (StageTime >= WarmupSeconds + StageSeconds)
+	{
+		BeginStage(StageIndex + 1);
+	}
+}
+
+void UMechSurvivalBenchmark::BeginStage(int32 NewStageIndex)
+{
+	StageIndex = NewStageIndex;
+	StageTime = 0.f;
+
+	if (!Stages.IsValidIndex(StageIndex))
+	{
+		Finish();
+		return;
+	}
+
+	const FMechSurvivalBenchmarkStage& Stage = Stages[StageIndex];
+	UE_LOG(LogMechBenchmark, Log, TEXT("Stage %d/%d '%s': %d bots firing %s every %.3fs, %d props, %d mechs"),
+		StageIndex + 1, Stages.Num(), *Stage.Name, Stage.Bots, Stage.Weapon.IsNone() ? TEXT("their default weapon") : *Stage.Weapon.ToString(), Stage.FireInterval, Stage.Props, Stage.Mechs);
+
+	StageActorsSpawned = 0;
+	ApplyStage(Stage);
+	StagePoolSpawnStart = GetPoolSpawnCount();
+
+	FMechSurvivalBenchmarkResult& Result = Results.AddDefaulted_GetRef();
+	Result.Stage = Stage.Name;
+	Result.ActorsSpawned = StageActorsSpawned;
+	Result.Mechs = Stage.Mechs;
+
+	UpdateMechs();
+}
+
+void UMechSurvivalBenchmark::ApplyStage(const FMechSurvivalBenchmarkStage& Stage)
+{
+	UWorld* World = GetWorld();
+	AGameModeBase* GameMode = World->GetAuthGameMode();
+
+	const AActor* PlayerStart = GameMode ? GameMode->FindPlayerStart(nullptr) : nullptr;
+	const FVector Origin = PlayerStart ? PlayerStart->GetActorLocation() : FVector::ZeroVector;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	// Bots use the same pawn class as the player, so they fire whatever the blueprint is set up with
+	UClass* BotClass = GameMode ? GameMode->DefaultPawnClass.Get() : nullptr;
+	if (BotClass == nullptr || !BotClass->IsChildOf(AMechSurvivalCharacter::StaticClass()))
+	{
+		BotClass = AMechSurvivalCharacter::StaticClass();
+	}
+
+	while (Bots.Num() > Stage.Bots)
+	{
+		AMechSurvivalCharacter* Bot = Bots.Pop();
+		BotFireCooldowns.Pop();
+		if (IsValid(Bot))
+		{
+			if (AController* Controller = Bot->GetController())
+			{
+				Controller->Destroy();
+			}
+			Bot->Destroy();
+		}
+	}
+	while (Bots.Num() < Stage.Bots)
+	{
+		const float Angle = 2.f * PI * Bots.Num() / FMath::Max(Stage.Bots, 1);
+		const FVector Location = Origin + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * BotRingRadius;
+		const FRotator Rotation(0.f, FMath::RadiansToDegrees(Angle), 0.f);
+
+		AMechSurvivalCharacter* Bot = World->SpawnActor<AMechSurvivalCharacter>(BotClass, Location, Rotation, SpawnParams);
+		if (Bot == nullptr)
+		{
+			UE_LOG(LogMechBenchmark, Warning, TEXT("Could not spawn bot %d"), Bots.Num());
+			break;
+		}
+		Bot->FireMode = BotFireMode;
+		Bot->SpawnDefaultController();
+		Bots.Add(Bot);
+		BotFireCooldowns.Add(FMath::FRand() * Stage.FireInterval);
+		++StageActorsSpawned;
+	}
+
+	const bool bHoldTrigger = !Stage.Weapon.IsNone() && Stage.FireInterval <= 0.f;
+	for (AMechSurvivalCharacter* Bot : Bots)
+	{
+		UMechSurvivalWeaponComponent* WeaponComponent = IsValid(Bot) ? Bot->GetWeaponComponent() : nullptr;
+		if (WeaponComponent == nullptr)
+		{
+			continue;
+		}
+
+		WeaponComponent->StopFire();
+		if (Stage.Weapon.IsNone())
+		{
+			WeaponComponent->EquipDefault();
+		}
+		else if (!WeaponComponent->EquipPreset(Stage.Weapon))
+		{
+			UE_LOG(LogMechBenchmark, Warning, TEXT("No weapon preset named %s"), *Stage.Weapon.ToString());
+		}
+
+		if (bHoldTrigger)
+		{
+			WeaponComponent->StartFire();
+		}
+	}
+
+	while (Props.Num() > Stage.Props)
+	{
+		AStaticMeshActor* Prop = Props.Pop();
+		if (IsValid(Prop))
+		{
+			Prop->Destroy();
+		}
+	}
+	if (Props.Num() < Stage.Props)
+	{
+		UStaticMesh* Mesh = PropMesh.LoadSynchronous();
+		if (Mesh == nullptr)
+		{
+			UE_LOG(LogMechBenchmark, Warning, TEXT("Prop mesh %s not found, skipping props"), *PropMesh.ToString());
+			return;
+		}
+
+		// Stack the pile as a cube in front of the player start
+		const int32 Side = FMath::Max(1, FMath::CeilToInt(FMath::Pow((float)Stage.Props, 1.f / 3.f)));
+		const float Spacing = Mesh->GetBounds().BoxExtent.GetMax() * 2.f * PropScale * 1.1f;
+		const FVector PileOrigin = Origin + FVector(BotRingRadius * 0.5f, -0.5f * Side * Spacing, 0.f);
+
+		while (Props.Num() < Stage.Props)
+		{
+			const int32 Index = Props.Num();
+			const FVector Location = PileOrigin + FVector(Index % Side, (Index / Side) % Side, Index / (Side * Side)) * Spacing;
+
+			AStaticMeshActor* Prop = World->SpawnActor<AStaticMeshActor>(Location, FRotator::ZeroRotator, SpawnParams);
+			if (Prop == nullptr)
+			{
+				break;
+			}
+			UStaticMeshComponent* MeshComponent = Prop->GetStaticMeshComponent();
+			MeshComponent->SetMobility(EComponentMobility::Movable);
+			MeshComponent->SetStaticMesh(Mesh);
+			MeshComponent->SetWorldScale3D(FVector(PropScale));
+			// Spawned, so not among the level props the batcher registers by itself
+			if (UMechSurvivalImpulseBatcher* ImpulseBatcher = UMechSurvivalImpulseBatcher::Get(World))
+			{
+				ImpulseBatcher->RegisterDebris(MeshComponent);
+			}
+			MeshComponent->SetSimulatePhysics(true);
+			Props.Add(Prop);
+			++StageActorsSpawned;
+		}
+	}
+}
+
+void UMechSurvivalBenchmark::UpdateMechs()
+{
+	UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(GetWorld());
+	if (Horde == nullptr || !Stages.IsValidIndex(StageIndex))
+	{
+		return;
+	}
+
+	const int32 Missing = Stages[StageIndex].Mechs - Horde->GetNumMechs();
+	if (Missing > 0)
+	{
+		const AGameModeBase* GameMode = GetWorld()->GetAuthGameMode();
+		const AActor* PlayerStart = GameMode ? GameMode->FindPlayerStart(nullptr) : nullptr;
+		const FVector Origin = PlayerStart ? PlayerStart->GetActorLocation() : FVector::ZeroVector;
+		Horde->SpawnMechs(Missing, Origin, MechMinRadius, MechMaxRadius);
+	}
+	else if (Missing < 0)
+	{
+		Horde->RemoveMechs(-Missing);
+	}
+}
+
+void UMechSurvivalBenchmark::DriveBots(float DeltaTime)
+{
+	if (!Stages.IsValidIndex(StageIndex) || Results.Num() == 0)
+	{
+		return;
+	}
+
+	const float FireInterval = Stages[StageIndex].FireInterval;
+	for (int32 Index = 0; Index < Bots.Num(); ++Index)
+	{
+		AMechSurvivalCharacter* Bot = Bots[Index];
+		AController* Controller = IsValid(Bot) ? Bot->GetController() : nullptr;
+		if (Controller == nullptr)
+		{
+			continue;
+		}
+
+		FRotator Aim = Controller->GetControlRotation();
+		Aim.Yaw += BotTurnRate * DeltaTime;
+		Aim.Pitch = -5.f;
+		Controller->SetControlRotation(Aim);
+
+		if (FireInterval <= 0.f)
+		{
+			continue;
+		}
+
+		BotFireCooldowns[Index] -= DeltaTime;
+		while (BotFireCooldowns[Index] <= 0.f)
+		{
+			BotFireCooldowns[Index] += FireInterval;
+			Bot->PullTrigger();
+
+			if (StageTime > WarmupSeconds)
+			{
+				++Results.Last().Shots;
+			}
+		}
+	}
+}
+
+void UMechSurvivalBenchmark::Sample(float DeltaTime)
+{
+	FMechSurvivalBenchmarkResult& Result = Results.Last();
+
+	// Weapon counters are cumulative, so the stage's share is taken against the first sampled frame
+	const FMechSurvivalWeaponFireStats WeaponStats = GetBotWeaponStats();
+	if (Result.Frames == 0)
+	{
+		StageWeaponStart = WeaponStats;
+	}
+	Result.Weapons.Batches = WeaponStats.Batches - StageWeaponStart.Batches;
+	Result.Weapons.Rounds = WeaponStats.Rounds - StageWeaponStart.Rounds;
+	Result.Weapons.Pellets = WeaponStats.Pellets - StageWeaponStart.Pellets;
+	Result.Weapons.Seconds = WeaponStats.Seconds - StageWeaponStart.Seconds;
+
+	const float GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	const double PhysicsSeconds = PhysicsEndMarker.LastTime - PhysicsStartMarker.LastTime;
+
+	++Result.Frames;
+	Result.TotalFrameMs += DeltaTime * 1000.0;
+	Result.TotalGameThreadMs += GameThreadMs;
+	Result.TotalPhysicsMs += FMath::Max(PhysicsSeconds, 0.0) * 1000.0;
+	Result.GameThreadSamples.Add(GameThreadMs);
+	Result.PeakUsedPhysical = FMath::Max<uint64>(Result.PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical);
+	Result.ActorsSpawned = StageActorsSpawned + GetPoolSpawnCount() - StagePoolSpawnStart;
+
+	if (const UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(GetWorld()))
+	{
+		Result.TotalHordeStepMs += Horde->GetLastStepSeconds() * 1000.0;
+	}
+
+	if (const UMechSurvivalImpulseBatcher* ImpulseBatcher = UMechSurvivalImpulseBatcher::Get(GetWorld()))
+	{
+		const FMechSurvivalImpulseStats& ImpulseStats = ImpulseBatcher->GetStats();
+		if (Result.Frames == 1)
+		{
+			StageImpulseStart = ImpulseStats;
+		}
+		Result.Impulses.Queued = ImpulseStats.Queued - StageImpulseStart.Queued;
+		Result.Impulses.Writes = ImpulseStats.Writes - StageImpulseStart.Writes;
+		Result.Impulses.Suppressed = ImpulseStats.Suppressed - StageImpulseStart.Suppressed;
+		Result.Impulses.PutToSleep = ImpulseStats.PutToSleep - StageImpulseStart.PutToSleep;
+		Result.TotalAwakeDebris += ImpulseBatcher->GetNumAwakeDebris();
+	}
+}
+
+void UMechSurvivalBenchmark::Finish()
+{
+	bFinished = true;
+
+	FString BasePath;
+	if (!FParse::Value(FCommandLine::Get(), TEXT("MechBenchmarkReport="), BasePath))
+	{
+		BasePath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / FDateTime::Now().ToString() / TEXT("MechBenchmark");
+	}
+	WriteReports(BasePath);
+	if (const UMechSurvivalMemoryBudget* MemoryBudget = UMechSurvivalMemoryBudget::Get(this))
+	{
+		MemoryBudget->WriteReport(BasePath + TEXT("Memory.csv"));
+	}
+
+	bool bPassed = true;
+	FString BaselinePath;
+	if (FParse::Value(FCommandLine::Get(), TEXT("MechBenchmarkBaseline="), BaselinePath))
+	{
+		bPassed = CompareAgainstBaseline(BaselinePath);
+	}
+
+	UE_LOG(LogMechBenchmark, Display, TEXT("Benchmark %s, report written to %s.csv"), bPassed ? TEXT("passed") : TEXT("FAILED"), *BasePath);
+
+	if (!GIsEditor)
+	{
+		FPlatformMisc::RequestExitWithStatus(false, bPassed ? 0 : 1);
+	}
+}
+
+void UMechSurvivalBenchmark::WriteReports(const FString& BasePath) const
+{
+	FString Csv = TEXT("Stage,Frames,AvgFrameMs,AvgGameThreadMs,P95GameThreadMs,AvgPhysicsMs,Shots,ActorsSpawned,PeakUsedPhysicalMB,Mechs,AvgHordeStepMs,Rounds,Pellets,AvgRoundUs,AvgAwakeDebris,ImpulsesQueued,ImpulseWrites,ImpulsesSuppressed,DebrisPutToSleep\n");
+	FString Json = TEXT("{\n\t\"stages\": [\n");
+
+	for (int32 Index = 0; Index < Results.Num(); ++Index)
+	{
+		const FMechSurvivalBenchmarkResult& Result = Results[Index];
+		const double PeakMB = Result.PeakUsedPhysical / (1024.0 * 1024.0);
+
+		Csv += FString::Printf(TEXT("%s,%d,%.3f,%.3f,%.3f,%.3f,%d,%d,%.1f,%d,%.3f,%d,%d,%.2f,%.1f,%d,%d,%d,%d\n"),
+			*Result.Stage, Result.Frames, Result.GetAverageFrameMs(), Result.GetAverageGameThreadMs(), Result.GetPercentileGameThreadMs(0.95f),
+			Result.GetAveragePhysicsMs(), Result.Shots, Result.ActorsSpawned, PeakMB, Result.Mechs, Result.GetAverageHordeStepMs(),
+			Result.Weapons.Rounds, Result.Weapons.Pellets, Result.GetAverageRoundUs(),
+			Result.GetAverageAwakeDebris(), Result.Impulses.Queued, Result.Impulses.Writes, Result.Impulses.Suppressed, Result.Impulses.PutToSleep);
+
+		Json += FString::Printf(TEXT("\t\t{ \"stage\": \"%s\", \"frames\": %d, \"avgFrameMs\": %.3f, \"avgGameThreadMs\": %.3f, \"p95GameThreadMs\": %.3f, \"avgPhysicsMs\": %.3f, \"shots\": %d, \"actorsSpawned\": %d, \"peakUsedPhysicalMB\": %.1f, \"mechs\": %d, \"avgHordeStepMs\": %.3f, \"rounds\": %d, \"pellets\": %d, \"avgRoundUs\": %.2f, \"avgAwakeDebris\": %.1f, \"impulsesQueued\": %d, \"impulseWrites\": %d, \"impulsesSuppressed\": %d, \"debrisPutToSleep\": %d }%s\n"),
+			*Result.Stage.ReplaceCharWithEscapedChar(), Result.Frames, Result.GetAverageFrameMs(), Result.GetAverageGameThreadMs(), Result.GetPercentileGameThreadMs(0.95f),
+			Result.GetAveragePhysicsMs(), Result.Shots, Result.ActorsSpawned, PeakMB, Result.Mechs, Result.GetAverageHordeStepMs(),
+			Result.Weapons.Rounds, Result.Weapons.Pellets, Result.GetAverageRoundUs(),
+			Result.GetAverageAwakeDebris(), Result.Impulses.Queued, Result.Impulses.Writes, Result.Impulses.Suppressed, Result.Impulses.PutToSleep,
+			Index + 1 < Results.Num() ? TEXT(",") : TEXT(""));
+	}
+	Json += TEXT("\t]\n}\n");
+
+	FFileHelper::SaveStringToFile(Csv, *(BasePath + TEXT(".csv")));
+	FFileHelper::SaveStringToFile(Json, *(BasePath + TEXT(".json")));
+}
+
+bool UMechSurvivalBenchmark::CompareAgainstBaseline(const FString& BaselinePath) const
+{
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *BaselinePath) || Lines.Num() < 2)
+	{
+		UE_LOG(LogMechBenchmark, Error, TEXT("Could not read baseline %s"), *BaselinePath);
+		return false;
+	}
+
+	float Tolerance = RegressionTolerance;
+	FParse::Value(FCommandLine::Get(), TEXT("MechBenchmarkTolerance="), Tolerance);
+	float MinDeltaMs = MinRegressionMs;
+	FParse::Value(FCommandLine::Get(), TEXT("MechBenchmarkMinRegressionMs="), MinDeltaMs);
+
+	// Over the relative tolerance and over the absolute floor both, so a stage of a few microseconds does not fail on noise
+	auto IsRegression = [Tolerance, MinDeltaMs](float CurrentMs, float BaselineMs)
+	{
+		return CurrentMs > BaselineMs * (1.f + Tolerance) && CurrentMs - BaselineMs > MinDeltaMs;
+	};
+
+	// Columns as written by WriteReports
+	const int32 StageColumn = 0;
+	const int32 GameThreadColumn = 3;
+	const int32 PhysicsColumn = 5;
+
+	bool bPassed = true;
+	for (int32 LineIndex = 1; LineIndex < Lines.Num(); ++LineIndex)
+	{
+		TArray<FString> Columns;
+		Lines[LineIndex].ParseIntoArray(Columns, TEXT(","), false);
+		if (Columns.Num() <= PhysicsColumn)
+		{
+			continue;
+		}
+
+		const FMechSurvivalBenchmarkResult* Result = Results.FindByPredicate([&Columns](const FMechSurvivalBenchmarkResult& Candidate) { return Candidate.Stage == Columns[StageColumn]; });
+		if (Result == nullptr)
+		{
+			UE_LOG(LogMechBenchmark, Warning, TEXT("Baseline stage '%s' was not run"), *Columns[StageColumn]);
+			continue;
+		}
+
+		const float BaselineGameThreadMs = FCString::Atof(*Columns[GameThreadColumn]);
+		const float BaselinePhysicsMs = FCString::Atof(*Columns[PhysicsColumn]);
+		if (IsRegression(Result->GetAverageGameThreadMs(), BaselineGameThreadMs))
+		{
+			UE_LOG(LogMechBenchmark, Error, TEXT("Stage '%s': game thread %.3f ms, baseline %.3f ms"), *Result->Stage, Result->GetAverageGameThreadMs(), BaselineGameThreadMs);
+			bPassed = false;
+		}
+		if (IsRegression(Result->GetAveragePhysicsMs(), BaselinePhysicsMs))
+		{
+			UE_LOG(LogMechBenchmark, Error, TEXT("Stage '%s': physics %.3f ms, baseline %.3f ms"), *Result->Stage, Result->GetAveragePhysicsMs(), BaselinePhysicsMs);
+			bPassed = false;
+		}
+	}
+
+	return bPassed;
+}
+
+int32 UMechSurvivalBenchmark::GetPoolSpawnCount() const
+{
+	const UMechSurvivalProjectilePool* Pool = UMechSurvivalProjectilePool::Get(this);
+	return Pool ? Pool->GetStats().Spawned : 0;
+}
+
+FMechSurvivalWeaponFireStats UMechSurvivalBenchmark::GetBotWeaponStats() const
+{
+	FMechSurvivalWeaponFireStats Total;
+	for (const AMechSurvivalCharacter* Bot : Bots)
+	{
+		if (const UMechSurvivalWeaponComponent* WeaponComponent = IsValid(Bot) ? Bot->GetWeaponComponent() : nullptr)
+		{
+			Total += WeaponComponent->GetFireStats();
+		}
+	}
+	return Total;
+}
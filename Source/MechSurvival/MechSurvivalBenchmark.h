@@ -0,0 +1,227 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Engine/EngineBaseTypes.h"
+#include "MechSurvivalBallistics.h"
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvivalWeaponComponent.h"
+#include "MechSurvivalBenchmark.generated.h"
+
+class AMechSurvivalCharacter;
+class AStaticMeshActor;
+class UStaticMesh;
+
+/** One step of the benchmark ramp; counts are absolute, not relative to the previous stage */
+USTRUCT()
+struct FMechSurvivalBenchmarkStage
+{
+	GENERATED_BODY()
+
+	/** Name used in the report and to match stages against a baseline */
+	UPROPERTY(config)
+	FString Name;
+
+	/** Number of bots firing continuously */
+	UPROPERTY(config)
+	int32 Bots = 0;
+
+	/** Seconds between two shots of the same bot */
+	UPROPERTY(config)
+	float FireInterval = 0.1f;
+
+	/** Number of simulating physics props in the pile */
+	UPROPERTY(config)
+	int32 Props = 0;
+
+	/** Number of horde mechs; mechs the bots kill are replaced straight away */
+	UPROPERTY(config)
+	int32 Mechs = 0;
+
+	/** Weapon preset the bots fire, none for their default weapon; with a FireInterval of 0 they hold the trigger down */
+	UPROPERTY(config)
+	FName Weapon;
+};
+
+/** Measurements gathered during one stage */
+struct FMechSurvivalBenchmarkResult
+{
+	FString Stage;
+	int32 Frames = 0;
+	double TotalFrameMs = 0.0;
+	double TotalGameThreadMs = 0.0;
+	double TotalPhysicsMs = 0.0;
+	TArray<float> GameThreadSamples;
+	int32 Shots = 0;
+	int32 ActorsSpawned = 0;
+	uint64 PeakUsedPhysical = 0;
+	int32 Mechs = 0;
+	double TotalHordeStepMs = 0.0;
+	FMechSurvivalWeaponFireStats Weapons;
+	FMechSurvivalImpulseStats Impulses;
+	int64 TotalAwakeDebris = 0;
+
+	double GetAverageFrameMs() const { return Frames > 0 ? TotalFrameMs / Frames : 0.0; }
+	double GetAverageGameThreadMs() const { return Frames > 0 ? TotalGameThreadMs / Frames : 0.0; }
+	double GetAveragePhysicsMs() const { return Frames > 0 ? TotalPhysicsMs / Frames : 0.0; }
+	double GetAverageHordeStepMs() const { return Frames > 0 ? TotalHordeStepMs / Frames : 0.0; }
+	double GetAverageAwakeDebris() const { return Frames > 0 ? (double)TotalAwakeDebris / Frames : 0.0; }
+	/** Cost of one trigger pull, all pellets included */
+	double GetAverageRoundUs() const { return Weapons.Rounds > 0 ? Weapons.Seconds * 1000000.0 / Weapons.Rounds : 0.0; }
+	double GetPercentileGameThreadMs(float Percentile) const;
+};
+
+/** Marks the start or end of the physics part of the frame for the benchmark */
+struct FMechSurvivalPhysicsMarkerTickFunction : public FTickFunction
+{
+	/** Time the marker last ran */
+	double LastTime = 0.0;
+
+	// FTickFunction interface
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override { return TEXT("MechSurvivalBenchmark physics marker"); }
+	// End of FTickFunction interface
+};
+
+/**
+ * Headless performance benchmark.
+ * Runs only when the game is started with -MechBenchmark, e.g.
+ *   MechSurvival -MechBenchmark -nullrhi -unattended [-MechBenchmarkBaseline=<report.csv>] [-MechBenchmarkTolerance=0.1] [-MechBenchmarkMinRegressionMs=0.2]
+ * Loads the benchmark map, then walks through the configured stages, spawning firing bots, physics props and horde mechs.
+ * Each stage records game thread time, physics time, shots, spawned actors and memory into a CSV and a JSON report under
+ * Saved/Benchmark. With a baseline the run fails with exit code 1 if any stage is slower than the tolerance allows, by
+ * more than the minimum regression in milliseconds, so that stages taking next to no time do not fail on noise.
+ * Run with -LLM as well to get the peak and average memory of every game system in <report>Memory.csv.
+ */
+UCLASS(config=Game)
+class UMechSurvivalBenchmark : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** True if this run was started as a benchmark */
+	static bool IsBenchmarkRun();
+
+protected:
+	/** Map the benchmark runs in; the game travels there if started elsewhere */
+	UPROPERTY(config)
+	FString BenchmarkMap;
+
+	/** Seconds the benchmark map may take to load before the run fails with exit code 1, e.g. when it was not cooked */
+	UPROPERTY(config)
+	float MapLoadTimeout = 120.f;
+
+	/** Seconds to let each stage settle before sampling */
+	UPROPERTY(config)
+	float WarmupSeconds = 3.f;
+
+	/** Seconds sampled per stage */
+	UPROPERTY(config)
+	float StageSeconds = 10.f;
+
+	/** The ramp, run in order */
+	UPROPERTY(config)
+	TArray<FMechSurvivalBenchmarkStage> Stages;
+
+	/** How bots fire */
+	UPROPERTY(config)
+	EMechSurvivalFireMode BotFireMode = EMechSurvivalFireMode::PooledActor;
+
+	/** Bots stand on a ring of this radius around the player start */
+	UPROPERTY(config)
+	float BotRingRadius = 800.f;
+
+	/** Mechs are spawned on a ring between these distances from the player start, and walk in towards the bots */
+	UPROPERTY(config)
+	float MechMinRadius = 3000.f;
+
+	UPROPERTY(config)
+	float MechMaxRadius = 8000.f;
+
+	/** Yaw speed of the bots, in deg/sec, so that they spray the whole arena */
+	UPROPERTY(config)
+	float BotTurnRate = 30.f;
+
+	/** Mesh of the physics props */
+	UPROPERTY(config)
+	TSoftObjectPtr<UStaticMesh> PropMesh;
+
+	/** Scale of the physics props */
+	UPROPERTY(config)
+	float PropScale = 0.25f;
+
+	/** Allowed relative slowdown per stage against the baseline before the run fails */
+	UPROPERTY(config)
+	float RegressionTolerance = 0.1f;
+
+	/** A stage only fails once it is also this many milliseconds slower than the baseline, for game thread and physics alike */
+	UPROPERTY(config)
+	float MinRegressionMs = 0.2f;
+
+private:
+	/** Moves to the stage at StageIndex, or finishes the run past the last one */
+	void BeginStage(int32 NewStageIndex);
+
+	/** Spawns or destroys bots and props to match a stage */
+	void ApplyStage(const FMechSurvivalBenchmarkStage& Stage);
+
+	/** Spawns or removes horde mechs to match the current stage */
+	void UpdateMechs();
+
+	/** Turns and fires the bots */
+	void DriveBots(float DeltaTime);
+
+	/** Records one frame of the current stage */
+	void Sample(float DeltaTime);
+
+	/** Writes the reports, compares against the baseline and exits */
+	void Finish();
+
+	/** Returns false if any stage regressed against the baseline CSV */
+	bool CompareAgainstBaseline(const FString& BaselinePath) const;
+
+	void WriteReports(const FString& BasePath) const;
+
+	/** Number of actors spawned by the pool so far */
+	int32 GetPoolSpawnCount() const;
+
+	/** Firing counters of all bots' weapons added up */
+	FMechSurvivalWeaponFireStats GetBotWeaponStats() const;
+
+	UPROPERTY(Transient)
+	TArray<AMechSurvivalCharacter*> Bots;
+
+	UPROPERTY(Transient)
+	TArray<AStaticMeshActor*> Props;
+
+	/** Time until each bot fires again, parallel to Bots */
+	TArray<float> BotFireCooldowns;
+
+	FMechSurvivalPhysicsMarkerTickFunction PhysicsStartMarker;
+	FMechSurvivalPhysicsMarkerTickFunction PhysicsEndMarker;
+
+	TArray<FMechSurvivalBenchmarkResult> Results;
+
+	int32 StageIndex = INDEX_NONE;
+	float StageTime = 0.f;
+	int32 StagePoolSpawnStart = 0;
+	int32 StageActorsSpawned = 0;
+	FMechSurvivalWeaponFireStats StageWeaponStart;
+	FMechSurvivalImpulseStats StageImpulseStart;
+	bool bFinished = false;
+};
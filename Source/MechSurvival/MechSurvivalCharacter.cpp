@@ -1,15 +1,38 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "MechSurvivalCharacter.h"
+#include "MechSurvival.h"
+#include "MechSurvivalAssetPreloader.h"
 #include "MechSurvivalProjectile.h"
+#include "MechSurvivalProjectilePool.h"
+#include "MechSurvivalBallistics.h"
+#include "MechSurvivalDeterminism.h"
+#include "MechSurvivalHUD.h"
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvivalLagCompensation.h"
+#include "MechSurvivalMemoryBudget.h"
+#include "MechSurvivalMovementComponent.h"
+#include "MechSurvivalShotReplicator.h"
+#include "MechSurvivalSignificance.h"
+#include "MechSurvivalSkeletalMeshComponent.h"
+#include "MechSurvivalSpatialHash.h"
+#include "MechSurvivalTelemetry.h"
+#include "MechSurvivalVRInput.h"
+#include "MechSurvivalWeaponComponent.h"
+#include "MechSurvivalWeaponData.h"
 #include "Animation/AnimInstance.h"
+#include "Animation/AnimMontage.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "GameFramework/DamageType.h"
+#include "GameFramework/GameStateBase.h"
 #include "GameFramework/InputSettings.h"
+#include "GameFramework/PlayerController.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Kismet/GameplayStatics.h"
 #include "MotionControllerComponent.h"
+#include "Sound/SoundBase.h"
 #include "XRMotionControllerBase.h" // for FXRMotionControllerBase::RightHandSourceId
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
@@ -17,7 +40,10 @@ DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 //////////////////////////////////////////////////////////////////////////
 // AMechSurvivalCharacter
 
-AMechSurvivalCharacter::AMechSurvivalCharacter()
+AMechSurvivalCharacter::AMechSurvivalCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer
+		.SetDefaultSubobjectClass<UMechSurvivalMovementComponent>(ACharacter::CharacterMovementComponentName)
+		.SetDefaultSubobjectClass<UMechSurvivalSkeletalMeshComponent>(ACharacter::MeshComponentName))
 {
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(55.f, 96.0f);
@@ -33,7 +59,8 @@ AMechSurvivalCharacter::AMechSurvivalCharacter()
 	FirstPersonCameraComponent->bUsePawnControlRotation = true;
 
 	// Create a mesh component that will be used when being viewed from a '1st person' view (when controlling this pawn)
-	Mesh1P = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("CharacterMesh1P"));
+	// It, the guns and the third person mesh animate within the animation budget
+	Mesh1P = CreateDefaultSubobject<UMechSurvivalSkeletalMeshComponent>(TEXT("CharacterMesh1P"));
 	Mesh1P->SetOnlyOwnerSee(true);
 	Mesh1P->SetupAttachment(FirstPersonCameraComponent);
 	Mesh1P->bCastDynamicShadow = false;
@@ -42,7 +69,7 @@ AMechSurvivalCharacter::AMechSurvivalCharacter()
 	Mesh1P->SetRelativeLocation(FVector(-0.5f, -4.4f, -155.7f));
 
 	// Create a gun mesh component
-	FP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("FP_Gun"));
+	FP_Gun = CreateDefaultSubobject<UMechSurvivalSkeletalMeshComponent>(TEXT("FP_Gun"));
 	FP_Gun->SetOnlyOwnerSee(true);			// only the owning player will see this mesh
 	FP_Gun->bCastDynamicShadow = false;
 	FP_Gun->CastShadow = false;
@@ -53,8 +80,14 @@ AMechSurvivalCharacter::AMechSurvivalCharacter()
 	FP_MuzzleLocation->SetupAttachment(FP_Gun);
 	FP_MuzzleLocation->SetRelativeLocation(FVector(0.2f, 48.4f, -10.6f));
 
-	// Default offset from the character location for projectiles to spawn
-	GunOffset = FVector(100.0f, 0.0f, 10.0f);
+	// Fire projectile actors unless the blueprint asks for simulated rounds
+	FireMode = EMechSurvivalFireMode::PooledActor;
+
+	// Client muzzles further than this from the pawn on the server are rejected
+	MaxFireRequestDistance = 300.f;
+	MaxFireRequestTimeAhead = 0.25f;
+	NextShotId = 0;
+	PendingTriggerSeconds = -1.0;
 
 	// Note: The ProjectileClass and the skeletal mesh/anim blueprints for Mesh1P, FP_Gun, and VR_Gun 
 	// are set in the derived blueprint asset named MyCharacter to avoid direct content references in C++.
@@ -68,7 +101,7 @@ AMechSurvivalCharacter::AMechSurvivalCharacter()
 
 	// Create a gun and attach it to the right-hand VR controller.
 	// Create a gun mesh component
-	VR_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("VR_Gun"));
+	VR_Gun = CreateDefaultSubobject<UMechSurvivalSkeletalMeshComponent>(TEXT("VR_Gun"));
 	VR_Gun->SetOnlyOwnerSee(true);			// only the owning player will see this mesh
 	VR_Gun->bCastDynamicShadow = false;
 	VR_Gun->CastShadow = false;
@@ -80,12 +113,17 @@ AMechSurvivalCharacter::AMechSurvivalCharacter()
 	VR_MuzzleLocation->SetRelativeLocation(FVector(0.000004, 53.999992, 10.000000));
 	VR_MuzzleLocation->SetRelativeRotation(FRotator(0.0f, 90.0f, 0.0f));		// Counteract the rotation of the VR gun model.
 
+	// The weapon decides when and what to fire; the muzzle offset comes from the weapon too
+	WeaponComponent = CreateDefaultSubobject<UMechSurvivalWeaponComponent>(TEXT("Weapon"));
+
 	// Uncomment the following line to turn motion controllers on by default:
 	//bUsingMotionControllers = true;
 }
 
 void AMechSurvivalCharacter::BeginPlay()
 {
+	MECHSURVIVAL_LLM_SCOPE(Characters);
+
 	// Call the base class  
 	Super::BeginPlay();
 
@@ -103,6 +141,80 @@ void AMechSurvivalCharacter::BeginPlay()
 		VR_Gun->SetHiddenInGame(true, true);
 		Mesh1P->SetHiddenInGame(false, true);
 	}
+
+	// Our assets are normally resident from the startup preload; classes it did not know about load them here
+	TArray<FSoftObjectPath> Assets;
+	GetPreloadAssets(Assets);
+	UMechSurvivalAssetPreloader* Preloader = UMechSurvivalAssetPreloader::Get(this);
+	if (Preloader != nullptr)
+	{
+		AssetsHandle = Preloader->RequestAsyncLoad(Assets, FStreamableDelegate::CreateUObject(this, &AMechSurvivalCharacter::OnAssetsLoaded), GetName());
+	}
+	else
+	{
+		OnAssetsLoaded();
+	}
+
+	// Far away and off-screen characters tick and animate less, and their guns are heard less
+	if (UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(this))
+	{
+		Significance->RegisterActor(this, EMechSurvivalSignificanceCategory::Character);
+	}
+
+	// The server keeps a history of where we were so that clients' shots can be checked against it
+	if (HasAuthority())
+	{
+		if (UMechSurvivalLagCompensation* LagCompensation = UMechSurvivalLagCompensation::Get(this))
+		{
+			LagCompensation->RegisterTarget(GetCapsuleComponent());
+		}
+
+		// Explosions are resolved by the server too
+		if (UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(this))
+		{
+			SpatialHash->RegisterEntity(GetCapsuleComponent());
+		}
+	}
+}
+
+void AMechSurvivalCharacter::GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const
+{
+	OutAssets.Add(ProjectileClass.ToSoftObjectPath());
+	OutAssets.Add(FireSound.ToSoftObjectPath());
+	OutAssets.Add(FireAnimation.ToSoftObjectPath());
+	if (WeaponComponent != nullptr)
+	{
+		WeaponComponent->GetPreloadAssets(OutAssets);
+	}
+}
+
+void AMechSurvivalCharacter::OnAssetsLoaded()
+{
+	// Fill the projectile pool now rather than on the first shots
+	if (UMechSurvivalProjectilePool* ProjectilePool = UMechSurvivalProjectilePool::Get(this))
+	{
+		ProjectilePool->Prewarm(GetProjectileClass());
+	}
+}
+
+void AMechSurvivalCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UMechSurvivalLagCompensation* LagCompensation = UMechSurvivalLagCompensation::Get(this))
+	{
+		LagCompensation->UnregisterTarget(GetCapsuleComponent());
+	}
+
+	if (UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(this))
+	{
+		SpatialHash->UnregisterEntity(GetCapsuleComponent());
+	}
+
+	if (UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(this))
+	{
+		Significance->UnregisterActor(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -113,79 +225,485 @@ void AMechSurvivalCharacter::SetupPlayerInputComponent(class UInputComponent* Pl
 	// set up gameplay key bindings
 	check(PlayerInputComponent);
 
+	// A simulated motion controller stands in for a headset in automated runs
+	if (UMechSurvivalVRInput::IsSimulatingMotionController() && !bUsingMotionControllers)
+	{
+		bUsingMotionControllers = true;
+		VR_Gun->SetHiddenInGame(false, true);
+		Mesh1P->SetHiddenInGame(true, true);
+	}
+
+	// Every binding goes through InputAxis or InputAction, so that a deterministic run sees all input
+
 	// Bind jump events
-	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ACharacter::Jump);
-	PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
+	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::JumpPressed>);
+	PlayerInputComponent->BindAction("Jump", IE_Released, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::JumpReleased>);
 
 	// Bind fire event
-	PlayerInputComponent->BindAction("Fire", IE_Pressed, this, &AMechSurvivalCharacter::OnFire);
+	PlayerInputComponent->BindAction("Fire", IE_Pressed, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::FirePressed>);
+	PlayerInputComponent->BindAction("Fire", IE_Released, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::FireReleased>);
 
 	// Enable touchscreen input
 	EnableTouchscreenMovement(PlayerInputComponent);
 
-	PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &AMechSurvivalCharacter::OnResetVR);
+	PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::ResetVR>);
+
+	// Bind boost events
+	PlayerInputComponent->BindAction("Boost", IE_Pressed, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::BoostPressed>);
+	PlayerInputComponent->BindAction("Boost", IE_Released, this, &AMechSurvivalCharacter::InputAction<EMechSurvivalInputAction::BoostReleased>);
 
 	// Bind movement events
-	PlayerInputComponent->BindAxis("MoveForward", this, &AMechSurvivalCharacter::MoveForward);
-	PlayerInputComponent->BindAxis("MoveRight", this, &AMechSurvivalCharacter::MoveRight);
+	PlayerInputComponent->BindAxis("MoveForward", this, &AMechSurvivalCharacter::InputAxis<EMechSurvivalInputAxis::MoveForward>);
+	PlayerInputComponent->BindAxis("MoveRight", this, &AMechSurvivalCharacter::InputAxis<EMechSurvivalInputAxis::MoveRight>);
 
 	// We have 2 versions of the rotation bindings to handle different kinds of devices differently
 	// "turn" handles devices that provide an absolute delta, such as a mouse.
 	// "turnrate" is for devices that we choose to treat as a rate of change, such as an analog joystick
-	PlayerInputComponent->BindAxis("Turn", this, &APawn::AddControllerYawInput);
-	PlayerInputComponent->BindAxis("TurnRate", this, &AMechSurvivalCharacter::TurnAtRate);
-	PlayerInputComponent->BindAxis("LookUp", this, &APawn::AddControllerPitchInput);
-	PlayerInputComponent->BindAxis("LookUpRate", this, &AMechSurvivalCharacter::LookUpAtRate);
+	PlayerInputComponent->BindAxis("Turn", this, &AMechSurvivalCharacter::InputAxis<EMechSurvivalInputAxis::Turn>);
+	PlayerInputComponent->BindAxis("TurnRate", this, &AMechSurvivalCharacter::InputAxis<EMechSurvivalInputAxis::TurnRate>);
+	PlayerInputComponent->BindAxis("LookUp", this, &AMechSurvivalCharacter::InputAxis<EMechSurvivalInputAxis::LookUp>);
+	PlayerInputComponent->BindAxis("LookUpRate", this, &AMechSurvivalCharacter::InputAxis<EMechSurvivalInputAxis::LookUpRate>);
+}
+
+template<EMechSurvivalInputAxis Axis>
+void AMechSurvivalCharacter::InputAxis(float Value)
+{
+	if (UMechSurvivalDeterminism* Determinism = UMechSurvivalDeterminism::Get(this))
+	{
+		Determinism->FilterAxis(this, Axis, Value);
+	}
+	ApplyInputAxis(Axis, Value);
+}
+
+template<EMechSurvivalInputAction Action>
+void AMechSurvivalCharacter::InputAction()
+{
+	UMechSurvivalDeterminism* Determinism = UMechSurvivalDeterminism::Get(this);
+	if (Determinism == nullptr || Determinism->FilterAction(this, Action))
+	{
+		ApplyInputAction(Action);
+	}
+}
+
+void AMechSurvivalCharacter::ApplyInputAxis(EMechSurvivalInputAxis Axis, float Value)
+{
+	switch (Axis)
+	{
+	case EMechSurvivalInputAxis::MoveForward:	MoveForward(Value); break;
+	case EMechSurvivalInputAxis::MoveRight:		MoveRight(Value); break;
+	case EMechSurvivalInputAxis::Turn:			AddControllerYawInput(Value); break;
+	case EMechSurvivalInputAxis::TurnRate:		TurnAtRate(Value); break;
+	case EMechSurvivalInputAxis::LookUp:		AddControllerPitchInput(Value); break;
+	case EMechSurvivalInputAxis::LookUpRate:	LookUpAtRate(Value); break;
+	default: break;
+	}
+}
+
+void AMechSurvivalCharacter::ApplyInputAction(EMechSurvivalInputAction Action)
+{
+	switch (Action)
+	{
+	case EMechSurvivalInputAction::JumpPressed:		Jump(); break;
+	case EMechSurvivalInputAction::JumpReleased:	StopJumping(); break;
+	case EMechSurvivalInputAction::FirePressed:		OnFire(); break;
+	case EMechSurvivalInputAction::FireReleased:	OnStopFire(); break;
+	case EMechSurvivalInputAction::ResetVR:			OnResetVR(); break;
+	case EMechSurvivalInputAction::BoostPressed:	SetBoost(true); break;
+	case EMechSurvivalInputAction::BoostReleased:	SetBoost(false); break;
+	default: break;
+	}
+}
+
+void AMechSurvivalCharacter::PullTrigger()
+{
+	WeaponComponent->StartFire();
+	WeaponComponent->StopFire();
 }
 
 void AMechSurvivalCharacter::OnFire()
 {
-	// try and fire a projectile
-	if (ProjectileClass != NULL)
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(OnFire);
+	MECHSURVIVAL_INC_COUNTER(InputEvents, 1);
+
+	// The first round is dated back to the pull; StartFire fires it straight away
+	UMechSurvivalVRInput* VRInput = bUsingMotionControllers ? UMechSurvivalVRInput::Get(this) : nullptr;
+	PendingTriggerSeconds = VRInput ? VRInput->ConsumeTriggerSeconds() : -1.0;
+
+	WeaponComponent->StartFire();
+
+	PendingTriggerSeconds = -1.0;
+}
+
+void AMechSurvivalCharacter::OnStopFire()
+{
+	MECHSURVIVAL_INC_COUNTER(InputEvents, 1);
+
+	WeaponComponent->StopFire();
+}
+
+void AMechSurvivalCharacter::SetBoost(bool bBoost)
+{
+	MECHSURVIVAL_INC_COUNTER(InputEvents, 1);
+
+	if (UMechSurvivalMovementComponent* MoveComponent = Cast<UMechSurvivalMovementComponent>(GetCharacterMovement()))
 	{
-		UWorld* const World = GetWorld();
-		if (World != NULL)
+		MoveComponent->SetWantsToBoost(bBoost);
+	}
+}
+
+UClass* AMechSurvivalCharacter::GetWeaponProjectileClass(const UMechSurvivalWeaponData* Weapon) const
+{
+	if (Weapon == nullptr)
+	{
+		return nullptr;
+	}
+	return Weapon->Stats.ProjectileClass.IsNull() ? GetProjectileClass() : Weapon->Stats.ProjectileClass.Get();
+}
+
+int32 AMechSurvivalCharacter::FireWeapon(const UMechSurvivalWeaponData* Weapon, int32 Rounds)
+{
+	UClass* WeaponProjectileClass = GetWeaponProjectileClass(Weapon);
+	if (WeaponProjectileClass == NULL || Rounds <= 0)
+	{
+		return 0;
+	}
+
+	const FMechSurvivalWeaponStats& Stats = Weapon->Stats;
+
+	FVector SpawnLocation;
+	FRotator SpawnRotation;
+	ESpawnActorCollisionHandlingMethod CollisionHandling;
+	bool bFreshPose = false;
+	float CorrectionDegrees = 0.f;
+	if (bUsingMotionControllers)
+	{
+		// the component moved in its own tick, a frame or so before the controller got here
+		FTransform Muzzle = VR_MuzzleLocation->GetComponentTransform();
+		FTransform FreshMuzzle;
+		bFreshPose = GetFreshVRMuzzleTransform(FreshMuzzle);
+		if (bFreshPose)
 		{
-			if (bUsingMotionControllers)
+			const float CosCorrection = FVector::DotProduct(Muzzle.GetUnitAxis(EAxis::X), FreshMuzzle.GetUnitAxis(EAxis::X));
+			CorrectionDegrees = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(CosCorrection, -1.f, 1.f)));
+			Muzzle = FreshMuzzle;
+		}
+		SpawnRotation = Muzzle.Rotator();
+		SpawnLocation = Muzzle.GetLocation();
+		CollisionHandling = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	}
+	else
+	{
+		SpawnRotation = GetControlRotation();
+		// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
+		SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(Stats.MuzzleOffset);
+		CollisionHandling = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+	}
+
+	// a motion controller's first round leaves when the trigger was pulled, not when the game got to it
+	const double TriggerSeconds = PendingTriggerSeconds;
+	PendingTriggerSeconds = -1.0;
+	UMechSurvivalVRInput* VRInput = TriggerSeconds >= 0.0 ? UMechSurvivalVRInput::Get(this) : nullptr;
+	float BackdateSeconds = 0.f;
+	if (VRInput != nullptr && !UMechSurvivalDeterminism::IsDeterministicRun())
+	{
+		BackdateSeconds = FMath::Clamp((float)(FPlatformTime::Seconds() - TriggerSeconds), 0.f, VRInput->GetMaxBackdateSeconds());
+	}
+
+	// every pellet of every round due this frame goes out in one batch
+	TArray<FRotator, TInlineAllocator<16>> Rotations;
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		// nobody predicted these, so any seed will do; clients get it with the shot and scatter the pellets alike
+		const uint16 FirstSeed = (uint16)FMath::RandRange(1, MAX_uint16);
+		uint16 Seed = FirstSeed;
+		for (int32 Round = 0; Round < Rounds; ++Round)
+		{
+			Stats.AddPelletRotations(SpawnRotation, Seed, Rotations);
+			Seed = FMechSurvivalFireRequest::NextShotId(Seed);
+		}
+
+		// projectiles are never replicated, clients get the shots from the replicator instead
+		if (AMechSurvivalShotReplicator* ShotReplicator = AMechSurvivalShotReplicator::Get(this))
+		{
+			ShotReplicator->RecordShot(this, WeaponProjectileClass, Weapon, SpawnLocation, SpawnRotation, FirstSeed, Rounds, false, BackdateSeconds);
+		}
+		LaunchProjectiles(Weapon, WeaponProjectileClass, SpawnLocation, Rotations, CollisionHandling, BackdateSeconds);
+	}
+	else
+	{
+		FMechSurvivalFireRequest Request;
+		Request.Location = SpawnLocation;
+		Request.Rotation = SpawnRotation;
+		const AGameStateBase* GameState = GetWorld()->GetGameState();
+		Request.Timestamp = (GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds()) - BackdateSeconds;
+
+		TArray<uint16, TInlineAllocator<16>> ShotIds;
+		for (int32 Round = 0; Round < Rounds; ++Round)
+		{
+			NextShotId = FMechSurvivalFireRequest::NextShotId(NextShotId);
+
+			// the server scatters the pellets with the same seed; only the first one is reconciled, the rest match anyway
+			const int32 FirstPellet = Rotations.Num();
+			Stats.AddPelletRotations(SpawnRotation, NextShotId, Rotations);
+			ShotIds.Add(NextShotId);
+			ShotIds.AddZeroed(Rotations.Num() - FirstPellet - 1);
+
+			// one request carries the frame's rounds; the server counts the ids on from the first
+			const int32 RoundInRequest = Round % FMechSurvivalFireRequest::MaxRounds;
+			if (RoundInRequest == 0)
 			{
-				const FRotator SpawnRotation = VR_MuzzleLocation->GetComponentRotation();
-				const FVector SpawnLocation = VR_MuzzleLocation->GetComponentLocation();
-				World->SpawnActor<AMechSurvivalProjectile>(ProjectileClass, SpawnLocation, SpawnRotation);
+				Request.ShotId = NextShotId;
 			}
-			else
+			Request.Rounds = (uint8)(RoundInRequest + 1);
+			if (Request.Rounds == FMechSurvivalFireRequest::MaxRounds || Round == Rounds - 1)
 			{
-				const FRotator SpawnRotation = GetControlRotation();
-				// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
-				const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
-
-				//Set Spawn Collision Handling Override
-				FActorSpawnParameters ActorSpawnParams;
-				ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
-
-				// spawn the projectile at the muzzle
-				World->SpawnActor<AMechSurvivalProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+				ServerFire(Request);
 			}
 		}
+
+		// show the rounds right away; the server simulates the real ones and we reconcile when they come back
+		if (UMechSurvivalBallistics* Ballistics = UMechSurvivalBallistics::Get(this))
+		{
+			Ballistics->FireBatch(Weapon, WeaponProjectileClass, SpawnLocation, Rotations, true, ShotIds, BackdateSeconds);
+		}
+	}
+
+	if (VRInput != nullptr)
+	{
+		VRInput->RecordShot(FPlatformTime::Seconds() - TriggerSeconds, BackdateSeconds, bFreshPose, CorrectionDegrees);
+	}
+
+	PlayFireEffects();
+	return Rotations.Num();
+}
+
+bool AMechSurvivalCharacter::GetFreshVRMuzzleTransform(FTransform& OutMuzzle) const
+{
+	FTransform ControllerToWorld;
+	if (!UMechSurvivalVRInput::PollControllerTransform(R_MotionController, ControllerToWorld))
+	{
+		return false;
 	}
 
+	// the gun and muzzle keep their offsets from the controller
+	const FTransform MuzzleToController = VR_MuzzleLocation->GetComponentTransform().GetRelativeTransform(R_MotionController->GetComponentTransform());
+	OutMuzzle = MuzzleToController * ControllerToWorld;
+	return true;
+}
+
+void AMechSurvivalCharacter::PlayFireEffects()
+{
+	MECHSURVIVAL_LLM_SCOPE(FireEffects);
+
+	// Fire effects are the first thing to go when they run over their memory budget
+	if (UMechSurvivalMemoryBudget::IsShedding(this, EMechSurvivalMemoryTag::FireEffects))
+	{
+		return;
+	}
+
+	// Shooters nobody is close to or looking at are not worth a sound or a montage
+	UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(this);
+
 	// try and play the sound if specified
-	if (FireSound != NULL)
+	USoundBase* Sound = FireSound.Get();
+	if (Sound != nullptr && (Significance == nullptr || Significance->TryPlayFireSound(this, Sound)))
 	{
-		UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
+		UGameplayStatics::PlaySoundAtLocation(this, Sound, GetActorLocation());
 	}
 
 	// try and play a firing animation if specified
-	if (FireAnimation != NULL)
+	UAnimMontage* Montage = FireAnimation.Get();
+	if (Montage != nullptr && (Significance == nullptr || Significance->ShouldPlayFireEffects(this)))
 	{
 		// Get the animation object for the arms mesh
 		UAnimInstance* AnimInstance = Mesh1P->GetAnimInstance();
 		if (AnimInstance != NULL)
 		{
-			AnimInstance->Montage_Play(FireAnimation, 1.f);
+			AnimInstance->Montage_Play(Montage, 1.f);
 		}
 	}
 }
 
+bool AMechSurvivalCharacter::ServerFire_Validate(const FMechSurvivalFireRequest& Request)
+{
+	return !Request.Location.ContainsNaN() && !Request.Rotation.ContainsNaN() && FMath::IsFinite(Request.Timestamp)
+		&& Request.ShotId != 0 && Request.Rounds > 0 && Request.Rounds <= FMechSurvivalFireRequest::MaxRounds;
+}
+
+void AMechSurvivalCharacter::ServerFire_Implementation(const FMechSurvivalFireRequest& Request)
+{
+	MECHSURVIVAL_INC_COUNTER(FireRequests, 1);
+
+	// the server's weapon decides what is fired, whatever the client has equipped
+	const UMechSurvivalWeaponData* Weapon = WeaponComponent->GetWeapon();
+	UClass* WeaponProjectileClass = GetWeaponProjectileClass(Weapon);
+	if (WeaponProjectileClass == NULL)
+	{
+		return;
+	}
+
+	// the client picks the muzzle, but it has to be near the pawn as the server sees it
+	if (FVector::DistSquared(Request.Location, GetActorLocation()) > FMath::Square(MaxFireRequestDistance))
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: ignoring shot from %s, too far from the pawn"), *GetName(), *Request.Location.ToString());
+		return;
+	}
+
+	// the timestamp decides how far back the shot is rewound, so it cannot claim to come from the future
+	if (Request.Timestamp > GetWorld()->GetTimeSeconds() + MaxFireRequestTimeAhead)
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: ignoring shot %d stamped %.3fs ahead of the server"), *GetName(), Request.ShotId, Request.Timestamp - GetWorld()->GetTimeSeconds());
+		return;
+	}
+
+	// and it cannot fire faster than the weapon does; rounds past the allowance are dropped
+	int32 Rounds = 0;
+	while (Rounds < Request.Rounds && WeaponComponent->ConsumeServerRound())
+	{
+		++Rounds;
+	}
+	if (Rounds < Request.Rounds)
+	{
+		UE_LOG(LogFPChar, Verbose, TEXT("%s: ignoring %d of %d rounds from shot %d, faster than %s fires"), *GetName(), Request.Rounds - Rounds, Request.Rounds, Request.ShotId, *GetNameSafe(Weapon));
+	}
+	if (Rounds == 0)
+	{
+		return;
+	}
+
+	TArray<FRotator, TInlineAllocator<16>> Rotations;
+	uint16 Seed = Request.ShotId;
+	for (int32 Round = 0; Round < Rounds; ++Round)
+	{
+		Weapon->Stats.AddPelletRotations(Request.Rotation, Seed, Rotations);
+		Seed = FMechSurvivalFireRequest::NextShotId(Seed);
+	}
+
+	// the shot has been flying on the client for as long as the request took to get here
+	UMechSurvivalLagCompensation* LagCompensation = UMechSurvivalLagCompensation::Get(this);
+	const float RewindSeconds = LagCompensation ? LagCompensation->GetRewindSeconds(Request.Timestamp) : 0.f;
+
+	// other clients scatter the same pellets from the seeds and catch them up as far
+	if (AMechSurvivalShotReplicator* ShotReplicator = AMechSurvivalShotReplicator::Get(this))
+	{
+		ShotReplicator->RecordShot(this, WeaponProjectileClass, Weapon, Request.Location, Request.Rotation, Request.ShotId, Rounds, true, RewindSeconds);
+	}
+
+	if (RewindSeconds <= 0.f)
+	{
+		LaunchProjectiles(Weapon, WeaponProjectileClass, Request.Location, Rotations, ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding);
+		return;
+	}
+
+	const FMechSurvivalBallisticParams Params = FMechSurvivalBallisticParams::FromWeapon(Weapon, WeaponProjectileClass);
+	const float GravityZ = GetWorld()->GetGravityZ();
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ServerFireCatchUp), false, this);
+
+	// pellets that catch up with the client's rounds, and pellets a wall stopped on the way
+	TArray<FRotator, TInlineAllocator<16>> CatchingUp;
+	TArray<FRotator, TInlineAllocator<16>> Blocked;
+
+	for (int32 Pellet = 0; Pellet < Rotations.Num(); ++Pellet)
+	{
+		// where the client's round has got to by now, falling as it flies
+		FVector CatchUpEnd;
+		FVector CatchUpVelocity;
+		Params.GetFlightAfter(Request.Location, Rotations[Pellet], RewindSeconds, GravityZ, CatchUpEnd, CatchUpVelocity);
+
+		// walls do not move, so the present world stops the catch-up
+		FHitResult BlockingHit;
+		const bool bBlocked = GetWorld()->SweepSingleByObjectType(BlockingHit, Request.Location, CatchUpEnd, FQuat::Identity, FCollisionObjectQueryParams(ECC_WorldStatic), FCollisionShape::MakeSphere(Params.Radius), QueryParams);
+		if (bBlocked)
+		{
+			CatchUpEnd = BlockingHit.Location;
+		}
+
+		// whatever moves is tested as the client saw it when firing
+		FMechSurvivalRewindHit RewindHit;
+		if (LagCompensation->RewindSweep(Request.Timestamp, Request.Location, CatchUpEnd, Params.Radius, this, RewindHit))
+		{
+			ApplyRewoundHit(RewindHit, CatchUpVelocity, Params.Damage);
+			continue;
+		}
+
+		// a blocked pellet starts at the muzzle and hits the wall for real
+		if (bBlocked)
+		{
+			Blocked.Add(Rotations[Pellet]);
+		}
+		else
+		{
+			CatchingUp.Add(Rotations[Pellet]);
+		}
+	}
+
+	LaunchProjectiles(Weapon, WeaponProjectileClass, Request.Location, CatchingUp, ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding, RewindSeconds);
+	LaunchProjectiles(Weapon, WeaponProjectileClass, Request.Location, Blocked, ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding);
+}
+
+void AMechSurvivalCharacter::LaunchProjectiles(const UMechSurvivalWeaponData* Weapon, UClass* WeaponProjectileClass, const FVector& SpawnLocation, TArrayView<const FRotator> Rotations, ESpawnActorCollisionHandlingMethod CollisionHandling, float CatchUpSeconds)
+{
+	if (Rotations.Num() == 0)
+	{
+		return;
+	}
+
+	UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Shot, SpawnLocation, (float)Rotations.Num());
+
+	if (FireMode == EMechSurvivalFireMode::Simulated)
+	{
+		// the simulation sweeps from the muzzle, so there is no spawn collision to resolve
+		if (UMechSurvivalBallistics* Ballistics = UMechSurvivalBallistics::Get(this))
+		{
+			Ballistics->FireBatch(Weapon, WeaponProjectileClass, SpawnLocation, Rotations, false, TArrayView<const uint16>(), CatchUpSeconds, this);
+		}
+	}
+	else if (UMechSurvivalProjectilePool* ProjectilePool = UMechSurvivalProjectilePool::Get(this))
+	{
+		ProjectilePool->AcquireBatch(Weapon, WeaponProjectileClass, SpawnLocation, Rotations, CollisionHandling, CatchUpSeconds, this);
+	}
+}
+
+void AMechSurvivalCharacter::ClientConfirmHits_Implementation(const TArray<FMechSurvivalConfirmedHit>& Hits)
+{
+	// The pawn may have changed hands since the hits were sent
+	const APlayerController* PlayerController = IsLocallyControlled() ? Cast<APlayerController>(GetController()) : nullptr;
+	AMechSurvivalHUD* HUD = PlayerController ? Cast<AMechSurvivalHUD>(PlayerController->GetHUD()) : nullptr;
+	if (HUD == nullptr)
+	{
+		return;
+	}
+
+	for (const FMechSurvivalConfirmedHit& Hit : Hits)
+	{
+		HUD->AddDamageNumber(Hit.Location, Hit.Damage);
+	}
+}
+
+void AMechSurvivalCharacter::ApplyRewoundHit(const FMechSurvivalRewindHit& RewindHit, const FVector& Velocity, float Damage)
+{
+	UPrimitiveComponent* Component = RewindHit.Component;
+	if (!IsValid(Component))
+	{
+		return;
+	}
+
+	// same rules as the projectile itself: physics bodies get pushed, pawns get hurt
+	if (Component->IsSimulatingPhysics())
+	{
+		UMechSurvivalImpulseBatcher::AddImpulseAtLocation(Component, Velocity * 100.0f, RewindHit.Location);
+		MECHSURVIVAL_INC_COUNTER(Impulses, 1);
+		UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Impulse, RewindHit.Location, Velocity.Size() * 100.0f);
+	}
+	else if (APawn* HitPawn = Cast<APawn>(Component->GetOwner()))
+	{
+		UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, RewindHit.Location, Damage);
+		const FVector Direction = Velocity.GetSafeNormal();
+		const FHitResult Hit(HitPawn, Component, RewindHit.Location, -Direction);
+		UGameplayStatics::ApplyPointDamage(HitPawn, Damage, Direction, Hit, GetController(), this, UDamageType::StaticClass());
+	}
+}
+
 void AMechSurvivalCharacter::OnResetVR()
 {
 	UHeadMountedDisplayFunctionLibrary::ResetOrientationAndPosition();
@@ -199,7 +717,8 @@ void AMechSurvivalCharacter::BeginTouch(const ETouchIndex::Type FingerIndex, con
 	}
 	if ((FingerIndex == TouchItem.FingerIndex) && (TouchItem.bMoved == false))
 	{
-		OnFire();
+		InputAction<EMechSurvivalInputAction::FirePressed>();
+		InputAction<EMechSurvivalInputAction::FireReleased>();
 	}
 	TouchItem.bIsPressed = true;
 	TouchItem.FingerIndex = FingerIndex;
@@ -256,8 +775,12 @@ void AMechSurvivalCharacter::EndTouch(const ETouchIndex::Type FingerIndex, const
 
 void AMechSurvivalCharacter::MoveForward(float Value)
 {
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(MovementInput);
+
 	if (Value != 0.0f)
 	{
+		MECHSURVIVAL_INC_COUNTER(InputEvents, 1);
+
 		// add movement in that direction
 		AddMovementInput(GetActorForwardVector(), Value);
 	}
@@ -265,8 +788,12 @@ void AMechSurvivalCharacter::MoveForward(float Value)
 
 void AMechSurvivalCharacter::MoveRight(float Value)
 {
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(MovementInput);
+
 	if (Value != 0.0f)
 	{
+		MECHSURVIVAL_INC_COUNTER(InputEvents, 1);
+
 		// add movement in that direction
 		AddMovementInput(GetActorRightVector(), Value);
 	}
@@ -274,12 +801,16 @@ void AMechSurvivalCharacter::MoveRight(float Value)
 
 void AMechSurvivalCharacter::TurnAtRate(float Rate)
 {
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(MovementInput);
+
 	// calculate delta for this frame from the rate information
 	AddControllerYawInput(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds());
 }
 
 void AMechSurvivalCharacter::LookUpAtRate(float Rate)
 {
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(MovementInput);
+
 	// calculate delta for this frame from the rate information
 	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
 }
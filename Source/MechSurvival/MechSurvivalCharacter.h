@@ -4,9 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "MechSurvivalBallistics.h"
+#include "MechSurvivalShotReplicator.h"
 #include "MechSurvivalCharacter.generated.h"
 
 class UInputComponent;
+enum class EMechSurvivalInputAxis : uint8;
+enum class EMechSurvivalInputAction : uint8;
 
 UCLASS(config=Game)
 class AMechSurvivalCharacter : public ACharacter
@@ -45,11 +49,45 @@ class AMechSurvivalCharacter : public ACharacter
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
 	class UMotionControllerComponent* L_MotionController;
 
+	/** Trigger of the weapon; decides when rounds go and how many */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Weapon, meta = (AllowPrivateAccess = "true"))
+	class UMechSurvivalWeaponComponent* WeaponComponent;
+
 public:
-	AMechSurvivalCharacter();
+	AMechSurvivalCharacter(const FObjectInitializer& ObjectInitializer);
+
+	/** Presses and releases the trigger once; lets bots and automated runs shoot */
+	void PullTrigger();
+
+	/**
+	 * Fires rounds of a weapon from the muzzle, all pellets of all rounds in one batch.
+	 * With authority the rounds are launched; otherwise they are shown right away and the server is asked to fire them.
+	 * @returns the number of pellets fired.
+	 */
+	int32 FireWeapon(const class UMechSurvivalWeaponData* Weapon, int32 Rounds);
+
+	/** Adds the assets the character refers to softly, for the startup preload */
+	void GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const;
+
+	/** Returns the projectile class, or null while it is still loading */
+	FORCEINLINE UClass* GetProjectileClass() const { return ProjectileClass.Get(); }
+
+	/** Does what an axis binding does, with the value given */
+	void ApplyInputAxis(EMechSurvivalInputAxis Axis, float Value);
+
+	/** Does what an action binding does */
+	void ApplyInputAction(EMechSurvivalInputAction Action);
+
+	/**
+	 * Shows the hits the server confirmed for this pawn's shots on its player's HUD.
+	 * Sent by the shot replicator once a frame, to the owning client only.
+	 */
+	UFUNCTION(Client, Unreliable)
+	void ClientConfirmHits(const TArray<FMechSurvivalConfirmedHit>& Hits);
 
 protected:
 	virtual void BeginPlay();
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
@@ -60,21 +98,29 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
 	float BaseLookUpRate;
 
-	/** Gun muzzle's offset from the characters location */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
-	FVector GunOffset;
+	/** Projectile class to spawn for weapons that do not name their own; loaded in the background, nothing is fired until it is in memory */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	TSoftClassPtr<class AMechSurvivalProjectile> ProjectileClass;
+
+	/** Whether shots launch projectile actors or rounds in the ballistic simulation */
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	EMechSurvivalFireMode FireMode;
 
-	/** Projectile class to spawn */
+	/** Furthest a client's muzzle may be from the pawn, as the server sees it, for its shot to be accepted */
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
-	TSubclassOf<class AMechSurvivalProjectile> ProjectileClass;
+	float MaxFireRequestDistance;
+
+	/** Furthest ahead of the server's clock a client's shot may be stamped, allowing for its estimate of that clock, to be accepted */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	float MaxFireRequestTimeAhead;
 
 	/** Sound to play each time we fire */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
-	class USoundBase* FireSound;
+	UPROPERTY(EditAnywhere, Category=Gameplay)
+	TSoftObjectPtr<class USoundBase> FireSound;
 
 	/** AnimMontage to play each time we fire */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
-	class UAnimMontage* FireAnimation;
+	UPROPERTY(EditAnywhere, Category = Gameplay)
+	TSoftObjectPtr<class UAnimMontage> FireAnimation;
 
 	/** Whether to use motion controller location for aiming. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
@@ -82,9 +128,41 @@ public:
 
 protected:
 	
-	/** Fires a projectile. */
+	/** Presses the trigger. */
 	void OnFire();
 
+	/** Releases the trigger. */
+	void OnStopFire();
+
+	/** Holds or lets go of the boost. */
+	void SetBoost(bool bBoost);
+
+	/** Plays the fire sound and animation */
+	void PlayFireEffects();
+
+	/** Projectile the weapon fires, or null while it is still loading */
+	UClass* GetWeaponProjectileClass(const class UMechSurvivalWeaponData* Weapon) const;
+
+	/**
+	 * Client asks the server to fire the rounds of its weapon due this frame from its muzzle, in one request.
+	 * The server scatters the pellets the same way the client did, seeded by the shot ids, checks the part of their
+	 * flight the client already showed against targets rewound to the client's fire time, then launches them that
+	 * far along so that they catch up with the client's rounds.
+	 */
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerFire(const FMechSurvivalFireRequest& Request);
+
+	/**
+	 * Launches pellets from the muzzle in one batch according to FireMode; authority only.
+	 * Clients learn of them from the shot the caller records with the shot replicator.
+	 * @param Rotations			Launch direction of each pellet
+	 * @param CatchUpSeconds	How long each pellet has been in flight on a client already; it starts that far along its path
+	 */
+	void LaunchProjectiles(const class UMechSurvivalWeaponData* Weapon, UClass* ProjectileClass, const FVector& SpawnLocation, TArrayView<const FRotator> Rotations, ESpawnActorCollisionHandlingMethod CollisionHandling, float CatchUpSeconds = 0.f);
+
+	/** Applies a hit found against rewound targets, as the projectile would have on reaching it */
+	void ApplyRewoundHit(const struct FMechSurvivalRewindHit& RewindHit, const FVector& Velocity, float Damage);
+
 	/** Resets HMD orientation and position in VR. */
 	void OnResetVR();
 
@@ -118,6 +196,29 @@ protected:
 	void EndTouch(const ETouchIndex::Type FingerIndex, const FVector Location);
 	void TouchUpdate(const ETouchIndex::Type FingerIndex, const FVector Location);
 	TouchData	TouchItem;
+
+	/** Every axis binding; lets a deterministic run record or replace the value before it is applied */
+	template<EMechSurvivalInputAxis Axis>
+	void InputAxis(float Value);
+
+	/** Every action binding; lets a deterministic run record it, or drop it while replaying */
+	template<EMechSurvivalInputAction Action>
+	void InputAction();
+
+	/** Id given to the next predicted shot; wraps around, skipping zero */
+	uint16 NextShotId;
+
+	/** Platform time the trigger went down at, for the first motion controller round it fires; negative once fired */
+	double PendingTriggerSeconds;
+
+	/** Muzzle of the VR gun where the controller is now, rather than where the component last moved it */
+	bool GetFreshVRMuzzleTransform(FTransform& OutMuzzle) const;
+
+	/** Called once the projectile class, sound and animation are loaded */
+	void OnAssetsLoaded();
+
+	/** Keeps our soft references loaded when the startup preload did not have them yet */
+	TSharedPtr<struct FStreamableHandle> AssetsHandle;
 	
 protected:
 	// APawn interface
@@ -137,6 +238,8 @@ public:
 	FORCEINLINE class USkeletalMeshComponent* GetMesh1P() const { return Mesh1P; }
 	/** Returns FirstPersonCameraComponent subobject **/
 	FORCEINLINE class UCameraComponent* GetFirstPersonCameraComponent() const { return FirstPersonCameraComponent; }
+	/** Returns WeaponComponent subobject **/
+	FORCEINLINE class UMechSurvivalWeaponComponent* GetWeaponComponent() const { return WeaponComponent; }
 
 };
 
@@ -0,0 +1,429 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalDeterminism.h"
+#include "MechSurvivalCharacter.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Crc.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechDeterminism, Log, All);
+
+namespace MechSurvivalDeterminism
+{
+	/** "MSIR" */
+	static const uint32 Magic = 0x5249534D;
+	static const uint32 Version = 2;
+
+	/** Set in the action count byte of frames that carry a checksum */
+	static const uint8 ChecksumFlag = 0x80;
+}
+
+static FAutoConsoleCommandWithWorld GDumpDeterminismCmd(
+	TEXT("MechSurvival.Determinism.Dump"),
+	TEXT("Logs the deterministic mode, the ticks simulated and the ticks per second"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalDeterminism* Determinism = UMechSurvivalDeterminism::Get(World))
+		{
+			Determinism->DumpStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GSaveInputCmd(
+	TEXT("MechSurvival.Determinism.SaveRecording"),
+	TEXT("Writes the input recorded so far to disk, without waiting for the game to exit"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalDeterminism* Determinism = UMechSurvivalDeterminism::Get(World))
+		{
+			Determinism->SaveRecording();
+		}
+	}));
+
+void UMechSurvivalDeterminism::FFrame::Serialize(FArchive& Ar)
+{
+	uint8 Flags = (uint8)Actions.Num() | (bHasChecksum ? MechSurvivalDeterminism::ChecksumFlag : 0);
+	Ar << AxisMask;
+	Ar << Flags;
+
+	if (Ar.IsLoading())
+	{
+		bHasChecksum = (Flags & MechSurvivalDeterminism::ChecksumFlag) != 0;
+		Actions.SetNumUninitialized(Flags & ~MechSurvivalDeterminism::ChecksumFlag);
+	}
+	for (EMechSurvivalInputAction& Action : Actions)
+	{
+		Ar << Action;
+	}
+	if (bHasChecksum)
+	{
+		Ar << Checksum;
+	}
+
+	for (int32 Axis = 0; Axis < (int32)EMechSurvivalInputAxis::Num; ++Axis)
+	{
+		if (AxisMask & (1 << Axis))
+		{
+			Ar << Axes[Axis];
+		}
+		else if (Ar.IsLoading())
+		{
+			Axes[Axis] = 0.f;
+		}
+	}
+}
+
+bool UMechSurvivalDeterminism::IsDeterministicRun()
+{
+	const TCHAR* CommandLine = FCommandLine::Get();
+	FString Name;
+	return FParse::Param(CommandLine, TEXT("MechDeterministic")) || FParse::Value(CommandLine, TEXT("MechRecordInput="), Name) || FParse::Value(CommandLine, TEXT("MechReplayInput="), Name);
+}
+
+bool UMechSurvivalDeterminism::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return IsDeterministicRun();
+}
+
+void UMechSurvivalDeterminism::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	SimulationHz = FMath::Max(SimulationHz, 1.f);
+	PhysicsSubsteps = FMath::Max(PhysicsSubsteps, 1);
+	ChecksumInterval = FMath::Max(ChecksumInterval, 1);
+
+	if (FParse::Value(FCommandLine::Get(), TEXT("MechReplayInput="), StreamName))
+	{
+		Mode = LoadReplay() ? EMode::Replay : EMode::FixedStep;
+	}
+	else if (FParse::Value(FCommandLine::Get(), TEXT("MechRecordInput="), StreamName))
+	{
+		Mode = EMode::Record;
+	}
+	else
+	{
+		Mode = EMode::FixedStep;
+	}
+
+	// Game time no longer follows the wall clock; the engine does not wait between frames either
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(1.0 / SimulationHz);
+
+	UPhysicsSettings* PhysicsSettings = UPhysicsSettings::Get();
+	PhysicsSettings->bSubstepping = PhysicsSubsteps > 1;
+	PhysicsSettings->MaxSubstepDeltaTime = 1.f / (SimulationHz * PhysicsSubsteps);
+	PhysicsSettings->MaxSubsteps = PhysicsSubsteps;
+
+	FMath::RandInit(RandomSeed);
+	FMath::SRandInit(RandomSeed);
+
+	UE_LOG(LogMechDeterminism, Log, TEXT("Deterministic simulation at %.0f Hz, %d physics substeps, seed %d%s%s"),
+		SimulationHz, PhysicsSubsteps, RandomSeed,
+		Mode == EMode::Record ? TEXT(", recording input to ") : (Mode == EMode::Replay ? TEXT(", replaying input from ") : TEXT("")),
+		Mode == EMode::Record || Mode == EMode::Replay ? *GetReplayPath(StreamName) : TEXT(""));
+}
+
+void UMechSurvivalDeterminism::Deinitialize()
+{
+	if (Mode == EMode::Record)
+	{
+		SaveRecording();
+	}
+
+	ReplayReader.Reset();
+	Stream.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalDeterminism* UMechSurvivalDeterminism::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	const UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+	return GameInstance ? GameInstance->GetSubsystem<UMechSurvivalDeterminism>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalDeterminism::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalDeterminism::IsTickable() const
+{
+	return Mode != EMode::Off;
+}
+
+TStatId UMechSurvivalDeterminism::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalDeterminism, STATGROUP_Tickables);
+}
+
+void UMechSurvivalDeterminism::Tick(float DeltaTime)
+{
+	++Ticks;
+
+	if (Mode == EMode::Replay && bReplayFinished)
+	{
+		FinishReplay();
+		return;
+	}
+
+	// A player recording should see the game at its real speed, however fast the machine renders it
+	if (Mode == EMode::Record)
+	{
+		const double Now = FPlatformTime::Seconds();
+		if (PacingStartSeconds == 0.0)
+		{
+			PacingStartSeconds = Now;
+		}
+		SimulatedSeconds += FApp::GetFixedDeltaTime();
+
+		const double Ahead = PacingStartSeconds + SimulatedSeconds - Now;
+		if (Ahead > 0.0)
+		{
+			FPlatformProcess::Sleep((float)Ahead);
+		}
+		else if (Ahead < -1.0)
+		{
+			// Too far behind to catch up; run slow from here rather than fast-forwarding
+			PacingStartSeconds = Now - SimulatedSeconds;
+		}
+	}
+}
+
+bool UMechSurvivalDeterminism::IsRecordedCharacter(const AMechSurvivalCharacter* Character) const
+{
+	const UWorld* World = Character->GetWorld();
+	return World != nullptr && Character->GetController() != nullptr && Character->GetController() == World->GetFirstPlayerController();
+}
+
+uint32 UMechSurvivalDeterminism::ComputeChecksum(const AMechSurvivalCharacter* Character)
+{
+	const FVector Location = Character->GetActorLocation();
+	const FRotator Aim = Character->GetControlRotation();
+	const uint32 Crc = FCrc::MemCrc32(&Location, sizeof(Location));
+	return FCrc::MemCrc32(&Aim, sizeof(Aim), Crc);
+}
+
+void UMechSurvivalDeterminism::SyncFrame(AMechSurvivalCharacter* Character)
+{
+	if (CurrentEngineFrame == GFrameCounter)
+	{
+		return;
+	}
+	CurrentEngineFrame = GFrameCounter;
+
+	const double Now = FPlatformTime::Seconds();
+	if (StartSeconds == 0.0)
+	{
+		StartSeconds = Now;
+	}
+	if (Mode == EMode::Record && NumFrames == 0)
+	{
+		MapName = UWorld::RemovePIEPrefix(Character->GetWorld()->GetMapName());
+	}
+	LastSeconds = Now;
+
+	if (Mode == EMode::Record)
+	{
+		// The previous tick's input is complete
+		if (NumFrames > 0)
+		{
+			FMemoryWriter Writer(Stream, false, true);
+			CurrentFrame.Serialize(Writer);
+		}
+
+		CurrentFrame.AxisMask = 0;
+		CurrentFrame.Actions.Reset();
+		CurrentFrame.bHasChecksum = NumFrames % ChecksumInterval == 0;
+		CurrentFrame.Checksum = CurrentFrame.bHasChecksum ? ComputeChecksum(Character) : 0;
+		++NumFrames;
+	}
+	else if (Mode == EMode::Replay)
+	{
+		if (bReplayFinished || NumFrames >= ReplayFrames)
+		{
+			bReplayFinished = true;
+			CurrentFrame.AxisMask = 0;
+			CurrentFrame.Actions.Reset();
+			return;
+		}
+
+		CurrentFrame.Serialize(*ReplayReader);
+		if (ReplayReader->IsError())
+		{
+			UE_LOG(LogMechDeterminism, Error, TEXT("Replay %s is truncated at tick %d"), *StreamName, NumFrames);
+			bReplayFinished = true;
+			return;
+		}
+
+		if (CurrentFrame.bHasChecksum)
+		{
+			++NumChecksums;
+			if (FirstDesyncFrame == INDEX_NONE && CurrentFrame.Checksum != ComputeChecksum(Character))
+			{
+				FirstDesyncFrame = NumFrames;
+				UE_LOG(LogMechDeterminism, Warning, TEXT("Replay diverged from the recording by tick %d"), NumFrames);
+			}
+		}
+		++NumFrames;
+
+		// Actions fire before the axes within a tick, as they did when recorded
+		for (EMechSurvivalInputAction Action : CurrentFrame.Actions)
+		{
+			Character->ApplyInputAction(Action);
+		}
+	}
+}
+
+void UMechSurvivalDeterminism::FilterAxis(AMechSurvivalCharacter* Character, EMechSurvivalInputAxis Axis, float& Value)
+{
+	if ((Mode != EMode::Record && Mode != EMode::Replay) || !IsRecordedCharacter(Character))
+	{
+		return;
+	}
+
+	SyncFrame(Character);
+
+	const uint8 Bit = 1 << (uint8)Axis;
+	if (Mode == EMode::Record)
+	{
+		if (Value != 0.f)
+		{
+			CurrentFrame.AxisMask |= Bit;
+			CurrentFrame.Axes[(int32)Axis] = Value;
+		}
+	}
+	else
+	{
+		Value = (CurrentFrame.AxisMask & Bit) ? CurrentFrame.Axes[(int32)Axis] : 0.f;
+	}
+}
+
+bool UMechSurvivalDeterminism::FilterAction(AMechSurvivalCharacter* Character, EMechSurvivalInputAction Action)
+{
+	if ((Mode != EMode::Record && Mode != EMode::Replay) || !IsRecordedCharacter(Character))
+	{
+		return true;
+	}
+
+	SyncFrame(Character);
+
+	if (Mode == EMode::Replay)
+	{
+		return false;
+	}
+
+	CurrentFrame.Actions.Add(Action);
+	return true;
+}
+
+FString UMechSurvivalDeterminism::GetReplayPath(const FString& Name)
+{
+	const FString FileName = FPaths::GetExtension(Name).IsEmpty() ? Name + TEXT(".msinput") : Name;
+	return FPaths::IsRelative(FileName) ? FPaths::ProjectSavedDir() / TEXT("Replays") / FileName : FileName;
+}
+
+bool UMechSurvivalDeterminism::SaveRecording() const
+{
+	if (Mode != EMode::Record)
+	{
+		return false;
+	}
+
+	// The frame still being filled in is left out; it may not have all its bindings yet
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	uint32 Magic = MechSurvivalDeterminism::Magic;
+	uint32 Version = MechSurvivalDeterminism::Version;
+	float Hz = SimulationHz;
+	int32 Seed = RandomSeed;
+	FString Map = MapName;
+	int32 NumCompleteFrames = FMath::Max(NumFrames - 1, 0);
+	Writer << Magic << Version << Hz << Seed << Map << NumCompleteFrames;
+	Bytes.Append(Stream);
+
+	const FString Path = GetReplayPath(StreamName);
+	if (!FFileHelper::SaveArrayToFile(Bytes, *Path))
+	{
+		UE_LOG(LogMechDeterminism, Error, TEXT("Could not write input recording %s"), *Path);
+		return false;
+	}
+
+	UE_LOG(LogMechDeterminism, Log, TEXT("Recorded %d ticks of input in %s, %d bytes"), NumCompleteFrames, *Path, Bytes.Num());
+	return true;
+}
+
+bool UMechSurvivalDeterminism::LoadReplay()
+{
+	const FString Path = GetReplayPath(StreamName);
+	if (!FFileHelper::LoadFileToArray(Stream, *Path))
+	{
+		UE_LOG(LogMechDeterminism, Error, TEXT("Could not read input recording %s; running with a fixed time step only"), *Path);
+		return false;
+	}
+
+	ReplayReader = MakeUnique<FMemoryReader>(Stream);
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	float Hz = 0.f;
+	int32 Seed = 0;
+	*ReplayReader << Magic << Version;
+	if (Magic != MechSurvivalDeterminism::Magic || Version != MechSurvivalDeterminism::Version)
+	{
+		UE_LOG(LogMechDeterminism, Error, TEXT("%s is not an input recording of this version; running with a fixed time step only"), *Path);
+		ReplayReader.Reset();
+		return false;
+	}
+	*ReplayReader << Hz << Seed << MapName << ReplayFrames;
+
+	// Input only reproduces the run under the same simulation
+	SimulationHz = Hz;
+	RandomSeed = Seed;
+	UE_LOG(LogMechDeterminism, Log, TEXT("Replaying %d ticks recorded in %s"), ReplayFrames, *MapName);
+	return true;
+}
+
+void UMechSurvivalDeterminism::FinishReplay()
+{
+	Mode = EMode::FixedStep;
+	DumpStats();
+
+	const double Seconds = LastSeconds - StartSeconds;
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("Replay.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Replay,Map,Ticks,Seconds,TicksPerSecond,Checksums,FirstDesyncTick\n")), *ReportPath);
+	}
+	const FString Line = FString::Printf(TEXT("%s,%s,%s,%d,%.3f,%.1f,%d,%d\n"),
+		*FDateTime::Now().ToString(), *StreamName, *MapName, NumFrames, Seconds, Seconds > 0.0 ? NumFrames / Seconds : 0.0, NumChecksums, FirstDesyncFrame);
+	FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+	// A diverged replay is no use as a regression workload
+	FPlatformMisc::RequestExitWithStatus(false, FirstDesyncFrame == INDEX_NONE ? 0 : 1);
+}
+
+void UMechSurvivalDeterminism::DumpStats() const
+{
+	static const TCHAR* ModeNames[] = { TEXT("off"), TEXT("fixed step"), TEXT("recording"), TEXT("replaying") };
+	const double Seconds = LastSeconds - StartSeconds;
+	UE_LOG(LogMechDeterminism, Log, TEXT("%s at %.0f Hz: %d engine ticks, %d input ticks in %.2f s, %.1f ticks per second"),
+		ModeNames[(int32)Mode], SimulationHz, Ticks, NumFrames, Seconds, Seconds > 0.0 ? NumFrames / Seconds : 0.0);
+	if (NumChecksums > 0)
+	{
+		UE_LOG(LogMechDeterminism, Log, TEXT("%d checksums compared, %s"), NumChecksums,
+			FirstDesyncFrame == INDEX_NONE ? TEXT("all matched") : *FString::Printf(TEXT("first divergence by tick %d"), FirstDesyncFrame));
+	}
+}
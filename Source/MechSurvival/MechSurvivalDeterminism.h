@@ -0,0 +1,191 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalDeterminism.generated.h"
+
+class AMechSurvivalCharacter;
+
+/** Axis bindings of the character, in the order they are stored in a recording */
+enum class EMechSurvivalInputAxis : uint8
+{
+	MoveForward,
+	MoveRight,
+	Turn,
+	TurnRate,
+	LookUp,
+	LookUpRate,
+
+	Num
+};
+
+/** Action bindings of the character; touch pulls the trigger through FirePressed and FireReleased */
+enum class EMechSurvivalInputAction : uint8
+{
+	JumpPressed,
+	JumpReleased,
+	FirePressed,
+	FireReleased,
+	ResetVR,
+	BoostPressed,
+	BoostReleased,
+
+	Num
+};
+
+/**
+ * Deterministic simulation, and recording and replay of the first local player's input.
+ *
+ * Off unless the game is started with one of
+ *   -MechDeterministic					fixed time step only
+ *   -MechRecordInput=<name>			plays normally and records input to Saved/Replays/<name>.msinput on exit
+ *   -MechReplayInput=<name>			replays a recording as fast as possible, then exits, e.g. with -nullrhi -unattended
+ *
+ * Every engine tick then advances the game by exactly 1 / SimulationHz, however long the frame took to render, physics
+ * is sub-stepped PhysicsSubsteps times per tick, the global random streams are seeded with RandomSeed and the startup
+ * preload is waited for rather than arriving whenever the disk delivers it. Recording runs are held back to real
+ * time; replays are not held back at all, so a replay measures simulation throughput in ticks per second.
+ *
+ * A recording holds, per tick, the value of every axis binding that was not zero and every action binding in the
+ * order it fired, a couple of bytes for an idle tick. Every ChecksumInterval ticks it also holds a checksum of the
+ * pawn's location and aim, which the replay compares to report the first tick it diverged at.
+ */
+UCLASS(config=Game)
+class UMechSurvivalDeterminism : public UGameInstanceSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the determinism of the game the context object lives in, if this run has one */
+	static UMechSurvivalDeterminism* Get(const UObject* WorldContextObject);
+
+	/** True if this run was started in any of the deterministic modes */
+	static bool IsDeterministicRun();
+
+	bool IsReplaying() const { return Mode == EMode::Replay; }
+
+	/**
+	 * Called by the character for every axis binding, every tick.
+	 * Records the value, or replaces it with the recorded one during a replay.
+	 */
+	void FilterAxis(AMechSurvivalCharacter* Character, EMechSurvivalInputAxis Axis, float& Value);
+
+	/**
+	 * Called by the character for every action binding.
+	 * Records the action and returns true; during a replay returns false, the recorded actions being dispatched instead.
+	 */
+	bool FilterAction(AMechSurvivalCharacter* Character, EMechSurvivalInputAction Action);
+
+	/** Writes the recording so far to disk; returns false if not recording or the file could not be written */
+	bool SaveRecording() const;
+
+	/** Writes the mode, tick count and throughput to the log */
+	void DumpStats() const;
+
+protected:
+	/** Simulation ticks per second */
+	UPROPERTY(config)
+	float SimulationHz = 60.f;
+
+	/** Physics steps per simulation tick */
+	UPROPERTY(config)
+	int32 PhysicsSubsteps = 2;
+
+	/** Seed of the global random streams */
+	UPROPERTY(config)
+	int32 RandomSeed = 1;
+
+	/** Ticks between two checksums of the pawn in a recording */
+	UPROPERTY(config)
+	int32 ChecksumInterval = 60;
+
+private:
+	enum class EMode : uint8
+	{
+		Off,
+		FixedStep,
+		Record,
+		Replay
+	};
+
+	/** Input of one tick */
+	struct FFrame
+	{
+		/** Bit per axis that was not zero */
+		uint8 AxisMask = 0;
+		float Axes[(int32)EMechSurvivalInputAxis::Num];
+		/** Actions in the order they fired */
+		TArray<EMechSurvivalInputAction, TInlineAllocator<4>> Actions;
+		bool bHasChecksum = false;
+		uint32 Checksum = 0;
+
+		void Serialize(FArchive& Ar);
+	};
+
+	/** Whether a character's input is the one recorded or replayed */
+	bool IsRecordedCharacter(const AMechSurvivalCharacter* Character) const;
+
+	/** Starts the next tick's frame the first time any binding is called in an engine frame */
+	void SyncFrame(AMechSurvivalCharacter* Character);
+
+	/** Checksum of where the pawn is and where it aims */
+	static uint32 ComputeChecksum(const AMechSurvivalCharacter* Character);
+
+	bool LoadReplay();
+
+	/** Reports throughput and divergence, then exits */
+	void FinishReplay();
+
+	static FString GetReplayPath(const FString& Name);
+
+	EMode Mode = EMode::Off;
+
+	/** File name given on the command line */
+	FString StreamName;
+
+	/** Map the recording was made in */
+	FString MapName;
+
+	/** Engine frame the current input frame belongs to */
+	uint64 CurrentEngineFrame = MAX_uint64;
+
+	FFrame CurrentFrame;
+	int32 NumFrames = 0;
+
+	/** Frames recorded so far, or the frames of the replay */
+	TArray<uint8> Stream;
+
+	/** Read position in Stream during a replay */
+	TUniquePtr<class FMemoryReader> ReplayReader;
+	int32 ReplayFrames = 0;
+	bool bReplayFinished = false;
+
+	/** Tick a replay first diverged at; INDEX_NONE if it has not */
+	int32 FirstDesyncFrame = INDEX_NONE;
+	int32 NumChecksums = 0;
+
+	/** Wall time of the first input frame and of the last */
+	double StartSeconds = 0.0;
+	double LastSeconds = 0.0;
+
+	/** Simulated seconds since the first tick, for holding recordings back to real time */
+	double SimulatedSeconds = 0.0;
+	double PacingStartSeconds = 0.0;
+	int32 Ticks = 0;
+};
@@ -1,17 +1,74 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "MechSurvivalGameMode.h"
+#include "MechSurvival.h"
 #include "MechSurvivalHUD.h"
 #include "MechSurvivalCharacter.h"
-#include "UObject/ConstructorHelpers.h"
+#include "MechSurvivalShotReplicator.h"
+#include "MechSurvivalWaveDirector.h"
+#include "Engine/World.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechGameMode, Log, All);
 
 AMechSurvivalGameMode::AMechSurvivalGameMode()
 	: Super()
 {
-	// set default pawn class to our Blueprinted character
-	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnClassFinder(TEXT("/Game/FirstPersonCPP/Blueprints/FirstPersonCharacter"));
-	DefaultPawnClass = PlayerPawnClassFinder.Class;
+	// set default pawn class to our Blueprinted character once it is loaded, see InitGame
+	PlayerPawnClass = TSoftClassPtr<APawn>(FSoftObjectPath(TEXT("/Game/FirstPersonCPP/Blueprints/FirstPersonCharacter.FirstPersonCharacter_C")));
+	DefaultPawnClass = AMechSurvivalCharacter::StaticClass();
 
 	// use our custom HUD class
 	HUDClass = AMechSurvivalHUD::StaticClass();
+
+	WaveDirector = CreateDefaultSubobject<UMechSurvivalWaveDirector>(TEXT("WaveDirector"));
+}
+
+void AMechSurvivalGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	if (PlayerPawnClass.IsNull())
+	{
+		return;
+	}
+
+	// the startup preload normally has it in memory by now; a map opened straight from the command line may beat it
+	UClass* PawnClass = PlayerPawnClass.Get();
+	if (PawnClass == nullptr)
+	{
+		UE_LOG(LogMechGameMode, Log, TEXT("Loading pawn class %s"), *PlayerPawnClass.ToString());
+		PawnClass = PlayerPawnClass.LoadSynchronous();
+	}
+
+	if (PawnClass != nullptr)
+	{
+		DefaultPawnClass = PawnClass;
+	}
+	else
+	{
+		UE_LOG(LogMechGameMode, Warning, TEXT("Pawn class %s not found, using %s"), *PlayerPawnClass.ToString(), *GetNameSafe(DefaultPawnClass));
+	}
+}
+
+void AMechSurvivalGameMode::GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const
+{
+	OutAssets.Add(PlayerPawnClass.ToSoftObjectPath());
+}
+
+void AMechSurvivalGameMode::InitGameState()
+{
+	Super::InitGameState();
+
+	// the channel that carries shots to clients, since projectiles themselves are not replicated
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	GetWorld()->SpawnActor<AMechSurvivalShotReplicator>(SpawnParams);
+}
+
+APawn* AMechSurvivalGameMode::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+	// Players' characters count towards their own memory budget rather than the game mode's
+	MECHSURVIVAL_LLM_SCOPE(Characters);
+
+	return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
 }
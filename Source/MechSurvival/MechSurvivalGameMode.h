@@ -11,8 +11,28 @@ class AMechSurvivalGameMode : public AGameModeBase
 {
 	GENERATED_BODY()
 
+	/** Pawn players get; loaded by the startup preload, so that the game mode's defaults pull in no content */
+	UPROPERTY(config, EditDefaultsOnly, Category=Classes)
+	TSoftClassPtr<APawn> PlayerPawnClass;
+
+	/** Spawns the waves of the match */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Waves, meta=(AllowPrivateAccess="true"))
+	class UMechSurvivalWaveDirector* WaveDirector;
+
 public:
 	AMechSurvivalGameMode();
+
+	// AGameModeBase interface
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+	virtual void InitGameState() override;
+	virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
+	// End of AGameModeBase interface
+
+	/** Adds the assets the game mode refers to softly, for the startup preload */
+	void GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const;
+
+	/** Returns WaveDirector subobject **/
+	FORCEINLINE class UMechSurvivalWaveDirector* GetWaveDirector() const { return WaveDirector; }
 };
 
 
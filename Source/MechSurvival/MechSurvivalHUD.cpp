@@ -1,24 +1,124 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "MechSurvivalHUD.h"
+#include "MechSurvival.h"
+#include "MechSurvivalAssetPreloader.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalMech.h"
 #include "Engine/Canvas.h"
 #include "Engine/Texture2D.h"
-#include "TextureResource.h"
-#include "CanvasItem.h"
-#include "UObject/ConstructorHelpers.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechHUD, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpHUDCmd(
+	TEXT("MechSurvival.HUD.Dump"),
+	TEXT("Logs how many draws and quads the first player's HUD used last frame"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		const APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+		if (const AMechSurvivalHUD* HUD = PlayerController ? Cast<AMechSurvivalHUD>(PlayerController->GetHUD()) : nullptr)
+		{
+			HUD->DumpStats();
+		}
+	}));
 
 AMechSurvivalHUD::AMechSurvivalHUD()
 {
-	// Set the crosshair texture
-	static ConstructorHelpers::FObjectFinder<UTexture2D> CrosshairTexObj(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair"));
-	CrosshairTex = CrosshairTexObj.Object;
+	// Set the crosshair texture; it is loaded in the background, not along with the class
+	CrosshairTex = TSoftObjectPtr<UTexture2D>(FSoftObjectPath(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair.FirstPersonCrosshair")));
+}
+
+void AMechSurvivalHUD::BeginPlay()
+{
+	MECHSURVIVAL_LLM_SCOPE(HUD);
+
+	Super::BeginPlay();
+
+	if (CrosshairTex.IsPending() || MarkerTex.IsPending() || HitMarkerTex.IsPending() || DamageDigitsTex.IsPending())
+	{
+		if (UMechSurvivalAssetPreloader* Preloader = UMechSurvivalAssetPreloader::Get(this))
+		{
+			TArray<FSoftObjectPath> Assets;
+			GetPreloadAssets(Assets);
+			TexturesHandle = Preloader->RequestAsyncLoad(Assets, FStreamableDelegate(), TEXT("MechSurvivalHUD"));
+		}
+	}
+
+	// Sized once, so that neither a burst of hits nor a wave of mechs allocates while drawing
+	FDamageNumber Unused;
+	Unused.Location = FVector::ZeroVector;
+	Unused.Amount = 0;
+	Unused.StartTime = -1.f;
+	DamageNumbers.Init(Unused, FMath::Max(MaxDamageNumbers, 1));
+	IndicatorLayer.Reserve(FMath::Max(MaxMarkers, MaxDamageNumbers * 4));
+	StaticLayer.Reserve(1);
+}
+
+void AMechSurvivalHUD::GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const
+{
+	OutAssets.Add(CrosshairTex.ToSoftObjectPath());
+	OutAssets.Add(MarkerTex.ToSoftObjectPath());
+	OutAssets.Add(HitMarkerTex.ToSoftObjectPath());
+	OutAssets.Add(DamageDigitsTex.ToSoftObjectPath());
 }
 
+void AMechSurvivalHUD::AddDamageNumber(const FVector& Location, float Damage)
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+	LastHitTime = Now;
+
+	if (DamageNumbers.Num() == 0)
+	{
+		return;
+	}
+
+	FDamageNumber& Number = DamageNumbers[NextDamageNumber];
+	Number.Location = Location;
+	Number.Amount = FMath::RoundToInt(Damage);
+	Number.StartTime = Now;
+	NextDamageNumber = (NextDamageNumber + 1) % DamageNumbers.Num();
+}
 
 void AMechSurvivalHUD::DrawHUD()
 {
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(DrawHUD);
+	MECHSURVIVAL_LLM_SCOPE(HUD);
+
 	Super::DrawHUD();
 
+	// The crosshair only moves when the viewport does
+	const FIntPoint CanvasSize(Canvas->SizeX, Canvas->SizeY);
+	if (bStaticLayerDirty || CanvasSize != StaticLayerSize)
+	{
+		StaticLayerSize = CanvasSize;
+		bStaticLayerDirty = !BuildStaticLayer();
+		++StaticLayerBuilds;
+	}
+
+	BuildIndicatorLayer();
+
+	// Indicators under the crosshair
+	LastDraws = IndicatorLayer.Draw(Canvas) + StaticLayer.Draw(Canvas);
+	LastQuads = IndicatorLayer.GetNumQuads() + StaticLayer.GetNumQuads();
+
+	MECHSURVIVAL_INC_COUNTER(HUDDrawItems, LastQuads);
+	MECHSURVIVAL_INC_COUNTER(HUDDrawCalls, LastDraws);
+}
+
+bool AMechSurvivalHUD::BuildStaticLayer()
+{
+	StaticLayer.Reset();
+
+	UTexture2D* Crosshair = CrosshairTex.Get();
+	if (Crosshair == nullptr)
+	{
+		return false;
+	}
+
 	// Draw very simple crosshair
 
 	// find center of the Canvas
@@ -29,7 +129,156 @@ void AMechSurvivalHUD::DrawHUD()
 										   (Center.Y + 20.0f));
 
 	// draw the crosshair
-	FCanvasTileItem TileItem( CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
-	TileItem.BlendMode = SE_BLEND_Translucent;
-	Canvas->DrawItem( TileItem );
+	const FVector2D CrosshairSize(Crosshair->GetSurfaceWidth(), Crosshair->GetSurfaceHeight());
+	StaticLayer.AddQuad(Crosshair, CrosshairDrawPosition, CrosshairSize, FVector2D(0.f, 0.f), FVector2D(1.f, 1.f), FLinearColor::White);
+	return true;
+}
+
+void AMechSurvivalHUD::BuildIndicatorLayer()
+{
+	IndicatorLayer.Reset();
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	if (PlayerOwner == nullptr)
+	{
+		return;
+	}
+	PlayerOwner->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	AddEnemyMarkers(ViewLocation);
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	UTexture2D* HitMarker = HitMarkerTex.Get();
+	if (HitMarker != nullptr && LastHitTime >= 0.f && Now - LastHitTime < HitMarkerSeconds)
+	{
+		const float Alpha = 1.f - (Now - LastHitTime) / HitMarkerSeconds;
+		const FVector2D Size(HitMarkerSize, HitMarkerSize);
+		const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
+		IndicatorLayer.AddQuad(HitMarker, Center - Size * 0.5f, Size, FVector2D(0.f, 0.f), FVector2D(1.f, 1.f), FLinearColor(1.f, 0.2f, 0.2f, Alpha));
+	}
+
+	AddDamageNumbers(Now);
+}
+
+void AMechSurvivalHUD::AddEnemyMarkers(const FVector& ViewLocation)
+{
+	UTexture2D* Marker = MarkerTex.Get();
+	if (Marker == nullptr || MaxMarkers <= 0)
+	{
+		return;
+	}
+
+	const float MaxDistanceSquared = FMath::Square(MarkerDistance);
+	const FVector2D Size(MarkerSize, MarkerSize);
+	int32 NumMarkers = 0;
+
+	auto AddMarker = [this, Marker, &ViewLocation, MaxDistanceSquared, &Size, &NumMarkers](const FVector& Location)
+	{
+		const float DistanceSquared = FVector::DistSquared(Location, ViewLocation);
+		if (DistanceSquared > MaxDistanceSquared)
+		{
+			return;
+		}
+
+		// Behind the camera or off the edges
+		const FVector Screen = Canvas->Project(Location);
+		if (Screen.Z <= 0.f || Screen.X < 0.f || Screen.Y < 0.f || Screen.X > Canvas->ClipX || Screen.Y > Canvas->ClipY)
+		{
+			return;
+		}
+
+		const float Alpha = 1.f - 0.75f * FMath::Sqrt(DistanceSquared / MaxDistanceSquared);
+		IndicatorLayer.AddQuad(Marker, FVector2D(Screen.X, Screen.Y) - Size * 0.5f, Size, FVector2D(0.f, 0.f), FVector2D(1.f, 1.f), FLinearColor(1.f, 0.3f, 0.1f, Alpha));
+		++NumMarkers;
+	};
+
+	// The horde only runs with authority; clients see its promoted actors
+	const UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this);
+	if (Horde != nullptr && Horde->GetNumMechs() > 0)
+	{
+		for (const FVector& Location : Horde->GetMechPositions())
+		{
+			AddMarker(Location);
+			if (NumMarkers >= MaxMarkers)
+			{
+				return;
+			}
+		}
+	}
+	else
+	{
+		for (TActorIterator<AMechSurvivalMech> It(GetWorld()); It; ++It)
+		{
+			if (!It->IsHidden())
+			{
+				AddMarker(It->GetActorLocation());
+				if (NumMarkers >= MaxMarkers)
+				{
+					return;
+				}
+			}
+		}
+	}
+}
+
+void AMechSurvivalHUD::AddDamageNumbers(float Now)
+{
+	if (DamageDigitsTex.Get() == nullptr || DamageNumberSeconds <= 0.f)
+	{
+		return;
+	}
+
+	for (const FDamageNumber& Number : DamageNumbers)
+	{
+		const float Age = Now - Number.StartTime;
+		if (Number.StartTime < 0.f || Age >= DamageNumberSeconds)
+		{
+			continue;
+		}
+
+		const FVector Screen = Canvas->Project(Number.Location);
+		if (Screen.Z <= 0.f)
+		{
+			continue;
+		}
+
+		const float Life = Age / DamageNumberSeconds;
+		const FVector2D Center(Screen.X, Screen.Y - DamageNumberRise * Life);
+		AddNumber(Number.Amount, Center, FLinearColor(1.f, 0.9f, 0.2f, 1.f - Life * Life));
+	}
+}
+
+void AMechSurvivalHUD::AddNumber(int32 Number, const FVector2D& Center, const FLinearColor& Color)
+{
+	UTexture2D* Digits = DamageDigitsTex.Get();
+
+	// Digits from the last, so no string is built
+	int32 Remaining = FMath::Abs(Number);
+	int32 NumDigits = 1;
+	for (int32 Rest = Remaining / 10; Rest > 0; Rest /= 10)
+	{
+		++NumDigits;
+	}
+	FVector2D Position(Center.X + 0.5f * NumDigits * DamageDigitSize.X - DamageDigitSize.X, Center.Y - 0.5f * DamageDigitSize.Y);
+	for (int32 Index = 0; Index < NumDigits; ++Index)
+	{
+		const int32 Digit = Remaining % 10;
+		Remaining /= 10;
+		IndicatorLayer.AddQuad(Digits, Position, DamageDigitSize, FVector2D(Digit * 0.1f, 0.f), FVector2D((Digit + 1) * 0.1f, 1.f), Color);
+		Position.X -= DamageDigitSize.X;
+	}
+}
+
+void AMechSurvivalHUD::DumpStats() const
+{
+	int32 NumDamageNumbers = 0;
+	const float Now = GetWorld()->GetTimeSeconds();
+	for (const FDamageNumber& Number : DamageNumbers)
+	{
+		NumDamageNumbers += (Number.StartTime >= 0.f && Now - Number.StartTime < DamageNumberSeconds) ? 1 : 0;
+	}
+
+	UE_LOG(LogMechHUD, Log, TEXT("Last frame: %d draws, %d quads (%d static, %d indicators), %d damage numbers showing; static layer built %d times"),
+		LastDraws, LastQuads, StaticLayer.GetNumQuads(), IndicatorLayer.GetNumQuads(), NumDamageNumbers, StaticLayerBuilds);
 }
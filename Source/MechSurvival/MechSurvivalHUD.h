@@ -1,12 +1,19 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
-#pragma once 
+#pragma once
 
 #include "CoreMinimal.h"
 #include "GameFramework/HUD.h"
+#include "MechSurvivalHUDBatch.h"
 #include "MechSurvivalHUD.generated.h"
 
-UCLASS()
+/**
+ * Crosshair, enemy markers, hit marker and damage numbers, drawn as batched quads.
+ * The static layer (the crosshair) is only rebuilt when invalidated, e.g. by a viewport resize; the indicator layer
+ * is rebuilt every frame into buffers sized up front. Each layer costs one canvas draw per texture however many
+ * indicators it holds.
+ */
+UCLASS(config=Game)
 class AMechSurvivalHUD : public AHUD
 {
 	GENERATED_BODY()
@@ -17,9 +24,110 @@ public:
 	/** Primary draw call for the HUD */
 	virtual void DrawHUD() override;
 
+	/** Adds the assets the HUD refers to softly, for the startup preload */
+	void GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const;
+
+	/** Shows a damage number rising from a world location, and flashes the hit marker; fed the hits the server confirmed for our own pawn */
+	void AddDamageNumber(const FVector& Location, float Damage);
+
+	/** Rebuilds the static layer on the next draw */
+	void InvalidateStaticLayer() { bStaticLayerDirty = true; }
+
+	/** Writes what the last frame drew to the log */
+	void DumpStats() const;
+
+protected:
+	virtual void BeginPlay() override;
+
 private:
-	/** Crosshair asset pointer */
-	class UTexture2D* CrosshairTex;
+	/** Puts the crosshair into the static layer; returns false while its texture is still loading */
+	bool BuildStaticLayer();
 
-};
+	/** Puts markers, the hit marker and damage numbers into the indicator layer */
+	void BuildIndicatorLayer();
+
+	void AddEnemyMarkers(const FVector& ViewLocation);
+
+	void AddDamageNumbers(float Now);
+
+	/** Adds the digits of a number centred on Center */
+	void AddNumber(int32 Number, const FVector2D& Center, const FLinearColor& Color);
+
+	/** Crosshair asset; nothing is drawn until it is loaded */
+	UPROPERTY(config)
+	TSoftObjectPtr<class UTexture2D> CrosshairTex;
+
+	/** Drawn over every enemy within MarkerDistance */
+	UPROPERTY(config)
+	TSoftObjectPtr<class UTexture2D> MarkerTex;
+
+	/** Flashed over the crosshair when damage is dealt */
+	UPROPERTY(config)
+	TSoftObjectPtr<class UTexture2D> HitMarkerTex;
+
+	/** Digits 0 to 9 side by side in one row; damage numbers are not drawn without it */
+	UPROPERTY(config)
+	TSoftObjectPtr<class UTexture2D> DamageDigitsTex;
+
+	UPROPERTY(config)
+	float MarkerDistance = 5000.f;
+
+	/** Most enemy markers drawn at once */
+	UPROPERTY(config)
+	int32 MaxMarkers = 256;
 
+	/** Size of an enemy marker on screen, in pixels */
+	UPROPERTY(config)
+	float MarkerSize = 16.f;
+
+	UPROPERTY(config)
+	float HitMarkerSeconds = 0.25f;
+
+	UPROPERTY(config)
+	float HitMarkerSize = 32.f;
+
+	/** Most damage numbers shown at once; the oldest make way for new ones */
+	UPROPERTY(config)
+	int32 MaxDamageNumbers = 128;
+
+	UPROPERTY(config)
+	float DamageNumberSeconds = 1.f;
+
+	/** How far a damage number rises over its life, in pixels */
+	UPROPERTY(config)
+	float DamageNumberRise = 40.f;
+
+	/** Size of one digit on screen, in pixels */
+	UPROPERTY(config)
+	FVector2D DamageDigitSize = FVector2D(12.f, 16.f);
+
+	/** Keeps the HUD textures loaded when the startup preload did not have them yet */
+	TSharedPtr<struct FStreamableHandle> TexturesHandle;
+
+	struct FDamageNumber
+	{
+		FVector Location;
+		int32 Amount;
+		/** World time it appeared; negative for unused slots */
+		float StartTime;
+	};
+
+	/** Ring of MaxDamageNumbers slots, written at NextDamageNumber */
+	TArray<FDamageNumber> DamageNumbers;
+	int32 NextDamageNumber = 0;
+
+	float LastHitTime = -1.f;
+
+	FMechSurvivalHUDBatch StaticLayer;
+	FMechSurvivalHUDBatch IndicatorLayer;
+
+	bool bStaticLayerDirty = true;
+
+	/** Canvas size the static layer was built for */
+	FIntPoint StaticLayerSize = FIntPoint::ZeroValue;
+
+	// What the last frame drew, for DumpStats
+	int32 LastDraws = 0;
+	int32 LastQuads = 0;
+	int32 StaticLayerBuilds = 0;
+};
@@ -0,0 +1,133 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalHUDBatch.h"
+#include "Engine/Canvas.h"
+#include "Engine/Texture.h"
+#include "Materials/MaterialInterface.h"
+#include "TextureResource.h"
+
+FMechSurvivalHUDBatch::FGroup::FGroup()
+	: Key(nullptr)
+	, Item(TArray<FCanvasUVTri>(), nullptr)
+{
+	Item.BlendMode = SE_BLEND_Translucent;
+}
+
+void FMechSurvivalHUDBatch::Reset()
+{
+	for (FGroup& Group : Groups)
+	{
+		Group.Item.TriangleList.Reset();
+	}
+	NumQuads = 0;
+}
+
+void FMechSurvivalHUDBatch::Reserve(int32 QuadsPerGroup)
+{
+	ReservedQuads = FMath::Max(ReservedQuads, QuadsPerGroup);
+	for (FGroup& Group : Groups)
+	{
+		Group.Item.TriangleList.Reserve(ReservedQuads * 2);
+	}
+}
+
+FMechSurvivalHUDBatch::FGroup& FMechSurvivalHUDBatch::FindOrAddGroup(const UObject* Key)
+{
+	for (FGroup& Group : Groups)
+	{
+		if (Group.Key == Key)
+		{
+			return Group;
+		}
+	}
+
+	FGroup& Group = Groups.AddDefaulted_GetRef();
+	Group.Key = Key;
+	Group.Item.TriangleList.Reserve(ReservedQuads * 2);
+	return Group;
+}
+
+void FMechSurvivalHUDBatch::AddTriangles(TArray<FCanvasUVTri>& Triangles, const FVector2D& Position, const FVector2D& Size, const FVector2D& UV0, const FVector2D& UV1, const FLinearColor& Color)
+{
+	const FVector2D TopRight(Position.X + Size.X, Position.Y);
+	const FVector2D BottomLeft(Position.X, Position.Y + Size.Y);
+	const FVector2D BottomRight = Position + Size;
+
+	FCanvasUVTri& Upper = Triangles.AddUninitialized_GetRef();
+	Upper.V0_Pos = Position;
+	Upper.V0_UV = UV0;
+	Upper.V0_Color = Color;
+	Upper.V1_Pos = TopRight;
+	Upper.V1_UV = FVector2D(UV1.X, UV0.Y);
+	Upper.V1_Color = Color;
+	Upper.V2_Pos = BottomRight;
+	Upper.V2_UV = UV1;
+	Upper.V2_Color = Color;
+
+	FCanvasUVTri& Lower = Triangles.AddUninitialized_GetRef();
+	Lower.V0_Pos = Position;
+	Lower.V0_UV = UV0;
+	Lower.V0_Color = Color;
+	Lower.V1_Pos = BottomRight;
+	Lower.V1_UV = UV1;
+	Lower.V1_Color = Color;
+	Lower.V2_Pos = BottomLeft;
+	Lower.V2_UV = FVector2D(UV0.X, UV1.Y);
+	Lower.V2_Color = Color;
+}
+
+void FMechSurvivalHUDBatch::AddQuad(UTexture* Texture, const FVector2D& Position, const FVector2D& Size, const FVector2D& UV0, const FVector2D& UV1, const FLinearColor& Color)
+{
+	if (Texture == nullptr)
+	{
+		return;
+	}
+
+	FGroup& Group = FindOrAddGroup(Texture);
+	AddTriangles(Group.Item.TriangleList, Position, Size, UV0, UV1, Color);
+	++NumQuads;
+}
+
+void FMechSurvivalHUDBatch::AddQuad(UMaterialInterface* Material, const FVector2D& Position, const FVector2D& Size, const FVector2D& UV0, const FVector2D& UV1, const FLinearColor& Color)
+{
+	if (Material == nullptr)
+	{
+		return;
+	}
+
+	FGroup& Group = FindOrAddGroup(Material);
+	AddTriangles(Group.Item.TriangleList, Position, Size, UV0, UV1, Color);
+	++NumQuads;
+}
+
+int32 FMechSurvivalHUDBatch::Draw(UCanvas* Canvas)
+{
+	int32 NumDraws = 0;
+	for (FGroup& Group : Groups)
+	{
+		if (Group.Item.TriangleList.Num() == 0)
+		{
+			continue;
+		}
+
+		// A texture may not have its resource yet while it streams in
+		if (const UMaterialInterface* Material = Cast<UMaterialInterface>(Group.Key))
+		{
+			Group.Item.MaterialRenderProxy = Material->GetRenderProxy();
+			Group.Item.Texture = nullptr;
+		}
+		else
+		{
+			Group.Item.MaterialRenderProxy = nullptr;
+			Group.Item.Texture = CastChecked<UTexture>(Group.Key)->Resource;
+			if (Group.Item.Texture == nullptr)
+			{
+				continue;
+			}
+		}
+
+		Canvas->DrawItem(Group.Item);
+		++NumDraws;
+	}
+	return NumDraws;
+}
@@ -0,0 +1,59 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CanvasItem.h"
+
+class UCanvas;
+class UMaterialInterface;
+class UTexture;
+
+/**
+ * Screen-space quads of one HUD layer, grouped by texture or material.
+ * Every group is a single triangle list drawn as one canvas item, which the canvas renders as one batched draw, so a
+ * few hundred markers cost as much to submit as one. Reset keeps the memory of every triangle list; once a layer has
+ * been as full as it gets, building it again does not allocate.
+ * Textures and materials are not referenced for garbage collection; the owner keeps them loaded.
+ */
+class FMechSurvivalHUDBatch
+{
+public:
+	/** Forgets every quad, keeping the triangle lists for the next build */
+	void Reset();
+
+	/** Grows every triangle list, and the ones created later, to hold this many quads without allocating */
+	void Reserve(int32 QuadsPerGroup);
+
+	/** Adds a quad with its top left corner at Position, drawn with a texture and translucent blending */
+	void AddQuad(UTexture* Texture, const FVector2D& Position, const FVector2D& Size, const FVector2D& UV0, const FVector2D& UV1, const FLinearColor& Color);
+
+	/** Adds a quad with its top left corner at Position, drawn with a material */
+	void AddQuad(UMaterialInterface* Material, const FVector2D& Position, const FVector2D& Size, const FVector2D& UV0, const FVector2D& UV1, const FLinearColor& Color);
+
+	/** Draws every group that has quads; returns the number of canvas draws */
+	int32 Draw(UCanvas* Canvas);
+
+	int32 GetNumQuads() const { return NumQuads; }
+
+private:
+	struct FGroup
+	{
+		FGroup();
+
+		/** Texture or material the quads are drawn with */
+		const UObject* Key;
+		/** Holds the triangle list from build to build */
+		FCanvasTriangleItem Item;
+	};
+
+	FGroup& FindOrAddGroup(const UObject* Key);
+
+	static void AddTriangles(TArray<FCanvasUVTri>& Triangles, const FVector2D& Position, const FVector2D& Size, const FVector2D& UV0, const FVector2D& UV1, const FLinearColor& Color);
+
+	/** Few enough to search linearly, and drawn in the order they were first used */
+	TArray<FGroup> Groups;
+
+	int32 NumQuads = 0;
+	int32 ReservedQuads = 0;
+};
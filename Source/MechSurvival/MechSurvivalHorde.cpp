@@ -0,0 +1,876 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalHorde.h"
+#include "MechSurvival.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalMech.h"
+#include "MechSurvivalProjectile.h"
+#include "MechSurvivalSpatialHash.h"
+#include "MechSurvivalTelemetry.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/ThreadSafeCounter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogHorde, Log, All);
+
+namespace MechSurvivalHorde
+{
+	/** Cells are grown past SeparationRadius when a very spread out horde would need more than this */
+	static const int32 MaxGridCells = 256 * 256;
+
+	/** Already promoted mechs rank as if they were this much closer, so that two mechs at about the same distance do not swap every frame */
+	static const float PromotedDistanceScale = 0.8f;
+}
+
+static TAutoConsoleVariable<int32> CVarHordeChunkSize(
+	TEXT("MechSurvival.Horde.ChunkSize"),
+	256,
+	TEXT("Number of mechs steered by one parallel task"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarHordeForceSerial(
+	TEXT("MechSurvival.Horde.ForceSerial"),
+	0,
+	TEXT("1 steers every mech on the game thread, for comparison with the parallel path"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorld GDumpHordeCmd(
+	TEXT("MechSurvival.Horde.Dump"),
+	TEXT("Logs the number of mechs and how long the last step took"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(World))
+		{
+			Horde->DumpStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpawnHordeCmd(
+	TEXT("MechSurvival.Horde.Spawn"),
+	TEXT("Spawns <Count> mechs around the first player, or removes every mech with a count of 0"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(World);
+		const APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+		const APawn* Pawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+		if (Horde == nullptr || Pawn == nullptr)
+		{
+			return;
+		}
+
+		const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100;
+		if (Count <= 0)
+		{
+			Horde->RemoveMechs();
+		}
+		else
+		{
+			Horde->SpawnMechs(Count, Pawn->GetActorLocation(), 3000.f, 8000.f);
+		}
+	}));
+
+bool UMechSurvivalHorde::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalHorde::Deinitialize()
+{
+	Positions.Empty();
+	Velocities.Empty();
+	Healths.Empty();
+	SteerTimers.Empty();
+	LODLevels.Empty();
+	SpatialHandles.Empty();
+	PromotedActors.Empty();
+	SteeredVelocities.Empty();
+
+	CellStarts.Empty();
+	SortedMechs.Empty();
+	MechCells.Empty();
+
+	SpareActors.Empty();
+	NumPromoted = 0;
+
+	for (AMechSurvivalProjectile* Projectile : Projectiles)
+	{
+		if (Projectile != nullptr)
+		{
+			Projectile->HordeTraceIndex = INDEX_NONE;
+		}
+	}
+	Projectiles.Empty();
+
+	InstanceActor = nullptr;
+	InstanceComponent = nullptr;
+	InstanceTransforms.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalHorde* UMechSurvivalHorde::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalHorde>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalHorde::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalHorde::IsTickable() const
+{
+	// Instances need one more update after the last mech is gone so that they get cleared
+	return Positions.Num() > 0 || (InstanceComponent != nullptr && InstanceComponent->GetInstanceCount() > 0);
+}
+
+TStatId UMechSurvivalHorde::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalHorde, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalHorde::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalHorde::Tick(float DeltaTime)
+{
+	MECHSURVIVAL_LLM_SCOPE(Horde);
+
+	StepMechs(DeltaTime);
+	TraceProjectiles();
+	UpdateInstances();
+
+	MECHSURVIVAL_SET_LEVEL(LiveMechs, Positions.Num());
+	MECHSURVIVAL_SET_LEVEL(PromotedMechs, NumPromoted);
+}
+
+int32 UMechSurvivalHorde::SpawnMechs(int32 Count, const FVector& Center, float MinRadius, float MaxRadius)
+{
+	MECHSURVIVAL_LLM_SCOPE(Horde);
+
+	UWorld* World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_Client)
+	{
+		// The horde belongs to the server
+		return 0;
+	}
+
+	const int32 NumToSpawn = FMath::Min(Count, MaxMechs - Positions.Num());
+	if (NumToSpawn <= 0)
+	{
+		return 0;
+	}
+
+	ReserveMechs(NumToSpawn);
+
+	const FCollisionObjectQueryParams ObjectParams(ECC_WorldStatic);
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MechSurvivalHordeSpawn), false);
+	UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(World);
+
+	for (int32 Spawned = 0; Spawned < NumToSpawn; ++Spawned)
+	{
+		// Uniform over the area of the ring, not bunched up at its inner edge
+		const float Angle = FMath::FRandRange(0.f, 2.f * PI);
+		const float Distance = FMath::Sqrt(FMath::Lerp(FMath::Square(MinRadius), FMath::Square(MaxRadius), FMath::FRand()));
+		FVector Location = Center + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * Distance;
+
+		FHitResult Hit;
+		if (World->LineTraceSingleByObjectType(Hit, Location + FVector(0.f, 0.f, 2000.f), Location - FVector(0.f, 0.f, 10000.f), ObjectParams, QueryParams))
+		{
+			Location.Z = Hit.Location.Z + MechHalfHeight;
+		}
+
+		AppendMech(Location, FVector::ZeroVector, MechHealth, SpatialHash);
+	}
+
+	bGridDirty = true;
+	return NumToSpawn;
+}
+
+void UMechSurvivalHorde::AppendMech(const FVector& Location, const FVector& Velocity, float Health, UMechSurvivalSpatialHash* SpatialHash)
+{
+	const float LongestInterval = LODIntervals.Num() > 0 ? LODIntervals.Last() : 0.f;
+
+	Positions.Add(Location);
+	Velocities.Add(Velocity);
+	Healths.Add(Health);
+	// Spread the first steering updates out instead of steering the whole batch in the same frame
+	SteerTimers.Add(FMath::FRand() * LongestInterval);
+	LODLevels.Add(0);
+	SpatialHandles.Add(SpatialHash != nullptr ? SpatialHash->AddMech(Positions.Num() - 1, Location, MechRadius, MechHalfHeight) : INDEX_NONE);
+	PromotedActors.Add(nullptr);
+}
+
+void UMechSurvivalHorde::ReserveMechs(int32 Count)
+{
+	const int32 NewMax = FMath::Min(Positions.Num() + Count, MaxMechs);
+	Positions.Reserve(NewMax);
+	Velocities.Reserve(NewMax);
+	Healths.Reserve(NewMax);
+	SteerTimers.Reserve(NewMax);
+	LODLevels.Reserve(NewMax);
+	SpatialHandles.Reserve(NewMax);
+	PromotedActors.Reserve(NewMax);
+	SteeredVelocities.Reserve(NewMax);
+	MechCells.Reserve(NewMax);
+	SortedMechs.Reserve(NewMax);
+	InstanceTransforms.Reserve(NewMax);
+}
+
+void UMechSurvivalHorde::RemoveMechs(int32 Count)
+{
+	const int32 NumToRemove = Count < 0 ? Positions.Num() : FMath::Min(Count, Positions.Num());
+	for (int32 Removed = 0; Removed < NumToRemove; ++Removed)
+	{
+		RemoveMech(Positions.Num() - 1);
+	}
+}
+
+void UMechSurvivalHorde::SerializeMechs(FArchive& Ar)
+{
+	if (!Ar.IsLoading())
+	{
+		// Promoted mechs were brought up to date with their actors at the start of the last step
+		Ar << Positions << Velocities << Healths;
+		return;
+	}
+
+	TArray<FVector> SavedPositions;
+	TArray<FVector> SavedVelocities;
+	TArray<float> SavedHealths;
+	Ar << SavedPositions << SavedVelocities << SavedHealths;
+	if (Ar.IsError() || SavedVelocities.Num() != SavedPositions.Num() || SavedHealths.Num() != SavedPositions.Num())
+	{
+		UE_LOG(LogHorde, Warning, TEXT("Saved horde is damaged, not restored"));
+		return;
+	}
+
+	RemoveMechs();
+
+	const int32 NumToAdd = FMath::Min(SavedPositions.Num(), MaxMechs);
+	ReserveMechs(NumToAdd);
+	UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(this);
+	for (int32 Index = 0; Index < NumToAdd; ++Index)
+	{
+		AppendMech(SavedPositions[Index], SavedVelocities[Index], SavedHealths[Index], SpatialHash);
+	}
+
+	bGridDirty = true;
+}
+
+void UMechSurvivalHorde::RemoveMech(int32 Index)
+{
+	if (PromotedActors[Index] != nullptr)
+	{
+		Demote(Index);
+	}
+
+	UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(this);
+	if (SpatialHash != nullptr)
+	{
+		SpatialHash->RemoveMech(SpatialHandles[Index]);
+	}
+
+	Positions.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	Healths.RemoveAtSwap(Index, 1, false);
+	SteerTimers.RemoveAtSwap(Index, 1, false);
+	LODLevels.RemoveAtSwap(Index, 1, false);
+	SpatialHandles.RemoveAtSwap(Index, 1, false);
+	PromotedActors.RemoveAtSwap(Index, 1, false);
+
+	// The last mech moved into the freed slot; its actor and its hash entity have to follow
+	if (PromotedActors.IsValidIndex(Index) && PromotedActors[Index] != nullptr)
+	{
+		PromotedActors[Index]->HordeIndex = Index;
+	}
+	if (SpatialHash != nullptr && SpatialHandles.IsValidIndex(Index))
+	{
+		SpatialHash->SetMechIndex(SpatialHandles[Index], Index);
+	}
+
+	bGridDirty = true;
+}
+
+void UMechSurvivalHorde::ApplyDamage(int32 MechIndex, float Damage, APawn* Instigator)
+{
+	if (!Healths.IsValidIndex(MechIndex) || Healths[MechIndex] <= 0.f)
+	{
+		return;
+	}
+
+	// The hit itself is recorded by whatever landed it, which also covers promoted mechs hit as actors
+	Healths[MechIndex] -= Damage;
+	if (Healths[MechIndex] <= 0.f)
+	{
+		MECHSURVIVAL_INC_COUNTER(MechsKilled, 1);
+		UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Death, Positions[MechIndex], Damage);
+	}
+
+	OnMechDamaged.Broadcast(Positions[MechIndex], Damage, Instigator);
+}
+
+void UMechSurvivalHorde::ApplyMechSettings(AMechSurvivalMech* Mech) const
+{
+	if (Mech != nullptr)
+	{
+		Mech->ApplyHordeSettings(MechMesh.LoadSynchronous(), MechMeshScale, MechRadius, MechHalfHeight, MechSpeed);
+	}
+}
+
+void UMechSurvivalHorde::DumpStats() const
+{
+	UE_LOG(LogHorde, Log, TEXT("%d mechs, %d promoted, %d spare actors; last step %.3f ms, %d mechs steered, chunk size %d%s"),
+		Positions.Num(), NumPromoted, SpareActors.Num(), LastStepSeconds * 1000.0, LastSteered,
+		CVarHordeChunkSize.GetValueOnGameThread(), CVarHordeForceSerial.GetValueOnGameThread() ? TEXT(", forced serial") : TEXT(""));
+}
+
+void UMechSurvivalHorde::StepMechs(float DeltaTime)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || DeltaTime <= 0.f || Positions.Num() == 0)
+	{
+		return;
+	}
+
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(HordeStep);
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Promoted mechs are moved by their actors; one destroyed from outside goes back to being an instance
+	for (int32 Index = 0; Index < PromotedActors.Num(); ++Index)
+	{
+		const AMechSurvivalMech* Actor = PromotedActors[Index];
+		if (Actor == nullptr)
+		{
+			continue;
+		}
+
+		if (!IsValid(Actor))
+		{
+			PromotedActors[Index] = nullptr;
+			--NumPromoted;
+			continue;
+		}
+
+		Positions[Index] = Actor->GetActorLocation();
+		Velocities[Index] = Actor->GetVelocity() * FVector(1.f, 1.f, 0.f);
+	}
+
+	if (bGridDirty)
+	{
+		BuildGrid();
+	}
+
+	TArray<FVector> Targets;
+	for (TActorIterator<AMechSurvivalCharacter> It(World); It; ++It)
+	{
+		Targets.Add(It->GetActorLocation());
+	}
+
+	TArray<FVector> Viewers;
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr)
+		{
+			Viewers.Add(PlayerController->GetPawn()->GetActorLocation());
+		}
+	}
+
+	const int32 NumMechs = Positions.Num();
+	SteeredVelocities.SetNumUninitialized(NumMechs, false);
+
+	// Steering reads the neighbours but only writes the mech's own slots, so chunks of mechs can run on any thread
+	const int32 ChunkSize = FMath::Max(1, CVarHordeChunkSize.GetValueOnGameThread());
+	const int32 NumChunks = FMath::DivideAndRoundUp(NumMechs, ChunkSize);
+	const bool bForceSerial = CVarHordeForceSerial.GetValueOnGameThread() != 0 || NumChunks == 1;
+
+	FThreadSafeCounter NumSteered;
+	ParallelFor(NumChunks, [this, DeltaTime, ChunkSize, NumMechs, &Targets, &Viewers, &NumSteered](int32 ChunkIndex)
+	{
+		const int32 BeginIndex = ChunkIndex * ChunkSize;
+		const int32 EndIndex = FMath::Min(BeginIndex + ChunkSize, NumMechs);
+		int32 ChunkSteered = 0;
+		for (int32 Index = BeginIndex; Index < EndIndex; ++Index)
+		{
+			ChunkSteered += SteerMech(Index, DeltaTime, Targets, Viewers) ? 1 : 0;
+		}
+		NumSteered.Add(ChunkSteered);
+	}, bForceSerial);
+
+	// Move phase, on the game thread
+	for (int32 Index = 0; Index < NumMechs; ++Index)
+	{
+		Velocities[Index] = SteeredVelocities[Index];
+		if (AMechSurvivalMech* Actor = PromotedActors[Index])
+		{
+			Actor->MoveTarget = Positions[Index] + Velocities[Index];
+		}
+		else
+		{
+			Positions[Index] += Velocities[Index] * DeltaTime;
+		}
+	}
+
+	// Backwards, so that removing a mech only moves an already handled one into its slot
+	for (int32 Index = NumMechs - 1; Index >= 0; --Index)
+	{
+		if (Healths[Index] <= 0.f)
+		{
+			RemoveMech(Index);
+		}
+	}
+
+	UpdatePromotions(Viewers);
+
+	// Traces and area queries between now and the next step see the mechs where they are now
+	BuildGrid();
+	if (UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(World))
+	{
+		SpatialHash->MoveMechs(SpatialHandles, Positions);
+	}
+
+	LastSteered = NumSteered.GetValue();
+	LastStepSeconds = FPlatformTime::Seconds() - StartTime;
+	MECHSURVIVAL_INC_COUNTER(MechSteeringUpdates, LastSteered);
+}
+
+bool UMechSurvivalHorde::SteerMech(int32 Index, float DeltaTime, const TArray<FVector>& Targets, const TArray<FVector>& Viewers)
+{
+	const FVector Position = Positions[Index];
+	SteeredVelocities[Index] = Velocities[Index];
+
+	// Steering LOD from the nearest player
+	float ViewerDistanceSquared = BIG_NUMBER;
+	for (const FVector& Viewer : Viewers)
+	{
+		ViewerDistanceSquared = FMath::Min(ViewerDistanceSquared, FVector::DistSquared2D(Position, Viewer));
+	}
+	uint8 LOD = 0;
+	while (LOD < LODDistances.Num() && ViewerDistanceSquared > FMath::Square(LODDistances[LOD]))
+	{
+		++LOD;
+	}
+	LODLevels[Index] = LOD;
+
+	// Nearby mechs are steered every frame; the rest keep their velocity until their timer runs out
+	SteerTimers[Index] -= DeltaTime;
+	if (SteerTimers[Index] > 0.f)
+	{
+		return false;
+	}
+	const float Interval = LODIntervals.IsValidIndex(LOD) ? LODIntervals[LOD] : (LODIntervals.Num() > 0 ? LODIntervals.Last() : 0.f);
+	SteerTimers[Index] = FMath::Max(SteerTimers[Index] + Interval, 0.f);
+
+	// Seek the nearest target
+	FVector Desired = FVector::ZeroVector;
+	float TargetDistanceSquared = BIG_NUMBER;
+	FVector Target = Position;
+	for (const FVector& Candidate : Targets)
+	{
+		const float DistanceSquared = FVector::DistSquared2D(Position, Candidate);
+		if (DistanceSquared < TargetDistanceSquared)
+		{
+			TargetDistanceSquared = DistanceSquared;
+			Target = Candidate;
+		}
+	}
+	if (Targets.Num() > 0 && TargetDistanceSquared > FMath::Square(StopDistance))
+	{
+		Desired = (Target - Position).GetSafeNormal2D() * MechSpeed;
+	}
+
+	// Separate from and align with the neighbours; cells are at least SeparationRadius wide, so the 3x3 block holds them all
+	FVector Separation = FVector::ZeroVector;
+	FVector NeighbourVelocity = FVector::ZeroVector;
+	int32 NumNeighbours = 0;
+	const FIntPoint Cell = GetCell(Position);
+	for (int32 Y = FMath::Max(Cell.Y - 1, 0); Y <= FMath::Min(Cell.Y + 1, GridSize.Y - 1); ++Y)
+	{
+		for (int32 X = FMath::Max(Cell.X - 1, 0); X <= FMath::Min(Cell.X + 1, GridSize.X - 1); ++X)
+		{
+			const int32 CellIndex = Y * GridSize.X + X;
+			for (int32 Sorted = CellStarts[CellIndex]; Sorted < CellStarts[CellIndex + 1]; ++Sorted)
+			{
+				const int32 Other = SortedMechs[Sorted];
+				if (Other == Index || !Positions.IsValidIndex(Other))
+				{
+					continue;
+				}
+
+				FVector Offset = Position - Positions[Other];
+				Offset.Z = 0.f;
+				const float DistanceSquared = Offset.SizeSquared();
+				if (DistanceSquared >= FMath::Square(SeparationRadius) || DistanceSquared < KINDA_SMALL_NUMBER)
+				{
+					continue;
+				}
+
+				const float Distance = FMath::Sqrt(DistanceSquared);
+				Separation += Offset / Distance * (1.f - Distance / SeparationRadius);
+				NeighbourVelocity += Velocities[Other];
+				++NumNeighbours;
+			}
+		}
+	}
+
+	FVector Velocity = Desired + Separation * (SeparationWeight * MechSpeed);
+	if (NumNeighbours > 0)
+	{
+		Velocity += (NeighbourVelocity / NumNeighbours - Velocities[Index]) * AlignmentWeight;
+	}
+	Velocity.Z = 0.f;
+
+	SteeredVelocities[Index] = Velocity.GetClampedToMaxSize(MechSpeed);
+	return true;
+}
+
+void UMechSurvivalHorde::BuildGrid()
+{
+	bGridDirty = false;
+
+	const int32 NumMechs = Positions.Num();
+	if (NumMechs == 0)
+	{
+		GridSize = FIntPoint::ZeroValue;
+		CellStarts.Reset();
+		SortedMechs.Reset();
+		return;
+	}
+
+	FBox2D Bounds(ForceInit);
+	for (const FVector& Position : Positions)
+	{
+		Bounds += FVector2D(Position);
+	}
+
+	const FVector2D Extent = Bounds.GetSize();
+	GridCellSize = FMath::Max(SeparationRadius, 1.f);
+	while ((Extent.X / GridCellSize + 1.f) * (Extent.Y / GridCellSize + 1.f) > MechSurvivalHorde::MaxGridCells)
+	{
+		GridCellSize *= 2.f;
+	}
+	GridOrigin = Bounds.Min;
+	GridSize = FIntPoint(FMath::FloorToInt(Extent.X / GridCellSize) + 1, FMath::FloorToInt(Extent.Y / GridCellSize) + 1);
+
+	// Counting sort: count per cell, turn the counts into start offsets, then scatter
+	const int32 NumCells = GridSize.X * GridSize.Y;
+	CellStarts.Reset();
+	CellStarts.SetNumZeroed(NumCells + 1);
+	MechCells.SetNumUninitialized(NumMechs, false);
+	for (int32 Index = 0; Index < NumMechs; ++Index)
+	{
+		const FIntPoint Cell = GetCell(Positions[Index]);
+		MechCells[Index] = Cell.Y * GridSize.X + Cell.X;
+		++CellStarts[MechCells[Index] + 1];
+	}
+	for (int32 CellIndex = 1; CellIndex <= NumCells; ++CellIndex)
+	{
+		CellStarts[CellIndex] += CellStarts[CellIndex - 1];
+	}
+
+	SortedMechs.SetNumUninitialized(NumMechs, false);
+	for (int32 Index = NumMechs - 1; Index >= 0; --Index)
+	{
+		// Filling each cell from its end keeps the mechs of a cell in index order
+		SortedMechs[--CellStarts[MechCells[Index] + 1]] = Index;
+	}
+
+	// The scatter moved every start back by one cell; put them back in place
+	for (int32 CellIndex = 0; CellIndex < NumCells; ++CellIndex)
+	{
+		CellStarts[CellIndex] = CellStarts[CellIndex + 1];
+	}
+	CellStarts[NumCells] = NumMechs;
+}
+
+FIntPoint UMechSurvivalHorde::GetCell(const FVector& Location) const
+{
+	return FIntPoint(
+		FMath::Clamp(FMath::FloorToInt((Location.X - GridOrigin.X) / GridCellSize), 0, FMath::Max(GridSize.X - 1, 0)),
+		FMath::Clamp(FMath::FloorToInt((Location.Y - GridOrigin.Y) / GridCellSize), 0, FMath::Max(GridSize.Y - 1, 0)));
+}
+
+bool UMechSurvivalHorde::TraceMechs(const FVector& Start, const FVector& End, float Radius, FMechSurvivalHordeHit& OutHit) const
+{
+	OutHit = FMechSurvivalHordeHit();
+	if (GridSize.X == 0 || bGridDirty)
+	{
+		return false;
+	}
+
+	const float HitRadius = MechRadius + Radius;
+	const float AxisHalfLength = FMath::Max(MechHalfHeight - MechRadius, 0.f);
+
+	// Only the cells under the segment, grown by the hit radius, can hold a mech it touches
+	FBox2D SegmentBounds(ForceInit);
+	SegmentBounds += FVector2D(Start);
+	SegmentBounds += FVector2D(End);
+	SegmentBounds = SegmentBounds.ExpandBy(HitRadius);
+	const FBox2D GridBounds(GridOrigin, GridOrigin + FVector2D(GridSize) * GridCellSize);
+	if (!SegmentBounds.Intersect(GridBounds))
+	{
+		return false;
+	}
+
+	const FIntPoint MinCell = GetCell(FVector(SegmentBounds.Min, 0.f));
+	const FIntPoint MaxCell = GetCell(FVector(SegmentBounds.Max, 0.f));
+
+	const FVector Segment = End - Start;
+	const float SegmentSizeSquared = Segment.SizeSquared();
+	const float SegmentSize = FMath::Sqrt(SegmentSizeSquared);
+	bool bHit = false;
+
+	for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+		{
+			const int32 CellIndex = Y * GridSize.X + X;
+			for (int32 Sorted = CellStarts[CellIndex]; Sorted < CellStarts[CellIndex + 1]; ++Sorted)
+			{
+				const int32 Index = SortedMechs[Sorted];
+				if (Healths[Index] <= 0.f || PromotedActors[Index] != nullptr)
+				{
+					// Dead ones are about to go; promoted ones have a real capsule
+					continue;
+				}
+
+				const FVector Center = Positions[Index];
+				if (FMath::PointDistToSegmentSquared(Center, Start, End) > FMath::Square(HitRadius + AxisHalfLength))
+				{
+					continue;
+				}
+
+				FVector OnSegment, OnAxis;
+				FMath::SegmentDistToSegmentSafe(Start, End, Center - FVector(0.f, 0.f, AxisHalfLength), Center + FVector(0.f, 0.f, AxisHalfLength), OnSegment, OnAxis);
+				const float DistanceSquared = FVector::DistSquared(OnSegment, OnAxis);
+				if (DistanceSquared > FMath::Square(HitRadius))
+				{
+					continue;
+				}
+
+				// Back off from the closest approach to where the sphere first touched the capsule
+				float Time = 0.f;
+				if (SegmentSizeSquared > KINDA_SMALL_NUMBER)
+				{
+					const float ClosestTime = ((OnSegment - Start) | Segment) / SegmentSizeSquared;
+					const float Penetration = FMath::Sqrt(FMath::Square(HitRadius) - DistanceSquared) / SegmentSize;
+					Time = FMath::Max(ClosestTime - Penetration, 0.f);
+				}
+
+				if (!bHit || Time < OutHit.Time)
+				{
+					bHit = true;
+					OutHit.MechIndex = Index;
+					OutHit.Time = Time;
+					OutHit.Location = Start + Segment * Time;
+				}
+			}
+		}
+	}
+
+	return bHit;
+}
+
+void UMechSurvivalHorde::RegisterProjectile(AMechSurvivalProjectile* Projectile)
+{
+	if (Projectile != nullptr && Projectile->HordeTraceIndex == INDEX_NONE)
+	{
+		Projectile->HordeTraceIndex = Projectiles.Add(Projectile);
+	}
+}
+
+void UMechSurvivalHorde::UnregisterProjectile(AMechSurvivalProjectile* Projectile)
+{
+	const int32 Index = Projectile ? Projectile->HordeTraceIndex : INDEX_NONE;
+	if (!Projectiles.IsValidIndex(Index) || Projectiles[Index] != Projectile)
+	{
+		return;
+	}
+
+	Projectile->HordeTraceIndex = INDEX_NONE;
+	Projectiles.RemoveAtSwap(Index, 1, false);
+	if (Projectiles.IsValidIndex(Index) && Projectiles[Index] != nullptr)
+	{
+		Projectiles[Index]->HordeTraceIndex = Index;
+	}
+}
+
+void UMechSurvivalHorde::TraceProjectiles()
+{
+	// The horde does not tick without mechs, so a gap means the last traced locations are stale
+	const bool bTrace = LastProjectileTraceFrame + 1 == GFrameCounter && Positions.Num() > 0;
+	LastProjectileTraceFrame = GFrameCounter;
+
+	// Backwards, since a projectile that hits is recycled and the last one takes its slot
+	for (int32 Index = Projectiles.Num() - 1; Index >= 0; --Index)
+	{
+		AMechSurvivalProjectile* Projectile = Projectiles[Index];
+		if (Projectile == nullptr)
+		{
+			// Collected without unregistering
+			Projectiles.RemoveAtSwap(Index, 1, false);
+			if (Projectiles.IsValidIndex(Index) && Projectiles[Index] != nullptr)
+			{
+				Projectiles[Index]->HordeTraceIndex = Index;
+			}
+			continue;
+		}
+
+		Projectile->TraceHorde(this, bTrace);
+	}
+}
+
+void UMechSurvivalHorde::UpdatePromotions(const TArray<FVector>& Viewers)
+{
+	// Nearest mechs within PromoteDistance of any player
+	TArray<TPair<float, int32>> Candidates;
+	if (MaxPromoted > 0)
+	{
+		const float PromoteDistanceSquared = FMath::Square(PromoteDistance);
+		for (int32 Index = 0; Index < Positions.Num(); ++Index)
+		{
+			float DistanceSquared = BIG_NUMBER;
+			for (const FVector& Viewer : Viewers)
+			{
+				DistanceSquared = FMath::Min(DistanceSquared, FVector::DistSquared(Positions[Index], Viewer));
+			}
+			if (DistanceSquared <= PromoteDistanceSquared)
+			{
+				const float Scale = PromotedActors[Index] != nullptr ? FMath::Square(MechSurvivalHorde::PromotedDistanceScale) : 1.f;
+				Candidates.Emplace(DistanceSquared * Scale, Index);
+			}
+		}
+		Candidates.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B) { return A.Key < B.Key; });
+		Candidates.SetNum(FMath::Min(Candidates.Num(), MaxPromoted), false);
+	}
+
+	// Demote first, so that the freed actors can be reused right away
+	for (int32 Index = 0; Index < PromotedActors.Num(); ++Index)
+	{
+		if (PromotedActors[Index] != nullptr && !Candidates.ContainsByPredicate([Index](const TPair<float, int32>& Candidate) { return Candidate.Value == Index; }))
+		{
+			Demote(Index);
+		}
+	}
+	for (const TPair<float, int32>& Candidate : Candidates)
+	{
+		if (PromotedActors[Candidate.Value] == nullptr)
+		{
+			Promote(Candidate.Value);
+		}
+	}
+}
+
+void UMechSurvivalHorde::Promote(int32 Index)
+{
+	AMechSurvivalMech* Actor = SpareActors.Num() > 0 ? SpareActors.Pop(false) : nullptr;
+	if (Actor == nullptr)
+	{
+		UClass* ActorClass = MechActorClass.IsNull() ? nullptr : MechActorClass.LoadSynchronous();
+		if (ActorClass == nullptr)
+		{
+			ActorClass = AMechSurvivalMech::StaticClass();
+		}
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		Actor = GetWorld()->SpawnActor<AMechSurvivalMech>(ActorClass, Positions[Index], FRotator::ZeroRotator, SpawnParams);
+		if (Actor == nullptr)
+		{
+			return;
+		}
+	}
+
+	Actor->ActivateForHorde(this, Index, Positions[Index], Velocities[Index]);
+	PromotedActors[Index] = Actor;
+	++NumPromoted;
+}
+
+void UMechSurvivalHorde::Demote(int32 Index)
+{
+	AMechSurvivalMech* Actor = PromotedActors[Index];
+	if (IsValid(Actor))
+	{
+		// The actor walked on real ground, so its height is better than the one the mech was spawned at
+		Positions[Index] = Actor->GetActorLocation();
+		Velocities[Index] = Actor->GetVelocity() * FVector(1.f, 1.f, 0.f);
+
+		Actor->DeactivateForHorde();
+		SpareActors.Add(Actor);
+	}
+
+	PromotedActors[Index] = nullptr;
+	--NumPromoted;
+}
+
+void UMechSurvivalHorde::UpdateInstances()
+{
+	if (InstanceComponent == nullptr)
+	{
+		UWorld* World = GetWorld();
+		if (World == nullptr || World->GetNetMode() == NM_DedicatedServer || MechMesh.IsNull() || Positions.Num() == 0)
+		{
+			// Nobody is looking, or there is nothing to look at
+			return;
+		}
+
+		if (MechMesh.Get() == nullptr)
+		{
+			UE_LOG(LogHorde, Log, TEXT("Loading mech mesh %s"), *MechMesh.ToString());
+		}
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		InstanceActor = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+		if (InstanceActor == nullptr)
+		{
+			return;
+		}
+		InstanceActor->SetRootComponent(NewObject<USceneComponent>(InstanceActor, TEXT("Root")));
+		InstanceActor->GetRootComponent()->RegisterComponent();
+
+		InstanceComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(InstanceActor);
+		InstanceComponent->SetMobility(EComponentMobility::Movable);
+		InstanceComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		InstanceComponent->SetStaticMesh(MechMesh.LoadSynchronous());
+		InstanceComponent->InstanceEndCullDistance = FMath::RoundToInt(CullDistance);
+		InstanceComponent->RegisterComponent();
+	}
+
+	// Promoted mechs are drawn by their actors; their instances collapse to nothing rather than leave the array, so that instance and mech indices match
+	InstanceTransforms.Reset(Positions.Num());
+	for (int32 Index = 0; Index < Positions.Num(); ++Index)
+	{
+		const FVector& Velocity = Velocities[Index];
+		const FRotator Rotation(0.f, Velocity.IsNearlyZero() ? 0.f : FMath::RadiansToDegrees(FMath::Atan2(Velocity.Y, Velocity.X)), 0.f);
+		const bool bDrawn = PromotedActors[Index] == nullptr && Healths[Index] > 0.f;
+		InstanceTransforms.Emplace(Rotation, Positions[Index], bDrawn ? MechMeshScale : FVector::ZeroVector);
+	}
+
+	// Grow or shrink at the end only, then move every instance in one batch
+	while (InstanceComponent->GetInstanceCount() > InstanceTransforms.Num())
+	{
+		InstanceComponent->RemoveInstance(InstanceComponent->GetInstanceCount() - 1);
+	}
+	for (int32 Index = InstanceComponent->GetInstanceCount(); Index < InstanceTransforms.Num(); ++Index)
+	{
+		InstanceComponent->AddInstanceWorldSpace(InstanceTransforms[Index]);
+	}
+	if (InstanceTransforms.Num() > 0)
+	{
+		InstanceComponent->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	}
+}
@@ -0,0 +1,278 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalHorde.generated.h"
+
+class AMechSurvivalMech;
+class AMechSurvivalProjectile;
+class APawn;
+class UHierarchicalInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/** A mech took damage, at a location, from the pawn that dealt it if known */
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FMechSurvivalMechDamaged, const FVector&, float, APawn*);
+
+/** Result of a trace against the horde */
+struct FMechSurvivalHordeHit
+{
+	/** Mech that was hit; valid until the horde steps again */
+	int32 MechIndex = INDEX_NONE;
+
+	/** Fraction of the traced segment travelled before the hit */
+	float Time = 1.f;
+
+	/** Where along the traced segment the hit happened */
+	FVector Location = FVector::ZeroVector;
+};
+
+/**
+ * Enemy mechs simulated in bulk rather than as actors.
+ * Each mech is a slot in a set of flat arrays. Once per frame the horde sorts all mechs into a uniform grid, steers
+ * the ones that are due for an update in parallel (seek the nearest player, separate from and align with the
+ * neighbours in the grid), then moves all of them. How often a mech is steered depends on its distance to the nearest
+ * player, see LODDistances and LODIntervals; in between it keeps its velocity. Mechs walk on the height they were
+ * spawned at and are drawn as instances of a single hierarchical instanced mesh.
+ *
+ * The few mechs nearest to players are promoted to AMechSurvivalMech actors, which have real collision and
+ * character movement, and demoted again once others are closer. Everything else can still be hit through TraceMechs,
+ * which the ballistic simulation uses; projectile actors in flight register with the horde, which traces all of
+ * them in one batch after each step, so that they cost nothing while there are no mechs. The horde only runs where
+ * the game is authoritative; clients see the promoted actors.
+ */
+UCLASS(config=Game)
+class UMechSurvivalHorde : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the horde of the world the context object lives in, if any */
+	static UMechSurvivalHorde* Get(const UObject* WorldContextObject);
+
+	/**
+	 * Adds mechs scattered over a ring around a point; each is dropped onto the ground below its spot.
+	 * @returns the number of mechs added, fewer than asked if the horde is full.
+	 */
+	int32 SpawnMechs(int32 Count, const FVector& Center, float MinRadius, float MaxRadius);
+
+	/** Grows the mech arrays and instance buffer ahead of time so that spawning Count more mechs does not reallocate */
+	void ReserveMechs(int32 Count);
+
+	/** Removes mechs from the end of the horde, or all of them if Count is negative */
+	void RemoveMechs(int32 Count = -1);
+
+	/**
+	 * Saves the location, velocity and health of every mech, or replaces the horde with the saved mechs when loading.
+	 * Restored mechs start out as instances and are promoted again like any other.
+	 */
+	void SerializeMechs(FArchive& Ar);
+
+	/**
+	 * Sweeps a sphere along a segment against every mech that is not promoted.
+	 * Does not modify the horde, so it may be called from worker threads while the horde is not stepping.
+	 * @returns true if a mech was hit.
+	 */
+	bool TraceMechs(const FVector& Start, const FVector& End, float Radius, FMechSurvivalHordeHit& OutHit) const;
+
+	/**
+	 * Damages a mech; a mech that runs out of health is removed on the next step. Instigator is the pawn that dealt
+	 * the damage, if known. Records the death in the telemetry, but not the hit, which is the caller's to record.
+	 */
+	void ApplyDamage(int32 MechIndex, float Damage, APawn* Instigator = nullptr);
+
+	/** Number of mechs, alive or dying */
+	int32 GetNumMechs() const { return Positions.Num(); }
+
+	/** Location of every mech, indexed by mech */
+	const TArray<FVector>& GetMechPositions() const { return Positions; }
+
+	/** Adds a projectile in flight to those traced against the mechs after every step, if it is not there already */
+	void RegisterProjectile(AMechSurvivalProjectile* Projectile);
+
+	/** Stops tracing a projectile, once it is back in its pool or gone */
+	void UnregisterProjectile(AMechSurvivalProjectile* Projectile);
+
+	/** Called whenever a mech takes damage, from anything; server only */
+	FMechSurvivalMechDamaged OnMechDamaged;
+
+	/** Sets up size, speed and look of a promoted mech actor; used on clients too, through the class defaults */
+	void ApplyMechSettings(AMechSurvivalMech* Mech) const;
+
+	/** Number of mechs currently represented by actors */
+	int32 GetNumPromoted() const { return NumPromoted; }
+
+	/** Wall time of the last step, in seconds */
+	double GetLastStepSeconds() const { return LastStepSeconds; }
+
+	/** Writes mech counts and step timing to the log */
+	void DumpStats() const;
+
+protected:
+	/** Upper bound on mechs */
+	UPROPERTY(config)
+	int32 MaxMechs = 8192;
+
+	/** Health of a freshly spawned mech */
+	UPROPERTY(config)
+	float MechHealth = 100.f;
+
+	/** Walking speed */
+	UPROPERTY(config)
+	float MechSpeed = 400.f;
+
+	/** Collision capsule of a mech, also used for the instances and the promoted actors */
+	UPROPERTY(config)
+	float MechRadius = 60.f;
+
+	UPROPERTY(config)
+	float MechHalfHeight = 120.f;
+
+	/** Mechs stop once this close to their target */
+	UPROPERTY(config)
+	float StopDistance = 150.f;
+
+	/** Neighbours closer than this push each other apart; also the size of a grid cell */
+	UPROPERTY(config)
+	float SeparationRadius = 300.f;
+
+	/** Strength of the push away from neighbours, relative to seeking the target */
+	UPROPERTY(config)
+	float SeparationWeight = 1.5f;
+
+	/** How much a mech matches the velocity of its neighbours */
+	UPROPERTY(config)
+	float AlignmentWeight = 0.3f;
+
+	/** Outer edge of each steering LOD, ascending; mechs beyond the last edge use the last interval */
+	UPROPERTY(config)
+	TArray<float> LODDistances;
+
+	/** Seconds between two steering updates, per LOD; one more entry than LODDistances */
+	UPROPERTY(config)
+	TArray<float> LODIntervals;
+
+	/** Number of mechs near players that are represented by actors */
+	UPROPERTY(config)
+	int32 MaxPromoted = 8;
+
+	/** Only mechs this close to a player are promoted */
+	UPROPERTY(config)
+	float PromoteDistance = 2500.f;
+
+	/** Actor class used for promoted mechs */
+	UPROPERTY(config)
+	TSoftClassPtr<AMechSurvivalMech> MechActorClass;
+
+	/** Mesh drawn for every mech that is not promoted */
+	UPROPERTY(config)
+	TSoftObjectPtr<UStaticMesh> MechMesh;
+
+	/** Scale applied to MechMesh */
+	UPROPERTY(config)
+	FVector MechMeshScale = FVector(1.f);
+
+	/** Mechs further than this from the camera are not drawn */
+	UPROPERTY(config)
+	float CullDistance = 30000.f;
+
+private:
+	/** Removes dead mechs, steers, moves and promotes; the only place mech indices change */
+	void StepMechs(float DeltaTime);
+
+	/**
+	 * Steers a single mech; only writes to that mech's slots, so it is safe to call from worker threads.
+	 * @returns false if the mech was not due and kept its velocity.
+	 */
+	bool SteerMech(int32 Index, float DeltaTime, const TArray<FVector>& Targets, const TArray<FVector>& Viewers);
+
+	/** Sorts every mech into the grid used for neighbour and trace queries */
+	void BuildGrid();
+
+	/** Returns the grid cell of a location, clamped to the grid */
+	FIntPoint GetCell(const FVector& Location) const;
+
+	/** Picks the mechs that should be actors this frame, and promotes or demotes to match */
+	void UpdatePromotions(const TArray<FVector>& Viewers);
+
+	void Promote(int32 Index);
+	void Demote(int32 Index);
+
+	/** Removes a mech; the last mech takes its slot */
+	void RemoveMech(int32 Index);
+
+	/** Rebuilds the instances from the current mech positions */
+	void UpdateInstances();
+
+	/** Traces the path every projectile in flight flew since the last step against the mechs */
+	void TraceProjectiles();
+
+	/** Appends one mech to the arrays and the spatial hash; the caller has checked there is room */
+	void AppendMech(const FVector& Location, const FVector& Velocity, float Health, class UMechSurvivalSpatialHash* SpatialHash);
+
+	// Mechs, struct-of-arrays; all arrays share indices
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> Healths;
+	TArray<float> SteerTimers;
+	TArray<uint8> LODLevels;
+	/** Handle of each mech in the spatial hash, which area queries and explosions find it through */
+	TArray<int32> SpatialHandles;
+
+	/** Actor of each mech while it is promoted, null otherwise */
+	UPROPERTY(Transient)
+	TArray<AMechSurvivalMech*> PromotedActors;
+
+	/** Velocities written by the parallel steering phase, copied over once every mech has been steered */
+	TArray<FVector> SteeredVelocities;
+
+	// Uniform grid over the mechs' bounding box, rebuilt every step: mech indices sorted by cell, and where each cell starts
+	FVector2D GridOrigin = FVector2D::ZeroVector;
+	float GridCellSize = 300.f;
+	FIntPoint GridSize = FIntPoint::ZeroValue;
+	TArray<int32> CellStarts;
+	TArray<int32> SortedMechs;
+	TArray<int32> MechCells;
+	bool bGridDirty = false;
+
+	/** Projectile actors in flight, each knowing its slot through HordeTraceIndex */
+	UPROPERTY(Transient)
+	TArray<AMechSurvivalProjectile*> Projectiles;
+
+	/** Frame the projectiles were last traced in; after a gap they only catch up with where they are */
+	uint64 LastProjectileTraceFrame = 0;
+
+	/** Demoted actors, kept around for the next promotion */
+	UPROPERTY(Transient)
+	TArray<AMechSurvivalMech*> SpareActors;
+
+	int32 NumPromoted = 0;
+
+	/** Owner of the instance component; null when mechs are not drawn */
+	UPROPERTY(Transient)
+	AActor* InstanceActor;
+
+	UPROPERTY(Transient)
+	UHierarchicalInstancedStaticMeshComponent* InstanceComponent;
+
+	/** Scratch buffer for instance transforms, kept to avoid reallocating every frame */
+	TArray<FTransform> InstanceTransforms;
+
+	double LastStepSeconds = 0.0;
+	int32 LastSteered = 0;
+};
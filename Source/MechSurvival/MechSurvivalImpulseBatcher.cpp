@@ -0,0 +1,359 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvival.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "PhysicsEngine/BodyInstance.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechImpulse, Log, All);
+
+static TAutoConsoleVariable<int32> CVarBatchImpulses(
+	TEXT("MechSurvival.Physics.BatchImpulses"),
+	1,
+	TEXT("1 merges hit impulses per body and writes them once before the physics step; 0 applies each one straight away, for comparison"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorld GDumpImpulsesCmd(
+	TEXT("MechSurvival.Physics.Dump"),
+	TEXT("Logs how many debris bodies are awake and how many impulses were merged, dropped or put to sleep"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalImpulseBatcher* Batcher = UMechSurvivalImpulseBatcher::Get(World))
+		{
+			Batcher->DumpStats();
+		}
+	}));
+
+void FMechSurvivalImpulseFlushTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Batcher != nullptr)
+	{
+		Batcher->Flush();
+	}
+}
+
+bool UMechSurvivalImpulseBatcher::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalImpulseBatcher::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UMechSurvivalImpulseBatcher::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UMechSurvivalImpulseBatcher::OnLevelRemoved);
+
+	// Ticks from the start, so that the levels' props are registered once play begins and kept under MaxAwakeDebris
+	RegisterFlushTick();
+}
+
+void UMechSurvivalImpulseBatcher::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	if (FlushTick.IsTickFunctionRegistered())
+	{
+		if (UWorld* World = GetWorld())
+		{
+			World->StartPhysicsTickFunction.RemovePrerequisite(this, FlushTick);
+		}
+		FlushTick.UnRegisterTickFunction();
+	}
+	FlushTick.Batcher = nullptr;
+
+	PendingImpulses.Empty();
+	PendingIndices.Empty();
+	Debris.Empty();
+	DebrisIndices.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalImpulseBatcher* UMechSurvivalImpulseBatcher::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalImpulseBatcher>() : nullptr;
+}
+
+void UMechSurvivalImpulseBatcher::AddImpulseAtLocation(UPrimitiveComponent* Component, const FVector& Impulse, const FVector& Location)
+{
+	UMechSurvivalImpulseBatcher* Batcher = CVarBatchImpulses.GetValueOnGameThread() != 0 ? Get(Component) : nullptr;
+	if (Batcher != nullptr)
+	{
+		Batcher->QueueImpulse(Component, Impulse, Location);
+	}
+	else
+	{
+		Component->AddImpulseAtLocation(Impulse, Location);
+	}
+}
+
+void UMechSurvivalImpulseBatcher::QueueImpulse(UPrimitiveComponent* Component, const FVector& Impulse, const FVector& Location)
+{
+	RegisterFlushTick();
+	++Stats.Queued;
+
+	const int32* ExistingIndex = PendingIndices.Find(Component);
+	if (ExistingIndex == nullptr)
+	{
+		PendingIndices.Add(Component, PendingImpulses.Num());
+
+		FPendingImpulse& Pending = PendingImpulses.AddDefaulted_GetRef();
+		Pending.Component = Component;
+		Pending.Impulse = Impulse;
+		Pending.Location = Location;
+		Pending.Moment = FVector::ZeroVector;
+		return;
+	}
+
+	// Moments are taken about the first hit, which keeps them small next to the body's size
+	FPendingImpulse& Pending = PendingImpulses[*ExistingIndex];
+	Pending.Impulse += Impulse;
+	Pending.Moment += (Location - Pending.Location) ^ Impulse;
+}
+
+void UMechSurvivalImpulseBatcher::RegisterFlushTick()
+{
+	if (FlushTick.IsTickFunctionRegistered())
+	{
+		return;
+	}
+
+	UWorld* World = GetWorld();
+	if (World == nullptr || World->PersistentLevel == nullptr)
+	{
+		return;
+	}
+
+	// In the physics group, so every pre-physics hit is in; the physics step waits for it
+	FlushTick.Batcher = this;
+	FlushTick.TickGroup = TG_StartPhysics;
+	FlushTick.bCanEverTick = true;
+	FlushTick.RegisterTickFunction(World->PersistentLevel);
+	World->StartPhysicsTickFunction.AddPrerequisite(this, FlushTick);
+}
+
+void UMechSurvivalImpulseBatcher::RegisterDebris(UPrimitiveComponent* Component)
+{
+	if (!IsValid(Component))
+	{
+		return;
+	}
+
+	FBodyInstance& Body = Component->BodyInstance;
+	Body.SleepFamily = ESleepFamily::Custom;
+	Body.CustomSleepThresholdMultiplier = DebrisSleepThresholdMultiplier;
+	Body.StabilizationThresholdMultiplier = DebrisStabilizationThresholdMultiplier;
+	Body.LinearDamping = DebrisLinearDamping;
+	Body.AngularDamping = DebrisAngularDamping;
+
+	// Thresholds are only read when the body is created
+	if (Component->IsPhysicsStateCreated())
+	{
+		Component->RecreatePhysicsState();
+	}
+
+	FindOrAddDebris(Component);
+	RegisterFlushTick();
+}
+
+int32 UMechSurvivalImpulseBatcher::FindOrAddDebris(UPrimitiveComponent* Component)
+{
+	if (const int32* ExistingIndex = DebrisIndices.Find(Component))
+	{
+		// A component that was collected since may have left its address to this one
+		Debris[*ExistingIndex].Component = Component;
+		return *ExistingIndex;
+	}
+
+	const int32 Index = Debris.Num();
+	FDebris& Entry = Debris.AddDefaulted_GetRef();
+	Entry.Component = Component;
+	Entry.Key = Component;
+	DebrisIndices.Add(Component, Index);
+	return Index;
+}
+
+void UMechSurvivalImpulseBatcher::Flush()
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(ImpulseFlush);
+
+	if (GetWorld()->HasBegunPlay())
+	{
+		TrackInitialLevels();
+	}
+
+	++FlushCount;
+
+	if (PendingImpulses.Num() > 0)
+	{
+		const float MinWakeImpulseSquared = FMath::Square(MinWakeImpulse);
+		int32 Writes = 0;
+
+		// One scene lock for every body rather than one per hit
+		FPhysicsCommand::ExecuteWrite(GetWorld()->GetPhysicsScene(), [this, MinWakeImpulseSquared, &Writes]()
+		{
+			for (const FPendingImpulse& Pending : PendingImpulses)
+			{
+				UPrimitiveComponent* Component = Pending.Component.Get();
+				FBodyInstance* Body = IsValid(Component) ? Component->GetBodyInstance() : nullptr;
+				if (Body == nullptr || !Body->IsInstanceSimulatingPhysics())
+				{
+					continue;
+				}
+
+				// Only registered debris are tracked; a body hit for the first time is pushed and left alone
+				const int32* DebrisIndex = DebrisIndices.Find(Component);
+				FDebris* Entry = DebrisIndex != nullptr && Debris[*DebrisIndex].Component.Get() == Component ? &Debris[*DebrisIndex] : nullptr;
+				if (Entry != nullptr && Pending.Impulse.SizeSquared() < MinWakeImpulseSquared && !Body->IsInstanceAwake())
+				{
+					++Stats.Suppressed;
+					continue;
+				}
+
+				// The same push and spin as each impulse at its own location
+				const FVector AngularImpulse = Pending.Moment + ((Pending.Location - Body->GetCOMPosition()) ^ Pending.Impulse);
+				Body->AddImpulse(Pending.Impulse, false);
+				Body->AddAngularImpulseInRadians(AngularImpulse, false);
+				if (Entry != nullptr)
+				{
+					Entry->LastImpulseFlush = FlushCount;
+				}
+				++Writes;
+			}
+		});
+
+		Stats.Writes += Writes;
+		MECHSURVIVAL_INC_COUNTER(ImpulseWrites, Writes);
+
+		PendingImpulses.Reset();
+		PendingIndices.Reset();
+	}
+
+	LimitAwakeDebris();
+}
+
+void UMechSurvivalImpulseBatcher::LimitAwakeDebris()
+{
+	// Forget destroyed props and ones that stopped simulating
+	const int32 NumDebris = Debris.Num();
+	Debris.RemoveAll([](const FDebris& Entry) { return !Entry.Component.IsValid() || !Entry.Component->IsSimulatingPhysics(); });
+	if (Debris.Num() != NumDebris)
+	{
+		RebuildDebrisIndices();
+	}
+
+	AwakeDebris.Reset();
+	for (int32 Index = 0; Index < Debris.Num(); ++Index)
+	{
+		const FBodyInstance* Body = Debris[Index].Component->GetBodyInstance();
+		if (Body != nullptr && Body->IsInstanceAwake())
+		{
+			AwakeDebris.Emplace(Index, Body->GetUnrealWorldVelocity().SizeSquared());
+		}
+	}
+	NumAwakeDebris = AwakeDebris.Num();
+
+	if (MaxAwakeDebris > 0 && NumAwakeDebris > MaxAwakeDebris)
+	{
+		// Slowest first; they are the nearest to settling anyway
+		AwakeDebris.Sort([](const TPair<int32, float>& A, const TPair<int32, float>& B) { return A.Value < B.Value; });
+
+		for (const TPair<int32, float>& Awake : AwakeDebris)
+		{
+			if (NumAwakeDebris <= MaxAwakeDebris)
+			{
+				break;
+			}
+
+			FDebris& Entry = Debris[Awake.Key];
+			if (Entry.LastImpulseFlush != FlushCount)
+			{
+				Entry.Component->PutAllRigidBodiesToSleep();
+				--NumAwakeDebris;
+				++Stats.PutToSleep;
+				MECHSURVIVAL_INC_COUNTER(DebrisPutToSleep, 1);
+			}
+		}
+	}
+
+	MECHSURVIVAL_SET_LEVEL(AwakeDebris, NumAwakeDebris);
+}
+
+void UMechSurvivalImpulseBatcher::RebuildDebrisIndices()
+{
+	DebrisIndices.Reset();
+	for (int32 Index = 0; Index < Debris.Num(); ++Index)
+	{
+		DebrisIndices.Add(Debris[Index].Key, Index);
+	}
+}
+
+void UMechSurvivalImpulseBatcher::TrackInitialLevels()
+{
+	if (bTrackedInitialLevels)
+	{
+		return;
+	}
+
+	bTrackedInitialLevels = true;
+	for (ULevel* Level : GetWorld()->GetLevels())
+	{
+		if (Level != nullptr && Level->bIsVisible)
+		{
+			RegisterLevelProps(Level);
+		}
+	}
+}
+
+void UMechSurvivalImpulseBatcher::RegisterLevelProps(ULevel* Level)
+{
+	TArray<UPrimitiveComponent*> LevelProps;
+	MechSurvivalProps::GetSimulatingProps(Level, LevelProps);
+	for (UPrimitiveComponent* Prop : LevelProps)
+	{
+		RegisterDebris(Prop);
+	}
+}
+
+void UMechSurvivalImpulseBatcher::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	// Levels there at the start are registered together once play begins
+	if (World == GetWorld() && Level != nullptr && bTrackedInitialLevels)
+	{
+		RegisterLevelProps(Level);
+	}
+}
+
+void UMechSurvivalImpulseBatcher::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+
+	// No level means every level is going
+	const int32 NumRemoved = Debris.RemoveAll([Level](const FDebris& Entry)
+	{
+		const UPrimitiveComponent* Component = Entry.Component.Get();
+		return Level == nullptr || Component == nullptr || Component->GetComponentLevel() == Level;
+	});
+	if (NumRemoved > 0)
+	{
+		RebuildDebrisIndices();
+	}
+}
+
+void UMechSurvivalImpulseBatcher::DumpStats() const
+{
+	UE_LOG(LogMechImpulse, Log, TEXT("%d debris bodies, %d awake (at most %d); %d impulses merged into %d writes, %d too weak to wake a body, %d bodies put to sleep; batching %s"),
+		Debris.Num(), NumAwakeDebris, MaxAwakeDebris, Stats.Queued, Stats.Writes, Stats.Suppressed, Stats.PutToSleep,
+		CVarBatchImpulses.GetValueOnGameThread() != 0 ? TEXT("on") : TEXT("off"));
+}
@@ -0,0 +1,173 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "MechSurvivalImpulseBatcher.generated.h"
+
+class ULevel;
+class UPrimitiveComponent;
+
+/** Counts since the world started, for the benchmark and the dump */
+struct FMechSurvivalImpulseStats
+{
+	/** Impulses handed to the batcher */
+	int32 Queued = 0;
+	/** Body writes they were merged into */
+	int32 Writes = 0;
+	/** Merged impulses too weak to wake a sleeping debris body, dropped */
+	int32 Suppressed = 0;
+	/** Debris bodies put to sleep to stay under MaxAwakeDebris */
+	int32 PutToSleep = 0;
+};
+
+/** Applies the queued impulses between the last pre-physics tick and the physics step */
+struct FMechSurvivalImpulseFlushTickFunction : public FTickFunction
+{
+	class UMechSurvivalImpulseBatcher* Batcher = nullptr;
+
+	// FTickFunction interface
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override { return TEXT("MechSurvivalImpulseBatcher flush"); }
+	// End of FTickFunction interface
+};
+
+/**
+ * Gathers the impulses of projectile and round hits per body and writes them to the physics scene once per frame.
+ *
+ * Every impulse queued during a frame is merged into one linear and one angular impulse per body, which add up to
+ * exactly what the separate impulses at their hit locations would have done, and all bodies are written under one
+ * scene lock just before the physics step. A sleeping debris body is only woken if its merged impulse reaches
+ * MinWakeImpulse, so stray rounds do not keep a settled pile awake.
+ *
+ * Debris are the simulating props placed in the levels, registered as play begins and as levels stream in and dropped
+ * as they stream out, and whatever else is registered with RegisterDebris; other bodies take their impulses and are
+ * otherwise left alone. Debris get sleep and stabilization thresholds raised by the Debris multipliers and some
+ * damping, so that they settle sooner. Whenever more than MaxAwakeDebris are awake, the slowest of those not hit this
+ * frame are put to sleep.
+ */
+UCLASS(config=Game)
+class UMechSurvivalImpulseBatcher : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	/** Returns the impulse batcher of the world the context object lives in, if any */
+	static UMechSurvivalImpulseBatcher* Get(const UObject* WorldContextObject);
+
+	/**
+	 * Pushes a simulating component at a location, like UPrimitiveComponent::AddImpulseAtLocation.
+	 * Queued for the next flush when the component's world has a batcher and batching is on; applied right away otherwise.
+	 */
+	static void AddImpulseAtLocation(UPrimitiveComponent* Component, const FVector& Impulse, const FVector& Location);
+
+	/** Gives a simulating prop debris sleep, stabilization and damping settings and counts it against MaxAwakeDebris */
+	void RegisterDebris(UPrimitiveComponent* Component);
+
+	/** Writes the queued impulses to the physics scene and enforces MaxAwakeDebris */
+	void Flush();
+
+	/** Debris bodies awake at the last flush */
+	int32 GetNumAwakeDebris() const { return NumAwakeDebris; }
+
+	const FMechSurvivalImpulseStats& GetStats() const { return Stats; }
+
+	/** Writes the debris counts and impulse counts to the log */
+	void DumpStats() const;
+
+protected:
+	/** Merged impulse, in kg cm/s, below which a sleeping debris body is left asleep */
+	UPROPERTY(config)
+	float MinWakeImpulse = 50000.f;
+
+	/** Debris bodies allowed to be awake at once; 0 for no limit */
+	UPROPERTY(config)
+	int32 MaxAwakeDebris = 256;
+
+	/** Scales the energy below which registered debris falls asleep */
+	UPROPERTY(config)
+	float DebrisSleepThresholdMultiplier = 4.f;
+
+	/** Scales the energy below which registered debris is stabilized, when the scene has stabilization on */
+	UPROPERTY(config)
+	float DebrisStabilizationThresholdMultiplier = 4.f;
+
+	UPROPERTY(config)
+	float DebrisLinearDamping = 0.2f;
+
+	UPROPERTY(config)
+	float DebrisAngularDamping = 0.5f;
+
+private:
+	/** Impulses queued for one body this frame */
+	struct FPendingImpulse
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		FVector Impulse;
+		/** Location of the first impulse */
+		FVector Location;
+		/** Sum of each impulse's moment about Location, for the angular impulse about the centre of mass */
+		FVector Moment;
+	};
+
+	struct FDebris
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		/** Key in DebrisIndices; never dereferenced, the component may be gone */
+		const UPrimitiveComponent* Key = nullptr;
+		/** Flush that last wrote an impulse to it; those are never put to sleep */
+		uint32 LastImpulseFlush = 0;
+	};
+
+	void QueueImpulse(UPrimitiveComponent* Component, const FVector& Impulse, const FVector& Location);
+
+	/** Starts the flush tick, before the physics step of the world */
+	void RegisterFlushTick();
+
+	/** Index of a component in Debris, adding it if needed */
+	int32 FindOrAddDebris(UPrimitiveComponent* Component);
+
+	/** Puts the slowest awake debris to sleep until no more than MaxAwakeDebris are awake */
+	void LimitAwakeDebris();
+
+	/** Rebuilds DebrisIndices after entries were removed from Debris */
+	void RebuildDebrisIndices();
+
+	/** Registers or drops the simulating props of a level as it is added to or removed from the world */
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	/** Registers the simulating props of the levels already loaded; those added later are registered as they come */
+	void TrackInitialLevels();
+	void RegisterLevelProps(ULevel* Level);
+
+	FMechSurvivalImpulseFlushTickFunction FlushTick;
+
+	TArray<FPendingImpulse> PendingImpulses;
+	TMap<UPrimitiveComponent*, int32> PendingIndices;
+
+	TArray<FDebris> Debris;
+	TMap<const UPrimitiveComponent*, int32> DebrisIndices;
+
+	/** Scratch for LimitAwakeDebris: debris index and squared speed of the awake bodies */
+	TArray<TPair<int32, float>> AwakeDebris;
+
+	uint32 FlushCount = 0;
+	int32 NumAwakeDebris = 0;
+
+	/** True once the props of the levels loaded at the start are registered */
+	bool bTrackedInitialLevels = false;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	FMechSurvivalImpulseStats Stats;
+};
@@ -0,0 +1,331 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalLagCompensation.h"
+#include "MechSurvival.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLagCompensation, Log, All);
+
+bool UMechSurvivalLagCompensation::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalLagCompensation::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	MaxSamples = FMath::Max(MaxSamples, 2);
+	SampleTimes.SetNumZeroed(MaxSamples);
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UMechSurvivalLagCompensation::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UMechSurvivalLagCompensation::OnLevelRemoved);
+}
+
+void UMechSurvivalLagCompensation::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	Targets.Empty();
+	SampleTimes.Empty();
+	NumSamples = 0;
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalLagCompensation* UMechSurvivalLagCompensation::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalLagCompensation>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalLagCompensation::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalLagCompensation::IsTickable() const
+{
+	// Only a server ever rewinds; it ticks once before any target shows up to register the levels' props
+	return (Targets.Num() > 0 || !bTrackedInitialLevels) && IsServer();
+}
+
+bool UMechSurvivalLagCompensation::IsServer() const
+{
+	const UWorld* World = GetWorld();
+	return World != nullptr && (World->GetNetMode() == NM_DedicatedServer || World->GetNetMode() == NM_ListenServer);
+}
+
+TStatId UMechSurvivalLagCompensation::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalLagCompensation, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalLagCompensation::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalLagCompensation::Tick(float DeltaTime)
+{
+	if (!GetWorld()->HasBegunPlay())
+	{
+		return;
+	}
+
+	TrackInitialLevels();
+	if (Targets.Num() == 0)
+	{
+		return;
+	}
+
+	RecordSample(GetWorld()->GetTimeSeconds());
+	UpdateStats(DeltaTime);
+}
+
+bool UMechSurvivalLagCompensation::RegisterTarget(UPrimitiveComponent* Component)
+{
+	if (Component == nullptr || Targets.ContainsByPredicate([Component](const FTarget& Target) { return Target.Component == Component; }))
+	{
+		return true;
+	}
+
+	const int32 BytesPerTarget = MaxSamples * sizeof(FVector);
+	if (GetHistoryBytes() + BytesPerTarget > MaxMemoryBytes)
+	{
+		// A level full of props would otherwise log one line per prop
+		UE_CLOG(!bWarnedBudget, LogLagCompensation, Warning, TEXT("History budget of %d bytes used up, %s and whatever registers after it will not be lag compensated"), MaxMemoryBytes, *GetPathNameSafe(Component));
+		bWarnedBudget = true;
+		return false;
+	}
+
+	FTarget& Target = Targets.AddDefaulted_GetRef();
+	Target.Component = Component;
+	if (const UCapsuleComponent* Capsule = Cast<UCapsuleComponent>(Component))
+	{
+		Target.Radius = Capsule->GetScaledCapsuleRadius();
+		Target.HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+	}
+	else
+	{
+		Target.Radius = Component->Bounds.SphereRadius;
+		Target.HalfHeight = 0.f;
+	}
+
+	// Until real samples come in, assume it has always been where it is now
+	const FVector Location = Target.HalfHeight > 0.f ? Component->GetComponentLocation() : Component->Bounds.Origin;
+	Target.Locations.Init(Location, MaxSamples);
+
+	return true;
+}
+
+void UMechSurvivalLagCompensation::UnregisterTarget(UPrimitiveComponent* Component)
+{
+	Targets.RemoveAllSwap([Component](const FTarget& Target) { return Target.Component == Component; });
+}
+
+float UMechSurvivalLagCompensation::GetRewindSeconds(float Timestamp) const
+{
+	const UWorld* World = GetWorld();
+	return World ? FMath::Clamp(World->GetTimeSeconds() - Timestamp, 0.f, MaxRewindSeconds) : 0.f;
+}
+
+int32 UMechSurvivalLagCompensation::GetHistoryBytes() const
+{
+	return SampleTimes.Num() * sizeof(float) + Targets.Num() * MaxSamples * sizeof(FVector);
+}
+
+void UMechSurvivalLagCompensation::RecordSample(float Time)
+{
+	const int32 Slot = NextSample;
+	SampleTimes[Slot] = Time;
+	NextSample = (NextSample + 1) % MaxSamples;
+	NumSamples = FMath::Min(NumSamples + 1, MaxSamples);
+
+	for (int32 Index = Targets.Num() - 1; Index >= 0; --Index)
+	{
+		FTarget& Target = Targets[Index];
+		const UPrimitiveComponent* Component = Target.Component.Get();
+		if (Component == nullptr)
+		{
+			Targets.RemoveAtSwap(Index, 1, false);
+			continue;
+		}
+		Target.Locations[Slot] = Target.HalfHeight > 0.f ? Component->GetComponentLocation() : Component->Bounds.Origin;
+	}
+}
+
+void UMechSurvivalLagCompensation::FindSamples(float Time, int32& OutOlder, int32& OutNewer, float& OutAlpha) const
+{
+	// Walk from the newest slot back in time; the ring holds at most MaxSamples entries
+	const int32 Newest = (NextSample - 1 + MaxSamples) % MaxSamples;
+	OutOlder = Newest;
+	OutNewer = Newest;
+	OutAlpha = 0.f;
+
+	if (Time >= SampleTimes[Newest])
+	{
+		return;
+	}
+
+	for (int32 Step = 1; Step < NumSamples; ++Step)
+	{
+		const int32 Slot = (Newest - Step + MaxSamples) % MaxSamples;
+		OutNewer = OutOlder;
+		OutOlder = Slot;
+		if (SampleTimes[Slot] <= Time)
+		{
+			const float Span = SampleTimes[OutNewer] - SampleTimes[OutOlder];
+			OutAlpha = Span > KINDA_SMALL_NUMBER ? (Time - SampleTimes[OutOlder]) / Span : 0.f;
+			return;
+		}
+	}
+
+	// Older than anything recorded: use the oldest sample
+	OutNewer = OutOlder;
+	OutAlpha = 0.f;
+}
+
+bool UMechSurvivalLagCompensation::RewindSweep(float Timestamp, const FVector& Start, const FVector& End, float Radius, const AActor* IgnoreActor, FMechSurvivalRewindHit& OutHit)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(RewindQuery);
+	MECHSURVIVAL_INC_COUNTER(RewindQueries, 1);
+	++QueriesThisSecond;
+
+	const UWorld* World = GetWorld();
+	if (World == nullptr || NumSamples == 0)
+	{
+		return false;
+	}
+
+	int32 Older, Newer;
+	float Alpha;
+	FindSamples(World->GetTimeSeconds() - GetRewindSeconds(Timestamp), Older, Newer, Alpha);
+
+	const FVector Segment = End - Start;
+	const float SegmentSizeSquared = Segment.SizeSquared();
+	const float SegmentSize = FMath::Sqrt(SegmentSizeSquared);
+
+	OutHit = FMechSurvivalRewindHit();
+	bool bHit = false;
+
+	for (const FTarget& Target : Targets)
+	{
+		UPrimitiveComponent* Component = Target.Component.Get();
+		if (Component == nullptr || (IgnoreActor != nullptr && Component->GetOwner() == IgnoreActor))
+		{
+			continue;
+		}
+
+		const FVector Center = FMath::Lerp(Target.Locations[Older], Target.Locations[Newer], Alpha);
+		const float HitRadius = Target.Radius + Radius;
+		const float AxisHalfLength = FMath::Max(Target.HalfHeight - Target.Radius, 0.f);
+
+		// Bounding sphere first, most targets are nowhere near the shot
+		if (FMath::PointDistToSegmentSquared(Center, Start, End) > FMath::Square(HitRadius + AxisHalfLength))
+		{
+			continue;
+		}
+
+		FVector OnSegment, OnAxis;
+		FMath::SegmentDistToSegmentSafe(Start, End, Center - FVector(0.f, 0.f, AxisHalfLength), Center + FVector(0.f, 0.f, AxisHalfLength), OnSegment, OnAxis);
+		const float DistanceSquared = FVector::DistSquared(OnSegment, OnAxis);
+		if (DistanceSquared > FMath::Square(HitRadius))
+		{
+			continue;
+		}
+
+		// Back off from the closest approach to where the sphere first touched the shape
+		float Time = 0.f;
+		if (SegmentSizeSquared > KINDA_SMALL_NUMBER)
+		{
+			const float ClosestTime = ((OnSegment - Start) | Segment) / SegmentSizeSquared;
+			const float Penetration = FMath::Sqrt(FMath::Square(HitRadius) - DistanceSquared) / SegmentSize;
+			Time = FMath::Max(ClosestTime - Penetration, 0.f);
+		}
+
+		if (!bHit || Time < OutHit.Time)
+		{
+			bHit = true;
+			OutHit.Component = Component;
+			OutHit.Time = Time;
+			OutHit.Location = Start + Segment * Time;
+		}
+	}
+
+	return bHit;
+}
+
+void UMechSurvivalLagCompensation::TrackInitialLevels()
+{
+	if (bTrackedInitialLevels)
+	{
+		return;
+	}
+
+	bTrackedInitialLevels = true;
+	for (ULevel* Level : GetWorld()->GetLevels())
+	{
+		if (Level != nullptr && Level->bIsVisible)
+		{
+			RegisterLevelProps(Level);
+		}
+	}
+}
+
+void UMechSurvivalLagCompensation::RegisterLevelProps(ULevel* Level)
+{
+	TArray<UPrimitiveComponent*> LevelProps;
+	MechSurvivalProps::GetSimulatingProps(Level, LevelProps);
+	for (UPrimitiveComponent* Prop : LevelProps)
+	{
+		if (!RegisterTarget(Prop))
+		{
+			break;
+		}
+	}
+}
+
+void UMechSurvivalLagCompensation::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	// Levels there at the start are registered together once play begins
+	if (World == GetWorld() && Level != nullptr && bTrackedInitialLevels && IsServer())
+	{
+		RegisterLevelProps(Level);
+	}
+}
+
+void UMechSurvivalLagCompensation::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+
+	// No level means every level is going; characters live in the persistent level and go with it
+	Targets.RemoveAllSwap([Level](const FTarget& Target)
+	{
+		const UPrimitiveComponent* Component = Target.Component.Get();
+		return Level == nullptr || Component == nullptr || Component->GetComponentLevel() == Level;
+	});
+}
+
+void UMechSurvivalLagCompensation::UpdateStats(float DeltaTime)
+{
+	StatsTime += DeltaTime;
+	if (StatsTime < 1.f)
+	{
+		return;
+	}
+
+	MECHSURVIVAL_SET_LEVEL(RewindQueriesPerSecond, FMath::RoundToInt(QueriesThisSecond / StatsTime));
+	MECHSURVIVAL_SET_LEVEL(RewindHistoryBytes, GetHistoryBytes());
+
+	QueriesThisSecond = 0;
+	StatsTime = 0.f;
+}
@@ -0,0 +1,147 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalLagCompensation.generated.h"
+
+class ULevel;
+class UPrimitiveComponent;
+
+/** Result of a rewound hit test */
+struct FMechSurvivalRewindHit
+{
+	/** Component that was hit, as it stood at the rewound time */
+	UPrimitiveComponent* Component = nullptr;
+
+	/** Where along the tested segment the hit happened */
+	FVector Location = FVector::ZeroVector;
+
+	/** Fraction of the tested segment travelled before the hit */
+	float Time = 1.f;
+};
+
+/**
+ * Server-side history of where shootable things were, so that a client's shot can be checked against the world
+ * the client saw when it fired rather than the one the server has by the time the shot arrives.
+ *
+ * Every registered component is sampled once per server frame into a fixed-size ring of locations; all targets share
+ * the ring's timestamps. Characters are tested as upright capsules and everything else as bounding spheres, so
+ * rotation is not stored. History length is bounded by MaxRewindSeconds and MaxSamples, and the number of targets by
+ * MaxMemoryBytes. Characters register themselves; the physics props placed in the levels are picked up as the levels
+ * come and go, since a prop knocked about by the horde moves as much as a mech does.
+ */
+UCLASS(config=Game)
+class UMechSurvivalLagCompensation : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the lag compensation of the world the context object lives in, if any */
+	static UMechSurvivalLagCompensation* Get(const UObject* WorldContextObject);
+
+	/** Starts recording a component; returns false if the memory budget is used up */
+	bool RegisterTarget(UPrimitiveComponent* Component);
+
+	/** Stops recording a component */
+	void UnregisterTarget(UPrimitiveComponent* Component);
+
+	/** Returns how far back a shot fired at Timestamp gets rewound, after clamping to the window */
+	float GetRewindSeconds(float Timestamp) const;
+
+	/**
+	 * Sweeps a sphere along a segment against the targets as they were at Timestamp.
+	 *
+	 * @param	Timestamp		Server world time to rewind to; clamped to the recorded window
+	 * @param	Start			Segment start
+	 * @param	End				Segment end
+	 * @param	Radius			Radius of the swept sphere
+	 * @param	IgnoreActor		Actor whose components are never hit, usually the shooter
+	 * @param	OutHit			Closest hit along the segment
+	 * @returns true if something was hit.
+	 */
+	bool RewindSweep(float Timestamp, const FVector& Start, const FVector& End, float Radius, const AActor* IgnoreActor, FMechSurvivalRewindHit& OutHit);
+
+	/** Bytes currently used by the location history */
+	int32 GetHistoryBytes() const;
+
+protected:
+	/** Furthest a shot may be rewound */
+	UPROPERTY(config)
+	float MaxRewindSeconds = 0.25f;
+
+	/** Length of the history ring; covers MaxRewindSeconds down to MaxSamples / MaxRewindSeconds server ticks per second */
+	UPROPERTY(config)
+	int32 MaxSamples = 32;
+
+	/** Upper bound for the memory of the location history */
+	UPROPERTY(config)
+	int32 MaxMemoryBytes = 1024 * 1024;
+
+private:
+	/** A recorded component, with its shape captured at registration */
+	struct FTarget
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		float Radius;
+		/** Zero for spheres */
+		float HalfHeight;
+		/** One location per history slot, indexed like SampleTimes */
+		TArray<FVector> Locations;
+	};
+
+	/** Records the current location of every target into the next history slot */
+	void RecordSample(float Time);
+
+	/** Finds the two history slots around Time and the blend between them */
+	void FindSamples(float Time, int32& OutOlder, int32& OutNewer, float& OutAlpha) const;
+
+	/** Publishes the query rate and memory stats once a second */
+	void UpdateStats(float DeltaTime);
+
+	/** Starts or stops recording the simulating props of a level as it is added to or removed from the world */
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	/** Registers the simulating props of the levels already loaded; those added later are registered as they come */
+	void TrackInitialLevels();
+	void RegisterLevelProps(ULevel* Level);
+
+	/** True on listen and dedicated servers, the only ones that rewind */
+	bool IsServer() const;
+
+	/** True once the props of the levels loaded at the start are registered */
+	bool bTrackedInitialLevels = false;
+
+	/** The history budget has run out once already; it is only reported the first time */
+	bool bWarnedBudget = false;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	TArray<FTarget> Targets;
+
+	/** Timestamps of the history slots, a ring written at NextSample */
+	TArray<float> SampleTimes;
+	int32 NextSample = 0;
+	int32 NumSamples = 0;
+
+	int32 QueriesThisSecond = 0;
+	float StatsTime = 0.f;
+};
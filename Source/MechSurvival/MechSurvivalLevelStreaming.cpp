@@ -0,0 +1,408 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalLevelStreaming.h"
+#include "MechSurvival.h"
+#include "MechSurvivalDeterminism.h"
+#include "Engine/LevelStreaming.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechStreaming, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpStreamingCmd(
+	TEXT("MechSurvival.Streaming.Dump"),
+	TEXT("Logs the arena cells that are loaded and the loads, unloads and hitches so far"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalLevelStreaming* Streaming = UMechSurvivalLevelStreaming::Get(World))
+		{
+			Streaming->DumpStats();
+		}
+	}));
+
+/** Reads X and Y out of a level named <Anything>_Cell_<X>_<Y> */
+static bool ParseCellCoordinates(const FString& LevelName, FIntPoint& OutCoordinates)
+{
+	static const FString Marker(TEXT("_Cell_"));
+	const int32 MarkerIndex = LevelName.Find(Marker, ESearchCase::IgnoreCase, ESearchDir::FromEnd);
+	if (MarkerIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	FString X;
+	FString Y;
+	if (!LevelName.Mid(MarkerIndex + Marker.Len()).Split(TEXT("_"), &X, &Y) || !X.IsNumeric() || !Y.IsNumeric())
+	{
+		return false;
+	}
+
+	OutCoordinates = FIntPoint(FCString::Atoi(*X), FCString::Atoi(*Y));
+	return true;
+}
+
+/** Sets an engine time limit, in ms, if this engine has it */
+static void SetStreamingBudget(const TCHAR* Name, float Milliseconds)
+{
+	if (Milliseconds <= 0.f)
+	{
+		return;
+	}
+
+	if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(Name))
+	{
+		Variable->Set(Milliseconds, ECVF_SetByGameSetting);
+	}
+	else
+	{
+		UE_LOG(LogMechStreaming, Warning, TEXT("%s does not exist, its streaming budget is not applied"), Name);
+	}
+}
+
+bool UMechSurvivalLevelStreaming::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalLevelStreaming::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	StartSeconds = FPlatformTime::Seconds();
+}
+
+void UMechSurvivalLevelStreaming::Deinitialize()
+{
+	if (Cells.Num() > 0)
+	{
+		DumpStats();
+		WriteReport();
+	}
+
+	Cells.Empty();
+	Sources.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalLevelStreaming* UMechSurvivalLevelStreaming::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalLevelStreaming>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalLevelStreaming::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalLevelStreaming::IsTickable() const
+{
+	const UWorld* World = GetWorld();
+	return World != nullptr && (Cells.Num() > 0 || World->GetStreamingLevels().Num() != NumGatheredStreamingLevels);
+}
+
+TStatId UMechSurvivalLevelStreaming::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalLevelStreaming, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalLevelStreaming::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalLevelStreaming::Tick(float DeltaTime)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(LevelStreamingUpdate);
+
+	// Hitches are felt in wall time, whatever the game's time step
+	const double Now = FPlatformTime::Seconds();
+	const double FrameMilliseconds = LastTickSeconds > 0.0 ? (Now - LastTickSeconds) * 1000.0 : 0.0;
+	LastTickSeconds = Now;
+
+	const UWorld* World = GetWorld();
+	if (World->GetStreamingLevels().Num() != NumGatheredStreamingLevels)
+	{
+		GatherCells();
+	}
+	if (Cells.Num() == 0)
+	{
+		return;
+	}
+
+	// Decisions go by game time, so that pause and time dilation hold streaming back like the rest of the gameplay, and
+	// a deterministic replay streams the same cells on the same ticks
+	const double GameSeconds = World->GetTimeSeconds();
+	if (GameSeconds >= NextUpdateSeconds)
+	{
+		NextUpdateSeconds = GameSeconds + UpdateInterval;
+
+		UpdateSources();
+
+		// Without anybody to stream around, everything stays where it was
+		if (Sources.Num() > 0)
+		{
+			UpdateCells();
+		}
+
+		Stats.PeakUsedPhysical = FMath::Max<uint64>(Stats.PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical);
+	}
+
+	UpdateStats(FrameMilliseconds);
+}
+
+void UMechSurvivalLevelStreaming::GatherCells()
+{
+	const UWorld* World = GetWorld();
+	const TArray<ULevelStreaming*>& StreamingLevels = World->GetStreamingLevels();
+	NumGatheredStreamingLevels = StreamingLevels.Num();
+
+	const bool bHadCells = Cells.Num() > 0;
+	const bool bBlockOnLoad = UMechSurvivalDeterminism::IsDeterministicRun();
+
+	Cells.Reset();
+	for (ULevelStreaming* Level : StreamingLevels)
+	{
+		FIntPoint Coordinates;
+		if (Level == nullptr || !ParseCellCoordinates(FPackageName::GetShortName(Level->GetWorldAssetPackageFName()), Coordinates))
+		{
+			continue;
+		}
+
+		FCell& Cell = Cells.AddDefaulted_GetRef();
+		Cell.Level = Level;
+		Cell.Coordinates = Coordinates;
+		const FVector2D Corner = GridOrigin + FVector2D(Coordinates) * CellSize;
+		Cell.Bounds = FBox2D(Corner, Corner + FVector2D(CellSize, CellSize));
+		Cell.bWanted = Level->ShouldBeLoaded();
+
+		// A replay has to find the same cells in place on the same tick as the recording
+		Level->bShouldBlockOnLoad = bBlockOnLoad;
+	}
+
+	if (Cells.Num() > 0 && !bHadCells)
+	{
+		UE_LOG(LogMechStreaming, Log, TEXT("Streaming %d cells of %.0f cm around the players"), Cells.Num(), CellSize);
+		ApplyBudgets();
+	}
+}
+
+void UMechSurvivalLevelStreaming::ApplyBudgets() const
+{
+	SetStreamingBudget(TEXT("s.LevelStreamingActorsUpdateTimeLimit"), AddToWorldBudgetMilliseconds);
+	SetStreamingBudget(TEXT("s.UnregisterComponentsTimeLimit"), RemoveFromWorldBudgetMilliseconds);
+	SetStreamingBudget(TEXT("s.AsyncLoadingTimeLimit"), AsyncLoadingBudgetMilliseconds);
+}
+
+void UMechSurvivalLevelStreaming::UpdateSources()
+{
+	Sources.Reset();
+
+	const UWorld* World = GetWorld();
+	const bool bIsServer = World->GetNetMode() != NM_Client;
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController == nullptr || !(bIsServer || PlayerController->IsLocalController()))
+		{
+			continue;
+		}
+
+		if (const APawn* Pawn = PlayerController->GetPawn())
+		{
+			const FVector Location = Pawn->GetActorLocation();
+			Sources.Add(FVector2D(Location));
+
+			const FVector Velocity = Pawn->GetVelocity();
+			if (LookaheadSeconds > 0.f && !Velocity.IsNearlyZero())
+			{
+				Sources.Add(FVector2D(Location + Velocity * LookaheadSeconds));
+			}
+		}
+		else if (PlayerController->IsLocalController())
+		{
+			// Waiting to spawn or spectating: stream around the camera
+			FVector Location;
+			FRotator Rotation;
+			PlayerController->GetPlayerViewPoint(Location, Rotation);
+			Sources.Add(FVector2D(Location));
+		}
+	}
+}
+
+void UMechSurvivalLevelStreaming::UpdateCells()
+{
+	const float LoadRadiusSquared = FMath::Square(LoadRadius);
+	const float UnloadRadiusSquared = FMath::Square(FMath::Max(UnloadRadius, LoadRadius));
+
+	TArray<int32, TInlineAllocator<16>> ToLoad;
+	TArray<int32, TInlineAllocator<16>> ToUnload;
+	int32 NumPending = 0;
+
+	for (int32 Index = 0; Index < Cells.Num(); ++Index)
+	{
+		FCell& Cell = Cells[Index];
+		if (!Cell.Level.IsValid())
+		{
+			continue;
+		}
+
+		float DistanceSquared = MAX_flt;
+		for (const FVector2D& Source : Sources)
+		{
+			DistanceSquared = FMath::Min(DistanceSquared, Cell.Bounds.ComputeSquaredDistanceToPoint(Source));
+		}
+		Cell.DistanceSquared = DistanceSquared;
+
+		if (Cell.bWanted)
+		{
+			if (IsCellPending(Cell))
+			{
+				++NumPending;
+			}
+			if (DistanceSquared > UnloadRadiusSquared)
+			{
+				ToUnload.Add(Index);
+			}
+		}
+		else if (DistanceSquared <= LoadRadiusSquared)
+		{
+			ToLoad.Add(Index);
+		}
+	}
+
+	// Nearest cells in first, furthest out first
+	ToLoad.Sort([this](int32 A, int32 B) { return Cells[A].DistanceSquared < Cells[B].DistanceSquared; });
+	ToUnload.Sort([this](int32 A, int32 B) { return Cells[A].DistanceSquared > Cells[B].DistanceSquared; });
+
+	const int32 NumLoads = FMath::Max(0, FMath::Min3(ToLoad.Num(), MaxLoadsPerUpdate, MaxPendingLoads - NumPending));
+	for (int32 Load = 0; Load < NumLoads; ++Load)
+	{
+		SetCellWanted(Cells[ToLoad[Load]], true);
+	}
+
+	const int32 NumUnloads = FMath::Min(ToUnload.Num(), MaxUnloadsPerUpdate);
+	for (int32 Unload = 0; Unload < NumUnloads; ++Unload)
+	{
+		SetCellWanted(Cells[ToUnload[Unload]], false);
+	}
+}
+
+void UMechSurvivalLevelStreaming::SetCellWanted(FCell& Cell, bool bWanted)
+{
+	ULevelStreaming* Level = Cell.Level.Get();
+	Cell.bWanted = bWanted;
+	Level->SetShouldBeLoaded(bWanted);
+	Level->SetShouldBeVisible(bWanted);
+	bStreamedLastFrame = true;
+
+	if (bWanted)
+	{
+		++Stats.Loads;
+	}
+	else
+	{
+		++Stats.Unloads;
+	}
+
+	UE_LOG(LogMechStreaming, Verbose, TEXT("%s cell %d, %d, %.0f cm away"), bWanted ? TEXT("Loading") : TEXT("Unloading"),
+		Cell.Coordinates.X, Cell.Coordinates.Y, FMath::Sqrt(Cell.DistanceSquared));
+}
+
+bool UMechSurvivalLevelStreaming::IsCellPending(const FCell& Cell)
+{
+	const ULevelStreaming* Level = Cell.Level.Get();
+	return Level != nullptr && (Cell.bWanted ? !Level->IsLevelVisible() : Level->IsLevelLoaded());
+}
+
+int32 UMechSurvivalLevelStreaming::GetNumVisibleCells() const
+{
+	int32 NumVisible = 0;
+	for (const FCell& Cell : Cells)
+	{
+		if (Cell.Level.IsValid() && Cell.Level->IsLevelVisible())
+		{
+			++NumVisible;
+		}
+	}
+	return NumVisible;
+}
+
+void UMechSurvivalLevelStreaming::UpdateStats(double FrameMilliseconds)
+{
+	bool bAnyPending = false;
+	int32 NumLoaded = 0;
+	for (const FCell& Cell : Cells)
+	{
+		bAnyPending |= IsCellPending(Cell);
+		if (Cell.Level.IsValid() && Cell.Level->IsLevelLoaded())
+		{
+			++NumLoaded;
+		}
+	}
+
+	// The frame a cell finished in counts too, as adding it to the world is what usually takes long
+	if ((bAnyPending || bStreamedLastFrame) && FrameMilliseconds > HitchMilliseconds)
+	{
+		++Stats.Hitches;
+		Stats.WorstHitchMilliseconds = FMath::Max(Stats.WorstHitchMilliseconds, (float)FrameMilliseconds);
+		MECHSURVIVAL_INC_COUNTER(StreamingHitches, 1);
+	}
+	bStreamedLastFrame = bAnyPending;
+
+	Stats.PeakLoadedCells = FMath::Max(Stats.PeakLoadedCells, NumLoaded);
+	MECHSURVIVAL_SET_LEVEL(LoadedCells, NumLoaded);
+
+	if (TimeToPlayableSeconds >= 0.0 || Sources.Num() == 0)
+	{
+		return;
+	}
+
+	const float LoadRadiusSquared = FMath::Square(LoadRadius);
+	for (const FCell& Cell : Cells)
+	{
+		if (Cell.Level.IsValid() && Cell.DistanceSquared <= LoadRadiusSquared && !(Cell.bWanted && Cell.Level->IsLevelVisible()))
+		{
+			return;
+		}
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	TimeToPlayableSeconds = Now - StartSeconds;
+	PlayableSinceStartSeconds = Now - GStartTime;
+	UE_LOG(LogMechStreaming, Log, TEXT("Playable %.2f s after the world started (%.2f s after launch), %d cells loaded, %.1f MB used"),
+		TimeToPlayableSeconds, PlayableSinceStartSeconds, NumLoaded, FPlatformMemory::GetStats().UsedPhysical / (1024.0 * 1024.0));
+}
+
+void UMechSurvivalLevelStreaming::WriteReport() const
+{
+	const FString MapName = UWorld::RemovePIEPrefix(GetWorld()->GetMapName());
+	const FString Line = FString::Printf(TEXT("%s,%s,%d,%d,%.3f,%.3f,%d,%d,%d,%.1f,%.1f\n"),
+		*FDateTime::Now().ToString(), *MapName, Cells.Num(), Stats.PeakLoadedCells, TimeToPlayableSeconds, PlayableSinceStartSeconds,
+		Stats.Loads, Stats.Unloads, Stats.Hitches, Stats.WorstHitchMilliseconds, Stats.PeakUsedPhysical / (1024.0 * 1024.0));
+
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("Streaming.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Map,Cells,PeakLoadedCells,TimeToPlayableSeconds,PlayableSinceLaunchSeconds,Loads,Unloads,Hitches,WorstHitchMs,PeakUsedMB\n")), *ReportPath);
+	}
+	FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+}
+
+void UMechSurvivalLevelStreaming::DumpStats() const
+{
+	UE_LOG(LogMechStreaming, Log, TEXT("%d of %d cells visible (peak %d loaded), following %d points; %d loads, %d unloads"),
+		GetNumVisibleCells(), Cells.Num(), Stats.PeakLoadedCells, Sources.Num(), Stats.Loads, Stats.Unloads);
+	UE_LOG(LogMechStreaming, Log, TEXT("%d streaming hitches over %.0f ms, worst %.1f ms; %s; peak %.1f MB used"),
+		Stats.Hitches, HitchMilliseconds, Stats.WorstHitchMilliseconds,
+		TimeToPlayableSeconds >= 0.0 ? *FString::Printf(TEXT("playable after %.2f s"), TimeToPlayableSeconds) : TEXT("not playable yet"),
+		Stats.PeakUsedPhysical / (1024.0 * 1024.0));
+}
@@ -0,0 +1,187 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalLevelStreaming.generated.h"
+
+class ULevelStreaming;
+
+/** Counts since the world started, for the report and the dump */
+struct FMechSurvivalLevelStreamingStats
+{
+	/** Cells asked to load and show */
+	int32 Loads = 0;
+	/** Cells asked to hide and unload */
+	int32 Unloads = 0;
+	/** Frames over HitchMilliseconds while a cell was loading, showing or hiding */
+	int32 Hitches = 0;
+	float WorstHitchMilliseconds = 0.f;
+	int32 PeakLoadedCells = 0;
+	uint64 PeakUsedPhysical = 0;
+};
+
+/**
+ * Streams the cells of a large arena in and out around the players.
+ *
+ * An arena is a persistent level holding what must always be there, and sublevels named <Anything>_Cell_<X>_<Y>,
+ * added with the Blueprint streaming method so that nothing loads them up front. Cell X, Y covers the square of side
+ * CellSize whose corner is GridOrigin + (X, Y) * CellSize; its sublevel should hold what lies in that square. Other
+ * sublevels are left alone, as are maps without cells.
+ *
+ * Every UpdateInterval a cell is wanted if a player's pawn, or where it will be LookaheadSeconds from now, is within
+ * LoadRadius of its square, and stays wanted until all of them are further than UnloadRadius, so that walking along a
+ * cell border does not load and unload it over and over. Servers follow every connected player's pawn, as their
+ * collision and AI need the cells too; clients follow their local players only.
+ *
+ * Loads go out nearest first, MaxLoadsPerUpdate at a time with no more than MaxPendingLoads in flight, and unloads
+ * MaxUnloadsPerUpdate at a time. How long the engine spends each frame adding a loaded cell's actors to the world,
+ * removing a hidden one's and async loading is capped by the Budget settings.
+ *
+ * Time to playable is from the world starting until every cell within LoadRadius of the players is visible. With the
+ * hitch count, the peak number of resident cells and memory it is appended to Saved/Benchmark/Streaming.csv when the
+ * world ends.
+ */
+UCLASS(config=Game)
+class UMechSurvivalLevelStreaming : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the level streaming of the world the context object lives in, if any */
+	static UMechSurvivalLevelStreaming* Get(const UObject* WorldContextObject);
+
+	int32 GetNumCells() const { return Cells.Num(); }
+
+	/** Cells loaded and visible */
+	int32 GetNumVisibleCells() const;
+
+	/** Seconds from the world starting until the cells around the players were first all visible; negative until then */
+	double GetTimeToPlayable() const { return TimeToPlayableSeconds; }
+
+	const FMechSurvivalLevelStreamingStats& GetStats() const { return Stats; }
+
+	/** Writes the cells and the streaming counts to the log */
+	void DumpStats() const;
+
+protected:
+	/** Side of a cell, in cm */
+	UPROPERTY(config)
+	float CellSize = 25600.f;
+
+	/** Corner of cell 0, 0 */
+	UPROPERTY(config)
+	FVector2D GridOrigin = FVector2D::ZeroVector;
+
+	/** Distance from a player to a cell's square within which the cell is loaded */
+	UPROPERTY(config)
+	float LoadRadius = 30000.f;
+
+	/** Distance from every player beyond which a loaded cell is unloaded; kept above LoadRadius */
+	UPROPERTY(config)
+	float UnloadRadius = 40000.f;
+
+	/** Players are also followed to where their velocity takes them in this many seconds, so cells ahead load early */
+	UPROPERTY(config)
+	float LookaheadSeconds = 1.f;
+
+	/** Seconds between decisions on which cells are wanted */
+	UPROPERTY(config)
+	float UpdateInterval = 0.1f;
+
+	UPROPERTY(config)
+	int32 MaxLoadsPerUpdate = 2;
+
+	UPROPERTY(config)
+	int32 MaxUnloadsPerUpdate = 1;
+
+	/** Cells loading or waiting to be shown at once */
+	UPROPERTY(config)
+	int32 MaxPendingLoads = 4;
+
+	/** Milliseconds per frame for adding the actors of loaded cells to the world; 0 keeps the engine's */
+	UPROPERTY(config)
+	float AddToWorldBudgetMilliseconds = 3.f;
+
+	/** Milliseconds per frame for removing the components of hidden cells; 0 keeps the engine's */
+	UPROPERTY(config)
+	float RemoveFromWorldBudgetMilliseconds = 1.f;
+
+	/** Milliseconds per frame for async loading while the game runs; 0 keeps the engine's */
+	UPROPERTY(config)
+	float AsyncLoadingBudgetMilliseconds = 4.f;
+
+	/** A frame longer than this while cells stream is counted as a hitch */
+	UPROPERTY(config)
+	float HitchMilliseconds = 50.f;
+
+private:
+	struct FCell
+	{
+		TWeakObjectPtr<ULevelStreaming> Level;
+		FIntPoint Coordinates;
+		FBox2D Bounds;
+		bool bWanted = false;
+		/** Squared distance to the nearest player at the last update */
+		float DistanceSquared = 0.f;
+	};
+
+	/** Finds the cell sublevels of the world; again whenever its streaming levels change */
+	void GatherCells();
+
+	/** Applies the Budget settings to the engine's streaming time limits */
+	void ApplyBudgets() const;
+
+	/** Collects where the followed players are and where they are heading */
+	void UpdateSources();
+
+	/** Decides which cells are wanted and sends out the loads and unloads within the limits */
+	void UpdateCells();
+
+	void SetCellWanted(FCell& Cell, bool bWanted);
+
+	/** Whether a cell is on its way in or out */
+	static bool IsCellPending(const FCell& Cell);
+
+	/** Counts hitches and resident cells, and checks whether the players can play yet */
+	void UpdateStats(double FrameMilliseconds);
+
+	/** Appends the session's line to the streaming report */
+	void WriteReport() const;
+
+	TArray<FCell> Cells;
+
+	/** Points the cells are loaded around */
+	TArray<FVector2D> Sources;
+
+	/** Streaming levels the world had when the cells were gathered */
+	int32 NumGatheredStreamingLevels = INDEX_NONE;
+
+	double StartSeconds = 0.0;
+	double LastTickSeconds = 0.0;
+	double NextUpdateSeconds = 0.0;
+	double TimeToPlayableSeconds = -1.0;
+	/** Seconds since the process started, at the same moment */
+	double PlayableSinceStartSeconds = -1.0;
+
+	/** Whether a cell changed state during the last frame, which counts its hitches too */
+	bool bStreamedLastFrame = false;
+
+	FMechSurvivalLevelStreamingStats Stats;
+};
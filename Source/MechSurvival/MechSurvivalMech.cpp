@@ -0,0 +1,108 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalMech.h"
+#include "MechSurvivalHorde.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/Controller.h"
+
+AMechSurvivalMech::AMechSurvivalMech()
+{
+	PrimaryActorTick.bCanEverTick = true;
+
+	BodyMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("BodyMesh"));
+	BodyMesh->SetupAttachment(GetCapsuleComponent());
+	BodyMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	// The skeletal mesh of ACharacter is not used
+	GetMesh()->SetVisibility(false);
+	GetMesh()->SetComponentTickEnabled(false);
+
+	// Nobody possesses horde mechs, the horde tells them where to go
+	AutoPossessAI = EAutoPossessAI::Disabled;
+	GetCharacterMovement()->bRunPhysicsWithNoController = true;
+	GetCharacterMovement()->bOrientRotationToMovement = true;
+	bUseControllerRotationYaw = false;
+
+	AcceptanceRadius = 150.f;
+
+	HordeIndex = INDEX_NONE;
+	MoveTarget = FVector::ZeroVector;
+	Horde = nullptr;
+}
+
+void AMechSurvivalMech::ApplyHordeSettings(UStaticMesh* Mesh, const FVector& MeshScale, float Radius, float HalfHeight, float Speed)
+{
+	GetCapsuleComponent()->SetCapsuleSize(Radius, HalfHeight);
+	GetCharacterMovement()->MaxWalkSpeed = Speed;
+	BodyMesh->SetStaticMesh(Mesh);
+	BodyMesh->SetRelativeScale3D(MeshScale);
+}
+
+void AMechSurvivalMech::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Clients never see the horde that spawned us, but they read the same config
+	GetDefault<UMechSurvivalHorde>()->ApplyMechSettings(this);
+}
+
+void AMechSurvivalMech::ActivateForHorde(UMechSurvivalHorde* InHorde, int32 InHordeIndex, const FVector& Location, const FVector& Velocity)
+{
+	Horde = InHorde;
+	HordeIndex = InHordeIndex;
+	MoveTarget = Location;
+
+	SetActorLocationAndRotation(Location, Velocity.IsNearlyZero() ? GetActorRotation() : Velocity.Rotation(), false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(true);
+
+	GetCharacterMovement()->Activate(true);
+	GetCharacterMovement()->SetMovementMode(MOVE_Walking);
+	GetCharacterMovement()->Velocity = Velocity;
+}
+
+void AMechSurvivalMech::DeactivateForHorde()
+{
+	Horde = nullptr;
+	HordeIndex = INDEX_NONE;
+
+	GetCharacterMovement()->StopMovementImmediately();
+	GetCharacterMovement()->Deactivate();
+
+	SetActorTickEnabled(false);
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
+
+void AMechSurvivalMech::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	const FVector ToTarget = MoveTarget - GetActorLocation();
+	if (ToTarget.SizeSquared2D() > FMath::Square(AcceptanceRadius))
+	{
+		AddMovementInput(ToTarget.GetSafeNormal2D());
+	}
+}
+
+float AMechSurvivalMech::TakeDamage(float DamageAmount, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
+{
+	const float ActualDamage = Super::TakeDamage(DamageAmount, DamageEvent, EventInstigator, DamageCauser);
+
+	// Health lives in the horde, so it survives promotion and demotion
+	if (Horde != nullptr && HordeIndex != INDEX_NONE)
+	{
+		APawn* DamageInstigator = EventInstigator != nullptr ? EventInstigator->GetPawn() : nullptr;
+		if (DamageInstigator == nullptr && DamageCauser != nullptr)
+		{
+			DamageInstigator = DamageCauser->GetInstigator();
+		}
+		Horde->ApplyDamage(HordeIndex, ActualDamage, DamageInstigator);
+	}
+
+	return ActualDamage;
+}
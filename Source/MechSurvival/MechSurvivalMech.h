@@ -0,0 +1,58 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Character.h"
+#include "MechSurvivalMech.generated.h"
+
+class UMechSurvivalHorde;
+class UStaticMesh;
+
+/**
+ * A horde mech close enough to a player to need a real body.
+ * Created and recycled by UMechSurvivalHorde, which keeps the mech's health and hands the actor a point to walk to.
+ * Runs character movement without a controller; damage taken is forwarded to the horde.
+ */
+UCLASS(config=Game)
+class AMechSurvivalMech : public ACharacter
+{
+	GENERATED_BODY()
+
+	/** What the mech looks like */
+	UPROPERTY(VisibleDefaultsOnly, Category=Mesh)
+	class UStaticMeshComponent* BodyMesh;
+
+public:
+	AMechSurvivalMech();
+
+	/** Binds the actor to a horde slot and places it there */
+	void ActivateForHorde(UMechSurvivalHorde* InHorde, int32 InHordeIndex, const FVector& Location, const FVector& Velocity);
+
+	/** Hides the actor and stops its movement and collision until it is activated again */
+	void DeactivateForHorde();
+
+	/** Sets up size, speed and look; called by the horde with its settings */
+	void ApplyHordeSettings(UStaticMesh* Mesh, const FVector& MeshScale, float Radius, float HalfHeight, float Speed);
+
+	/** Slot of this mech in the horde; the horde updates it when slots move */
+	int32 HordeIndex;
+
+	/** Where the horde wants the mech to go */
+	FVector MoveTarget;
+
+	// AActor interface
+	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaSeconds) override;
+	virtual float TakeDamage(float DamageAmount, struct FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
+	// End of AActor interface
+
+protected:
+	/** Stops walking once this close to MoveTarget */
+	UPROPERTY(EditDefaultsOnly, Category=Mech)
+	float AcceptanceRadius;
+
+private:
+	UPROPERTY(Transient)
+	UMechSurvivalHorde* Horde;
+};
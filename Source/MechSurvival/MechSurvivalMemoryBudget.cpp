@@ -0,0 +1,265 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalMemoryBudget.h"
+#include "MechSurvivalBenchmark.h"
+#include "MechSurvivalProjectilePool.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechMemory, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpMemoryCmd(
+	TEXT("MechSurvival.Memory.Dump"),
+	TEXT("Logs the budget, peak, average and current memory of every game system's LLM tag; needs -LLM"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalMemoryBudget* MemoryBudget = UMechSurvivalMemoryBudget::Get(World))
+		{
+			MemoryBudget->DumpStats();
+		}
+	}));
+
+static double ToMB(double Bytes)
+{
+	return Bytes / (1024.0 * 1024.0);
+}
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+
+// One stat per tag for "stat LLMFULL", all of them adding up to MechSurvival in "stat LLM"
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival"), STAT_MechSurvivalLLM, STATGROUP_LLM);
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival Projectiles"), STAT_MechSurvivalProjectilesLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival Characters"), STAT_MechSurvivalCharactersLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival HUD"), STAT_MechSurvivalHUDLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival FireEffects"), STAT_MechSurvivalFireEffectsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival Horde"), STAT_MechSurvivalHordeLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("MechSurvival Waves"), STAT_MechSurvivalWavesLLM, STATGROUP_LLMFULL);
+
+void MechSurvivalMemory::RegisterTags()
+{
+	const FName StatNames[] =
+	{
+		GET_STATFNAME(STAT_MechSurvivalProjectilesLLM),
+		GET_STATFNAME(STAT_MechSurvivalCharactersLLM),
+		GET_STATFNAME(STAT_MechSurvivalHUDLLM),
+		GET_STATFNAME(STAT_MechSurvivalFireEffectsLLM),
+		GET_STATFNAME(STAT_MechSurvivalHordeLLM),
+		GET_STATFNAME(STAT_MechSurvivalWavesLLM),
+	};
+	static_assert(ARRAY_COUNT(StatNames) == (int32)EMechSurvivalMemoryTag::Num, "Every memory tag needs a stat");
+
+	for (int32 Index = 0; Index < (int32)EMechSurvivalMemoryTag::Num; ++Index)
+	{
+		const EMechSurvivalMemoryTag Tag = (EMechSurvivalMemoryTag)Index;
+		FLowLevelMemTracker::Get().RegisterProjectTag((int32)ToLLMTag(Tag), UMechSurvivalMemoryBudget::GetTagName(Tag), StatNames[Index], GET_STATFNAME(STAT_MechSurvivalLLM));
+	}
+}
+
+#endif
+
+bool UMechSurvivalMemoryBudget::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalMemoryBudget::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	bTracking = FLowLevelMemTracker::IsEnabled();
+#endif
+	if (!bTracking)
+	{
+		UE_LOG(LogMechMemory, Verbose, TEXT("Memory budgets are not enforced; run with -LLM to track them"));
+		return;
+	}
+
+	// Benchmark and stress runs measure the game as configured, not as shed
+	bAllowShedding = !UMechSurvivalBenchmark::IsBenchmarkRun() && !FParse::Param(FCommandLine::Get(), TEXT("MechRepStress"));
+
+	for (const FMechSurvivalMemoryBudgetEntry& Entry : Budgets)
+	{
+		int32 Index = 0;
+		while (Index < (int32)EMechSurvivalMemoryTag::Num && Entry.Tag != FName(GetTagName((EMechSurvivalMemoryTag)Index)))
+		{
+			++Index;
+		}
+
+		if (Index == (int32)EMechSurvivalMemoryTag::Num)
+		{
+			UE_LOG(LogMechMemory, Warning, TEXT("There is no memory tag %s; its budget is ignored"), *Entry.Tag.ToString());
+			continue;
+		}
+
+		BudgetBytes[Index] = (int64)(FMath::Max(Entry.BudgetMB, 0.f) * 1024.0 * 1024.0);
+		bShedOverBudget[Index] = Entry.bShedOverBudget;
+	}
+}
+
+void UMechSurvivalMemoryBudget::Deinitialize()
+{
+	if (bTracking && TagStats[0].Samples > 0)
+	{
+		DumpStats();
+	}
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalMemoryBudget* UMechSurvivalMemoryBudget::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalMemoryBudget>() : nullptr;
+}
+
+bool UMechSurvivalMemoryBudget::IsShedding(const UObject* WorldContextObject, EMechSurvivalMemoryTag Tag)
+{
+	const UMechSurvivalMemoryBudget* MemoryBudget = Get(WorldContextObject);
+	return MemoryBudget != nullptr && MemoryBudget->bAllowShedding && MemoryBudget->bShedOverBudget[(int32)Tag] && MemoryBudget->bOverBudget[(int32)Tag];
+}
+
+const TCHAR* UMechSurvivalMemoryBudget::GetTagName(EMechSurvivalMemoryTag Tag)
+{
+	switch (Tag)
+	{
+	case EMechSurvivalMemoryTag::Projectiles: return TEXT("Projectiles");
+	case EMechSurvivalMemoryTag::Characters: return TEXT("Characters");
+	case EMechSurvivalMemoryTag::HUD: return TEXT("HUD");
+	case EMechSurvivalMemoryTag::FireEffects: return TEXT("FireEffects");
+	case EMechSurvivalMemoryTag::Horde: return TEXT("Horde");
+	case EMechSurvivalMemoryTag::Waves: return TEXT("Waves");
+	default: return TEXT("Unknown");
+	}
+}
+
+ETickableTickType UMechSurvivalMemoryBudget::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalMemoryBudget::IsTickable() const
+{
+	return GetWorld() != nullptr && bTracking;
+}
+
+TStatId UMechSurvivalMemoryBudget::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalMemoryBudget, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalMemoryBudget::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalMemoryBudget::Tick(float DeltaTime)
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	TimeSinceCheck += DeltaTime;
+	if (TimeSinceCheck < CheckInterval)
+	{
+		return;
+	}
+	TimeSinceCheck = 0.f;
+
+	int32 NumOverBudget = 0;
+	for (int32 Index = 0; Index < (int32)EMechSurvivalMemoryTag::Num; ++Index)
+	{
+		const EMechSurvivalMemoryTag Tag = (EMechSurvivalMemoryTag)Index;
+		const int64 Bytes = FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, MechSurvivalMemory::ToLLMTag(Tag));
+
+		FMechSurvivalMemoryTagStats& Stats = TagStats[Index];
+		Stats.CurrentBytes = Bytes;
+		Stats.PeakBytes = FMath::Max(Stats.PeakBytes, Bytes);
+		Stats.TotalBytes += Bytes;
+		++Stats.Samples;
+
+		const int64 Budget = BudgetBytes[Index];
+		if (Budget <= 0)
+		{
+			continue;
+		}
+
+		// Back under only well below the budget, so that a tag hovering at it does not flap
+		const bool bWillShed = bShedOverBudget[Index] && bAllowShedding;
+		if (!bOverBudget[Index] && Bytes > Budget)
+		{
+			bOverBudget[Index] = true;
+			++Stats.OverBudget;
+			UE_LOG(LogMechMemory, Warning, TEXT("%s is over its memory budget: %.1f MB of %.1f MB%s"),
+				GetTagName(Tag), ToMB(Bytes), ToMB(Budget), bWillShed ? TEXT(", shedding") : TEXT(""));
+		}
+		else if (bOverBudget[Index] && Bytes < Budget * RecoverFraction)
+		{
+			bOverBudget[Index] = false;
+			UE_LOG(LogMechMemory, Log, TEXT("%s is back under its memory budget: %.1f MB of %.1f MB"), GetTagName(Tag), ToMB(Bytes), ToMB(Budget));
+		}
+
+		if (bOverBudget[Index])
+		{
+			++NumOverBudget;
+			if (bWillShed)
+			{
+				Shed(Tag);
+			}
+		}
+	}
+
+	MECHSURVIVAL_SET_LEVEL(MemoryTagsOverBudget, NumOverBudget);
+#endif
+}
+
+void UMechSurvivalMemoryBudget::Shed(EMechSurvivalMemoryTag Tag)
+{
+	switch (Tag)
+	{
+	case EMechSurvivalMemoryTag::Projectiles:
+		if (UMechSurvivalProjectilePool* Pool = UMechSurvivalProjectilePool::Get(this))
+		{
+			Pool->TrimDormant(PoolTrimKeep);
+		}
+		break;
+	default:
+		// FireEffects is shed by the characters asking IsShedding; the others have nothing to give up
+		break;
+	}
+}
+
+void UMechSurvivalMemoryBudget::WriteReport(const FString& Path) const
+{
+	FString Csv = TEXT("Tag,BudgetMB,PeakMB,AverageMB,CurrentMB,TimesOverBudget,Samples\n");
+	for (int32 Index = 0; Index < (int32)EMechSurvivalMemoryTag::Num; ++Index)
+	{
+		const FMechSurvivalMemoryTagStats& Stats = TagStats[Index];
+		Csv += FString::Printf(TEXT("%s,%.1f,%.2f,%.2f,%.2f,%d,%d\n"), GetTagName((EMechSurvivalMemoryTag)Index),
+			ToMB(BudgetBytes[Index]), ToMB(Stats.PeakBytes), ToMB(Stats.GetAverageBytes()), ToMB(Stats.CurrentBytes), Stats.OverBudget, Stats.Samples);
+	}
+
+	if (!bTracking)
+	{
+		UE_LOG(LogMechMemory, Warning, TEXT("Memory report %s is empty; run with -LLM to track the tags"), *Path);
+	}
+	FFileHelper::SaveStringToFile(Csv, *Path);
+}
+
+void UMechSurvivalMemoryBudget::DumpStats() const
+{
+	if (!bTracking)
+	{
+		UE_LOG(LogMechMemory, Log, TEXT("Memory tags are not tracked; run with -LLM"));
+		return;
+	}
+
+	for (int32 Index = 0; Index < (int32)EMechSurvivalMemoryTag::Num; ++Index)
+	{
+		const FMechSurvivalMemoryTagStats& Stats = TagStats[Index];
+		UE_LOG(LogMechMemory, Log, TEXT("%-12s %8.2f MB now, %8.2f MB peak, %8.2f MB on average; budget %s, over it %d times%s"),
+			GetTagName((EMechSurvivalMemoryTag)Index), ToMB(Stats.CurrentBytes), ToMB(Stats.PeakBytes), ToMB(Stats.GetAverageBytes()),
+			BudgetBytes[Index] > 0 ? *FString::Printf(TEXT("%.1f MB"), ToMB(BudgetBytes[Index])) : TEXT("none"), Stats.OverBudget,
+			bOverBudget[Index] ? TEXT(", over now") : TEXT(""));
+	}
+}
@@ -0,0 +1,127 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvival.h"
+#include "MechSurvivalMemoryBudget.generated.h"
+
+/** Memory a system may use before the watchdog steps in */
+USTRUCT()
+struct FMechSurvivalMemoryBudgetEntry
+{
+	GENERATED_BODY()
+
+	/** Name of the tag: Projectiles, Characters, HUD, FireEffects, Horde or Waves */
+	UPROPERTY(config)
+	FName Tag;
+
+	/** 0 only records the tag */
+	UPROPERTY(config)
+	float BudgetMB = 0.f;
+
+	/**
+	 * Sheds load while over budget: Projectiles trims the dormant projectiles of the pool, FireEffects fires without
+	 * sounds and montages. The other tags have nothing to shed and only log.
+	 */
+	UPROPERTY(config)
+	bool bShedOverBudget = false;
+};
+
+/** What the watchdog saw of one tag since the world started */
+struct FMechSurvivalMemoryTagStats
+{
+	int64 CurrentBytes = 0;
+	int64 PeakBytes = 0;
+	/** Sum of every sample, for the average */
+	double TotalBytes = 0.0;
+	int32 Samples = 0;
+	/** Times the tag went over its budget */
+	int32 OverBudget = 0;
+
+	double GetAverageBytes() const { return Samples > 0 ? TotalBytes / Samples : 0.0; }
+};
+
+/**
+ * Memory budgets of the game's systems.
+ *
+ * Allocations made in MECHSURVIVAL_LLM_SCOPE scopes are counted by the low level memory tracker under the system's
+ * tag, and show in "stat LLMFULL". When the game runs with -LLM, the watchdog samples every tag each CheckInterval
+ * seconds and logs a tag going over its budget and coming back under RecoverFraction of it; tags marked to shed load
+ * do so for as long as they are over. Benchmark and stress runs only record, so that shedding does not change what
+ * they measure. The peak and average of every tag go to the log when the world ends, to MechSurvival.Memory.Dump, and
+ * next to the benchmark report as <report>Memory.csv. Without -LLM, or in Shipping, nothing is tracked.
+ */
+UCLASS(config=Game)
+class UMechSurvivalMemoryBudget : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the memory budget of the world the context object lives in, if any */
+	static UMechSurvivalMemoryBudget* Get(const UObject* WorldContextObject);
+
+	/** True while a tag marked to shed load is over its budget */
+	static bool IsShedding(const UObject* WorldContextObject, EMechSurvivalMemoryTag Tag);
+
+	/** Name of a tag, as in the config and the reports */
+	static const TCHAR* GetTagName(EMechSurvivalMemoryTag Tag);
+
+	const FMechSurvivalMemoryTagStats& GetTagStats(EMechSurvivalMemoryTag Tag) const { return TagStats[(int32)Tag]; }
+
+	/** Writes the budget, peak, average and current memory of every tag to a CSV */
+	void WriteReport(const FString& Path) const;
+
+	/** Writes the same to the log */
+	void DumpStats() const;
+
+protected:
+	/** Seconds between two samples of the tags */
+	UPROPERTY(config)
+	float CheckInterval = 1.f;
+
+	/** A tag over its budget is back under once it drops below this fraction of it */
+	UPROPERTY(config)
+	float RecoverFraction = 0.9f;
+
+	/** Dormant projectiles of each class the pool keeps when Projectiles sheds */
+	UPROPERTY(config)
+	int32 PoolTrimKeep = 16;
+
+	UPROPERTY(config)
+	TArray<FMechSurvivalMemoryBudgetEntry> Budgets;
+
+private:
+	/** Sheds what a tag over its budget can shed */
+	void Shed(EMechSurvivalMemoryTag Tag);
+
+	/** True when the game runs with -LLM */
+	bool bTracking = false;
+
+	/** False in benchmark and stress runs */
+	bool bAllowShedding = true;
+
+	float TimeSinceCheck = 0.f;
+
+	// Indexed by tag
+	int64 BudgetBytes[(int32)EMechSurvivalMemoryTag::Num] = {};
+	bool bShedOverBudget[(int32)EMechSurvivalMemoryTag::Num] = {};
+	bool bOverBudget[(int32)EMechSurvivalMemoryTag::Num] = {};
+	FMechSurvivalMemoryTagStats TagStats[(int32)EMechSurvivalMemoryTag::Num];
+};
@@ -0,0 +1,219 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalMovementComponent.h"
+#include "MechSurvival.h"
+#include "GameFramework/Character.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechMovement, Log, All);
+
+FMechSurvivalServerMoveStats UMechSurvivalMovementComponent::ServerMoveStats;
+
+static FAutoConsoleCommand GDumpMovementCmd(
+	TEXT("MechSurvival.Movement.Dump"),
+	TEXT("Logs how many client moves the server simulated, how long they took and how many were corrected"),
+	FConsoleCommandDelegate::CreateStatic([]()
+	{
+		UMechSurvivalMovementComponent::DumpServerMoveStats();
+	}));
+
+/** A move of a mech, with its boost input and the energy it started with */
+class FSavedMove_MechSurvival : public FSavedMove_Character
+{
+public:
+	typedef FSavedMove_Character Super;
+
+	// FSavedMove_Character interface
+	virtual void Clear() override
+	{
+		Super::Clear();
+
+		bSavedWantsToBoost = false;
+		SavedBoostEnergy = 0.f;
+	}
+
+	virtual uint8 GetCompressedFlags() const override
+	{
+		uint8 Flags = Super::GetCompressedFlags();
+		if (bSavedWantsToBoost)
+		{
+			Flags |= FLAG_Custom_0;
+		}
+		return Flags;
+	}
+
+	virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const override
+	{
+		// Running out halfway through would boost the whole combined move on one side and half of it on the other
+		const FSavedMove_MechSurvival* NewMechMove = static_cast<const FSavedMove_MechSurvival*>(NewMove.Get());
+		if (bSavedWantsToBoost && (SavedBoostEnergy > 0.f) != (NewMechMove->SavedBoostEnergy > 0.f))
+		{
+			return false;
+		}
+		return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+	}
+
+	virtual void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData) override
+	{
+		Super::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+
+		const UMechSurvivalMovementComponent* MoveComponent = CastChecked<UMechSurvivalMovementComponent>(C->GetCharacterMovement());
+		bSavedWantsToBoost = MoveComponent->bWantsToBoost;
+		SavedBoostEnergy = MoveComponent->BoostEnergy;
+	}
+
+	virtual void PrepMoveFor(ACharacter* C) override
+	{
+		Super::PrepMoveFor(C);
+
+		// Replayed from the energy it had, not what is left after the moves that followed
+		UMechSurvivalMovementComponent* MoveComponent = CastChecked<UMechSurvivalMovementComponent>(C->GetCharacterMovement());
+		MoveComponent->BoostEnergy = SavedBoostEnergy;
+	}
+	// End of FSavedMove_Character interface
+
+	bool bSavedWantsToBoost = false;
+	float SavedBoostEnergy = 0.f;
+};
+
+class FNetworkPredictionData_Client_MechSurvival : public FNetworkPredictionData_Client_Character
+{
+public:
+	explicit FNetworkPredictionData_Client_MechSurvival(const UCharacterMovementComponent& ClientMovement)
+		: FNetworkPredictionData_Client_Character(ClientMovement)
+	{
+	}
+
+	// FNetworkPredictionData_Client_Character interface
+	virtual FSavedMovePtr AllocateNewMove() override
+	{
+		return FSavedMovePtr(new FSavedMove_MechSurvival());
+	}
+	// End of FNetworkPredictionData_Client_Character interface
+};
+
+UMechSurvivalMovementComponent::UMechSurvivalMovementComponent()
+{
+	// Heavy stride: slow to get going, quick to stop, little air control
+	MaxWalkSpeed = 550.f;
+	MaxAcceleration = 1024.f;
+	BrakingDecelerationWalking = 2800.f;
+	GroundFriction = 6.f;
+	AirControl = 0.05f;
+	Mass = 800.f;
+
+	BoostSpeedMultiplier = 1.8f;
+	BoostAccelerationMultiplier = 2.f;
+	MaxBoostSeconds = 3.f;
+	BoostRechargeSeconds = 6.f;
+
+	InputDirections = 128;
+	InputMagnitudeSteps = 16;
+}
+
+void UMechSurvivalMovementComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BoostEnergy = MaxBoostSeconds;
+}
+
+FNetworkPredictionData_Client* UMechSurvivalMovementComponent::GetPredictionData_Client() const
+{
+	if (ClientPredictionData == nullptr)
+	{
+		UMechSurvivalMovementComponent* MutableThis = const_cast<UMechSurvivalMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_MechSurvival(*this);
+	}
+	return ClientPredictionData;
+}
+
+bool UMechSurvivalMovementComponent::IsBoosting() const
+{
+	return bWantsToBoost && BoostEnergy > 0.f && IsMovingOnGround();
+}
+
+float UMechSurvivalMovementComponent::GetMaxSpeed() const
+{
+	const float MaxSpeed = Super::GetMaxSpeed();
+	return IsBoosting() ? MaxSpeed * BoostSpeedMultiplier : MaxSpeed;
+}
+
+float UMechSurvivalMovementComponent::GetMaxAcceleration() const
+{
+	const float Acceleration = Super::GetMaxAcceleration();
+	return IsBoosting() ? Acceleration * BoostAccelerationMultiplier : Acceleration;
+}
+
+void UMechSurvivalMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+
+	bWantsToBoost = (Flags & FSavedMove_Character::FLAG_Custom_0) != 0;
+}
+
+FVector UMechSurvivalMovementComponent::ScaleInputAcceleration(const FVector& InputAcceleration) const
+{
+	const FVector Acceleration = Super::ScaleInputAcceleration(InputAcceleration);
+
+	// Only ground and air moves are flat; swimming and flying keep their full input
+	if (InputDirections <= 0 || InputMagnitudeSteps <= 0 || Acceleration.IsNearlyZero() || !FMath::IsNearlyZero(Acceleration.Z))
+	{
+		return Acceleration;
+	}
+
+	const float MaxInputAcceleration = GetMaxAcceleration();
+	const float Strength = FMath::RoundToFloat(FMath::Min(Acceleration.Size2D() / MaxInputAcceleration, 1.f) * InputMagnitudeSteps) / InputMagnitudeSteps;
+	const float HeadingStep = 2.f * PI / InputDirections;
+	const float Heading = FMath::RoundToFloat(FMath::Atan2(Acceleration.Y, Acceleration.X) / HeadingStep) * HeadingStep;
+
+	// Tenths of a unit, what the move RPC's FVector_NetQuantize10 carries, so the server moves with exactly this
+	const float Magnitude = Strength * MaxInputAcceleration;
+	return FVector(FMath::RoundToFloat(FMath::Cos(Heading) * Magnitude * 10.f) * 0.1f, FMath::RoundToFloat(FMath::Sin(Heading) * Magnitude * 10.f) * 0.1f, 0.f);
+}
+
+void UMechSurvivalMovementComponent::OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity)
+{
+	Super::OnMovementUpdated(DeltaSeconds, OldLocation, OldVelocity);
+
+	// Runs for every move on the client, the server and in replays alike, so the energy stays in step
+	if (IsBoosting())
+	{
+		BoostEnergy = FMath::Max(0.f, BoostEnergy - DeltaSeconds);
+	}
+	else if (!bWantsToBoost && BoostRechargeSeconds > 0.f)
+	{
+		BoostEnergy = FMath::Min(MaxBoostSeconds, BoostEnergy + DeltaSeconds * MaxBoostSeconds / BoostRechargeSeconds);
+	}
+}
+
+void UMechSurvivalMovementComponent::ServerMove_Implementation(float TimeStamp, FVector_NetQuantize10 InAccel, FVector_NetQuantize100 ClientLoc, uint8 CompressedMoveFlags, uint8 ClientRoll, uint32 View, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(ServerMove);
+	MECHSURVIVAL_INC_COUNTER(ServerMoves, 1);
+
+	// Dual moves come through here once per move
+	const double StartSeconds = FPlatformTime::Seconds();
+	Super::ServerMove_Implementation(TimeStamp, InAccel, ClientLoc, CompressedMoveFlags, ClientRoll, View, ClientMovementBase, ClientBaseBoneName, ClientMovementMode);
+	ServerMoveStats.Seconds += FPlatformTime::Seconds() - StartSeconds;
+	++ServerMoveStats.Moves;
+}
+
+void UMechSurvivalMovementComponent::SendClientAdjustment()
+{
+	const FNetworkPredictionData_Server_Character* ServerData = HasPredictionData_Server() ? GetPredictionData_Server_Character() : nullptr;
+	if (ServerData != nullptr && ServerData->PendingAdjustment.TimeStamp > 0.f && !ServerData->PendingAdjustment.bAckGoodMove)
+	{
+		++ServerMoveStats.Corrections;
+		MECHSURVIVAL_INC_COUNTER(MoveCorrections, 1);
+	}
+
+	Super::SendClientAdjustment();
+}
+
+void UMechSurvivalMovementComponent::DumpServerMoveStats()
+{
+	UE_LOG(LogMechMovement, Log, TEXT("%d client moves simulated in %.2f ms, %.2f us each; %d corrections sent"),
+		ServerMoveStats.Moves, ServerMoveStats.Seconds * 1000.0, ServerMoveStats.Moves > 0 ? ServerMoveStats.Seconds * 1000000.0 / ServerMoveStats.Moves : 0.0,
+		ServerMoveStats.Corrections);
+}
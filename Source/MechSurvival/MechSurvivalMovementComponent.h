@@ -0,0 +1,106 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "MechSurvivalMovementComponent.generated.h"
+
+/** Server move processing since the game started, over every character; for the benchmarks and the dump */
+struct FMechSurvivalServerMoveStats
+{
+	/** Client moves the server simulated; a dual move counts twice */
+	int32 Moves = 0;
+	/** Corrections sent back to clients */
+	int32 Corrections = 0;
+	/** Spent simulating and checking them */
+	double Seconds = 0.0;
+};
+
+/**
+ * Character movement of the player mechs.
+ *
+ * Heavy stride: mechs gather speed slowly, brake hard and hardly steer in the air; the defaults set here are a
+ * starting point for the blueprint. Boost: while the boost input is held on the ground and there is energy left, the
+ * mech goes BoostSpeedMultiplier times as fast and accelerates BoostAccelerationMultiplier times as hard. Energy is
+ * MaxBoostSeconds of boost, refilled over BoostRechargeSeconds while boost is not held. The boost input travels in
+ * the compressed flags of the client's moves and the energy is saved with them, so boosting is predicted and
+ * replayed like the rest of the move.
+ *
+ * Moves are cheap to send and to check. Input acceleration is snapped to InputDirections headings and
+ * InputMagnitudeSteps strengths, then rounded to the tenth of a unit the move RPC carries. The server then simulates
+ * exactly what the client did, with no rounding drift to correct, and a steady stick gives runs of identical moves
+ * that the client combines into one. How often clients send moves and how often the server may correct them is set
+ * in the [/Script/Engine.GameNetworkManager] section of DefaultGame.ini, with a coarser rate past a player count.
+ */
+UCLASS()
+class UMechSurvivalMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+	friend class FSavedMove_MechSurvival;
+
+public:
+	UMechSurvivalMovementComponent();
+
+	// UActorComponent interface
+	virtual void BeginPlay() override;
+	// End of UActorComponent interface
+
+	// UCharacterMovementComponent interface
+	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+	virtual float GetMaxSpeed() const override;
+	virtual float GetMaxAcceleration() const override;
+	virtual void SendClientAdjustment() override;
+	virtual void ServerMove_Implementation(float TimeStamp, FVector_NetQuantize10 InAccel, FVector_NetQuantize100 ClientLoc, uint8 CompressedMoveFlags, uint8 ClientRoll, uint32 View, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+	// End of UCharacterMovementComponent interface
+
+	/** Presses or releases the boost input */
+	void SetWantsToBoost(bool bInWantsToBoost) { bWantsToBoost = bInWantsToBoost; }
+
+	/** Whether the mech goes at boost speed in this move */
+	bool IsBoosting() const;
+
+	/** Seconds of boost left */
+	float GetBoostEnergy() const { return BoostEnergy; }
+
+	static const FMechSurvivalServerMoveStats& GetServerMoveStats() { return ServerMoveStats; }
+
+	/** Writes the server move counts and time to the log */
+	static void DumpServerMoveStats();
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Mech Movement")
+	float BoostSpeedMultiplier;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Mech Movement")
+	float BoostAccelerationMultiplier;
+
+	/** Seconds of boost when full */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Mech Movement")
+	float MaxBoostSeconds;
+
+	/** Seconds to refill from empty, while boost is not held */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Mech Movement")
+	float BoostRechargeSeconds;
+
+	/** Headings input acceleration is snapped to; 0 leaves it as it is */
+	UPROPERTY(EditAnywhere, Category = "Mech Movement|Networking")
+	int32 InputDirections;
+
+	/** Strengths between none and full that input acceleration is snapped to; 0 leaves it as it is */
+	UPROPERTY(EditAnywhere, Category = "Mech Movement|Networking")
+	int32 InputMagnitudeSteps;
+
+protected:
+	// UCharacterMovementComponent interface
+	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
+	virtual FVector ScaleInputAcceleration(const FVector& InputAcceleration) const override;
+	virtual void OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity) override;
+	// End of UCharacterMovementComponent interface
+
+private:
+	bool bWantsToBoost = false;
+	float BoostEnergy = 0.f;
+
+	static FMechSurvivalServerMoveStats ServerMoveStats;
+};
@@ -1,8 +1,19 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "MechSurvivalProjectile.h"
+#include "MechSurvival.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvivalProjectilePool.h"
+#include "MechSurvivalSignificance.h"
+#include "MechSurvivalSpatialHash.h"
+#include "MechSurvivalTelemetry.h"
+#include "MechSurvivalWeaponData.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "GameFramework/DamageType.h"
+#include "GameFramework/Pawn.h"
+#include "Kismet/GameplayStatics.h"
 
 AMechSurvivalProjectile::AMechSurvivalProjectile() 
 {
@@ -27,17 +38,216 @@ AMechSurvivalProjectile::AMechSurvivalProjectile()
 	ProjectileMovement->bRotationFollowsVelocity = true;
 	ProjectileMovement->bShouldBounce = true;
 
-	// Die after 3 seconds by default
+	// Die after 3 seconds by default; weapons set their own flight, see ApplyWeapon
 	InitialLifeSpan = 3.0f;
+
+	Damage = 20.0f;
+	ExplosionRadius = 0.0f;
+
+	// Horde mechs have no collision of their own; the horde traces the path against them, see TraceHorde
+	PrimaryActorTick.bCanEverTick = false;
+
+	Pool = nullptr;
+	LastLocation = FVector::ZeroVector;
+	HordeTraceIndex = INDEX_NONE;
+}
+
+void AMechSurvivalProjectile::BeginPlay()
+{
+	Super::BeginPlay();
+
+	LastLocation = GetActorLocation();
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		Horde->RegisterProjectile(this);
+	}
+
+	// Rounds far from every player and off-screen move in longer steps
+	if (UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(this))
+	{
+		Significance->RegisterActor(this, EMechSurvivalSignificanceCategory::Projectile);
+	}
+}
+
+void AMechSurvivalProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		Horde->UnregisterProjectile(this);
+	}
+
+	if (UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(this))
+	{
+		Significance->UnregisterActor(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AMechSurvivalProjectile::TraceHorde(UMechSurvivalHorde* Horde, bool bTrace)
+{
+	const FVector Location = GetActorLocation();
+	FMechSurvivalHordeHit HordeHit;
+	if (bTrace && Horde->TraceMechs(LastLocation, Location, CollisionComp->GetScaledSphereRadius(), HordeHit))
+	{
+		MECHSURVIVAL_INC_COUNTER(Hits, 1);
+		if (ExplosionRadius > 0.0f)
+		{
+			Explode(HordeHit.Location);
+		}
+		else
+		{
+			Horde->ApplyDamage(HordeHit.MechIndex, Damage, GetInstigator());
+			UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, HordeHit.Location, Damage);
+		}
+
+		Recycle();
+		return;
+	}
+
+	LastLocation = Location;
 }
 
 void AMechSurvivalProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(ProjectileHit);
+
+	// Hits counts rounds stopped by what they hit, as simulated rounds do; bounces off walls are not hits
+
+	// Explosive rounds go off on whatever they hit, the explosion damages and pushes
+	if (ExplosionRadius > 0.0f && OtherActor != this)
+	{
+		MECHSURVIVAL_INC_COUNTER(Hits, 1);
+		Explode(Hit.ImpactPoint);
+		Recycle();
+	}
 	// Only add impulse and destroy projectile if we hit a physics
-	if ((OtherActor != NULL) && (OtherActor != this) && (OtherComp != NULL) && OtherComp->IsSimulatingPhysics())
+	else if ((OtherActor != NULL) && (OtherActor != this) && (OtherComp != NULL) && OtherComp->IsSimulatingPhysics())
+	{
+		MECHSURVIVAL_INC_COUNTER(Hits, 1);
+		UMechSurvivalImpulseBatcher::AddImpulseAtLocation(OtherComp, GetVelocity() * 100.0f, GetActorLocation());
+		MECHSURVIVAL_INC_COUNTER(Impulses, 1);
+		UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Impulse, GetActorLocation(), GetVelocity().Size() * 100.0f);
+
+		Recycle();
+	}
+	// Pawns take damage and stop the projectile
+	else if ((OtherActor != NULL) && (OtherActor != this) && OtherActor->IsA<APawn>())
 	{
-		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
+		MECHSURVIVAL_INC_COUNTER(Hits, 1);
+		UGameplayStatics::ApplyPointDamage(OtherActor, Damage, GetVelocity().GetSafeNormal(), Hit, GetInstigatorController(), this, UDamageType::StaticClass());
+		UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, Hit.ImpactPoint, Damage);
 
+		Recycle();
+	}
+}
+
+void AMechSurvivalProjectile::ApplyWeapon(const UMechSurvivalWeaponData* Weapon)
+{
+	if (Weapon != nullptr)
+	{
+		const FMechSurvivalWeaponStats& Stats = Weapon->Stats;
+		ProjectileMovement->InitialSpeed = Stats.InitialSpeed;
+		ProjectileMovement->MaxSpeed = Stats.MaxSpeed;
+		ProjectileMovement->ProjectileGravityScale = Stats.GravityScale;
+		ProjectileMovement->bShouldBounce = Stats.bShouldBounce;
+		ProjectileMovement->Bounciness = Stats.Bounciness;
+		InitialLifeSpan = Stats.LifeSpan;
+		Damage = Stats.Damage;
+		ExplosionRadius = Stats.ExplosionRadius;
+		return;
+	}
+
+	// Pooled projectiles may have been fired by a weapon before
+	const AMechSurvivalProjectile* Defaults = GetClass()->GetDefaultObject<AMechSurvivalProjectile>();
+	const UProjectileMovementComponent* DefaultMovement = Defaults->GetProjectileMovement();
+	ProjectileMovement->InitialSpeed = DefaultMovement->InitialSpeed;
+	ProjectileMovement->MaxSpeed = DefaultMovement->MaxSpeed;
+	ProjectileMovement->ProjectileGravityScale = DefaultMovement->ProjectileGravityScale;
+	ProjectileMovement->bShouldBounce = DefaultMovement->bShouldBounce;
+	ProjectileMovement->Bounciness = DefaultMovement->Bounciness;
+	InitialLifeSpan = Defaults->InitialLifeSpan;
+	Damage = Defaults->Damage;
+	ExplosionRadius = Defaults->ExplosionRadius;
+}
+
+void AMechSurvivalProjectile::Explode(const FVector& Location)
+{
+	if (UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(this))
+	{
+		SpatialHash->QueueExplosion(Location, ExplosionRadius, Damage, this, GetInstigator());
+	}
+}
+
+void AMechSurvivalProjectile::ActivatePooled(const FVector& Location, const FRotator& Rotation, const UMechSurvivalWeaponData* Weapon, float CatchUpSeconds, APawn* InInstigator)
+{
+	ApplyWeapon(Weapon);
+	SetInstigator(InInstigator);
+
+	// Same initial velocity UProjectileMovementComponent::InitializeComponent gives a freshly spawned projectile
+	FVector LaunchLocation = Location;
+	FVector Velocity = Rotation.Vector() * ProjectileMovement->InitialSpeed;
+	CatchUpSeconds = FMath::Max(CatchUpSeconds, 0.f);
+	if (CatchUpSeconds > 0.f)
+	{
+		const FVector Gravity(0.f, 0.f, ProjectileMovement->GetGravityZ());
+		LaunchLocation += Velocity * CatchUpSeconds + Gravity * (0.5f * CatchUpSeconds * CatchUpSeconds);
+		Velocity += Gravity * CatchUpSeconds;
+	}
+
+	SetActorLocationAndRotation(LaunchLocation, Velocity.Rotation(), false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	LastLocation = LaunchLocation;
+
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->Velocity = Velocity;
+	ProjectileMovement->Activate(true);
+
+	// A zero lifespan lives until it hits something, however long it has been flying
+	SetLifeSpan(InitialLifeSpan > 0.f ? FMath::Max(InitialLifeSpan - CatchUpSeconds, KINDA_SMALL_NUMBER) : 0.f);
+
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		Horde->RegisterProjectile(this);
+	}
+
+	// Its level is from wherever it flew last
+	if (UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(this))
+	{
+		Significance->RefreshActor(this);
+	}
+}
+
+void AMechSurvivalProjectile::DeactivatePooled()
+{
+	SetLifeSpan(0.f);
+
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->Deactivate();
+
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		Horde->UnregisterProjectile(this);
+	}
+
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
+
+void AMechSurvivalProjectile::LifeSpanExpired()
+{
+	Recycle();
+}
+
+void AMechSurvivalProjectile::Recycle()
+{
+	if (Pool != nullptr)
+	{
+		Pool->Release(this);
+	}
+	else
+	{
 		Destroy();
 	}
 }
\ No newline at end of file
@@ -22,10 +22,66 @@ class AMechSurvivalProjectile : public AActor
 public:
 	AMechSurvivalProjectile();
 
+	/** Damage dealt to a pawn this projectile hits; a weapon firing the projectile overrides it, see ApplyWeapon */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	float Damage;
+
+	/** Radius the projectile explodes over when it hits anything, see UMechSurvivalSpatialHash; 0 does not explode */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	float ExplosionRadius;
+
 	/** called when projectile hits something */
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 
+	/**
+	 * Puts the projectile back in flight from the given muzzle transform, as if it had just been spawned there, or
+	 * CatchUpSeconds of free flight further along for a shot that has been flying elsewhere already.
+	 * InInstigator is credited with whatever it hits.
+	 */
+	void ActivatePooled(const FVector& Location, const FRotator& Rotation, const class UMechSurvivalWeaponData* Weapon = nullptr, float CatchUpSeconds = 0.f, APawn* InInstigator = nullptr);
+
+	/** Takes speed, bounce, lifespan, damage and explosion from the weapon, or back from the class defaults if there is none */
+	void ApplyWeapon(const class UMechSurvivalWeaponData* Weapon);
+
+	/** Hides the projectile and stops its movement, collision and lifespan until it is activated again */
+	void DeactivatePooled();
+
+	/** Marks the projectile as owned by a pool */
+	void SetPool(class UMechSurvivalProjectilePool* InPool) { Pool = InPool; }
+
+	/**
+	 * Traces the path flown since the horde last saw the projectile against the mechs, and stops the projectile on
+	 * the first one it hit. Called by the horde once per step for every projectile in flight; bTrace is false when the
+	 * horde skipped frames, and only catches up with where the projectile is.
+	 */
+	void TraceHorde(class UMechSurvivalHorde* Horde, bool bTrace);
+
+	/** Slot of the projectile among those the horde traces, INDEX_NONE while not in flight; kept by the horde */
+	int32 HordeTraceIndex;
+
+protected:
+	// AActor interface
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void LifeSpanExpired() override;
+	// End of AActor interface
+
+	/** Returns the projectile to its pool, or destroys it if it was spawned without one */
+	void Recycle();
+
+	/** Queues an explosion of ExplosionRadius and Damage at the location with the spatial hash */
+	void Explode(const FVector& Location);
+
+private:
+	/** Pool that owns this projectile, if any */
+	UPROPERTY(Transient)
+	class UMechSurvivalProjectilePool* Pool;
+
+	/** Where the projectile was when the horde last traced it; the path since then is traced next */
+	FVector LastLocation;
+
+public:
 	/** Returns CollisionComp subobject **/
 	FORCEINLINE class USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
@@ -0,0 +1,267 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalProjectilePool.h"
+#include "MechSurvival.h"
+#include "MechSurvivalProjectile.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogProjectilePool, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpProjectilePoolCmd(
+	TEXT("MechSurvival.ProjectilePool.Dump"),
+	TEXT("Logs the projectile pool state and its hit/miss counters"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalProjectilePool* Pool = UMechSurvivalProjectilePool::Get(World))
+		{
+			Pool->DumpStats();
+		}
+	}));
+
+bool UMechSurvivalProjectilePool::ShouldCreateSubsystem(UObject* Outer) const
+{
+	// Only worlds that actually play need a pool
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalProjectilePool::Deinitialize()
+{
+	DumpStats();
+
+	// The projectiles themselves go away with the world
+	Buckets.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalProjectilePool* UMechSurvivalProjectilePool::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalProjectilePool>() : nullptr;
+}
+
+void UMechSurvivalProjectilePool::Prewarm(TSubclassOf<AMechSurvivalProjectile> ProjectileClass)
+{
+	MECHSURVIVAL_LLM_SCOPE(Projectiles);
+
+	UWorld* World = GetWorld();
+	if (ProjectileClass == nullptr || World == nullptr)
+	{
+		return;
+	}
+
+	FMechSurvivalProjectilePoolBucket& Bucket = Buckets.FindOrAdd(ProjectileClass);
+	const int32 TargetCount = FMath::Min(PrewarmCount, Capacity);
+	while (GetOwnedCount(Bucket) < TargetCount)
+	{
+		AMechSurvivalProjectile* Projectile = SpawnPooled(World, ProjectileClass, FVector::ZeroVector, FRotator::ZeroRotator);
+		if (Projectile == nullptr)
+		{
+			break;
+		}
+		Projectile->DeactivatePooled();
+		Bucket.Dormant.Add(Projectile);
+	}
+}
+
+AMechSurvivalProjectile* UMechSurvivalProjectilePool::Acquire(TSubclassOf<AMechSurvivalProjectile> ProjectileClass, FVector Location, const FRotator& Rotation, ESpawnActorCollisionHandlingMethod CollisionHandling)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(PoolAcquire);
+
+	UWorld* World = GetWorld();
+	if (ProjectileClass == nullptr || World == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (!ResolveSpawnLocation(World, ProjectileClass, Location, Rotation, CollisionHandling))
+	{
+		return nullptr;
+	}
+
+	FMechSurvivalProjectilePoolBucket& Bucket = Buckets.FindOrAdd(ProjectileClass);
+	AMechSurvivalProjectile* Projectile = TakeFromBucket(World, ProjectileClass, Bucket, Location, Rotation);
+	if (Projectile != nullptr)
+	{
+		Projectile->ActivatePooled(Location, Rotation);
+		Bucket.Active.Add(Projectile);
+		MECHSURVIVAL_INC_COUNTER(Spawns, 1);
+		INC_DWORD_STAT(STAT_MechSurvival_LiveProjectileActors);
+	}
+
+	return Projectile;
+}
+
+int32 UMechSurvivalProjectilePool::AcquireBatch(const UMechSurvivalWeaponData* Weapon, TSubclassOf<AMechSurvivalProjectile> ProjectileClass, FVector Location, TArrayView<const FRotator> Rotations, ESpawnActorCollisionHandlingMethod CollisionHandling, float CatchUpSeconds, APawn* Instigator)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(PoolAcquire);
+
+	UWorld* World = GetWorld();
+	if (ProjectileClass == nullptr || World == nullptr || Rotations.Num() == 0)
+	{
+		return 0;
+	}
+
+	// Pellets share the muzzle, so one check covers them all
+	if (!ResolveSpawnLocation(World, ProjectileClass, Location, Rotations[0], CollisionHandling))
+	{
+		return 0;
+	}
+
+	FMechSurvivalProjectilePoolBucket& Bucket = Buckets.FindOrAdd(ProjectileClass);
+	Bucket.Active.Reserve(Bucket.Active.Num() + Rotations.Num());
+
+	int32 Launched = 0;
+	for (const FRotator& Rotation : Rotations)
+	{
+		AMechSurvivalProjectile* Projectile = TakeFromBucket(World, ProjectileClass, Bucket, Location, Rotation);
+		if (Projectile == nullptr)
+		{
+			break;
+		}
+		Projectile->ActivatePooled(Location, Rotation, Weapon, CatchUpSeconds, Instigator);
+		Bucket.Active.Add(Projectile);
+		++Launched;
+	}
+
+	MECHSURVIVAL_INC_COUNTER(Spawns, Launched);
+	INC_DWORD_STAT_BY(STAT_MechSurvival_LiveProjectileActors, Launched);
+	return Launched;
+}
+
+bool UMechSurvivalProjectilePool::ResolveSpawnLocation(UWorld* World, UClass* ProjectileClass, FVector& Location, const FRotator& Rotation, ESpawnActorCollisionHandlingMethod CollisionHandling) const
+{
+	// Apply the same placement rules SpawnActor would, using the class defaults as the template
+	if (CollisionHandling == ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding ||
+		CollisionHandling == ESpawnActorCollisionHandlingMethod::DontSpawnIfColliding)
+	{
+		const AActor* Template = ProjectileClass->GetDefaultObject<AActor>();
+		if (World->EncroachingBlockingGeometry(Template, Location, Rotation))
+		{
+			if (CollisionHandling == ESpawnActorCollisionHandlingMethod::DontSpawnIfColliding || !World->FindTeleportSpot(Template, Location, Rotation))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+AMechSurvivalProjectile* UMechSurvivalProjectilePool::TakeFromBucket(UWorld* World, UClass* ProjectileClass, FMechSurvivalProjectilePoolBucket& Bucket, const FVector& Location, const FRotator& Rotation)
+{
+	AMechSurvivalProjectile* Projectile = nullptr;
+	while (Projectile == nullptr && Bucket.Dormant.Num() > 0)
+	{
+		// Anything destroyed behind our back (e.g. by a level unload) is simply dropped
+		Projectile = Bucket.Dormant.Pop(false);
+		if (!IsValid(Projectile))
+		{
+			Projectile = nullptr;
+		}
+	}
+
+	if (Projectile != nullptr)
+	{
+		++Stats.Hits;
+	}
+	else
+	{
+		++Stats.Misses;
+		MECHSURVIVAL_INC_COUNTER(PoolMisses, 1);
+
+		if (GetOwnedCount(Bucket) < Capacity || OverflowPolicy == EMechSurvivalPoolOverflowPolicy::SpawnTransient)
+		{
+			Projectile = SpawnPooled(World, ProjectileClass, Location, Rotation);
+		}
+		else if (OverflowPolicy == EMechSurvivalPoolOverflowPolicy::RecycleOldest && Bucket.Active.Num() > 0)
+		{
+			Projectile = Bucket.Active[0];
+			Bucket.Active.RemoveAt(0, 1, false);
+			++Stats.Recycled;
+			DEC_DWORD_STAT(STAT_MechSurvival_LiveProjectileActors);
+		}
+		else
+		{
+			++Stats.Rejected;
+		}
+	}
+
+	return Projectile;
+}
+
+void UMechSurvivalProjectilePool::Release(AMechSurvivalProjectile* Projectile)
+{
+	if (Projectile == nullptr)
+	{
+		return;
+	}
+
+	FMechSurvivalProjectilePoolBucket* Bucket = Buckets.Find(Projectile->GetClass());
+	if (Bucket == nullptr || Bucket->Active.Remove(Projectile) == 0)
+	{
+		// Not in flight, so either already dormant or never ours
+		return;
+	}
+
+	DEC_DWORD_STAT(STAT_MechSurvival_LiveProjectileActors);
+
+	if (GetOwnedCount(*Bucket) >= Capacity)
+	{
+		// A transient spawned under SpawnTransient; the pool is already full without it
+		++Stats.Destroyed;
+		Projectile->Destroy();
+		return;
+	}
+
+	Projectile->DeactivatePooled();
+	Bucket->Dormant.Add(Projectile);
+}
+
+int32 UMechSurvivalProjectilePool::TrimDormant(int32 KeepPerClass)
+{
+	int32 NumTrimmed = 0;
+	for (TPair<UClass*, FMechSurvivalProjectilePoolBucket>& Pair : Buckets)
+	{
+		TArray<AMechSurvivalProjectile*>& Dormant = Pair.Value.Dormant;
+		while (Dormant.Num() > FMath::Max(KeepPerClass, 0))
+		{
+			if (AMechSurvivalProjectile* Projectile = Dormant.Pop(false))
+			{
+				Projectile->Destroy();
+				++NumTrimmed;
+			}
+		}
+	}
+
+	Stats.Trimmed += NumTrimmed;
+	return NumTrimmed;
+}
+
+void UMechSurvivalProjectilePool::DumpStats() const
+{
+	for (const TPair<UClass*, FMechSurvivalProjectilePoolBucket>& Pair : Buckets)
+	{
+		UE_LOG(LogProjectilePool, Log, TEXT("%s: %d dormant, %d in flight (capacity %d)"),
+			*GetNameSafe(Pair.Key), Pair.Value.Dormant.Num(), Pair.Value.Active.Num(), Capacity);
+	}
+	UE_LOG(LogProjectilePool, Log, TEXT("Hits %d, misses %d, spawned %d, recycled %d, rejected %d, destroyed %d, trimmed %d"),
+		Stats.Hits, Stats.Misses, Stats.Spawned, Stats.Recycled, Stats.Rejected, Stats.Destroyed, Stats.Trimmed);
+}
+
+AMechSurvivalProjectile* UMechSurvivalProjectilePool::SpawnPooled(UWorld* World, UClass* ProjectileClass, const FVector& Location, const FRotator& Rotation)
+{
+	MECHSURVIVAL_LLM_SCOPE(Projectiles);
+
+	FActorSpawnParameters ActorSpawnParams;
+	ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	AMechSurvivalProjectile* Projectile = World->SpawnActor<AMechSurvivalProjectile>(ProjectileClass, Location, Rotation, ActorSpawnParams);
+	if (Projectile != nullptr)
+	{
+		Projectile->SetPool(this);
+		++Stats.Spawned;
+	}
+	return Projectile;
+}
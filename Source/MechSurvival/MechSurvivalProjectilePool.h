@@ -0,0 +1,153 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineTypes.h"
+#include "MechSurvivalProjectilePool.generated.h"
+
+class AMechSurvivalProjectile;
+class APawn;
+class UMechSurvivalWeaponData;
+
+/** What the pool does when every projectile of a class is already in flight */
+UENUM()
+enum class EMechSurvivalPoolOverflowPolicy : uint8
+{
+	/** Spawn an extra projectile; it is destroyed instead of pooled once it comes back */
+	SpawnTransient,
+	/** Pull the oldest projectile still in flight and fire it again */
+	RecycleOldest,
+	/** Do not fire at all */
+	Reject
+};
+
+/** Running counters for the projectile pool, cumulative since the world started */
+struct FMechSurvivalProjectilePoolStats
+{
+	/** Requests served by a dormant projectile */
+	int32 Hits = 0;
+	/** Requests that found no dormant projectile */
+	int32 Misses = 0;
+	/** Projectile actors spawned, including pre-warming */
+	int32 Spawned = 0;
+	/** Projectiles pulled out of flight by RecycleOldest */
+	int32 Recycled = 0;
+	/** Requests refused by Reject */
+	int32 Rejected = 0;
+	/** Transient projectiles destroyed because the pool was already full */
+	int32 Destroyed = 0;
+	/** Dormant projectiles destroyed by TrimDormant */
+	int32 Trimmed = 0;
+};
+
+/** Projectiles of one class, dormant and in flight */
+USTRUCT()
+struct FMechSurvivalProjectilePoolBucket
+{
+	GENERATED_BODY()
+
+	/** Hidden, collision-free projectiles ready to be handed out */
+	UPROPERTY()
+	TArray<AMechSurvivalProjectile*> Dormant;
+
+	/** Projectiles in flight, oldest first */
+	UPROPERTY()
+	TArray<AMechSurvivalProjectile*> Active;
+};
+
+/**
+ * Per-world pool of projectile actors.
+ * Firing pulls a dormant projectile out of the pool and hitting something or running out of lifespan puts it back,
+ * so sustained fire does not construct, register or garbage collect actors.
+ */
+UCLASS(config=Game)
+class UMechSurvivalProjectilePool : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	/** Returns the pool for the world the context object lives in, if any */
+	static UMechSurvivalProjectilePool* Get(const UObject* WorldContextObject);
+
+	/** Spawns dormant projectiles until the pool for this class holds PrewarmCount of them */
+	void Prewarm(TSubclassOf<AMechSurvivalProjectile> ProjectileClass);
+
+	/**
+	 * Launches a projectile from the pool.
+	 *
+	 * @param	ProjectileClass		Class of projectile to launch
+	 * @param	Location			Muzzle location
+	 * @param	Rotation			Launch direction
+	 * @param	CollisionHandling	Same meaning as FActorSpawnParameters::SpawnCollisionHandlingOverride
+	 * @returns the launched projectile, or null if the shot was blocked or rejected.
+	 */
+	AMechSurvivalProjectile* Acquire(TSubclassOf<AMechSurvivalProjectile> ProjectileClass, FVector Location, const FRotator& Rotation, ESpawnActorCollisionHandlingMethod CollisionHandling = ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+
+	/**
+	 * Launches every pellet a weapon fired this frame from the same muzzle.
+	 * The muzzle is checked for blocking geometry once for the whole batch and the bucket is looked up once.
+	 *
+	 * @param	Weapon				Weapon whose stats the projectiles take; null for the class defaults
+	 * @param	ProjectileClass		Class of projectile to launch
+	 * @param	Location			Muzzle location
+	 * @param	Rotations			Launch direction of each pellet
+	 * @param	CollisionHandling	Same meaning as FActorSpawnParameters::SpawnCollisionHandlingOverride
+	 * @param	CatchUpSeconds		How long each projectile has been flying already, for shots fired earlier on a client
+	 * @param	Instigator			Pawn credited with what the projectiles hit
+	 * @returns the number of projectiles launched.
+	 */
+	int32 AcquireBatch(const UMechSurvivalWeaponData* Weapon, TSubclassOf<AMechSurvivalProjectile> ProjectileClass, FVector Location, TArrayView<const FRotator> Rotations, ESpawnActorCollisionHandlingMethod CollisionHandling = ESpawnActorCollisionHandlingMethod::AlwaysSpawn, float CatchUpSeconds = 0.f, APawn* Instigator = nullptr);
+
+	/** Returns a projectile to the pool, or destroys it if the pool for its class is already full */
+	void Release(AMechSurvivalProjectile* Projectile);
+
+	/**
+	 * Destroys dormant projectiles beyond KeepPerClass of each class, to give memory back; the pool grows again as needed.
+	 * @returns the number of projectiles destroyed.
+	 */
+	int32 TrimDormant(int32 KeepPerClass);
+
+	/** Returns the counters gathered so far */
+	const FMechSurvivalProjectilePoolStats& GetStats() const { return Stats; }
+
+	/** Writes the pool state and counters to the log */
+	void DumpStats() const;
+
+protected:
+	/** Maximum number of projectiles of one class owned by the pool */
+	UPROPERTY(config)
+	int32 Capacity = 128;
+
+	/** Number of dormant projectiles created by Prewarm */
+	UPROPERTY(config)
+	int32 PrewarmCount = 64;
+
+	/** Behaviour when a request arrives and nothing is dormant */
+	UPROPERTY(config)
+	EMechSurvivalPoolOverflowPolicy OverflowPolicy = EMechSurvivalPoolOverflowPolicy::SpawnTransient;
+
+private:
+	/** Applies SpawnActor's placement rules to a muzzle, using the class defaults as the template; returns false if nothing may be launched */
+	bool ResolveSpawnLocation(UWorld* World, UClass* ProjectileClass, FVector& Location, const FRotator& Rotation, ESpawnActorCollisionHandlingMethod CollisionHandling) const;
+
+	/** Takes a projectile out of a bucket, spawning or recycling one according to the overflow policy; null if rejected */
+	AMechSurvivalProjectile* TakeFromBucket(UWorld* World, UClass* ProjectileClass, FMechSurvivalProjectilePoolBucket& Bucket, const FVector& Location, const FRotator& Rotation);
+
+	/** Spawns a projectile that belongs to the pool */
+	AMechSurvivalProjectile* SpawnPooled(UWorld* World, UClass* ProjectileClass, const FVector& Location, const FRotator& Rotation);
+
+	/** Number of projectiles of a class owned by the pool, dormant or not */
+	static int32 GetOwnedCount(const FMechSurvivalProjectilePoolBucket& Bucket) { return Bucket.Dormant.Num() + Bucket.Active.Num(); }
+
+	UPROPERTY()
+	TMap<UClass*, FMechSurvivalProjectilePoolBucket> Buckets;
+
+	FMechSurvivalProjectilePoolStats Stats;
+};
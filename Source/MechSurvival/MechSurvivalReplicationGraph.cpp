@@ -0,0 +1,349 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalReplicationGraph.h"
+#include "MechSurvivalGameMode.h"
+#include "MechSurvivalProjectile.h"
+#include "Engine/LevelScriptActor.h"
+#include "Engine/NetDriver.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/Info.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "Misc/CommandLine.h"
+#include "UObject/UObjectIterator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechRepGraph, Log, All);
+
+namespace MechSurvivalReplicationGraph
+{
+	bool IsSpatialized(EMechSurvivalClassRepNodeMapping Mapping)
+	{
+		return Mapping >= EMechSurvivalClassRepNodeMapping::Spatialize_Static && Mapping <= EMechSurvivalClassRepNodeMapping::Spatialize_Dormancy;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+//	UMechSurvivalReplicationGraphNode_FrequencyBuckets
+// ------------------------------------------------------------------------------------------------------------------
+
+void UMechSurvivalReplicationGraphNode_FrequencyBuckets::NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo)
+{
+	Actors.Add(ActorInfo.Actor);
+}
+
+bool UMechSurvivalReplicationGraphNode_FrequencyBuckets::NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound)
+{
+	const bool bRemoved = Actors.RemoveSingleSwap(ActorInfo.Actor, false) > 0;
+	if (!bRemoved && bWarnIfNotFound)
+	{
+		UE_LOG(LogMechRepGraph, Warning, TEXT("%s was not in the distance buckets"), *GetNameSafe(ActorInfo.Actor));
+	}
+	return bRemoved;
+}
+
+void UMechSurvivalReplicationGraphNode_FrequencyBuckets::NotifyResetAllNetworkActors()
+{
+	Actors.Reset();
+}
+
+void UMechSurvivalReplicationGraphNode_FrequencyBuckets::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	if (Actors.Num() == 0 || BucketDistances.Num() == 0)
+	{
+		return;
+	}
+
+	GatheredActors.Reset(Actors.Num());
+
+	for (int32 Index = 0; Index < Actors.Num(); ++Index)
+	{
+		AActor* Actor = Actors[Index];
+		const FVector Location = Actor->GetActorLocation();
+
+		// Splitscreen connections have several viewers; the nearest one decides
+		float DistanceSquared = MAX_flt;
+		for (const FNetViewer& Viewer : Params.Viewers)
+		{
+			DistanceSquared = FMath::Min(DistanceSquared, FVector::DistSquared(Viewer.ViewLocation, Location));
+		}
+
+		for (int32 Bucket = 0; Bucket < BucketDistances.Num(); ++Bucket)
+		{
+			if (DistanceSquared <= FMath::Square(BucketDistances[Bucket]))
+			{
+				const uint32 Period = BucketPeriods.IsValidIndex(Bucket) ? FMath::Max(BucketPeriods[Bucket], 1) : 1;
+				if ((Params.ReplicationFrameNum + Index) % Period == 0)
+				{
+					GatheredActors.Add(Actor);
+				}
+				break;
+			}
+		}
+	}
+
+	if (GatheredActors.Num() > 0)
+	{
+		Params.OutGatheredReplicationLists.AddReplicationActorList(GatheredActors);
+	}
+}
+
+void UMechSurvivalReplicationGraphNode_FrequencyBuckets::LogNode(FReplicationGraphDebugInfo& DebugInfo, const FString& NodeName) const
+{
+	DebugInfo.Log(NodeName);
+	DebugInfo.PushIndent();
+	DebugInfo.Log(FString::Printf(TEXT("%d actors in %d buckets"), Actors.Num(), BucketDistances.Num()));
+	for (const AActor* Actor : Actors)
+	{
+		DebugInfo.Log(GetNameSafe(Actor));
+	}
+	DebugInfo.PopIndent();
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+//	UMechSurvivalReplicationGraphNode_AlwaysRelevant_ForConnection
+// ------------------------------------------------------------------------------------------------------------------
+
+void UMechSurvivalReplicationGraphNode_AlwaysRelevant_ForConnection::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	// Possession and view targets change at any time, so the list is rebuilt from the viewers rather than kept up to date
+	ReplicationActorList.Reset();
+
+	for (const FNetViewer& Viewer : Params.Viewers)
+	{
+		ReplicationActorList.ConditionalAdd(Viewer.InViewer);
+		if (Viewer.ViewTarget != Viewer.InViewer)
+		{
+			ReplicationActorList.ConditionalAdd(Viewer.ViewTarget);
+		}
+
+		if (APlayerController* PlayerController = Cast<APlayerController>(Viewer.InViewer))
+		{
+			ReplicationActorList.ConditionalAdd(PlayerController->PlayerState);
+
+			APawn* Pawn = PlayerController->GetPawn();
+			if (Pawn != nullptr && Pawn != Viewer.ViewTarget)
+			{
+				ReplicationActorList.ConditionalAdd(Pawn);
+			}
+		}
+	}
+
+	Params.OutGatheredReplicationLists.AddReplicationActorList(ReplicationActorList);
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+//	UMechSurvivalReplicationGraph
+// ------------------------------------------------------------------------------------------------------------------
+
+UReplicationDriver* UMechSurvivalReplicationGraph::CreateForNetDriver(UNetDriver* ForNetDriver, const FURL& URL, UWorld* World)
+{
+	if (ForNetDriver == nullptr || ForNetDriver->NetDriverName != NAME_GameNetDriver || World == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Kept switchable so that replication cost can be compared against the legacy relevancy pass
+	if (FParse::Param(FCommandLine::Get(), TEXT("NoMechRepGraph")))
+	{
+		UE_LOG(LogMechRepGraph, Log, TEXT("Replication graph disabled from the command line, using legacy relevancy"));
+		return nullptr;
+	}
+
+	if (Cast<AMechSurvivalGameMode>(World->GetAuthGameMode()) == nullptr)
+	{
+		return nullptr;
+	}
+
+	return NewObject<UMechSurvivalReplicationGraph>(GetTransientPackage());
+}
+
+void UMechSurvivalReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	// Explicit rules; everything else is derived from the class defaults below
+	ClassRepNodePolicies.Set(ALevelScriptActor::StaticClass(), EMechSurvivalClassRepNodeMapping::NotRouted);
+	ClassRepNodePolicies.Set(AInfo::StaticClass(), EMechSurvivalClassRepNodeMapping::RelevantAllConnections);
+	ClassRepNodePolicies.Set(AMechSurvivalProjectile::StaticClass(), EMechSurvivalClassRepNodeMapping::Spatialize_Dynamic);
+	ClassRepNodePolicies.Set(AStaticMeshActor::StaticClass(), EMechSurvivalClassRepNodeMapping::Spatialize_Dormancy);
+
+	const float DistantCullDistanceSquared = FMath::Square(DistantCullDistance);
+	auto GetMappingFromDefaults = [DistantCullDistanceSquared](const AActor* CDO)
+	{
+		if (CDO->bAlwaysRelevant && !CDO->bOnlyRelevantToOwner)
+		{
+			return EMechSurvivalClassRepNodeMapping::RelevantAllConnections;
+		}
+		if (CDO->bAlwaysRelevant || CDO->bOnlyRelevantToOwner || CDO->bNetUseOwnerRelevancy)
+		{
+			// Owner-only actors such as player controllers go through the per-connection node
+			return EMechSurvivalClassRepNodeMapping::NotRouted;
+		}
+		return CDO->NetCullDistanceSquared >= DistantCullDistanceSquared ? EMechSurvivalClassRepNodeMapping::Distant : EMechSurvivalClassRepNodeMapping::Spatialize_Dynamic;
+	};
+
+	TArray<UClass*> ReplicatedClasses;
+	for (TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		const AActor* ActorCDO = Cast<AActor>(Class->GetDefaultObject());
+		if (ActorCDO == nullptr || !ActorCDO->GetIsReplicated())
+		{
+			continue;
+		}
+
+		// Blueprint compilation leftovers
+		if (Class->GetName().StartsWith(TEXT("SKEL_")) || Class->GetName().StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+
+		ReplicatedClasses.Add(Class);
+
+		if (ClassRepNodePolicies.Contains(Class, false))
+		{
+			continue;
+		}
+
+		// A class that routes like its parent needs no entry, the lookup walks up the hierarchy
+		const AActor* SuperCDO = Cast<AActor>(Class->GetSuperClass()->GetDefaultObject());
+		if (SuperCDO != nullptr && SuperCDO->GetIsReplicated() && GetMappingFromDefaults(SuperCDO) == GetMappingFromDefaults(ActorCDO))
+		{
+			continue;
+		}
+
+		ClassRepNodePolicies.Set(Class, GetMappingFromDefaults(ActorCDO));
+	}
+
+	for (UClass* Class : ReplicatedClasses)
+	{
+		FClassReplicationInfo ClassInfo;
+		InitClassReplicationInfo(ClassInfo, Class, GetMappingPolicy(Class), NetDriver->NetServerMaxTickRate);
+		GlobalActorReplicationInfoMap.SetClassInfo(Class, ClassInfo);
+	}
+}
+
+void UMechSurvivalReplicationGraph::InitClassReplicationInfo(FClassReplicationInfo& Info, UClass* Class, EMechSurvivalClassRepNodeMapping Mapping, float ServerMaxTickRate) const
+{
+	const AActor* CDO = Cast<AActor>(Class->GetDefaultObject());
+	if (CDO == nullptr)
+	{
+		return;
+	}
+
+	if (MechSurvivalReplicationGraph::IsSpatialized(Mapping) || Mapping == EMechSurvivalClassRepNodeMapping::Distant)
+	{
+		Info.SetCullDistanceSquared(CDO->NetCullDistanceSquared);
+	}
+
+	Info.ReplicationPeriodFrame = FMath::Max<uint32>((uint32)FMath::RoundToFloat(ServerMaxTickRate / CDO->NetUpdateFrequency), 1);
+
+	// Bucketed actors are only gathered every few frames; their channels must outlive the longest gap
+	if (Mapping == EMechSurvivalClassRepNodeMapping::Distant)
+	{
+		int32 LongestPeriod = 1;
+		for (int32 Period : BucketPeriods)
+		{
+			LongestPeriod = FMath::Max(LongestPeriod, Period);
+		}
+		Info.ActorChannelFrameTimeout = (uint8)FMath::Min<int32>(Info.ActorChannelFrameTimeout + LongestPeriod, MAX_uint8);
+	}
+}
+
+EMechSurvivalClassRepNodeMapping UMechSurvivalReplicationGraph::GetMappingPolicy(UClass* Class)
+{
+	const EMechSurvivalClassRepNodeMapping* Mapping = ClassRepNodePolicies.Get(Class);
+	return Mapping ? *Mapping : EMechSurvivalClassRepNodeMapping::NotRouted;
+}
+
+void UMechSurvivalReplicationGraph::InitGlobalGraphNodes()
+{
+	// Lists are pooled by size; sized for a few thousand actors in a wave
+	PreAllocateRepList(3, 12);
+	PreAllocateRepList(6, 12);
+	PreAllocateRepList(128, 64);
+	PreAllocateRepList(512, 16);
+	PreAllocateRepList(2048, 8);
+
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = CellSize;
+	GridNode->SpatialBias = SpatialBias;
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+
+	DistantNode = CreateNewNode<UMechSurvivalReplicationGraphNode_FrequencyBuckets>();
+	DistantNode->BucketDistances = BucketDistances;
+	DistantNode->BucketPeriods = BucketPeriods;
+	AddGlobalGraphNode(DistantNode);
+}
+
+void UMechSurvivalReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	UMechSurvivalReplicationGraphNode_AlwaysRelevant_ForConnection* AlwaysRelevantForConnectionNode = CreateNewNode<UMechSurvivalReplicationGraphNode_AlwaysRelevant_ForConnection>();
+	AddConnectionGraphNode(AlwaysRelevantForConnectionNode, RepGraphConnection);
+}
+
+void UMechSurvivalReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	switch (GetMappingPolicy(ActorInfo.Class))
+	{
+		case EMechSurvivalClassRepNodeMapping::NotRouted:
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::RelevantAllConnections:
+			// Actors in streaming levels are only gathered for connections that have the level loaded
+			AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Spatialize_Static:
+			GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Spatialize_Dynamic:
+			GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Spatialize_Dormancy:
+			GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Distant:
+			DistantNode->NotifyAddNetworkActor(ActorInfo);
+			break;
+	}
+}
+
+void UMechSurvivalReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	switch (GetMappingPolicy(ActorInfo.Class))
+	{
+		case EMechSurvivalClassRepNodeMapping::NotRouted:
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::RelevantAllConnections:
+			AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Spatialize_Static:
+			GridNode->RemoveActor_Static(ActorInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Spatialize_Dynamic:
+			GridNode->RemoveActor_Dynamic(ActorInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Spatialize_Dormancy:
+			GridNode->RemoveActor_Dormancy(ActorInfo);
+			break;
+
+		case EMechSurvivalClassRepNodeMapping::Distant:
+			DistantNode->NotifyRemoveNetworkActor(ActorInfo);
+			break;
+	}
+}
@@ -0,0 +1,139 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "MechSurvivalReplicationGraph.generated.h"
+
+class UNetDriver;
+struct FURL;
+
+/** How actors of a class are routed into the graph */
+enum class EMechSurvivalClassRepNodeMapping : uint8
+{
+	/** Not routed to any global node; such actors are handled by per-connection nodes, or are not replicated through the graph */
+	NotRouted,
+	/** Relevant to every connection, all the time */
+	RelevantAllConnections,
+	/** Spatialized and assumed never to move */
+	Spatialize_Static,
+	/** Spatialized and updated every frame */
+	Spatialize_Dynamic,
+	/** Spatialized as dynamic while awake and as static while dormant */
+	Spatialize_Dormancy,
+	/** Visible from much further than the grid is meant for; replicated less often the further away it is */
+	Distant,
+};
+
+/**
+ * Actors that are seen from far away, sorted into distance buckets per connection.
+ * Actors in the nearest bucket are offered every frame, those further out only every few frames. Actors are
+ * staggered across frames by their position in the list so that a bucket does not replicate in bursts.
+ */
+UCLASS()
+class UMechSurvivalReplicationGraphNode_FrequencyBuckets : public UReplicationGraphNode
+{
+	GENERATED_BODY()
+
+public:
+	// UReplicationGraphNode interface
+	virtual void NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual bool NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound = true) override;
+	virtual void NotifyResetAllNetworkActors() override;
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+	virtual void LogNode(FReplicationGraphDebugInfo& DebugInfo, const FString& NodeName) const override;
+	// End of UReplicationGraphNode interface
+
+	/** Outer edge of each bucket, ascending; actors beyond the last edge are not gathered at all */
+	TArray<float> BucketDistances;
+
+	/** Frames between two gathers of an actor, per bucket */
+	TArray<int32> BucketPeriods;
+
+private:
+	TArray<AActor*> Actors;
+
+	/** Rebuilt for each connection; the graph replicates it before gathering for the next one */
+	FActorRepListRefView GatheredActors;
+};
+
+/** Always relevant to one connection: its player controller, player state, pawn and view target */
+UCLASS()
+class UMechSurvivalReplicationGraphNode_AlwaysRelevant_ForConnection : public UReplicationGraphNode_AlwaysRelevant_ForConnection
+{
+	GENERATED_BODY()
+
+public:
+	// UReplicationGraphNode interface
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+	// End of UReplicationGraphNode interface
+};
+
+/**
+ * Replication graph for MechSurvival games.
+ * Replaces the per-connection, per-actor relevancy pass of the legacy net driver, which grows with connections times
+ * actors, with a few shared nodes:
+ *  - a 2D spatial grid for pawns, props and anything else that is only relevant nearby,
+ *  - a list of actors relevant to everyone, such as the game state and the shot replicator,
+ *  - a per-connection node for the connection's own controller and pawn,
+ *  - distance buckets for actors that are visible from far away, which get rarer updates the further out they are.
+ * The graph is used by the game net driver of worlds running AMechSurvivalGameMode, unless the server is started
+ * with -NoMechRepGraph.
+ */
+UCLASS(transient, config=Engine)
+class UMechSurvivalReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	/** Picks the replication driver for a new net driver; bound to UReplicationDriver::CreateReplicationDriverDelegate by the module */
+	static UReplicationDriver* CreateForNetDriver(UNetDriver* ForNetDriver, const FURL& URL, UWorld* World);
+
+	// UReplicationGraph interface
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	// End of UReplicationGraph interface
+
+protected:
+	/** Size of a grid cell */
+	UPROPERTY(config)
+	float CellSize = 10000.f;
+
+	/** Lower left corner of the grid; actors further out are clamped into the edge cells */
+	UPROPERTY(config)
+	FVector2D SpatialBias = FVector2D(-150000.f, -150000.f);
+
+	/** Classes whose default cull distance is at least this far go into the distance buckets instead of the grid */
+	UPROPERTY(config)
+	float DistantCullDistance = 50000.f;
+
+	/** Outer edge of each distance bucket, ascending */
+	UPROPERTY(config)
+	TArray<float> BucketDistances;
+
+	/** Frames between two updates of an actor in each distance bucket, parallel to BucketDistances */
+	UPROPERTY(config)
+	TArray<int32> BucketPeriods;
+
+private:
+	/** Returns how actors of a class are routed, walking up to the nearest class that has a policy */
+	EMechSurvivalClassRepNodeMapping GetMappingPolicy(UClass* Class);
+
+	/** Fills in the replication period, cull distance and channel timeout of a class from its defaults and routing */
+	void InitClassReplicationInfo(FClassReplicationInfo& Info, UClass* Class, EMechSurvivalClassRepNodeMapping Mapping, float ServerMaxTickRate) const;
+
+	UPROPERTY()
+	UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+	UPROPERTY()
+	UMechSurvivalReplicationGraphNode_FrequencyBuckets* DistantNode;
+
+	TClassMap<EMechSurvivalClassRepNodeMapping> ClassRepNodePolicies;
+};
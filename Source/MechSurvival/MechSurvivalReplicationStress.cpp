@@ -0,0 +1,297 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalReplicationStress.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalDeterminism.h"
+#include "Components/SceneComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechRepStress, Log, All);
+
+AMechSurvivalReplicationStressActor::AMechSurvivalReplicationStressActor()
+{
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+	RootComponent->SetMobility(EComponentMobility::Movable);
+
+	bReplicates = true;
+	SetReplicatingMovement(true);
+	NetUpdateFrequency = 10.f;
+}
+
+bool UMechSurvivalReplicationStress::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld() && (FParse::Param(FCommandLine::Get(), TEXT("MechRepStress")) || FParse::Param(FCommandLine::Get(), TEXT("MechRepStressBot")));
+}
+
+void UMechSurvivalReplicationStress::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	FParse::Value(FCommandLine::Get(), TEXT("MechRepStressActors="), StressActors);
+	FParse::Value(FCommandLine::Get(), TEXT("MechRepStressClients="), ExpectedClients);
+
+	// Bots head off in different directions, so they do not all end up in the same spot
+	bBot = FParse::Param(FCommandLine::Get(), TEXT("MechRepStressBot"));
+	BotHeadingOffset = FRandomStream(FPlatformProcess::GetCurrentProcessId()).FRandRange(0.f, 360.f);
+}
+
+void UMechSurvivalReplicationStress::Deinitialize()
+{
+	EndTimingFlush();
+
+	Actors.Empty();
+
+	Super::Deinitialize();
+}
+
+ETickableTickType UMechSurvivalReplicationStress::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UMechSurvivalReplicationStress::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalReplicationStress, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalReplicationStress::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalReplicationStress::Tick(float DeltaTime)
+{
+	UWorld* World = GetWorld();
+	if (bFinished || World == nullptr || !World->HasBegunPlay() || World->GetNetDriver() == nullptr)
+	{
+		return;
+	}
+
+	if (bBot)
+	{
+		DriveBot(DeltaTime);
+		return;
+	}
+
+	if (Actors.Num() == 0)
+	{
+		SpawnActors();
+	}
+	MoveActors(DeltaTime);
+
+	if (!bMeasuring)
+	{
+		const int32 Clients = World->GetNetDriver()->ClientConnections.Num();
+		WaitTime += DeltaTime;
+		if (Clients < ExpectedClients && WaitTime < ClientTimeoutSeconds)
+		{
+			return;
+		}
+
+		UE_LOG(LogMechRepStress, Display, TEXT("%d of %d clients connected, measuring"), Clients, ExpectedClients);
+		MeasuredClients = Clients;
+		bMeasuring = true;
+		BeginTimingFlush();
+		return;
+	}
+
+	MeasureTime += DeltaTime;
+	if (MeasureTime >= WarmupSeconds + SampleSeconds)
+	{
+		Finish();
+	}
+	else if (MeasureTime > WarmupSeconds)
+	{
+		if (FrameSamples.Num() == 0)
+		{
+			MoveStatsAtSampleStart = UMechSurvivalMovementComponent::GetServerMoveStats();
+		}
+		FrameSamples.Add(DeltaTime * 1000.f);
+
+		const TArray<UNetConnection*>& Connections = World->GetNetDriver()->ClientConnections;
+		if (Connections.Num() > 0)
+		{
+			int64 InBytesPerSecond = 0;
+			int64 OutBytesPerSecond = 0;
+			for (const UNetConnection* Connection : Connections)
+			{
+				InBytesPerSecond += Connection->InBytesPerSecond;
+				OutBytesPerSecond += Connection->OutBytesPerSecond;
+			}
+			ClientInBytesPerSecond += (double)InBytesPerSecond / Connections.Num();
+			ClientOutBytesPerSecond += (double)OutBytesPerSecond / Connections.Num();
+			++BandwidthSamples;
+		}
+	}
+}
+
+void UMechSurvivalReplicationStress::DriveBot(float DeltaTime)
+{
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	AMechSurvivalCharacter* Character = PlayerController ? Cast<AMechSurvivalCharacter>(PlayerController->GetPawn()) : nullptr;
+	if (Character == nullptr)
+	{
+		return;
+	}
+
+	// Always turning, the hardest case for combining moves
+	BotTime += DeltaTime;
+	Character->AddMovementInput(FRotator(0.f, BotHeadingOffset + BotTime * BotTurnRate, 0.f).Vector(), 1.f);
+
+	const bool bBoost = FMath::Fmod(BotTime, 3.f) < 1.f;
+	if (bBoost != bBotBoosting)
+	{
+		bBotBoosting = bBoost;
+		Character->ApplyInputAction(bBoost ? EMechSurvivalInputAction::BoostPressed : EMechSurvivalInputAction::BoostReleased);
+	}
+}
+
+void UMechSurvivalReplicationStress::SpawnActors()
+{
+	UWorld* World = GetWorld();
+	const AGameModeBase* GameMode = World->GetAuthGameMode();
+	const AActor* PlayerStart = GameMode ? GameMode->FindPlayerStart(nullptr) : nullptr;
+	const FVector Origin = PlayerStart ? PlayerStart->GetActorLocation() : FVector::ZeroVector;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	// Fixed seed so that both runs of a comparison see the same layout
+	FRandomStream Random(0x5EED);
+	Actors.Reserve(StressActors);
+	Orbits.Reserve(StressActors);
+	for (int32 Index = 0; Index < StressActors; ++Index)
+	{
+		const FVector2D Center = FVector2D(Origin) + FVector2D(Random.GetUnitVector()).GetSafeNormal() * AreaRadius * FMath::Sqrt(Random.GetFraction());
+		const FVector4 Orbit(Center.X, Center.Y, Random.FRandRange(200.f, 1000.f), Random.FRandRange(0.f, 2.f * PI));
+		const FVector Location(Orbit.X + Orbit.Z * FMath::Cos(Orbit.W), Orbit.Y + Orbit.Z * FMath::Sin(Orbit.W), Origin.Z);
+
+		if (AMechSurvivalReplicationStressActor* Actor = World->SpawnActor<AMechSurvivalReplicationStressActor>(Location, FRotator::ZeroRotator, SpawnParams))
+		{
+			Actors.Add(Actor);
+			Orbits.Add(Orbit);
+		}
+	}
+
+	UE_LOG(LogMechRepStress, Display, TEXT("Spawned %d replicated actors, waiting for %d clients"), Actors.Num(), ExpectedClients);
+}
+
+void UMechSurvivalReplicationStress::MoveActors(float DeltaTime)
+{
+	for (int32 Index = 0; Index < Actors.Num(); ++Index)
+	{
+		AMechSurvivalReplicationStressActor* Actor = Actors[Index];
+		FVector4& Orbit = Orbits[Index];
+		if (!IsValid(Actor))
+		{
+			continue;
+		}
+
+		Orbit.W = FMath::Fmod(Orbit.W + ActorSpeed / Orbit.Z * DeltaTime, 2.f * PI);
+		const FVector Location(Orbit.X + Orbit.Z * FMath::Cos(Orbit.W), Orbit.Y + Orbit.Z * FMath::Sin(Orbit.W), Actor->GetActorLocation().Z);
+		Actor->SetActorLocation(Location);
+	}
+}
+
+void UMechSurvivalReplicationStress::BeginTimingFlush()
+{
+	// Bound once the net driver has been listening for a while: a multicast delegate calls its bindings last to first,
+	// so the start stamp goes ahead of the driver's TickFlush, and the post flush event follows all of them
+	UWorld* World = GetWorld();
+	TickFlushHandle = World->OnTickFlush().AddUObject(this, &UMechSurvivalReplicationStress::OnTickFlush);
+	PostTickFlushHandle = World->OnPostTickFlush().AddUObject(this, &UMechSurvivalReplicationStress::OnPostTickFlush);
+}
+
+void UMechSurvivalReplicationStress::EndTimingFlush()
+{
+	if (UWorld* World = GetWorld())
+	{
+		World->OnTickFlush().Remove(TickFlushHandle);
+		World->OnPostTickFlush().Remove(PostTickFlushHandle);
+	}
+	TickFlushHandle.Reset();
+	PostTickFlushHandle.Reset();
+	TickFlushTime = 0.0;
+}
+
+void UMechSurvivalReplicationStress::OnTickFlush(float DeltaSeconds)
+{
+	TickFlushTime = FPlatformTime::Seconds();
+}
+
+void UMechSurvivalReplicationStress::OnPostTickFlush()
+{
+	if (bMeasuring && !bFinished && MeasureTime > WarmupSeconds && TickFlushTime > 0.0)
+	{
+		ReplicationSamples.Add((FPlatformTime::Seconds() - TickFlushTime) * 1000.0);
+	}
+	TickFlushTime = 0.0;
+}
+
+void UMechSurvivalReplicationStress::Finish()
+{
+	bFinished = true;
+	EndTimingFlush();
+
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	const TCHAR* Mode = NetDriver && NetDriver->GetReplicationDriver() ? TEXT("ReplicationGraph") : TEXT("Legacy");
+
+	auto Average = [](const TArray<float>& Samples) { float Sum = 0.f; for (float Sample : Samples) { Sum += Sample; } return Samples.Num() > 0 ? Sum / Samples.Num() : 0.f; };
+	auto Percentile = [](TArray<float> Samples, float Fraction) { Samples.Sort(); return Samples.Num() > 0 ? Samples[FMath::Clamp(FMath::CeilToInt(Fraction * Samples.Num()) - 1, 0, Samples.Num() - 1)] : 0.f; };
+
+	const FString Line = FString::Printf(TEXT("%s,%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n"),
+		*FDateTime::Now().ToString(), Mode, MeasuredClients, Actors.Num(), ReplicationSamples.Num(),
+		Average(ReplicationSamples), Percentile(ReplicationSamples, 0.95f), Percentile(ReplicationSamples, 1.f), Average(FrameSamples));
+
+	// One file for all runs, so the legacy and graph rows of a comparison end up next to each other
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("RepStress.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Mode,Clients,Actors,Frames,AvgReplicationMs,P95ReplicationMs,MaxReplicationMs,AvgFrameMs\n")), *ReportPath);
+	}
+	FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+	UE_LOG(LogMechRepStress, Display, TEXT("%s: %d clients x %d actors, replication %.3f ms avg, %.3f ms p95; written to %s"),
+		Mode, MeasuredClients, Actors.Num(), Average(ReplicationSamples), Percentile(ReplicationSamples, 0.95f), *ReportPath);
+
+	WriteMovementReport(FMath::Max(MeasureTime - WarmupSeconds, KINDA_SMALL_NUMBER));
+
+	if (!GIsEditor)
+	{
+		FPlatformMisc::RequestExitWithStatus(false, 0);
+	}
+}
+
+void UMechSurvivalReplicationStress::WriteMovementReport(float SampledSeconds) const
+{
+	const FMechSurvivalServerMoveStats& MoveStats = UMechSurvivalMovementComponent::GetServerMoveStats();
+	const int32 Moves = MoveStats.Moves - MoveStatsAtSampleStart.Moves;
+	const int32 Corrections = MoveStats.Corrections - MoveStatsAtSampleStart.Corrections;
+	const double MoveSeconds = MoveStats.Seconds - MoveStatsAtSampleStart.Seconds;
+	const double InBytesPerSecond = BandwidthSamples > 0 ? ClientInBytesPerSecond / BandwidthSamples : 0.0;
+	const double OutBytesPerSecond = BandwidthSamples > 0 ? ClientOutBytesPerSecond / BandwidthSamples : 0.0;
+
+	const FString Line = FString::Printf(TEXT("%s,%d,%.1f,%.3f,%.2f,%.1f,%.0f,%.0f\n"),
+		*FDateTime::Now().ToString(), MeasuredClients, Moves / SampledSeconds, MoveSeconds * 1000.0 / SampledSeconds,
+		Moves > 0 ? MoveSeconds * 1000000.0 / Moves : 0.0, Corrections / SampledSeconds, InBytesPerSecond, OutBytesPerSecond);
+
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("Movement.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Clients,ServerMovesPerSecond,ServerMoveMsPerSecond,AvgServerMoveUs,CorrectionsPerSecond,ClientInBytesPerSecond,ClientOutBytesPerSecond\n")), *ReportPath);
+	}
+	FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+	UE_LOG(LogMechRepStress, Display, TEXT("Movement: %.0f client moves per second, %.3f ms of server time per second, %.1f corrections per second; %.0f B/s in and %.0f B/s out per client"),
+		Moves / SampledSeconds, MoveSeconds * 1000.0 / SampledSeconds, Corrections / SampledSeconds, InBytesPerSecond, OutBytesPerSecond);
+}
@@ -0,0 +1,139 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "MechSurvivalMovementComponent.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalReplicationStress.generated.h"
+
+/** Bare replicated actor that the replication stress test moves around */
+UCLASS(notplaceable)
+class AMechSurvivalReplicationStressActor : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AMechSurvivalReplicationStressActor();
+};
+
+/**
+ * Server-side replication stress test.
+ * Runs only on a server started with -MechRepStress, e.g.
+ *   MechSurvivalServer <map> -MechRepStress [-MechRepStressActors=2000] [-MechRepStressClients=32] [-NoMechRepGraph] -log
+ * with the clients connected over loopback, each started as
+ *   MechSurvival 127.0.0.1 -nullrhi -nosound -unattended [-MechRepStressBot]
+ * Spawns the replicated actors, waits for the clients, then measures how long the net driver takes to replicate each
+ * frame. Running once as is and once with -NoMechRepGraph gives the replication graph and legacy relevancy figures
+ * side by side in Saved/Benchmark/RepStress.csv; the server exits when done.
+ *
+ * A client started with -MechRepStressBot walks its pawn round in a wide circle and boosts one second in three, so that
+ * the server has a steady stream of moves to check. The time the server spent on client moves, the corrections it
+ * sent and the bytes per second to and from each client are written to Saved/Benchmark/Movement.csv.
+ */
+UCLASS(config=Game)
+class UMechSurvivalReplicationStress : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+protected:
+	/** Replicated actors to spawn */
+	UPROPERTY(config)
+	int32 StressActors = 2000;
+
+	/** Clients to wait for before measuring */
+	UPROPERTY(config)
+	int32 ExpectedClients = 32;
+
+	/** Gives up waiting for clients after this long and measures with whoever is connected */
+	UPROPERTY(config)
+	float ClientTimeoutSeconds = 180.f;
+
+	/** Seconds to let channels open before sampling */
+	UPROPERTY(config)
+	float WarmupSeconds = 10.f;
+
+	/** Seconds sampled */
+	UPROPERTY(config)
+	float SampleSeconds = 30.f;
+
+	/** Actors are scattered over a disc of this radius around the player start, so part of them is out of range of any client */
+	UPROPERTY(config)
+	float AreaRadius = 30000.f;
+
+	/** Speed at which the actors circle, so that every one of them has movement to replicate */
+	UPROPERTY(config)
+	float ActorSpeed = 300.f;
+
+	/** Degrees per second a bot client turns its pawn by */
+	UPROPERTY(config)
+	float BotTurnRate = 45.f;
+
+private:
+	void SpawnActors();
+	void MoveActors(float DeltaTime);
+	void Finish();
+
+	/** Walks and boosts the local pawn of a bot client */
+	void DriveBot(float DeltaTime);
+
+	/** Appends the server move and bandwidth figures to the movement report */
+	void WriteMovementReport(float SampledSeconds) const;
+
+	/**
+	 * Bracket the net drivers' TickFlush, where they replicate, so nothing else in the frame is timed: not the tickables,
+	 * this subsystem's own moves included, nor the frame end
+	 */
+	void BeginTimingFlush();
+	void EndTimingFlush();
+	void OnTickFlush(float DeltaSeconds);
+	void OnPostTickFlush();
+
+	UPROPERTY(Transient)
+	TArray<AMechSurvivalReplicationStressActor*> Actors;
+
+	/** Circle each actor moves on: center XY and radius in XYZ, phase in W */
+	TArray<FVector4> Orbits;
+
+	TArray<float> ReplicationSamples;
+	TArray<float> FrameSamples;
+
+	FDelegateHandle TickFlushHandle;
+	FDelegateHandle PostTickFlushHandle;
+	double TickFlushTime = 0.0;
+
+	float WaitTime = 0.f;
+	float MeasureTime = 0.f;
+	int32 MeasuredClients = 0;
+	bool bMeasuring = false;
+	bool bFinished = false;
+
+	/** Server move counts when sampling started */
+	FMechSurvivalServerMoveStats MoveStatsAtSampleStart;
+
+	/** Sum over the sampled frames of the average bytes per second from and to a client */
+	double ClientInBytesPerSecond = 0.0;
+	double ClientOutBytesPerSecond = 0.0;
+	int32 BandwidthSamples = 0;
+
+	bool bBot = false;
+	bool bBotBoosting = false;
+	float BotTime = 0.f;
+	float BotHeadingOffset = 0.f;
+};
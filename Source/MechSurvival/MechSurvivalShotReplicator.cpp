@@ -0,0 +1,408 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalShotReplicator.h"
+#include "MechSurvival.h"
+#include "MechSurvivalBallistics.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalProjectile.h"
+#include "MechSurvivalWeaponComponent.h"
+#include "MechSurvivalWeaponData.h"
+#include "Engine/NetSerialization.h"
+#include "Engine/PackageMapClient.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+
+namespace MechSurvivalShotReplicator
+{
+	/** The replicator of each world, registered as it is created on the server and on clients, for RecordShot's hot path */
+	static TMap<const UWorld*, TWeakObjectPtr<AMechSurvivalShotReplicator>> Replicators;
+
+	/** Rounds a vector to the 0.1 unit grid SerializePackedVector<10, 24> uses */
+	FVector Quantize(const FVector& Value)
+	{
+		return FVector(FMath::RoundToFloat(Value.X * 10.f), FMath::RoundToFloat(Value.Y * 10.f), FMath::RoundToFloat(Value.Z * 10.f)) * 0.1f;
+	}
+
+	/** Writes or reads pitch and yaw as 16 bits each; roll is always zero for a shot */
+	void SerializeAim(FArchive& Ar, FRotator& Rotation)
+	{
+		uint16 Pitch = 0;
+		uint16 Yaw = 0;
+		if (Ar.IsSaving())
+		{
+			Pitch = FRotator::CompressAxisToShort(Rotation.Pitch);
+			Yaw = FRotator::CompressAxisToShort(Rotation.Yaw);
+		}
+		Ar << Pitch;
+		Ar << Yaw;
+		if (Ar.IsLoading())
+		{
+			Rotation = FRotator(FRotator::DecompressAxisFromShort(Pitch), FRotator::DecompressAxisFromShort(Yaw), 0.f);
+		}
+	}
+}
+
+bool FMechSurvivalFireRequest::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	bOutSuccess = SerializePackedVector<10, 24>(Location, Ar);
+	MechSurvivalShotReplicator::SerializeAim(Ar, Rotation);
+	Ar << Timestamp;
+	Ar << ShotId;
+
+	uint32 NumRounds = Rounds;
+	Ar.SerializeInt(NumRounds, MaxRounds + 1);
+	Rounds = (uint8)NumRounds;
+	return true;
+}
+
+bool FMechSurvivalShotBatch::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	bOutSuccess = true;
+
+	// Objects shared by several shots go into small tables that the shots index into
+	TArray<UObject*> Classes;
+	TArray<UObject*> Weapons;
+	TArray<UObject*> Instigators;
+	uint32 NumShots = Shots.Num();
+	uint32 NumClasses = 0;
+	uint32 NumWeapons = 0;
+	uint32 NumInstigators = 0;
+
+	if (Ar.IsSaving())
+	{
+		for (const FMechSurvivalShot& Shot : Shots)
+		{
+			Classes.AddUnique(Shot.ProjectileClass);
+			if (Shot.Weapon != nullptr)
+			{
+				Weapons.AddUnique(const_cast<UMechSurvivalWeaponData*>(Shot.Weapon));
+			}
+			Instigators.AddUnique(Shot.Instigator);
+		}
+		NumClasses = Classes.Num();
+		NumWeapons = Weapons.Num();
+		NumInstigators = Instigators.Num();
+	}
+
+	Ar.SerializeIntPacked(NumShots);
+	Ar.SerializeIntPacked(NumClasses);
+	Ar.SerializeIntPacked(NumWeapons);
+	Ar.SerializeIntPacked(NumInstigators);
+
+	if (Ar.IsLoading())
+	{
+		if (NumShots > (uint32)MaxShotsPerBatch)
+		{
+			// A damaged or hostile packet; refuse it before allocating anything
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		if (NumClasses > NumShots || NumWeapons > NumShots || NumInstigators > NumShots || (NumShots > 0 && (NumClasses == 0 || NumInstigators == 0)))
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		Classes.SetNumZeroed(NumClasses);
+		Weapons.SetNumZeroed(NumWeapons);
+		Instigators.SetNumZeroed(NumInstigators);
+		Shots.SetNum(NumShots);
+	}
+
+	for (UObject*& Class : Classes)
+	{
+		bOutSuccess &= Map->SerializeObject(Ar, UClass::StaticClass(), Class);
+	}
+	for (UObject*& Weapon : Weapons)
+	{
+		// Ini presets are not assets, but every machine has them by name
+		const UMechSurvivalWeaponData* WeaponData = Cast<UMechSurvivalWeaponData>(Weapon);
+		uint8 bPreset = WeaponData != nullptr && !WeaponData->IsSupportedForNetworking();
+		Ar.SerializeBits(&bPreset, 1);
+		if (bPreset)
+		{
+			FName PresetName = WeaponData != nullptr ? WeaponData->Stats.Name : NAME_None;
+			Ar << PresetName;
+			if (Ar.IsLoading())
+			{
+				Weapon = UMechSurvivalWeaponComponent::FindPresetWeapon(PresetName);
+			}
+		}
+		else
+		{
+			bOutSuccess &= Map->SerializeObject(Ar, UMechSurvivalWeaponData::StaticClass(), Weapon);
+		}
+	}
+	for (UObject*& Instigator : Instigators)
+	{
+		bOutSuccess &= Map->SerializeObject(Ar, APawn::StaticClass(), Instigator);
+	}
+
+	FVector PreviousLocation = FVector::ZeroVector;
+	for (FMechSurvivalShot& Shot : Shots)
+	{
+		uint32 ClassIndex = Ar.IsSaving() ? Classes.IndexOfByKey(Shot.ProjectileClass) : 0;
+		uint32 InstigatorIndex = Ar.IsSaving() ? Instigators.IndexOfByKey(Shot.Instigator) : 0;
+		Ar.SerializeInt(ClassIndex, FMath::Max<uint32>(NumClasses, 2));
+		Ar.SerializeInt(InstigatorIndex, FMath::Max<uint32>(NumInstigators, 2));
+
+		// Zero for no weapon, so batches without weapons spend nothing on them
+		uint32 WeaponIndex = 0;
+		if (NumWeapons > 0)
+		{
+			WeaponIndex = Ar.IsSaving() && Shot.Weapon != nullptr ? Weapons.IndexOfByKey(Shot.Weapon) + 1 : 0;
+			Ar.SerializeInt(WeaponIndex, NumWeapons + 1);
+		}
+
+		// Delta against what the receiver will have reconstructed, so rounding does not accumulate along the batch
+		FVector Delta = MechSurvivalShotReplicator::Quantize(Shot.Location - PreviousLocation);
+		bOutSuccess &= SerializePackedVector<10, 24>(Delta, Ar);
+		PreviousLocation += Delta;
+
+		MechSurvivalShotReplicator::SerializeAim(Ar, Shot.Rotation);
+
+		// The pellets of every round follow from the seed, so they cost nothing on the wire
+		Ar << Shot.Seed;
+		uint32 Rounds = Shot.Rounds;
+		Ar.SerializeInt(Rounds, FMechSurvivalFireRequest::MaxRounds + 1);
+		Shot.Rounds = (uint8)Rounds;
+
+		uint8 bPredicted = Shot.bPredicted;
+		Ar.SerializeBits(&bPredicted, 1);
+		Shot.bPredicted = bPredicted != 0;
+
+		// Only shots caught up with a client carry their flight time
+		uint32 CatchUpMilliseconds = FMath::Max(FMath::RoundToInt(Shot.CatchUpSeconds * 1000.f), 0);
+		uint8 bCaughtUp = CatchUpMilliseconds > 0;
+		Ar.SerializeBits(&bCaughtUp, 1);
+		if (bCaughtUp)
+		{
+			Ar.SerializeIntPacked(CatchUpMilliseconds);
+		}
+		Shot.CatchUpSeconds = bCaughtUp ? CatchUpMilliseconds * 0.001f : 0.f;
+
+		if (Ar.IsLoading())
+		{
+			if (ClassIndex >= NumClasses || InstigatorIndex >= NumInstigators || WeaponIndex > NumWeapons || Shot.Seed == 0 || Shot.Rounds == 0)
+			{
+				bOutSuccess = false;
+				break;
+			}
+			Shot.ProjectileClass = Cast<UClass>(Classes[ClassIndex]);
+			Shot.Weapon = WeaponIndex > 0 ? Cast<UMechSurvivalWeaponData>(Weapons[WeaponIndex - 1]) : nullptr;
+			Shot.Instigator = Cast<APawn>(Instigators[InstigatorIndex]);
+			Shot.Location = PreviousLocation;
+		}
+	}
+
+	return true;
+}
+
+AMechSurvivalShotReplicator::AMechSurvivalShotReplicator()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	// Flush after everything else had a chance to fire this frame
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+
+	bReplicates = true;
+	bAlwaysRelevant = true;
+	// Nothing but RPCs go through this actor, so property replication can be rare
+	NetUpdateFrequency = 1.f;
+}
+
+AMechSurvivalShotReplicator* AMechSurvivalShotReplicator::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	const TWeakObjectPtr<AMechSurvivalShotReplicator>* Replicator = World ? MechSurvivalShotReplicator::Replicators.Find(World) : nullptr;
+	return Replicator ? Replicator->Get() : nullptr;
+}
+
+void AMechSurvivalShotReplicator::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	if (const UWorld* World = GetWorld())
+	{
+		MechSurvivalShotReplicator::Replicators.Add(World, this);
+	}
+}
+
+void AMechSurvivalShotReplicator::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Damage is only dealt on the server
+	UMechSurvivalHorde* Horde = HasAuthority() ? UMechSurvivalHorde::Get(this) : nullptr;
+	if (Horde != nullptr)
+	{
+		MechDamagedHandle = Horde->OnMechDamaged.AddUObject(this, &AMechSurvivalShotReplicator::OnMechDamaged);
+	}
+}
+
+void AMechSurvivalShotReplicator::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		Horde->OnMechDamaged.Remove(MechDamagedHandle);
+	}
+	PendingHits.Empty();
+
+	const UWorld* World = GetWorld();
+	const TWeakObjectPtr<AMechSurvivalShotReplicator>* Registered = World ? MechSurvivalShotReplicator::Replicators.Find(World) : nullptr;
+	if (Registered != nullptr && Registered->Get() == this)
+	{
+		MechSurvivalShotReplicator::Replicators.Remove(World);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AMechSurvivalShotReplicator::RecordShot(APawn* Instigator, TSubclassOf<AMechSurvivalProjectile> ProjectileClass, const UMechSurvivalWeaponData* Weapon, const FVector& Location, const FRotator& Aim, uint16 Seed, int32 Rounds, bool bPredicted, float CatchUpSeconds)
+{
+	if (!HasAuthority() || GetNetMode() == NM_Standalone || ProjectileClass == nullptr || Rounds <= 0 || Seed == 0)
+	{
+		return;
+	}
+
+	// More rounds than one entry carries only come from a long hitch; the rest go in further entries
+	while (Rounds > 0)
+	{
+		FMechSurvivalShot& Shot = PendingShots.Shots.AddDefaulted_GetRef();
+		Shot.ProjectileClass = ProjectileClass;
+		Shot.Weapon = Weapon;
+		Shot.Instigator = Instigator;
+		Shot.Location = Location;
+		Shot.Rotation = Aim;
+		Shot.Seed = Seed;
+		Shot.Rounds = (uint8)FMath::Min(Rounds, FMechSurvivalFireRequest::MaxRounds);
+		Shot.bPredicted = bPredicted;
+		Shot.CatchUpSeconds = CatchUpSeconds;
+
+		for (int32 Round = 0; Round < Shot.Rounds; ++Round)
+		{
+			Seed = FMechSurvivalFireRequest::NextShotId(Seed);
+		}
+		Rounds -= Shot.Rounds;
+	}
+}
+
+void AMechSurvivalShotReplicator::OnMechDamaged(const FVector& Location, float Damage, APawn* Instigator)
+{
+	// Mechs hurting each other, or damage nobody can be credited with, shows on no HUD
+	if (Instigator == nullptr || !Instigator->IsPlayerControlled())
+	{
+		return;
+	}
+
+	TArray<FMechSurvivalConfirmedHit>& Hits = PendingHits.FindOrAdd(Instigator);
+	if (Hits.Num() < FMath::Max(MaxConfirmedHitsPerFrame, 1))
+	{
+		FMechSurvivalConfirmedHit& Hit = Hits.AddDefaulted_GetRef();
+		Hit.Location = Location;
+		Hit.Damage = Damage;
+	}
+}
+
+void AMechSurvivalShotReplicator::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (PendingShots.Shots.Num() > 0)
+	{
+		FlushShots();
+	}
+	if (PendingHits.Num() > 0)
+	{
+		FlushHits();
+	}
+}
+
+void AMechSurvivalShotReplicator::FlushHits()
+{
+	// Owner-only, so each player hears of its own hits and nobody else's; the server's own player gets the call directly
+	for (const TPair<TWeakObjectPtr<APawn>, TArray<FMechSurvivalConfirmedHit>>& Pair : PendingHits)
+	{
+		if (AMechSurvivalCharacter* Character = Cast<AMechSurvivalCharacter>(Pair.Key.Get()))
+		{
+			Character->ClientConfirmHits(Pair.Value);
+		}
+	}
+
+	PendingHits.Reset();
+}
+
+void AMechSurvivalShotReplicator::FlushShots()
+{
+	MECHSURVIVAL_INC_COUNTER(ShotEventsReplicated, PendingShots.Shots.Num());
+
+	// Clients refuse anything larger than the wire limit
+	const int32 BatchSize = FMath::Clamp(MaxShotsPerBatch, 1, FMechSurvivalShotBatch::MaxShotsPerBatch);
+	if (PendingShots.Shots.Num() <= BatchSize)
+	{
+		MulticastShots(PendingShots);
+	}
+	else
+	{
+		FMechSurvivalShotBatch Chunk;
+		for (int32 Start = 0; Start < PendingShots.Shots.Num(); Start += BatchSize)
+		{
+			const int32 Count = FMath::Min(BatchSize, PendingShots.Shots.Num() - Start);
+			Chunk.Shots.Reset();
+			Chunk.Shots.Append(PendingShots.Shots.GetData() + Start, Count);
+			MulticastShots(Chunk);
+		}
+	}
+
+	PendingShots.Shots.Reset();
+}
+
+void AMechSurvivalShotReplicator::MulticastShots_Implementation(const FMechSurvivalShotBatch& Batch)
+{
+	if (HasAuthority())
+	{
+		// The server simulated these for real already
+		return;
+	}
+
+	UMechSurvivalBallistics* Ballistics = UMechSurvivalBallistics::Get(this);
+	if (Ballistics == nullptr)
+	{
+		return;
+	}
+
+	TArray<FRotator, TInlineAllocator<16>> Rotations;
+	for (const FMechSurvivalShot& Shot : Batch.Shots)
+	{
+		// Our own shots were shown the moment we fired them; only line them up with what the server decided
+		const bool bOwnShot = Shot.Instigator != nullptr && Shot.Instigator->IsLocallyControlled();
+
+		// Same seeds, same scatter as on the server
+		Rotations.Reset();
+		uint16 Seed = Shot.Seed;
+		for (int32 Round = 0; Round < Shot.Rounds; ++Round)
+		{
+			const int32 FirstPellet = Rotations.Num();
+			if (Shot.Weapon != nullptr)
+			{
+				Shot.Weapon->Stats.AddPelletRotations(Shot.Rotation, Seed, Rotations);
+			}
+			else
+			{
+				Rotations.Add(Shot.Rotation);
+			}
+
+			if (bOwnShot && Shot.bPredicted)
+			{
+				Ballistics->ReconcilePredictedRound(Seed, Shot.Location, Rotations[FirstPellet]);
+			}
+			Seed = FMechSurvivalFireRequest::NextShotId(Seed);
+		}
+
+		if (!bOwnShot)
+		{
+			Ballistics->FireBatch(Shot.Weapon, Shot.ProjectileClass, Shot.Location, Rotations, true, TArrayView<const uint16>(), Shot.CatchUpSeconds);
+		}
+	}
+}
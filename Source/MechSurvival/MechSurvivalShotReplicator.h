@@ -0,0 +1,186 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Info.h"
+#include "Engine/NetSerialization.h"
+#include "MechSurvivalShotReplicator.generated.h"
+
+class AMechSurvivalProjectile;
+class UMechSurvivalWeaponData;
+
+/** What a client tells the server about the rounds it fired in one frame */
+USTRUCT()
+struct FMechSurvivalFireRequest
+{
+	GENERATED_BODY()
+
+	/** Most rounds one request may carry; a client firing more in a frame sends several */
+	static constexpr int32 MaxRounds = 16;
+
+	/** Shot ids count up from one and wrap around past zero, which means no id */
+	static uint16 NextShotId(uint16 ShotId) { return ShotId == MAX_uint16 ? 1 : ShotId + 1; }
+
+	/** Muzzle location, quantized to a tenth of a unit on the wire */
+	FVector Location = FVector::ZeroVector;
+
+	/** Aim; roll is not sent and pitch/yaw are quantized to 16 bits each */
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	/** Server world time at which the client fired, as estimated by the client */
+	float Timestamp = 0.f;
+
+	/** Client-chosen id of the first predicted round, never zero; the others take the ids after it. Each id also seeds its round's pellet spread */
+	uint16 ShotId = 0;
+
+	/** Rounds fired this frame, from 1 to MaxRounds */
+	uint8 Rounds = 1;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FMechSurvivalFireRequest> : public TStructOpsTypeTraitsBase2<FMechSurvivalFireRequest>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/**
+ * The rounds one pawn fired in one frame, as seen by clients.
+ * Only the aim and the seed travel; clients scatter the pellets of each round with the weapon's spread themselves.
+ */
+struct FMechSurvivalShot
+{
+	UClass* ProjectileClass = nullptr;
+
+	/** Weapon the rounds fly by, an asset or an ini preset, which goes by name; null for the projectile class defaults */
+	const UMechSurvivalWeaponData* Weapon = nullptr;
+
+	class APawn* Instigator = nullptr;
+	FVector Location = FVector::ZeroVector;
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	/** Seed of the first round's pellets, never zero; the following rounds take the next seeds, see FMechSurvivalFireRequest::NextShotId */
+	uint16 Seed = 1;
+
+	/** Rounds fired, from 1 to FMechSurvivalFireRequest::MaxRounds */
+	uint8 Rounds = 1;
+
+	/** True if the seeds are the ids of rounds the instigating client predicted */
+	bool bPredicted = false;
+
+	/** How long the server's round has been flying already, for shots it caught up with a client; whole milliseconds on the wire */
+	float CatchUpSeconds = 0.f;
+};
+
+/**
+ * All shots the server simulated in one frame.
+ * Projectile classes, weapons and instigators are sent once per batch and referenced by index. Each muzzle location is
+ * sent as a delta from the previous shot, which is small for the shots of one pawn.
+ */
+USTRUCT()
+struct FMechSurvivalShotBatch
+{
+	GENERATED_BODY()
+
+	/** Most shots a batch may carry on the wire; a larger count read from a packet is an error, not an allocation */
+	static constexpr int32 MaxShotsPerBatch = 512;
+
+	TArray<FMechSurvivalShot> Shots;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FMechSurvivalShotBatch> : public TStructOpsTypeTraitsBase2<FMechSurvivalShotBatch>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/** A hit the server confirmed for a player's shot, for that player's hit marker and damage numbers */
+USTRUCT()
+struct FMechSurvivalConfirmedHit
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector_NetQuantize Location;
+
+	UPROPERTY()
+	float Damage = 0.f;
+};
+
+/**
+ * Server-to-client channel for shots.
+ * Projectiles are never replicated as actors; instead the server collects every shot it simulates during a frame and
+ * sends them to all clients in one unreliable multicast, one entry per pawn and frame whatever the rounds and pellets.
+ * Clients turn them into cosmetic rounds, except for their own shots which they already showed when firing; those are
+ * reconciled with the server's version instead. The damage the horde takes from a player's shots goes back the other
+ * way once a frame, to that player's client only, for its HUD. One of these exists per world, spawned by the game mode.
+ */
+UCLASS(config=Game, notplaceable)
+class AMechSurvivalShotReplicator : public AInfo
+{
+	GENERATED_BODY()
+
+public:
+	AMechSurvivalShotReplicator();
+
+	/** Returns the replicator of the world the context object lives in, if any */
+	static AMechSurvivalShotReplicator* Get(const UObject* WorldContextObject);
+
+	/**
+	 * Queues the rounds a pawn fired this frame for the next batch; server only.
+	 * @param Aim				Aim the pellets of every round are scattered around
+	 * @param Seed				Seed of the first round's pellets, never zero; the next rounds take the next seeds
+	 * @param Rounds			Rounds fired, at most FMechSurvivalFireRequest::MaxRounds
+	 * @param bPredicted		True if the seeds are the ids of rounds the instigator's client predicted
+	 * @param CatchUpSeconds	How long the rounds have been flying already, for rounds caught up with a client
+	 */
+	void RecordShot(APawn* Instigator, TSubclassOf<AMechSurvivalProjectile> ProjectileClass, const UMechSurvivalWeaponData* Weapon, const FVector& Location, const FRotator& Aim, uint16 Seed, int32 Rounds, bool bPredicted, float CatchUpSeconds = 0.f);
+
+	// AActor interface
+	virtual void PostInitializeComponents() override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void Tick(float DeltaSeconds) override;
+	// End of AActor interface
+
+protected:
+	/** Delivers a frame's worth of shots to every client */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastShots(const FMechSurvivalShotBatch& Batch);
+
+	/** Upper bound on shots in a single multicast, at most FMechSurvivalShotBatch::MaxShotsPerBatch; larger frames are split */
+	UPROPERTY(config)
+	int32 MaxShotsPerBatch = 128;
+
+	/** Most confirmed hits a player is sent per frame; past that, the hit marker flashes for the others all the same */
+	UPROPERTY(config)
+	int32 MaxConfirmedHitsPerFrame = 32;
+
+private:
+	/** Sends the shots recorded this frame to every client */
+	void FlushShots();
+
+	/** Sends each player the hits its shots landed this frame */
+	void FlushHits();
+
+	/** Queues a hit on the horde for its instigator's client, if a player dealt it */
+	void OnMechDamaged(const FVector& Location, float Damage, APawn* Instigator);
+
+	/** Shots recorded since the last flush */
+	FMechSurvivalShotBatch PendingShots;
+
+	/** Hits confirmed since the last flush, by the pawn that landed them */
+	TMap<TWeakObjectPtr<APawn>, TArray<FMechSurvivalConfirmedHit>> PendingHits;
+
+	FDelegateHandle MechDamagedHandle;
+};
@@ -0,0 +1,440 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalSignificance.h"
+#include "MechSurvival.h"
+#include "MechSurvivalAnimationBudget.h"
+#include "MechSurvivalProjectile.h"
+#include "MechSurvivalSkeletalMeshComponent.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Sound/SoundBase.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSignificance, Log, All);
+
+static TAutoConsoleVariable<int32> CVarSignificanceDebug(
+	TEXT("MechSurvival.Significance.Debug"),
+	0,
+	TEXT("1 draws the significance level over every scored actor, green for full fidelity to red for insignificant"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorld GDumpSignificanceCmd(
+	TEXT("MechSurvival.Significance.Dump"),
+	TEXT("Logs the number of actors at each significance level and how many fire sounds and effects were culled"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalSignificance* Significance = UMechSurvivalSignificance::Get(World))
+		{
+			Significance->DumpStats();
+		}
+	}));
+
+/** Sets a tick interval, never going below the one the actor was made with */
+static void SetActorTickInterval(AActor* Actor, float Interval)
+{
+	Actor->SetActorTickInterval(FMath::Max(Actor->GetClass()->GetDefaultObject<AActor>()->PrimaryActorTick.TickInterval, Interval));
+}
+
+/** Sets a tick interval, never going below the one the component was made with */
+static void SetComponentTickInterval(UActorComponent* Component, float Interval)
+{
+	const UActorComponent* Defaults = CastChecked<UActorComponent>(Component->GetArchetype());
+	Component->SetComponentTickInterval(FMath::Max(Defaults->PrimaryComponentTick.TickInterval, Interval));
+}
+
+bool UMechSurvivalSignificance::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalSignificance::Deinitialize()
+{
+	Entries.Empty();
+	EntryIndices.Empty();
+	Viewers.Empty();
+	FireSoundEndTimes.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalSignificance* UMechSurvivalSignificance::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalSignificance>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalSignificance::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalSignificance::IsTickable() const
+{
+	return GetWorld() != nullptr && (Entries.Num() > 0 || FireSoundEndTimes.Num() > 0);
+}
+
+TStatId UMechSurvivalSignificance::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalSignificance, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalSignificance::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalSignificance::Tick(float DeltaTime)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(SignificanceUpdate);
+
+	UpdateViewers();
+
+	// Without anybody to matter to, everything stays where it was
+	if (Viewers.Num() > 0)
+	{
+		const int32 NumToScore = FMath::Min(Entries.Num(), FMath::Max(1, ActorsPerFrame));
+		for (int32 Step = 0; Step < NumToScore && Entries.Num() > 0; ++Step)
+		{
+			if (NextEntry >= Entries.Num())
+			{
+				NextEntry = 0;
+			}
+
+			FEntry& Entry = Entries[NextEntry];
+			const AActor* Actor = Entry.Actor.Get();
+			if (Actor == nullptr)
+			{
+				// The entry swapped into this slot is scored next
+				RemoveEntryAt(NextEntry);
+				continue;
+			}
+
+			// Pooled projectiles waiting in the pool are hidden; they are scored again when fired
+			if (!Actor->IsHidden())
+			{
+				UpdateEntry(Entry);
+			}
+			++NextEntry;
+		}
+	}
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	FireSoundEndTimes.RemoveAllSwap([Now](float EndTime) { return EndTime <= Now; });
+
+	UpdateStats();
+}
+
+void UMechSurvivalSignificance::UpdateViewers()
+{
+	Viewers.Reset();
+
+	const UWorld* World = GetWorld();
+	const bool bIsServer = World->GetNetMode() != NM_Client;
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController == nullptr)
+		{
+			continue;
+		}
+
+		if (PlayerController->IsLocalController())
+		{
+			FViewer& Viewer = Viewers.AddDefaulted_GetRef();
+			FRotator Rotation;
+			PlayerController->GetPlayerViewPoint(Viewer.Location, Rotation);
+			Viewer.Direction = Rotation.Vector();
+			const float FOV = PlayerController->PlayerCameraManager ? PlayerController->PlayerCameraManager->GetFOVAngle() : 90.f;
+			Viewer.CosHalfFOV = FMath::Cos(FMath::DegreesToRadians(FMath::Min(0.5f * FOV + ViewMarginDegrees, 180.f)));
+			Viewer.Pawn = PlayerController->GetPawn();
+		}
+		else if (bIsServer && PlayerController->GetPawn() != nullptr)
+		{
+			// What a remote player looks at is up to its client; the server only knows where it is
+			FViewer& Viewer = Viewers.AddDefaulted_GetRef();
+			Viewer.Location = PlayerController->GetPawn()->GetActorLocation();
+			Viewer.Direction = FVector::ForwardVector;
+			Viewer.CosHalfFOV = -1.f;
+			Viewer.Pawn = PlayerController->GetPawn();
+		}
+	}
+}
+
+float UMechSurvivalSignificance::ScoreActor(const AActor* Actor) const
+{
+	const FVector Location = Actor->GetActorLocation();
+	const float InvMaxDistance = 1.f / FMath::Max(MaxDistance, 1.f);
+
+	float BestScore = 0.f;
+	for (const FViewer& Viewer : Viewers)
+	{
+		if (Viewer.Pawn != nullptr && (Actor == Viewer.Pawn || Actor->GetOwner() == Viewer.Pawn || Actor->GetInstigator() == Viewer.Pawn))
+		{
+			return 1.f;
+		}
+
+		const FVector ToActor = Location - Viewer.Location;
+		const float Distance = ToActor.Size();
+		float Score = 1.f - FMath::Min(Distance * InvMaxDistance, 1.f);
+		if (Viewer.CosHalfFOV > -1.f && Distance > KINDA_SMALL_NUMBER && FVector::DotProduct(ToActor, Viewer.Direction) < Viewer.CosHalfFOV * Distance)
+		{
+			Score *= OffscreenScale;
+		}
+		BestScore = FMath::Max(BestScore, Score);
+	}
+	return BestScore;
+}
+
+bool UMechSurvivalSignificance::IsLocalPlayerPawn(const AActor* Actor) const
+{
+	const APawn* Pawn = Cast<APawn>(Actor);
+	return Pawn != nullptr && Pawn->IsLocallyControlled() && Pawn->IsPlayerControlled();
+}
+
+int32 UMechSurvivalSignificance::GetLevelForScore(float Score) const
+{
+	int32 Level = 0;
+	while (Level < LevelThresholds.Num() && Score < LevelThresholds[Level])
+	{
+		++Level;
+	}
+	return Level;
+}
+
+void UMechSurvivalSignificance::UpdateEntry(FEntry& Entry)
+{
+	AActor* Actor = Entry.Actor.Get();
+	Entry.Score = ScoreActor(Actor);
+
+	if (Entry.Category == EMechSurvivalSignificanceCategory::Character)
+	{
+		SetAnimationSignificance(Actor, Entry.Score);
+	}
+
+	const int32 Level = GetLevelForScore(Entry.Score);
+	if (Level != Entry.Level)
+	{
+		ApplyLevel(Actor, Entry.Category, Level);
+		Entry.Level = Level;
+	}
+}
+
+void UMechSurvivalSignificance::ApplyLevel(AActor* Actor, EMechSurvivalSignificanceCategory Category, int32 Level) const
+{
+	const float Interval = TickIntervals.Num() > 0 ? TickIntervals[FMath::Min(Level, TickIntervals.Num() - 1)] : 0.f;
+	SetActorTickInterval(Actor, Interval);
+
+	if (Category == EMechSurvivalSignificanceCategory::Character)
+	{
+		// Frame skipping by screen size on top of the slower tick; at the deepest levels only what is on screen animates
+		const UMechSurvivalAnimationBudget* AnimationBudget = UMechSurvivalAnimationBudget::Get(Actor);
+		const bool bBudgeted = AnimationBudget != nullptr && AnimationBudget->IsBudgeting();
+		TInlineComponentArray<USkeletalMeshComponent*> Meshes(Actor);
+		for (USkeletalMeshComponent* Mesh : Meshes)
+		{
+			// The budget paces these by their score instead
+			if (bBudgeted && Mesh->IsA<UMechSurvivalSkeletalMeshComponent>())
+			{
+				continue;
+			}
+
+			const USkeletalMeshComponent* Defaults = CastChecked<USkeletalMeshComponent>(Mesh->GetArchetype());
+			SetComponentTickInterval(Mesh, Interval);
+			Mesh->bEnableUpdateRateOptimizations = Defaults->bEnableUpdateRateOptimizations || Level > 0;
+			Mesh->VisibilityBasedAnimTickOption = Level >= RenderedOnlyAnimationLevel ? EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered : Defaults->VisibilityBasedAnimTickOption;
+		}
+	}
+	else if (Category == EMechSurvivalSignificanceCategory::Projectile)
+	{
+		// Movement sweeps stay continuous, so a slower tick takes longer steps but never tunnels
+		AMechSurvivalProjectile* Projectile = CastChecked<AMechSurvivalProjectile>(Actor);
+		UProjectileMovementComponent* Movement = Projectile->GetProjectileMovement();
+		const UProjectileMovementComponent* DefaultMovement = Projectile->GetClass()->GetDefaultObject<AMechSurvivalProjectile>()->GetProjectileMovement();
+		SetComponentTickInterval(Movement, Interval);
+
+		const bool bReducedCollision = Level >= ReducedCollisionLevel;
+		Movement->MaxSimulationIterations = bReducedCollision ? 1 : DefaultMovement->MaxSimulationIterations;
+		Movement->bForceSubStepping = bReducedCollision ? false : DefaultMovement->bForceSubStepping;
+	}
+}
+
+void UMechSurvivalSignificance::SetAnimationSignificance(AActor* Actor, float Score) const
+{
+	// Our own pawn animates every frame, whatever the budget
+	const bool bNeverSkip = IsLocalPlayerPawn(Actor);
+	TInlineComponentArray<UMechSurvivalSkeletalMeshComponent*> Meshes(Actor);
+	for (UMechSurvivalSkeletalMeshComponent* Mesh : Meshes)
+	{
+		Mesh->SetComponentSignificance(Score, bNeverSkip);
+	}
+}
+
+void UMechSurvivalSignificance::RegisterActor(AActor* Actor, EMechSurvivalSignificanceCategory Category)
+{
+	if (Actor == nullptr || EntryIndices.Contains(Actor))
+	{
+		return;
+	}
+
+	checkf(Category != EMechSurvivalSignificanceCategory::Projectile || Actor->IsA<AMechSurvivalProjectile>(), TEXT("%s is not a projectile"), *GetNameSafe(Actor));
+
+	EntryIndices.Add(Actor, Entries.Num());
+	FEntry& Entry = Entries.AddDefaulted_GetRef();
+	Entry.Actor = Actor;
+	Entry.Key = Actor;
+	Entry.Category = Category;
+	Entry.Score = 1.f;
+	Entry.Level = 0;
+}
+
+void UMechSurvivalSignificance::UnregisterActor(AActor* Actor)
+{
+	const int32* Index = EntryIndices.Find(Actor);
+	if (Index == nullptr)
+	{
+		return;
+	}
+
+	const FEntry& Entry = Entries[*Index];
+	if (Entry.Level != 0 && Actor != nullptr)
+	{
+		ApplyLevel(Actor, Entry.Category, 0);
+	}
+	RemoveEntryAt(*Index);
+}
+
+void UMechSurvivalSignificance::RemoveEntryAt(int32 Index)
+{
+	EntryIndices.Remove(Entries[Index].Key);
+	Entries.RemoveAtSwap(Index, 1, false);
+	if (Entries.IsValidIndex(Index))
+	{
+		EntryIndices.Add(Entries[Index].Key, Index);
+	}
+}
+
+void UMechSurvivalSignificance::RefreshActor(AActor* Actor)
+{
+	const int32* Index = EntryIndices.Find(Actor);
+	if (Index != nullptr && Viewers.Num() > 0)
+	{
+		UpdateEntry(Entries[*Index]);
+	}
+}
+
+int32 UMechSurvivalSignificance::GetLevel(const AActor* Actor) const
+{
+	const int32* Index = EntryIndices.Find(Actor);
+	return Index ? Entries[*Index].Level : 0;
+}
+
+bool UMechSurvivalSignificance::ShouldPlayFireEffects(const AActor* Shooter)
+{
+	// Nobody to see them
+	if (GetWorld()->GetNetMode() == NM_DedicatedServer)
+	{
+		return false;
+	}
+
+	if (IsLocalPlayerPawn(Shooter) || GetLevel(Shooter) <= MaxFireEffectsLevel)
+	{
+		return true;
+	}
+
+	++FireEffectsCulled;
+	return false;
+}
+
+bool UMechSurvivalSignificance::TryPlayFireSound(const AActor* Shooter, const USoundBase* Sound)
+{
+	if (Sound == nullptr || GetWorld()->GetNetMode() == NM_DedicatedServer)
+	{
+		return false;
+	}
+
+	// Our own gun is always heard and does not take a slot from the others
+	if (IsLocalPlayerPawn(Shooter))
+	{
+		++FireSoundsPlayed;
+		MECHSURVIVAL_INC_COUNTER(FireSoundsPlayed, 1);
+		return true;
+	}
+
+	if (GetLevel(Shooter) > MaxFireEffectsLevel || FireSoundEndTimes.Num() >= MaxConcurrentFireSounds)
+	{
+		++FireSoundsCulled;
+		MECHSURVIVAL_INC_COUNTER(FireSoundsCulled, 1);
+		return false;
+	}
+
+	const float Duration = Sound->GetDuration();
+	FireSoundEndTimes.Add(GetWorld()->GetTimeSeconds() + (Duration > 0.f && Duration < INDEFINITELY_LOOPING_DURATION ? Duration : FireSoundSeconds));
+
+	++FireSoundsPlayed;
+	MECHSURVIVAL_INC_COUNTER(FireSoundsPlayed, 1);
+	return true;
+}
+
+void UMechSurvivalSignificance::UpdateStats()
+{
+	const int32 InsignificantLevel = LevelThresholds.Num();
+	int32 NumInsignificant = 0;
+	for (const FEntry& Entry : Entries)
+	{
+		NumInsignificant += Entry.Level >= InsignificantLevel ? 1 : 0;
+	}
+	MECHSURVIVAL_SET_LEVEL(SignificantActors, Entries.Num() - NumInsignificant);
+	MECHSURVIVAL_SET_LEVEL(InsignificantActors, NumInsignificant);
+
+#if ENABLE_DRAW_DEBUG
+	if (CVarSignificanceDebug.GetValueOnGameThread() != 0)
+	{
+		const UWorld* World = GetWorld();
+		for (const FEntry& Entry : Entries)
+		{
+			const AActor* Actor = Entry.Actor.Get();
+			if (Actor == nullptr || Actor->IsHidden())
+			{
+				continue;
+			}
+
+			const float Depth = InsignificantLevel > 0 ? (float)Entry.Level / InsignificantLevel : 0.f;
+			const FColor Color = FLinearColor::LerpUsingHSV(FLinearColor::Green, FLinearColor::Red, Depth).ToFColor(true);
+			DrawDebugString(World, Actor->GetActorLocation() + FVector(0.f, 0.f, 50.f), FString::Printf(TEXT("%d %.2f"), Entry.Level, Entry.Score), nullptr, Color, 0.f, true);
+		}
+	}
+#endif
+}
+
+void UMechSurvivalSignificance::DumpStats() const
+{
+	const int32 NumLevels = LevelThresholds.Num() + 1;
+	const int32 NumCategories = (int32)EMechSurvivalSignificanceCategory::Num;
+	TArray<int32> Counts;
+	Counts.SetNumZeroed(NumCategories * NumLevels);
+	for (const FEntry& Entry : Entries)
+	{
+		Counts[(int32)Entry.Category * NumLevels + FMath::Min(Entry.Level, NumLevels - 1)]++;
+	}
+
+	UE_LOG(LogSignificance, Log, TEXT("%d actors scored against %d viewers, %d per frame"), Entries.Num(), Viewers.Num(), ActorsPerFrame);
+	static const TCHAR* CategoryNames[] = { TEXT("Characters"), TEXT("Projectiles") };
+	static_assert(UE_ARRAY_COUNT(CategoryNames) == (int32)EMechSurvivalSignificanceCategory::Num, "Name every significance category");
+	for (int32 Category = 0; Category < NumCategories; ++Category)
+	{
+		FString Line;
+		for (int32 Level = 0; Level < NumLevels; ++Level)
+		{
+			Line += FString::Printf(TEXT(" L%d=%d"), Level, Counts[Category * NumLevels + Level]);
+		}
+		UE_LOG(LogSignificance, Log, TEXT("%s:%s"), CategoryNames[Category], *Line);
+	}
+	UE_LOG(LogSignificance, Log, TEXT("Fire sounds: %d playing (cap %d), %d played, %d culled; fire animations culled: %d"),
+		FireSoundEndTimes.Num(), MaxConcurrentFireSounds, FireSoundsPlayed, FireSoundsCulled, FireEffectsCulled);
+}
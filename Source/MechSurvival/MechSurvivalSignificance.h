@@ -0,0 +1,187 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalSignificance.generated.h"
+
+class USoundBase;
+
+/** What a registered actor is, which decides what its significance level scales */
+enum class EMechSurvivalSignificanceCategory : uint8
+{
+	/** Actor tick and skeletal mesh animation rate */
+	Character,
+	/** Actor and movement tick, and how finely bounces are resolved */
+	Projectile,
+
+	Num
+};
+
+/**
+ * Decides how much of the frame each actor deserves, by how much it matters to the local players.
+ *
+ * Registered actors are scored from 0 to 1 against every local player's view: closer is higher, off-screen is scaled
+ * down by OffscreenScale, and the player's own pawn always scores 1. The best score over all players is bucketed into
+ * a level by LevelThresholds, level 0 being full fidelity and the last level insignificant. A level change sets the
+ * actor's tick intervals, animation update rate and collision fidelity; fire sounds and animations only play for
+ * shooters up to MaxFireEffectsLevel and no more than MaxConcurrentFireSounds at once. Character meshes paced by the
+ * animation budget get the score itself, and the budget sets their animation rate rather than the level.
+ *
+ * Scoring is time-sliced, ActorsPerFrame actors per frame, so its own cost stays flat with 64 players or a large
+ * horde. Servers also score against every remote player's pawn, without a view frustum, so that nothing a client is
+ * near runs coarser on the server; a dedicated server plays no fire sounds or animations at all.
+ */
+UCLASS(config=Game)
+class UMechSurvivalSignificance : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the significance of the world the context object lives in, if any */
+	static UMechSurvivalSignificance* Get(const UObject* WorldContextObject);
+
+	/** Starts scoring an actor; it is at full fidelity until its first score */
+	void RegisterActor(AActor* Actor, EMechSurvivalSignificanceCategory Category);
+
+	/** Stops scoring an actor and puts it back to full fidelity */
+	void UnregisterActor(AActor* Actor);
+
+	/** Scores an actor right away, e.g. a pooled projectile fired somewhere else than where it last flew */
+	void RefreshActor(AActor* Actor);
+
+	/** Level of a registered actor; 0 for unregistered ones */
+	int32 GetLevel(const AActor* Actor) const;
+
+	/** Whether a shooter is significant enough for its fire animation to play */
+	bool ShouldPlayFireEffects(const AActor* Shooter);
+
+	/**
+	 * Whether a shooter's fire sound may play now; if so it is counted against MaxConcurrentFireSounds until it ends.
+	 * Sounds of the local players' own pawns always play.
+	 */
+	bool TryPlayFireSound(const AActor* Shooter, const USoundBase* Sound);
+
+	/** Writes the number of actors at each level and the fire sound counts to the log */
+	void DumpStats() const;
+
+protected:
+	/** Distance at which an on-screen actor scores 0 */
+	UPROPERTY(config)
+	float MaxDistance = 10000.f;
+
+	/** Score multiplier for actors outside every local player's view */
+	UPROPERTY(config)
+	float OffscreenScale = 0.35f;
+
+	/** Degrees added to the camera's field of view before an actor counts as off-screen, for actors at the edge */
+	UPROPERTY(config)
+	float ViewMarginDegrees = 10.f;
+
+	/** Lowest score of each level but the last; an actor scoring below all of them is at the last level */
+	UPROPERTY(config)
+	TArray<float> LevelThresholds;
+
+	/** Tick interval of the actor and its components at each level; the last entry also covers any deeper level */
+	UPROPERTY(config)
+	TArray<float> TickIntervals;
+
+	/** Projectiles from this level on resolve one bounce per movement update instead of several */
+	UPROPERTY(config)
+	int32 ReducedCollisionLevel = 2;
+
+	/** Skeletal meshes from this level on only animate while they are rendered */
+	UPROPERTY(config)
+	int32 RenderedOnlyAnimationLevel = 2;
+
+	/** Deepest level of a shooter whose fire sound and animation still play */
+	UPROPERTY(config)
+	int32 MaxFireEffectsLevel = 1;
+
+	/** Fire sounds playing at once, not counting the local players' own */
+	UPROPERTY(config)
+	int32 MaxConcurrentFireSounds = 8;
+
+	/** How long a fire sound counts against the cap when its length is unknown or endless */
+	UPROPERTY(config)
+	float FireSoundSeconds = 0.5f;
+
+	/** Actors scored per frame; every actor is rescored once every Num / ActorsPerFrame frames */
+	UPROPERTY(config)
+	int32 ActorsPerFrame = 256;
+
+private:
+	/** A player's point of view */
+	struct FViewer
+	{
+		FVector Location;
+		FVector Direction;
+		/** Cosine of half the field of view plus the margin; -1 when there is no frustum to test */
+		float CosHalfFOV;
+		const AActor* Pawn;
+	};
+
+	struct FEntry
+	{
+		TWeakObjectPtr<AActor> Actor;
+		/** Key of the entry in EntryIndices, still valid once the actor is gone */
+		const AActor* Key;
+		EMechSurvivalSignificanceCategory Category;
+		float Score;
+		int32 Level;
+	};
+
+	/** Collects the local players' views and, on a server, the remote players' pawns */
+	void UpdateViewers();
+
+	float ScoreActor(const AActor* Actor) const;
+
+	/** Whether an actor is the pawn of a local player, which always plays its own effects */
+	bool IsLocalPlayerPawn(const AActor* Actor) const;
+
+	int32 GetLevelForScore(float Score) const;
+
+	/** Scores one entry and applies its level if it changed */
+	void UpdateEntry(FEntry& Entry);
+
+	/** Sets the tick intervals, animation rate and collision fidelity of an actor for a level */
+	void ApplyLevel(AActor* Actor, EMechSurvivalSignificanceCategory Category, int32 Level) const;
+
+	/** Hands a character's score to the animation budget, which ranks its meshes by it */
+	void SetAnimationSignificance(AActor* Actor, float Score) const;
+
+	void RemoveEntryAt(int32 Index);
+
+	/** Publishes the level counts and draws the debug view */
+	void UpdateStats();
+
+	TArray<FEntry> Entries;
+	TMap<const AActor*, int32> EntryIndices;
+
+	/** Entry scored next, so that the time slices go round all of them */
+	int32 NextEntry = 0;
+
+	TArray<FViewer> Viewers;
+
+	/** World time each playing fire sound ends at */
+	TArray<float> FireSoundEndTimes;
+
+	int32 FireSoundsPlayed = 0;
+	int32 FireSoundsCulled = 0;
+	int32 FireEffectsCulled = 0;
+};
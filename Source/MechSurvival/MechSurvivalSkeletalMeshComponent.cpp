@@ -0,0 +1,52 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalSkeletalMeshComponent.h"
+#include "MechSurvivalAnimationBudget.h"
+
+void UMechSurvivalSkeletalMeshComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UMechSurvivalAnimationBudget* AnimationBudget = UMechSurvivalAnimationBudget::Get(this))
+	{
+		AnimationBudget->RegisterMesh(this);
+	}
+}
+
+void UMechSurvivalSkeletalMeshComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UMechSurvivalAnimationBudget* AnimationBudget = UMechSurvivalAnimationBudget::Get(this))
+	{
+		AnimationBudget->UnregisterMesh(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UMechSurvivalSkeletalMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	const double StartSeconds = FPlatformTime::Seconds();
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	GameThreadSeconds += FPlatformTime::Seconds() - StartSeconds;
+
+	// Frames the rate optimizations skip or interpolate still tick, but do not evaluate a pose
+	const bool bSkippedEvaluation = AnimUpdateRateParams != nullptr && ShouldUseUpdateRateOptimizations() && AnimUpdateRateParams->ShouldSkipEvaluation();
+	if (!bSkippedEvaluation)
+	{
+		LastEvaluatedFrame = GFrameCounter;
+	}
+}
+
+void UMechSurvivalSkeletalMeshComponent::CompleteParallelAnimationEvaluation(bool bDoPostAnimEvaluation)
+{
+	const double StartSeconds = FPlatformTime::Seconds();
+	Super::CompleteParallelAnimationEvaluation(bDoPostAnimEvaluation);
+	GameThreadSeconds += FPlatformTime::Seconds() - StartSeconds;
+}
+
+double UMechSurvivalSkeletalMeshComponent::ConsumeGameThreadSeconds()
+{
+	const double Seconds = GameThreadSeconds;
+	GameThreadSeconds = 0.0;
+	return Seconds;
+}
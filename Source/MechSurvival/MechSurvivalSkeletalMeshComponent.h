@@ -0,0 +1,42 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkeletalMeshComponentBudgeted.h"
+#include "MechSurvivalSkeletalMeshComponent.generated.h"
+
+/**
+ * Skeletal mesh of a character, animated within the animation budget.
+ *
+ * The engine's budget allocator decides every frame which of these meshes animate, which interpolate between skipped
+ * frames and how many frames they may skip, by the significance UMechSurvivalSignificance gives their owner. The game
+ * thread time each mesh spends on its animation, ticking and completing its parallel evaluation, is kept here for
+ * UMechSurvivalAnimationBudget to report.
+ */
+UCLASS(ClassGroup=MechSurvival, meta=(BlueprintSpawnableComponent))
+class UMechSurvivalSkeletalMeshComponent : public USkeletalMeshComponentBudgeted
+{
+	GENERATED_BODY()
+
+public:
+	// UActorComponent interface
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	// End of UActorComponent interface
+
+	// USkeletalMeshComponent interface
+	virtual void CompleteParallelAnimationEvaluation(bool bDoPostAnimEvaluation) override;
+	// End of USkeletalMeshComponent interface
+
+	/** Game thread seconds spent animating since the last call; resets them */
+	double ConsumeGameThreadSeconds();
+
+	/** Whether the pose was evaluated this frame, rather than skipped, interpolated or not ticked at all */
+	bool WasEvaluatedThisFrame() const { return LastEvaluatedFrame == GFrameCounter; }
+
+private:
+	double GameThreadSeconds = 0.0;
+	uint64 LastEvaluatedFrame = 0;
+};
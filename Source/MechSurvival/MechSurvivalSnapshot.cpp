@@ -0,0 +1,1075 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalSnapshot.h"
+#include "MechSurvival.h"
+#include "MechSurvivalBallistics.h"
+#include "MechSurvivalBenchmark.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalGameMode.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalProjectile.h"
+#include "MechSurvivalProjectilePool.h"
+#include "MechSurvivalWaveDirector.h"
+#include "MechSurvivalWeaponComponent.h"
+#include "MechSurvivalWeaponData.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Compression.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Templates/Atomic.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechSnapshot, Log, All);
+
+static FAutoConsoleCommandWithWorldAndArgs GSaveSnapshotCmd(
+	TEXT("MechSurvival.Snapshot.Save"),
+	TEXT("Takes a snapshot of the match, named [Name] or the configured SnapshotName"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UMechSurvivalSnapshot* Snapshot = UMechSurvivalSnapshot::Get(World))
+		{
+			if (!Snapshot->TakeSnapshot(Args.Num() > 0 ? Args[0] : FString()))
+			{
+				UE_LOG(LogMechSnapshot, Warning, TEXT("No snapshot taken; this is a client or the previous snapshot is still being written"));
+			}
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GRestoreSnapshotCmd(
+	TEXT("MechSurvival.Snapshot.Restore"),
+	TEXT("Puts the match back the way snapshot [Name], or the configured SnapshotName, has it"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UMechSurvivalSnapshot* Snapshot = UMechSurvivalSnapshot::Get(World))
+		{
+			Snapshot->RestoreSnapshot(Args.Num() > 0 ? Args[0] : FString());
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GDumpSnapshotCmd(
+	TEXT("MechSurvival.Snapshot.Dump"),
+	TEXT("Logs how many snapshots were taken, how long they stalled the game thread and how large they are"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalSnapshot* Snapshot = UMechSurvivalSnapshot::Get(World))
+		{
+			Snapshot->DumpStats();
+		}
+	}));
+
+/**
+ * Compresses and writes the snapshots the game thread captured, one at a time. The sections of a snapshot are shared
+ * with the game thread, which never changes a section once captured but only replaces it with a new one.
+ */
+class FMechSurvivalSnapshotWriter : public FRunnable
+{
+public:
+	struct FSection
+	{
+		EMechSurvivalSnapshotSection Type;
+		TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> Data;
+	};
+
+	struct FJob
+	{
+		FString Path;
+		uint32 Sequence = 0;
+		TArray<FSection> Sections;
+	};
+
+	FMechSurvivalSnapshotWriter()
+		: WakeEvent(FPlatformProcess::GetSynchEventFromPool())
+		, bStopping(false)
+		, bBusy(false)
+		, NumWritten(0)
+		, NumFailed(0)
+		, LastSize(0)
+		, LastCompressedSize(0)
+		, LastWriteMicroseconds(0)
+	{
+	}
+
+	virtual ~FMechSurvivalSnapshotWriter()
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	}
+
+	// FRunnable interface
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			WakeEvent->Wait();
+			WritePending();
+		}
+
+		// A snapshot handed over just before the stop is still written
+		WritePending();
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+		WakeEvent->Trigger();
+	}
+	// End of FRunnable interface
+
+	/** True from the moment a snapshot is handed over until it is on disk */
+	bool IsBusy() const { return bBusy; }
+
+	/** Hands a snapshot over to be written; returns false, keeping the job, if the previous one is not written yet */
+	bool Submit(FJob&& Job, bool bOnThread)
+	{
+		if (bBusy)
+		{
+			return false;
+		}
+
+		bBusy = true;
+		{
+			FScopeLock Lock(&JobLock);
+			PendingJob = MoveTemp(Job);
+			bHasJob = true;
+		}
+
+		if (bOnThread)
+		{
+			WakeEvent->Trigger();
+		}
+		else
+		{
+			WritePending();
+		}
+		return true;
+	}
+
+	int32 GetNumWritten() const { return NumWritten; }
+	int32 GetNumFailed() const { return NumFailed; }
+	uint32 GetLastSize() const { return LastSize; }
+	uint32 GetLastCompressedSize() const { return LastCompressedSize; }
+	uint32 GetLastWriteMicroseconds() const { return LastWriteMicroseconds; }
+
+private:
+	void WritePending()
+	{
+		FJob Job;
+		{
+			FScopeLock Lock(&JobLock);
+			if (!bHasJob)
+			{
+				return;
+			}
+			Job = MoveTemp(PendingJob);
+			PendingJob = FJob();
+			bHasJob = false;
+		}
+
+		if (Write(Job))
+		{
+			++NumWritten;
+		}
+		else
+		{
+			++NumFailed;
+		}
+		bBusy = false;
+	}
+
+	bool Write(const FJob& Job)
+	{
+		const double StartSeconds = FPlatformTime::Seconds();
+
+		// Every section is its type and size, then its bytes
+		TArray<uint8> Uncompressed;
+		FMemoryWriter Ar(Uncompressed);
+		for (const FSection& Section : Job.Sections)
+		{
+			uint32 Type = (uint32)Section.Type;
+			uint32 Size = (uint32)Section.Data->Num();
+			Ar << Type << Size;
+			Ar.Serialize(Section.Data->GetData(), Size);
+		}
+
+		const int32 HeaderSize = sizeof(FMechSurvivalSnapshotFileHeader);
+		int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, Uncompressed.Num());
+		TArray<uint8> File;
+		File.SetNumUninitialized(HeaderSize + CompressedSize);
+		if (!FCompression::CompressMemory(NAME_Zlib, File.GetData() + HeaderSize, CompressedSize, Uncompressed.GetData(), Uncompressed.Num()))
+		{
+			UE_LOG(LogMechSnapshot, Error, TEXT("Could not compress snapshot %u"), Job.Sequence);
+			return false;
+		}
+		File.SetNum(HeaderSize + CompressedSize, false);
+
+		FMechSurvivalSnapshotFileHeader Header;
+		Header.Magic = MechSurvivalSnapshot::Magic;
+		Header.Version = MechSurvivalSnapshot::Version;
+		Header.UncompressedSize = (uint32)Uncompressed.Num();
+		Header.CompressedSize = (uint32)CompressedSize;
+		Header.Sequence = Job.Sequence;
+		Header.NumSections = (uint32)Job.Sections.Num();
+		Header.UtcTicks = FDateTime::UtcNow().GetTicks();
+		FMemory::Memcpy(File.GetData(), &Header, HeaderSize);
+
+		// Written next to the last snapshot and moved over it, so a crash while writing leaves the last one whole
+		const FString TempPath = Job.Path + TEXT(".tmp");
+		if (!FFileHelper::SaveArrayToFile(File, *TempPath) || !IFileManager::Get().Move(*Job.Path, *TempPath, true))
+		{
+			UE_LOG(LogMechSnapshot, Error, TEXT("Could not write snapshot %u to %s"), Job.Sequence, *Job.Path);
+			return false;
+		}
+
+		const uint32 WriteMicroseconds = (uint32)((FPlatformTime::Seconds() - StartSeconds) * 1000000.0);
+		LastSize = Header.UncompressedSize;
+		LastCompressedSize = (uint32)File.Num();
+		LastWriteMicroseconds = WriteMicroseconds;
+
+		UE_LOG(LogMechSnapshot, Verbose, TEXT("Wrote snapshot %u to %s: %d sections, %u bytes, %u compressed, in %.2f ms"),
+			Job.Sequence, *Job.Path, Job.Sections.Num(), Header.UncompressedSize, (uint32)File.Num(), WriteMicroseconds / 1000.0);
+		return true;
+	}
+
+	FCriticalSection JobLock;
+	FJob PendingJob;
+	bool bHasJob = false;
+
+	FEvent* WakeEvent;
+	TAtomic<bool> bStopping;
+	TAtomic<bool> bBusy;
+
+	TAtomic<int32> NumWritten;
+	TAtomic<int32> NumFailed;
+	TAtomic<uint32> LastSize;
+	TAtomic<uint32> LastCompressedSize;
+	TAtomic<uint32> LastWriteMicroseconds;
+};
+
+bool UMechSurvivalSnapshot::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalSnapshot::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	bRestorePending = FParse::Value(FCommandLine::Get(), TEXT("MechRestore="), PendingRestoreName) || FParse::Param(FCommandLine::Get(), TEXT("MechRestore"));
+
+	// Benchmark and stress runs measure the game without snapshots in the way
+	bAutoSnapshots = !UMechSurvivalBenchmark::IsBenchmarkRun() && !FParse::Param(FCommandLine::Get(), TEXT("MechRepStress"));
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UMechSurvivalSnapshot::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UMechSurvivalSnapshot::OnLevelRemoved);
+}
+
+void UMechSurvivalSnapshot::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	if (WriterThread != nullptr)
+	{
+		// Stops the writer, which finishes the snapshot it has, and waits for it
+		WriterThread->Kill(true);
+		delete WriterThread;
+		WriterThread = nullptr;
+	}
+
+	if (Stats.Snapshots > 0)
+	{
+		DumpStats();
+	}
+
+	delete Writer;
+	Writer = nullptr;
+
+	Props.Empty();
+	PropBlocks.Empty();
+	PendingProps.Empty();
+	PendingCharacters.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalSnapshot* UMechSurvivalSnapshot::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalSnapshot>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalSnapshot::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalSnapshot::IsTickable() const
+{
+	return GetWorld() != nullptr;
+}
+
+TStatId UMechSurvivalSnapshot::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalSnapshot, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalSnapshot::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalSnapshot::Tick(float DeltaTime)
+{
+	UWorld* World = GetWorld();
+	if (World->GetNetMode() == NM_Client || !World->HasBegunPlay())
+	{
+		return;
+	}
+
+	TrackInitialLevels();
+
+	if (bRestorePending)
+	{
+		bRestorePending = false;
+		RestoreSnapshot(PendingRestoreName);
+	}
+
+	if (PendingCharacters.Num() > 0)
+	{
+		ApplyPendingCharacters();
+	}
+
+	if (Writer != nullptr)
+	{
+		Stats.Failed = Writer->GetNumFailed();
+		MECHSURVIVAL_SET_LEVEL(SnapshotBytes, Writer->GetLastCompressedSize());
+	}
+
+	if (!bAutoSnapshots || SnapshotInterval <= 0.f)
+	{
+		return;
+	}
+
+	TimeSinceSnapshot += DeltaTime;
+	if (TimeSinceSnapshot >= SnapshotInterval && !TakeSnapshot())
+	{
+		// Still writing the last one; the next frame tries again
+		++Stats.Deferred;
+	}
+}
+
+bool UMechSurvivalSnapshot::TakeSnapshot(const FString& Name)
+{
+	const UWorld* World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_Client)
+	{
+		return false;
+	}
+
+	if (Writer == nullptr)
+	{
+		Writer = new FMechSurvivalSnapshotWriter();
+		if (FPlatformProcess::SupportsMultithreading())
+		{
+			WriterThread = FRunnableThread::Create(Writer, TEXT("MechSurvivalSnapshotWriter"), 0, TPri_BelowNormal);
+		}
+		if (WriterThread == nullptr)
+		{
+			UE_LOG(LogMechSnapshot, Warning, TEXT("No snapshot writer thread; snapshots are written on the game thread"));
+		}
+	}
+
+	if (Writer->IsBusy())
+	{
+		return false;
+	}
+
+	CaptureSnapshot(GetSnapshotPath(Name));
+	TimeSinceSnapshot = 0.f;
+	return true;
+}
+
+FString UMechSurvivalSnapshot::GetSnapshotPath(const FString& Name) const
+{
+	return FPaths::ProjectSavedDir() / TEXT("Snapshots") / (Name.IsEmpty() ? SnapshotName : Name) + TEXT(".mssnap");
+}
+
+TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> UMechSurvivalSnapshot::CaptureSection(TFunctionRef<void(FArchive&)> Save) const
+{
+	TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> Data = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+	FMemoryWriter Ar(*Data);
+	Save(Ar);
+	return Data;
+}
+
+void UMechSurvivalSnapshot::CaptureSnapshot(const FString& Path)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(SnapshotCapture);
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	UWorld* World = GetWorld();
+
+	FMechSurvivalSnapshotWriter::FJob Job;
+	Job.Path = Path;
+	Job.Sequence = Sequence++;
+
+	auto AddSection = [&Job](EMechSurvivalSnapshotSection Type, const TSharedRef<TArray<uint8>, ESPMode::ThreadSafe>& Data)
+	{
+		Job.Sections.Add(FMechSurvivalSnapshotWriter::FSection{ Type, Data });
+	};
+
+	// The map first, so a restore checks it before changing anything
+	AddSection(EMechSurvivalSnapshotSection::Match, CaptureSection([this](FArchive& Ar) { SaveMatch(Ar); }));
+
+	const AMechSurvivalGameMode* GameMode = World->GetAuthGameMode<AMechSurvivalGameMode>();
+	if (UMechSurvivalWaveDirector* WaveDirector = GameMode ? GameMode->GetWaveDirector() : nullptr)
+	{
+		AddSection(EMechSurvivalSnapshotSection::Wave, CaptureSection([WaveDirector](FArchive& Ar) { WaveDirector->SerializeWave(Ar); }));
+	}
+
+	AddSection(EMechSurvivalSnapshotSection::Characters, CaptureSection([this](FArchive& Ar) { SaveCharacters(Ar); }));
+	AddSection(EMechSurvivalSnapshotSection::Projectiles, CaptureSection([this](FArchive& Ar) { SaveProjectiles(Ar); }));
+
+	if (UMechSurvivalBallistics* Ballistics = UMechSurvivalBallistics::Get(this))
+	{
+		AddSection(EMechSurvivalSnapshotSection::Rounds, CaptureSection([Ballistics](FArchive& Ar) { Ballistics->SerializeRounds(Ar); }));
+	}
+
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		AddSection(EMechSurvivalSnapshotSection::Mechs, CaptureSection([Horde](FArchive& Ar) { Horde->SerializeMechs(Ar); }));
+	}
+
+	int32 NumReused = 0;
+
+	// Props keep their order while none come or go, so each block holds the same props as last time
+	for (int32 Index = Props.Num() - 1; Index >= 0; --Index)
+	{
+		if (!Props[Index].Component.IsValid())
+		{
+			Props.RemoveAt(Index, 1, false);
+			bPropsChanged = true;
+		}
+	}
+
+	if (bPropsChanged)
+	{
+		PropBlocks.Reset();
+		bPropsChanged = false;
+	}
+
+	const int32 BlockSize = FMath::Max(PropsPerBlock, 1);
+	const int32 NumBlocks = FMath::DivideAndRoundUp(Props.Num(), BlockSize);
+	for (int32 Block = 0; Block < NumBlocks; ++Block)
+	{
+		const int32 FirstProp = Block * BlockSize;
+		const int32 NumProps = FMath::Min(BlockSize, Props.Num() - FirstProp);
+
+		// Sleeping props that have not moved since they were captured are still what the last block says
+		bool bDirty = Block >= PropBlocks.Num();
+		for (int32 Index = FirstProp; !bDirty && Index < FirstProp + NumProps; ++Index)
+		{
+			const FTrackedProp& Prop = Props[Index];
+			const UPrimitiveComponent* Component = Prop.Component.Get();
+			bDirty = Prop.bCapturedAwake || Component->RigidBodyIsAwake() || !Component->GetComponentLocation().Equals(Prop.CapturedLocation, PropMoveTolerance);
+		}
+
+		if (bDirty)
+		{
+			TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> Data = CaptureSection([this, FirstProp, NumProps](FArchive& Ar) { SavePropBlock(Ar, FirstProp, NumProps); });
+			if (Block < PropBlocks.Num())
+			{
+				PropBlocks[Block] = Data;
+			}
+			else
+			{
+				PropBlocks.Add(Data);
+			}
+		}
+		else
+		{
+			++NumReused;
+		}
+
+		AddSection(EMechSurvivalSnapshotSection::Props, PropBlocks[Block]);
+	}
+
+	const int32 NumSections = Job.Sections.Num();
+	Writer->Submit(MoveTemp(Job), WriterThread != nullptr);
+
+	const double StallSeconds = FPlatformTime::Seconds() - StartSeconds;
+	LastStallSeconds = StallSeconds;
+
+	++Stats.Snapshots;
+	Stats.TotalStallSeconds += StallSeconds;
+	Stats.MaxStallSeconds = FMath::Max(Stats.MaxStallSeconds, StallSeconds);
+	Stats.SectionsCopied += NumSections - NumReused;
+	Stats.SectionsReused += NumReused;
+
+	MECHSURVIVAL_SET_LEVEL(SnapshotStallMicroseconds, (uint32)(StallSeconds * 1000000.0));
+
+	UE_LOG(LogMechSnapshot, Verbose, TEXT("Captured snapshot %u in %.3f ms: %d sections, %d reused"), Sequence - 1, StallSeconds * 1000.0, NumSections, NumReused);
+}
+
+void UMechSurvivalSnapshot::SaveMatch(FArchive& Ar) const
+{
+	FString MapName = UWorld::RemovePIEPrefix(GetWorld()->GetOutermost()->GetName());
+	Ar << MapName;
+}
+
+bool UMechSurvivalSnapshot::LoadMatch(FArchive& Ar) const
+{
+	FString MapName;
+	Ar << MapName;
+
+	const FString CurrentMapName = UWorld::RemovePIEPrefix(GetWorld()->GetOutermost()->GetName());
+	if (Ar.IsError() || MapName != CurrentMapName)
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("The snapshot was taken on %s, not on %s; nothing restored"), *MapName, *CurrentMapName);
+		return false;
+	}
+	return true;
+}
+
+void UMechSurvivalSnapshot::SaveCharacters(FArchive& Ar) const
+{
+	TArray<FSavedCharacter> Characters;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		const AMechSurvivalCharacter* Character = PlayerController ? Cast<AMechSurvivalCharacter>(PlayerController->GetPawn()) : nullptr;
+		if (Character == nullptr)
+		{
+			continue;
+		}
+
+		FSavedCharacter& Saved = Characters.AddDefaulted_GetRef();
+		Saved.PlayerName = PlayerController->PlayerState ? PlayerController->PlayerState->GetPlayerName() : FString();
+		Saved.Transform = Character->GetActorTransform();
+		Saved.Velocity = Character->GetVelocity();
+		Saved.ControlRotation = PlayerController->GetControlRotation();
+
+		const UMechSurvivalWeaponComponent* WeaponComponent = Character->GetWeaponComponent();
+		if (const UMechSurvivalWeaponData* Weapon = WeaponComponent ? WeaponComponent->GetWeapon() : nullptr)
+		{
+			// Ini presets are built at runtime and only known by name
+			Saved.Weapon = Weapon->IsAsset() ? Weapon->GetPathName() : Weapon->Stats.Name.ToString();
+		}
+	}
+
+	int32 NumCharacters = Characters.Num();
+	Ar << NumCharacters;
+	for (FSavedCharacter& Saved : Characters)
+	{
+		Saved.Serialize(Ar);
+	}
+}
+
+void UMechSurvivalSnapshot::LoadCharacters(FArchive& Ar)
+{
+	int32 NumCharacters = 0;
+	Ar << NumCharacters;
+	if (Ar.IsError() || NumCharacters < 0 || NumCharacters > Ar.TotalSize())
+	{
+		Ar.SetError();
+		return;
+	}
+
+	TArray<FSavedCharacter> Characters;
+	Characters.SetNum(NumCharacters);
+	for (FSavedCharacter& Saved : Characters)
+	{
+		Saved.Serialize(Ar);
+	}
+	if (Ar.IsError())
+	{
+		return;
+	}
+
+	TArray<AMechSurvivalCharacter*> Players;
+	TArray<FString> PlayerNames;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (AMechSurvivalCharacter* Character = PlayerController ? Cast<AMechSurvivalCharacter>(PlayerController->GetPawn()) : nullptr)
+		{
+			Players.Add(Character);
+			PlayerNames.Add(PlayerController->PlayerState ? PlayerController->PlayerState->GetPlayerName() : FString());
+		}
+	}
+
+	// Players keep their own character where their name is the same
+	for (int32 SavedIndex = Characters.Num() - 1; SavedIndex >= 0; --SavedIndex)
+	{
+		const int32 PlayerIndex = PlayerNames.IndexOfByKey(Characters[SavedIndex].PlayerName);
+		if (PlayerIndex != INDEX_NONE)
+		{
+			ApplyCharacter(Players[PlayerIndex], Characters[SavedIndex]);
+			Players.RemoveAt(PlayerIndex);
+			PlayerNames.RemoveAt(PlayerIndex);
+			Characters.RemoveAt(SavedIndex);
+		}
+	}
+
+	// Names are not stable on every online subsystem; whoever is left takes the characters left, in order
+	const int32 NumByOrder = FMath::Min(Players.Num(), Characters.Num());
+	for (int32 Index = 0; Index < NumByOrder; ++Index)
+	{
+		ApplyCharacter(Players[Index], Characters[Index]);
+	}
+	Characters.RemoveAt(0, NumByOrder);
+
+	PendingCharacters = MoveTemp(Characters);
+}
+
+void UMechSurvivalSnapshot::ApplyPendingCharacters()
+{
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It && PendingCharacters.Num() > 0; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		AMechSurvivalCharacter* Character = PlayerController ? Cast<AMechSurvivalCharacter>(PlayerController->GetPawn()) : nullptr;
+		if (Character == nullptr || PlayerController->PlayerState == nullptr)
+		{
+			continue;
+		}
+
+		const FString PlayerName = PlayerController->PlayerState->GetPlayerName();
+		const int32 SavedIndex = PendingCharacters.IndexOfByPredicate([&PlayerName](const FSavedCharacter& Saved) { return Saved.PlayerName == PlayerName; });
+		if (SavedIndex != INDEX_NONE)
+		{
+			ApplyCharacter(Character, PendingCharacters[SavedIndex]);
+			PendingCharacters.RemoveAtSwap(SavedIndex);
+		}
+	}
+}
+
+void UMechSurvivalSnapshot::ApplyCharacter(AMechSurvivalCharacter* Character, const FSavedCharacter& Saved)
+{
+	Character->TeleportTo(Saved.Transform.GetLocation(), Saved.Transform.Rotator(), false, true);
+	if (UCharacterMovementComponent* Movement = Character->GetCharacterMovement())
+	{
+		Movement->Velocity = Saved.Velocity;
+	}
+
+	if (APlayerController* PlayerController = Cast<APlayerController>(Character->GetController()))
+	{
+		PlayerController->SetControlRotation(Saved.ControlRotation);
+		PlayerController->ClientSetRotation(Saved.ControlRotation);
+	}
+
+	UMechSurvivalWeaponComponent* WeaponComponent = Character->GetWeaponComponent();
+	if (WeaponComponent == nullptr || Saved.Weapon.IsEmpty())
+	{
+		return;
+	}
+
+	if (Saved.Weapon.StartsWith(TEXT("/")))
+	{
+		if (UMechSurvivalWeaponData* Weapon = LoadObject<UMechSurvivalWeaponData>(nullptr, *Saved.Weapon))
+		{
+			WeaponComponent->Equip(Weapon);
+		}
+	}
+	else if (!WeaponComponent->EquipPreset(FName(*Saved.Weapon)))
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("Weapon preset %s no longer exists; %s keeps the weapon it has"), *Saved.Weapon, *Saved.PlayerName);
+	}
+}
+
+void UMechSurvivalSnapshot::SaveProjectiles(FArchive& Ar) const
+{
+	TArray<const AMechSurvivalProjectile*> Projectiles;
+	for (TActorIterator<AMechSurvivalProjectile> It(GetWorld()); It; ++It)
+	{
+		// Dormant pooled projectiles have their movement deactivated
+		if (!It->IsPendingKill() && It->GetProjectileMovement()->IsActive())
+		{
+			Projectiles.Add(*It);
+		}
+	}
+
+	int32 NumProjectiles = Projectiles.Num();
+	Ar << NumProjectiles;
+	for (const AMechSurvivalProjectile* Projectile : Projectiles)
+	{
+		FString ClassPath = FSoftClassPath(Projectile->GetClass()).ToString();
+		FVector Location = Projectile->GetActorLocation();
+		FVector Velocity = Projectile->GetProjectileMovement()->Velocity;
+		float LifeSpan = Projectile->GetLifeSpan();
+		float Damage = Projectile->Damage;
+		float ExplosionRadius = Projectile->ExplosionRadius;
+		Ar << ClassPath << Location << Velocity << LifeSpan << Damage << ExplosionRadius;
+	}
+}
+
+void UMechSurvivalSnapshot::LoadProjectiles(FArchive& Ar)
+{
+	UWorld* World = GetWorld();
+	UMechSurvivalProjectilePool* Pool = UMechSurvivalProjectilePool::Get(this);
+
+	// Whatever is in flight now was not there when the snapshot was taken
+	TArray<AMechSurvivalProjectile*> InFlight;
+	for (TActorIterator<AMechSurvivalProjectile> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill() && It->GetProjectileMovement()->IsActive())
+		{
+			InFlight.Add(*It);
+		}
+	}
+	for (AMechSurvivalProjectile* Projectile : InFlight)
+	{
+		if (Pool != nullptr)
+		{
+			Pool->Release(Projectile);
+		}
+		if (Projectile->GetProjectileMovement()->IsActive())
+		{
+			Projectile->Destroy();
+		}
+	}
+
+	int32 NumProjectiles = 0;
+	Ar << NumProjectiles;
+	if (Ar.IsError() || NumProjectiles < 0 || NumProjectiles > Ar.TotalSize())
+	{
+		Ar.SetError();
+		return;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	for (int32 Index = 0; Index < NumProjectiles; ++Index)
+	{
+		FString ClassPath;
+		FVector Location;
+		FVector Velocity;
+		float LifeSpan = 0.f;
+		float Damage = 0.f;
+		float ExplosionRadius = 0.f;
+		Ar << ClassPath << Location << Velocity << LifeSpan << Damage << ExplosionRadius;
+		if (Ar.IsError())
+		{
+			return;
+		}
+
+		UClass* ProjectileClass = FSoftClassPath(ClassPath).TryLoadClass<AMechSurvivalProjectile>();
+		if (ProjectileClass == nullptr)
+		{
+			continue;
+		}
+
+		AMechSurvivalProjectile* Projectile = Pool != nullptr
+			? Pool->Acquire(ProjectileClass, Location, Velocity.Rotation())
+			: World->SpawnActor<AMechSurvivalProjectile>(ProjectileClass, Location, Velocity.Rotation(), SpawnParams);
+		if (Projectile != nullptr)
+		{
+			Projectile->GetProjectileMovement()->Velocity = Velocity;
+			Projectile->SetLifeSpan(FMath::Max(LifeSpan, 0.f));
+			Projectile->Damage = Damage;
+			Projectile->ExplosionRadius = ExplosionRadius;
+		}
+	}
+}
+
+void UMechSurvivalSnapshot::SavePropBlock(FArchive& Ar, int32 FirstProp, int32 NumProps)
+{
+	Ar << NumProps;
+	for (int32 Index = FirstProp; Index < FirstProp + NumProps; ++Index)
+	{
+		FTrackedProp& Prop = Props[Index];
+		const UPrimitiveComponent* Component = Prop.Component.Get();
+
+		FSavedProp Saved;
+		Saved.Transform = Component->GetComponentTransform();
+		Saved.LinearVelocity = Component->GetPhysicsLinearVelocity();
+		Saved.AngularVelocity = Component->GetPhysicsAngularVelocityInDegrees();
+		Saved.bAwake = Component->RigidBodyIsAwake();
+
+		Ar << Prop.Path;
+		Saved.Serialize(Ar);
+
+		Prop.CapturedLocation = Saved.Transform.GetLocation();
+		Prop.bCapturedAwake = Saved.bAwake;
+	}
+}
+
+void UMechSurvivalSnapshot::LoadProps(FArchive& Ar)
+{
+	int32 NumProps = 0;
+	Ar << NumProps;
+	if (Ar.IsError() || NumProps < 0 || NumProps > Ar.TotalSize())
+	{
+		Ar.SetError();
+		return;
+	}
+
+	for (int32 Index = 0; Index < NumProps; ++Index)
+	{
+		FString Path;
+		FSavedProp Saved;
+		Ar << Path;
+		Saved.Serialize(Ar);
+		if (Ar.IsError())
+		{
+			return;
+		}
+		PendingProps.Add(Path, Saved);
+	}
+}
+
+void UMechSurvivalSnapshot::ApplyProp(UPrimitiveComponent* Component, const FSavedProp& Saved)
+{
+	Component->SetWorldTransform(Saved.Transform, false, nullptr, ETeleportType::TeleportPhysics);
+	Component->SetPhysicsLinearVelocity(Saved.LinearVelocity);
+	Component->SetPhysicsAngularVelocityInDegrees(Saved.AngularVelocity);
+	if (!Saved.bAwake)
+	{
+		Component->PutRigidBodyToSleep();
+	}
+}
+
+void UMechSurvivalSnapshot::TrackInitialLevels()
+{
+	if (bTrackedInitialLevels)
+	{
+		return;
+	}
+
+	bTrackedInitialLevels = true;
+	for (ULevel* Level : GetWorld()->GetLevels())
+	{
+		if (Level != nullptr && Level->bIsVisible)
+		{
+			TrackLevelProps(Level);
+		}
+	}
+}
+
+void UMechSurvivalSnapshot::TrackLevelProps(ULevel* Level)
+{
+	TArray<UPrimitiveComponent*> LevelProps;
+	MechSurvivalProps::GetSimulatingProps(Level, LevelProps);
+	for (UPrimitiveComponent* Root : LevelProps)
+	{
+		FTrackedProp& Prop = Props.AddDefaulted_GetRef();
+		Prop.Component = Root;
+		Prop.Path = Root->GetPathName();
+		bPropsChanged = true;
+
+		if (const FSavedProp* Saved = PendingProps.Find(Prop.Path))
+		{
+			ApplyProp(Root, *Saved);
+			PendingProps.Remove(Prop.Path);
+		}
+	}
+}
+
+void UMechSurvivalSnapshot::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	// Levels there at the start are tracked together once play begins
+	if (World == GetWorld() && Level != nullptr && bTrackedInitialLevels)
+	{
+		TrackLevelProps(Level);
+	}
+}
+
+void UMechSurvivalSnapshot::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+
+	// No level means every level is going
+	const int32 NumRemoved = Props.RemoveAll([Level](const FTrackedProp& Prop)
+	{
+		const UPrimitiveComponent* Component = Prop.Component.Get();
+		return Level == nullptr || Component == nullptr || Component->GetComponentLevel() == Level;
+	});
+	bPropsChanged |= NumRemoved > 0;
+}
+
+bool UMechSurvivalSnapshot::RestoreSnapshot(const FString& Name)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_Client)
+	{
+		return false;
+	}
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	const FString Path = GetSnapshotPath(Name);
+
+	TArray<uint8> File;
+	if (!FFileHelper::LoadFileToArray(File, *Path))
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("No snapshot at %s"), *Path);
+		return false;
+	}
+
+	const int32 HeaderSize = sizeof(FMechSurvivalSnapshotFileHeader);
+	FMechSurvivalSnapshotFileHeader Header;
+	if (File.Num() < HeaderSize)
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("%s is not a snapshot"), *Path);
+		return false;
+	}
+	FMemory::Memcpy(&Header, File.GetData(), HeaderSize);
+
+	if (Header.Magic != MechSurvivalSnapshot::Magic || Header.Version != MechSurvivalSnapshot::Version
+		|| (int64)Header.CompressedSize != File.Num() - HeaderSize || Header.UncompressedSize > (uint32)MAX_int32)
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("%s is not a version %u snapshot, or is cut short"), *Path, MechSurvivalSnapshot::Version);
+		return false;
+	}
+
+	TArray<uint8> Data;
+	Data.SetNumUninitialized((int32)Header.UncompressedSize);
+	if (!FCompression::UncompressMemory(NAME_Zlib, Data.GetData(), Data.Num(), File.GetData() + HeaderSize, (int32)Header.CompressedSize))
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("Could not decompress %s"), *Path);
+		return false;
+	}
+	File.Empty();
+
+	// Find every section before changing anything, so a damaged snapshot leaves the match alone
+	struct FSectionRange
+	{
+		uint32 Type = 0;
+		uint32 Size = 0;
+		int64 Offset = 0;
+	};
+
+	TArray<FSectionRange> Sections;
+	FMemoryReader Reader(Data);
+	for (uint32 Index = 0; Index < Header.NumSections; ++Index)
+	{
+		FSectionRange& Section = Sections.AddDefaulted_GetRef();
+		Reader << Section.Type << Section.Size;
+		Section.Offset = Reader.Tell();
+		if (Reader.IsError() || Section.Offset + Section.Size > Data.Num())
+		{
+			UE_LOG(LogMechSnapshot, Warning, TEXT("%s is damaged at section %u"), *Path, Index);
+			return false;
+		}
+		Reader.Seek(Section.Offset + Section.Size);
+	}
+
+	if (Sections.Num() == 0 || Sections[0].Type != (uint32)EMechSurvivalSnapshotSection::Match)
+	{
+		UE_LOG(LogMechSnapshot, Warning, TEXT("%s does not start with its map"), *Path);
+		return false;
+	}
+
+	Reader.Seek(Sections[0].Offset);
+	if (!LoadMatch(Reader))
+	{
+		return false;
+	}
+
+	TrackInitialLevels();
+	PendingProps.Reset();
+	PendingCharacters.Reset();
+
+	const AMechSurvivalGameMode* GameMode = World->GetAuthGameMode<AMechSurvivalGameMode>();
+	UMechSurvivalWaveDirector* WaveDirector = GameMode ? GameMode->GetWaveDirector() : nullptr;
+	UMechSurvivalBallistics* Ballistics = UMechSurvivalBallistics::Get(this);
+	UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this);
+
+	for (int32 Index = 1; Index < Sections.Num(); ++Index)
+	{
+		const FSectionRange& Section = Sections[Index];
+		Reader.Seek(Section.Offset);
+
+		switch ((EMechSurvivalSnapshotSection)Section.Type)
+		{
+		case EMechSurvivalSnapshotSection::Wave:
+			if (WaveDirector != nullptr)
+			{
+				WaveDirector->SerializeWave(Reader);
+			}
+			break;
+		case EMechSurvivalSnapshotSection::Characters:
+			LoadCharacters(Reader);
+			break;
+		case EMechSurvivalSnapshotSection::Projectiles:
+			LoadProjectiles(Reader);
+			break;
+		case EMechSurvivalSnapshotSection::Rounds:
+			if (Ballistics != nullptr)
+			{
+				Ballistics->SerializeRounds(Reader);
+			}
+			break;
+		case EMechSurvivalSnapshotSection::Mechs:
+			if (Horde != nullptr)
+			{
+				Horde->SerializeMechs(Reader);
+			}
+			break;
+		case EMechSurvivalSnapshotSection::Props:
+			LoadProps(Reader);
+			break;
+		default:
+			// A section from a newer build; what it holds stays as it is
+			break;
+		}
+
+		if (Reader.IsError() || Reader.Tell() > Section.Offset + Section.Size)
+		{
+			UE_LOG(LogMechSnapshot, Warning, TEXT("Section %d of %s is damaged; the sections after it are not restored"), Index, *Path);
+			break;
+		}
+	}
+
+	// Props of the levels loaded now; the others are restored as their level comes in
+	for (const FTrackedProp& Prop : Props)
+	{
+		UPrimitiveComponent* Component = Prop.Component.Get();
+		const FSavedProp* Saved = Component ? PendingProps.Find(Prop.Path) : nullptr;
+		if (Saved != nullptr)
+		{
+			ApplyProp(Component, *Saved);
+			PendingProps.Remove(Prop.Path);
+		}
+	}
+
+	// Everything moved, so the next snapshot captures every block again
+	bPropsChanged = true;
+	TimeSinceSnapshot = 0.f;
+
+	UE_LOG(LogMechSnapshot, Log, TEXT("Restored snapshot %u from %s in %.2f ms; %d props and %d characters wait for their level or player"),
+		Header.Sequence, *Path, (FPlatformTime::Seconds() - StartSeconds) * 1000.0, PendingProps.Num(), PendingCharacters.Num());
+	return true;
+}
+
+void UMechSurvivalSnapshot::DumpStats() const
+{
+	const int32 Snapshots = FMath::Max(Stats.Snapshots, 1);
+	const int64 Sections = FMath::Max<int64>(Stats.SectionsCopied + Stats.SectionsReused, 1);
+	UE_LOG(LogMechSnapshot, Log, TEXT("%d snapshots, %d deferred, %d failed; %d props tracked in %d blocks, last stall %.3f ms"),
+		Stats.Snapshots, Stats.Deferred, Writer ? Writer->GetNumFailed() : Stats.Failed, Props.Num(), PropBlocks.Num(), LastStallSeconds * 1000.0);
+	UE_LOG(LogMechSnapshot, Log, TEXT("Stall %.3f ms on average, %.3f ms at worst; %.1f%% of sections reused"),
+		Stats.TotalStallSeconds * 1000.0 / Snapshots, Stats.MaxStallSeconds * 1000.0, 100.0 * Stats.SectionsReused / Sections);
+	if (Writer != nullptr)
+	{
+		UE_LOG(LogMechSnapshot, Log, TEXT("Last snapshot %u bytes, %u compressed, written in %.2f ms; %d written"),
+			Writer->GetLastSize(), Writer->GetLastCompressedSize(), Writer->GetLastWriteMicroseconds() / 1000.0, Writer->GetNumWritten());
+	}
+}
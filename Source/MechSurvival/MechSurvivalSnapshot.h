@@ -0,0 +1,244 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalSnapshot.generated.h"
+
+class FRunnableThread;
+class ULevel;
+class UPrimitiveComponent;
+
+namespace MechSurvivalSnapshot
+{
+	/** "MSSN", at the start of every snapshot file */
+	static const uint32 Magic = 0x4E53534D;
+	/** Bumped whenever the header or a section changes */
+	static const uint32 Version = 1;
+}
+
+/** What a section of a snapshot holds; stored as a uint32, append only. Loading skips sections it does not know. */
+enum class EMechSurvivalSnapshotSection : uint32
+{
+	/** Map the snapshot was taken on */
+	Match,
+	/** UMechSurvivalWaveDirector::SerializeWave */
+	Wave,
+	/** Players' characters: transform, velocity, aim and weapon */
+	Characters,
+	/** Projectile actors in flight */
+	Projectiles,
+	/** UMechSurvivalBallistics::SerializeRounds */
+	Rounds,
+	/** UMechSurvivalHorde::SerializeMechs */
+	Mechs,
+	/** A block of simulating props placed in the levels */
+	Props,
+
+	Num
+};
+
+/** Start of every snapshot file, followed by the compressed sections */
+struct FMechSurvivalSnapshotFileHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 UncompressedSize;
+	uint32 CompressedSize;
+	/** Position of the snapshot in its run, from 0 */
+	uint32 Sequence;
+	uint32 NumSections;
+	/** FDateTime::UtcNow when it was taken */
+	int64 UtcTicks;
+};
+
+static_assert(sizeof(FMechSurvivalSnapshotFileHeader) == 32, "The snapshot file format relies on the header size; bump MechSurvivalSnapshot::Version when changing it");
+
+/** Counts since the world started, for the dump */
+struct FMechSurvivalSnapshotStats
+{
+	int32 Snapshots = 0;
+	/** Snapshots put off by a frame because the previous one was still being written */
+	int32 Deferred = 0;
+	int32 Failed = 0;
+	/** Game thread time spent capturing */
+	double TotalStallSeconds = 0.0;
+	double MaxStallSeconds = 0.0;
+	/** Sections copied again and sections handed on as they were */
+	int64 SectionsCopied = 0;
+	int64 SectionsReused = 0;
+};
+
+/**
+ * Checkpoints of the match, for picking a long run up again after a crash or a server restart.
+ *
+ * Every SnapshotInterval seconds the server captures the wave, the players' characters, projectiles and rounds in
+ * flight, the horde and the simulating props of the loaded levels into sections of a compact binary format. Sections
+ * are immutable once captured and handed to a writer thread by reference, so a section that has not changed since the
+ * last snapshot is not copied again: props are kept in blocks of PropsPerBlock, and a block is only captured again
+ * when one of its props is awake or has moved. The writer compresses the sections and writes them to
+ * Saved/Snapshots/<SnapshotName>.mssnap through a temporary file, so a crash never leaves a torn snapshot behind.
+ *
+ * A snapshot is restored with -MechRestore[=<name>] once play begins, or with MechSurvival.Snapshot.Restore. Props are
+ * found again by their path; those in levels that are not loaded yet, and characters of players that have not joined
+ * yet, are restored when they show up. Game thread stall and snapshot size are shown by the Snapshot Stall Us and
+ * Snapshot Bytes stats and MechSurvival.Snapshot.Dump.
+ */
+UCLASS(config=Game)
+class UMechSurvivalSnapshot : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the snapshot system of the world the context object lives in, if any */
+	static UMechSurvivalSnapshot* Get(const UObject* WorldContextObject);
+
+	/**
+	 * Captures the match and hands it to the writer; server only.
+	 * @returns false if the previous snapshot is still being written, in which case nothing is captured.
+	 */
+	bool TakeSnapshot(const FString& Name = FString());
+
+	/** Reads a snapshot and puts the match back the way it was; server only */
+	bool RestoreSnapshot(const FString& Name = FString());
+
+	/** Path of the snapshot file of that name; an empty name is SnapshotName */
+	FString GetSnapshotPath(const FString& Name) const;
+
+	const FMechSurvivalSnapshotStats& GetStats() const { return Stats; }
+
+	/** Writes the snapshot counts, stall and size to the log */
+	void DumpStats() const;
+
+protected:
+	/** Seconds between two automatic snapshots; 0 only snapshots on request */
+	UPROPERTY(config)
+	float SnapshotInterval = 30.f;
+
+	/** Name of the automatic snapshots, and of those taken or restored without one */
+	UPROPERTY(config)
+	FString SnapshotName = TEXT("Checkpoint");
+
+	/** Props per section; smaller blocks copy fewer sleeping props along with an awake one */
+	UPROPERTY(config)
+	int32 PropsPerBlock = 64;
+
+	/** Props closer than this to where they were captured are not captured again while they sleep */
+	UPROPERTY(config)
+	float PropMoveTolerance = 1.f;
+
+private:
+	/** A simulating prop placed in a level */
+	struct FTrackedProp
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		FString Path;
+		FVector CapturedLocation = FVector::ZeroVector;
+		bool bCapturedAwake = true;
+	};
+
+	/** A prop as it is saved, and as it waits for its level to be loaded */
+	struct FSavedProp
+	{
+		FTransform Transform;
+		FVector LinearVelocity = FVector::ZeroVector;
+		FVector AngularVelocity = FVector::ZeroVector;
+		bool bAwake = false;
+
+		void Serialize(FArchive& Ar) { Ar << Transform << LinearVelocity << AngularVelocity << bAwake; }
+	};
+
+	/** A player's character as it is saved, and as it waits for its player to join */
+	struct FSavedCharacter
+	{
+		FString PlayerName;
+		FTransform Transform;
+		FVector Velocity = FVector::ZeroVector;
+		FRotator ControlRotation = FRotator::ZeroRotator;
+		/** Path of a weapon asset, or the name of a weapon preset */
+		FString Weapon;
+
+		void Serialize(FArchive& Ar) { Ar << PlayerName << Transform << Velocity << ControlRotation << Weapon; }
+	};
+
+	/** Captures the sections that changed and hands all of them to the writer */
+	void CaptureSnapshot(const FString& Path);
+
+	/** Captures one section through the archive Save fills in */
+	TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> CaptureSection(TFunctionRef<void(FArchive&)> Save) const;
+
+	void SaveMatch(FArchive& Ar) const;
+	void SaveCharacters(FArchive& Ar) const;
+	void SaveProjectiles(FArchive& Ar) const;
+	void SavePropBlock(FArchive& Ar, int32 FirstProp, int32 NumProps);
+
+	/** Returns false if the snapshot was taken on another map */
+	bool LoadMatch(FArchive& Ar) const;
+	void LoadCharacters(FArchive& Ar);
+	void LoadProjectiles(FArchive& Ar);
+	void LoadProps(FArchive& Ar);
+
+	static void ApplyCharacter(class AMechSurvivalCharacter* Character, const FSavedCharacter& Saved);
+	static void ApplyProp(UPrimitiveComponent* Component, const FSavedProp& Saved);
+
+	/** Restores the characters of players that joined since the snapshot was restored */
+	void ApplyPendingCharacters();
+
+	/** Starts or stops tracking the simulating props of a level as it is added to or removed from the world */
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	/** Tracks the simulating props of the levels already loaded; those added later are tracked as they come */
+	void TrackInitialLevels();
+	void TrackLevelProps(ULevel* Level);
+
+	/** True once the props of the levels loaded at the start are tracked */
+	bool bTrackedInitialLevels = false;
+
+	TArray<FTrackedProp> Props;
+
+	/** Set when props were added or removed; every block is captured again */
+	bool bPropsChanged = true;
+
+	/** Props blocks of the last snapshot, handed on again while they do not change */
+	TArray<TSharedRef<TArray<uint8>, ESPMode::ThreadSafe>> PropBlocks;
+
+	/** Restored props and characters that were not there yet, by component path and by player name */
+	TMap<FString, FSavedProp> PendingProps;
+	TArray<FSavedCharacter> PendingCharacters;
+
+	/** Restore requested with -MechRestore, done once play has begun */
+	bool bRestorePending = false;
+	FString PendingRestoreName;
+
+	/** Off in benchmark and stress runs, which measure the game without it */
+	bool bAutoSnapshots = true;
+	float TimeSinceSnapshot = 0.f;
+	uint32 Sequence = 0;
+	double LastStallSeconds = 0.0;
+
+	/** Writer of the snapshots and the thread it runs on; started by the first snapshot */
+	class FMechSurvivalSnapshotWriter* Writer = nullptr;
+	FRunnableThread* WriterThread = nullptr;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	FMechSurvivalSnapshotStats Stats;
+};
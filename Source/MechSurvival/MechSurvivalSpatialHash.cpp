@@ -0,0 +1,646 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalSpatialHash.h"
+#include "MechSurvival.h"
+#include "MechSurvivalHorde.h"
+#include "MechSurvivalImpulseBatcher.h"
+#include "MechSurvivalTelemetry.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SphereComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "GameFramework/DamageType.h"
+#include "GameFramework/Pawn.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Math/RandomStream.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechSpatialHash, Log, All);
+
+static FAutoConsoleCommandWithWorld GDumpSpatialHashCmd(
+	TEXT("MechSurvival.SpatialHash.Dump"),
+	TEXT("Logs the entities in the spatial hash and what its area queries cost"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(World))
+		{
+			SpatialHash->DumpStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GBenchmarkSpatialHashCmd(
+	TEXT("MechSurvival.SpatialHash.Benchmark"),
+	TEXT("Times <Queries> radius queries through the spatial hash and through OverlapMultiByChannel at every benchmark entity count, default 10000"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UMechSurvivalSpatialHash* SpatialHash = UMechSurvivalSpatialHash::Get(World))
+		{
+			SpatialHash->RunBenchmark(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000);
+		}
+	}));
+
+namespace MechSurvivalSpatialHash
+{
+	static uint64 MakeCellKey(int32 X, int32 Y)
+	{
+		return ((uint64)(uint32)X << 32) | (uint64)(uint32)Y;
+	}
+}
+
+bool UMechSurvivalSpatialHash::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void UMechSurvivalSpatialHash::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UMechSurvivalSpatialHash::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UMechSurvivalSpatialHash::OnLevelRemoved);
+}
+
+void UMechSurvivalSpatialHash::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	if (Stats.Queries > 0)
+	{
+		DumpStats();
+	}
+
+	Locations.Empty();
+	Radii.Empty();
+	AxisHalfLengths.Empty();
+	EntityCells.Empty();
+	NextInCell.Empty();
+	PrevInCell.Empty();
+	Components.Empty();
+	MechIndices.Empty();
+	FreeHandles.Empty();
+	CellHeads.Empty();
+	ComponentHandles.Empty();
+	PendingExplosions.Empty();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalSpatialHash* UMechSurvivalSpatialHash::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UMechSurvivalSpatialHash>() : nullptr;
+}
+
+ETickableTickType UMechSurvivalSpatialHash::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalSpatialHash::IsTickable() const
+{
+	// Ticks once before any entity shows up to register the levels' props
+	return GetWorld() != nullptr && (GetNumEntities() > 0 || PendingExplosions.Num() > 0 || !bTrackedInitialLevels);
+}
+
+TStatId UMechSurvivalSpatialHash::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalSpatialHash, STATGROUP_Tickables);
+}
+
+UWorld* UMechSurvivalSpatialHash::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UMechSurvivalSpatialHash::Tick(float DeltaTime)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(SpatialHashUpdate);
+
+	if (GetWorld()->HasBegunPlay())
+	{
+		TrackInitialLevels();
+	}
+
+	UpdateActorEntities();
+	ResolveExplosions();
+
+	MECHSURVIVAL_SET_LEVEL(SpatialHashEntities, GetNumEntities());
+}
+
+void UMechSurvivalSpatialHash::RegisterEntity(UPrimitiveComponent* Component)
+{
+	if (Component == nullptr || ComponentHandles.Contains(Component))
+	{
+		return;
+	}
+
+	// Capsules are centred on their component, so the bounds origin is where both shapes are
+	float Radius = Component->Bounds.SphereRadius;
+	float HalfHeight = 0.f;
+	if (const UCapsuleComponent* Capsule = Cast<UCapsuleComponent>(Component))
+	{
+		Radius = Capsule->GetScaledCapsuleRadius();
+		HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+	}
+
+	const int32 Handle = AddEntity(Component->Bounds.Origin, Radius, HalfHeight);
+	Components[Handle] = Component;
+	ComponentHandles.Add(Component, Handle);
+}
+
+void UMechSurvivalSpatialHash::UnregisterEntity(UPrimitiveComponent* Component)
+{
+	int32 Handle = INDEX_NONE;
+	if (ComponentHandles.RemoveAndCopyValue(Component, Handle))
+	{
+		RemoveEntity(Handle);
+	}
+}
+
+int32 UMechSurvivalSpatialHash::AddMech(int32 MechIndex, const FVector& Location, float Radius, float HalfHeight)
+{
+	const int32 Handle = AddEntity(Location, Radius, HalfHeight);
+	MechIndices[Handle] = MechIndex;
+	return Handle;
+}
+
+void UMechSurvivalSpatialHash::MoveMechs(TArrayView<const int32> Handles, TArrayView<const FVector> NewLocations)
+{
+	check(Handles.Num() == NewLocations.Num());
+
+	for (int32 Index = 0; Index < Handles.Num(); ++Index)
+	{
+		if (Handles[Index] != INDEX_NONE)
+		{
+			MoveEntity(Handles[Index], NewLocations[Index]);
+		}
+	}
+}
+
+void UMechSurvivalSpatialHash::SetMechIndex(int32 Handle, int32 MechIndex)
+{
+	if (MechIndices.IsValidIndex(Handle))
+	{
+		MechIndices[Handle] = MechIndex;
+	}
+}
+
+void UMechSurvivalSpatialHash::RemoveMech(int32 Handle)
+{
+	if (Radii.IsValidIndex(Handle) && Radii[Handle] >= 0.f)
+	{
+		RemoveEntity(Handle);
+	}
+}
+
+int32 UMechSurvivalSpatialHash::AddEntity(const FVector& Location, float Radius, float HalfHeight)
+{
+	int32 Handle = INDEX_NONE;
+	if (FreeHandles.Num() > 0)
+	{
+		Handle = FreeHandles.Pop(false);
+	}
+	else
+	{
+		Handle = Locations.AddUninitialized();
+		Radii.AddUninitialized();
+		AxisHalfLengths.AddUninitialized();
+		EntityCells.AddUninitialized();
+		NextInCell.AddUninitialized();
+		PrevInCell.AddUninitialized();
+		Components.AddDefaulted();
+		MechIndices.AddUninitialized();
+	}
+
+	Radius = FMath::Max(Radius, 0.f);
+	Locations[Handle] = Location;
+	Radii[Handle] = Radius;
+	AxisHalfLengths[Handle] = FMath::Max(HalfHeight - Radius, 0.f);
+	Components[Handle] = nullptr;
+	MechIndices[Handle] = INDEX_NONE;
+	MaxEntityRadius = FMath::Max(MaxEntityRadius, Radius);
+
+	EntityCells[Handle] = GetCellKey(Location);
+	LinkEntity(Handle);
+	return Handle;
+}
+
+void UMechSurvivalSpatialHash::RemoveEntity(int32 Handle)
+{
+	UnlinkEntity(Handle);
+	Radii[Handle] = -1.f;
+	Components[Handle] = nullptr;
+	MechIndices[Handle] = INDEX_NONE;
+	FreeHandles.Add(Handle);
+}
+
+void UMechSurvivalSpatialHash::MoveEntity(int32 Handle, const FVector& Location)
+{
+	Locations[Handle] = Location;
+
+	const uint64 Cell = GetCellKey(Location);
+	if (Cell != EntityCells[Handle])
+	{
+		UnlinkEntity(Handle);
+		EntityCells[Handle] = Cell;
+		LinkEntity(Handle);
+		++Stats.CellChanges;
+	}
+}
+
+uint64 UMechSurvivalSpatialHash::GetCellKey(const FVector& Location) const
+{
+	const float InvCellSize = 1.f / CellSize;
+	return MechSurvivalSpatialHash::MakeCellKey(FMath::FloorToInt(Location.X * InvCellSize), FMath::FloorToInt(Location.Y * InvCellSize));
+}
+
+void UMechSurvivalSpatialHash::LinkEntity(int32 Handle)
+{
+	PrevInCell[Handle] = INDEX_NONE;
+	if (int32* Head = CellHeads.Find(EntityCells[Handle]))
+	{
+		NextInCell[Handle] = *Head;
+		PrevInCell[*Head] = Handle;
+		*Head = Handle;
+	}
+	else
+	{
+		NextInCell[Handle] = INDEX_NONE;
+		CellHeads.Add(EntityCells[Handle], Handle);
+	}
+}
+
+void UMechSurvivalSpatialHash::UnlinkEntity(int32 Handle)
+{
+	const int32 Prev = PrevInCell[Handle];
+	const int32 Next = NextInCell[Handle];
+	if (Next != INDEX_NONE)
+	{
+		PrevInCell[Next] = Prev;
+	}
+
+	if (Prev != INDEX_NONE)
+	{
+		NextInCell[Prev] = Next;
+	}
+	else if (Next != INDEX_NONE)
+	{
+		CellHeads.FindChecked(EntityCells[Handle]) = Next;
+	}
+	else
+	{
+		CellHeads.Remove(EntityCells[Handle]);
+	}
+}
+
+void UMechSurvivalSpatialHash::UpdateActorEntities()
+{
+	for (auto It = ComponentHandles.CreateIterator(); It; ++It)
+	{
+		const int32 Handle = It.Value();
+		const UPrimitiveComponent* Component = Components[Handle].Get();
+		if (Component == nullptr)
+		{
+			RemoveEntity(Handle);
+			It.RemoveCurrent();
+			continue;
+		}
+
+		MoveEntity(Handle, Component->Bounds.Origin);
+	}
+}
+
+void UMechSurvivalSpatialHash::TrackInitialLevels()
+{
+	if (bTrackedInitialLevels)
+	{
+		return;
+	}
+
+	bTrackedInitialLevels = true;
+	for (ULevel* Level : GetWorld()->GetLevels())
+	{
+		if (Level != nullptr && Level->bIsVisible)
+		{
+			RegisterLevelProps(Level);
+		}
+	}
+}
+
+void UMechSurvivalSpatialHash::RegisterLevelProps(ULevel* Level)
+{
+	TArray<UPrimitiveComponent*> LevelProps;
+	MechSurvivalProps::GetSimulatingProps(Level, LevelProps);
+	for (UPrimitiveComponent* Prop : LevelProps)
+	{
+		RegisterEntity(Prop);
+	}
+}
+
+void UMechSurvivalSpatialHash::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	// Levels there at the start are registered together once play begins
+	if (World == GetWorld() && Level != nullptr && bTrackedInitialLevels)
+	{
+		RegisterLevelProps(Level);
+	}
+}
+
+void UMechSurvivalSpatialHash::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+
+	// No level means every level is going; characters live in the persistent level and go with it
+	for (auto It = ComponentHandles.CreateIterator(); It; ++It)
+	{
+		const UPrimitiveComponent* Component = Components[It.Value()].Get();
+		if (Level == nullptr || Component == nullptr || Component->GetComponentLevel() == Level)
+		{
+			RemoveEntity(It.Value());
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void UMechSurvivalSpatialHash::QueryAreas(TArrayView<const FMechSurvivalAreaQuery> Queries, FMechSurvivalAreaResults& OutResults)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(AreaQuery);
+	const double StartSeconds = FPlatformTime::Seconds();
+
+	OutResults.Hits.Reset();
+	OutResults.Starts.Reset(Queries.Num() + 1);
+
+	const float InvCellSize = 1.f / CellSize;
+	for (const FMechSurvivalAreaQuery& Query : Queries)
+	{
+		OutResults.Starts.Add(OutResults.Hits.Num());
+
+		// A centre this far from the origin can still have the entity's surface inside the radius
+		const float Reach = Query.Radius + MaxEntityRadius;
+		const int32 MinX = FMath::FloorToInt((Query.Origin.X - Reach) * InvCellSize);
+		const int32 MaxX = FMath::FloorToInt((Query.Origin.X + Reach) * InvCellSize);
+		const int32 MinY = FMath::FloorToInt((Query.Origin.Y - Reach) * InvCellSize);
+		const int32 MaxY = FMath::FloorToInt((Query.Origin.Y + Reach) * InvCellSize);
+
+		const bool bCone = Query.HalfAngleDegrees < 180.f;
+		const float HalfAngle = FMath::DegreesToRadians(Query.HalfAngleDegrees);
+
+		for (int32 Y = MinY; Y <= MaxY; ++Y)
+		{
+			for (int32 X = MinX; X <= MaxX; ++X)
+			{
+				const int32* Head = CellHeads.Find(MechSurvivalSpatialHash::MakeCellKey(X, Y));
+				if (Head == nullptr)
+				{
+					continue;
+				}
+
+				for (int32 Handle = *Head; Handle != INDEX_NONE; Handle = NextInCell[Handle])
+				{
+					// Point of the capsule's axis nearest the origin; the surface is Radius closer
+					const FVector& Center = Locations[Handle];
+					const float AxisHalfLength = AxisHalfLengths[Handle];
+					const FVector OnAxis(Center.X, Center.Y, FMath::Clamp(Query.Origin.Z, Center.Z - AxisHalfLength, Center.Z + AxisHalfLength));
+					const FVector ToAxis = OnAxis - Query.Origin;
+					const float AxisDistance = ToAxis.Size();
+					const float Radius = Radii[Handle];
+					const float Distance = FMath::Max(AxisDistance - Radius, 0.f);
+					if (Distance > Query.Radius)
+					{
+						continue;
+					}
+
+					// An entity pokes into the cone by the angle it covers as seen from the origin
+					if (bCone && AxisDistance > Radius)
+					{
+						const float Angle = FMath::Acos(FMath::Clamp((ToAxis | Query.Direction) / AxisDistance, -1.f, 1.f));
+						if (Angle > HalfAngle + FMath::Asin(Radius / AxisDistance))
+						{
+							continue;
+						}
+					}
+
+					UPrimitiveComponent* Component = Components[Handle].Get();
+					const int32 MechIndex = MechIndices[Handle];
+					if (Component == nullptr && MechIndex == INDEX_NONE)
+					{
+						continue;
+					}
+
+					FMechSurvivalAreaHit& Hit = OutResults.Hits.AddDefaulted_GetRef();
+					Hit.Component = Component;
+					Hit.MechIndex = MechIndex;
+					Hit.Location = Distance > 0.f ? OnAxis - ToAxis * (Radius / AxisDistance) : Query.Origin;
+					Hit.Distance = Distance;
+				}
+			}
+		}
+	}
+	OutResults.Starts.Add(OutResults.Hits.Num());
+
+	Stats.Queries += Queries.Num();
+	Stats.Hits += OutResults.Hits.Num();
+	Stats.QuerySeconds += FPlatformTime::Seconds() - StartSeconds;
+	MECHSURVIVAL_INC_COUNTER(AreaQueries, Queries.Num());
+}
+
+void UMechSurvivalSpatialHash::QueueExplosion(const FVector& Origin, float Radius, float Damage, AActor* DamageCauser, APawn* Instigator)
+{
+	const UWorld* World = GetWorld();
+	if (Radius <= 0.f || World == nullptr || World->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	FExplosion& Explosion = PendingExplosions.AddDefaulted_GetRef();
+	Explosion.Origin = Origin;
+	Explosion.Radius = Radius;
+	Explosion.Damage = Damage;
+	Explosion.DamageCauser = DamageCauser;
+	Explosion.Instigator = Instigator;
+}
+
+void UMechSurvivalSpatialHash::ResolveExplosions()
+{
+	if (PendingExplosions.Num() == 0)
+	{
+		return;
+	}
+
+	// Queried now rather than when queued, so that the mech indices are those of the horde as it is
+	ExplosionQueries.Reset(PendingExplosions.Num());
+	for (const FExplosion& Explosion : PendingExplosions)
+	{
+		FMechSurvivalAreaQuery& Query = ExplosionQueries.AddDefaulted_GetRef();
+		Query.Origin = Explosion.Origin;
+		Query.Radius = Explosion.Radius;
+	}
+	QueryAreas(ExplosionQueries, ExplosionResults);
+
+	UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this);
+	for (int32 Index = 0; Index < PendingExplosions.Num(); ++Index)
+	{
+		const FExplosion& Explosion = PendingExplosions[Index];
+		APawn* Instigator = Explosion.Instigator.Get();
+		for (const FMechSurvivalAreaHit& Hit : ExplosionResults.GetHits(Index))
+		{
+			const float Falloff = FMath::Lerp(1.f, ExplosionEdgeDamageScale, FMath::Clamp(Hit.Distance / Explosion.Radius, 0.f, 1.f));
+			const float Damage = Explosion.Damage * Falloff;
+			FVector Away = (Hit.Location - Explosion.Origin).GetSafeNormal();
+			if (Away.IsZero())
+			{
+				Away = FVector::UpVector;
+			}
+
+			if (Hit.MechIndex != INDEX_NONE)
+			{
+				if (Horde != nullptr)
+				{
+					Horde->ApplyDamage(Hit.MechIndex, Damage, Instigator);
+					UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, Hit.Location, Damage);
+				}
+			}
+			// An earlier hit of this frame may have destroyed the actor
+			else if (IsValid(Hit.Component) && Hit.Component->IsSimulatingPhysics())
+			{
+				const FVector Impulse = Away * ExplosionImpulse * Falloff;
+				UMechSurvivalImpulseBatcher::AddImpulseAtLocation(Hit.Component, Impulse, Hit.Location);
+				UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Impulse, Hit.Location, Impulse.Size());
+			}
+			else if (IsValid(Hit.Component) && Hit.Component->GetOwner() != nullptr)
+			{
+				AActor* Actor = Hit.Component->GetOwner();
+				const FHitResult DamageHit(Actor, Hit.Component, Hit.Location, -Away);
+				UGameplayStatics::ApplyPointDamage(Actor, Damage, Away, DamageHit, Instigator ? Instigator->GetController() : nullptr, Explosion.DamageCauser.Get(), UDamageType::StaticClass());
+				UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent::Hit, Hit.Location, Damage);
+			}
+		}
+	}
+
+	Stats.Explosions += PendingExplosions.Num();
+	MECHSURVIVAL_INC_COUNTER(Explosions, PendingExplosions.Num());
+	PendingExplosions.Reset();
+}
+
+void UMechSurvivalSpatialHash::RunBenchmark(int32 NumQueries)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr)
+	{
+		return;
+	}
+	NumQueries = FMath::Max(NumQueries, 1);
+
+	// Same spread every run, so that runs can be compared
+	FRandomStream Random(1337);
+	TArray<FMechSurvivalAreaQuery> Queries;
+	Queries.SetNum(NumQueries);
+	for (FMechSurvivalAreaQuery& Query : Queries)
+	{
+		Query.Origin = BenchmarkCenter + FVector(Random.FRandRange(-BenchmarkExtent, BenchmarkExtent), Random.FRandRange(-BenchmarkExtent, BenchmarkExtent), 0.f);
+		Query.Radius = BenchmarkQueryRadius;
+	}
+	const TArrayView<const FMechSurvivalAreaQuery> WarmUpQueries(Queries.GetData(), FMath::Min(NumQueries, 64));
+
+	FMechSurvivalAreaResults Results;
+	TArray<FOverlapResult> Overlaps;
+	const FCollisionShape Sphere = FCollisionShape::MakeSphere(BenchmarkQueryRadius);
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MechSurvivalSpatialHashBenchmark), false);
+
+	// One file for all runs, so the two can be followed over time
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("SpatialHash.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Entities,Queries,HashMicrosecondsPerQuery,OverlapMicrosecondsPerQuery,HashHits,OverlapHits\n")), *ReportPath);
+	}
+
+	for (const int32 NumEntities : BenchmarkEntityCounts)
+	{
+		if (NumEntities <= 0)
+		{
+			continue;
+		}
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		AActor* Holder = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform(BenchmarkCenter), SpawnParams);
+		if (Holder == nullptr)
+		{
+			continue;
+		}
+
+		// Overlap-only spheres, so that both sides find the same entities and nothing else
+		TArray<USphereComponent*> Entities;
+		Entities.Reserve(NumEntities);
+		for (int32 Index = 0; Index < NumEntities; ++Index)
+		{
+			USphereComponent* Entity = NewObject<USphereComponent>(Holder);
+			Entity->InitSphereRadius(BenchmarkEntityRadius);
+			Entity->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+			Entity->SetCollisionObjectType(ECC_WorldDynamic);
+			Entity->SetCollisionResponseToAllChannels(ECR_Overlap);
+			Entity->SetGenerateOverlapEvents(false);
+			if (Index == 0)
+			{
+				Holder->SetRootComponent(Entity);
+			}
+			Entity->SetWorldLocation(BenchmarkCenter + FVector(Random.FRandRange(-BenchmarkExtent, BenchmarkExtent), Random.FRandRange(-BenchmarkExtent, BenchmarkExtent), Random.FRandRange(-100.f, 100.f)));
+			Entity->RegisterComponent();
+			RegisterEntity(Entity);
+			Entities.Add(Entity);
+		}
+
+		// Both sides touch their structures once before they are timed
+		QueryAreas(WarmUpQueries, Results);
+		for (const FMechSurvivalAreaQuery& Query : WarmUpQueries)
+		{
+			World->OverlapMultiByChannel(Overlaps, Query.Origin, FQuat::Identity, ECC_WorldDynamic, Sphere, QueryParams);
+		}
+
+		const double HashStartSeconds = FPlatformTime::Seconds();
+		QueryAreas(Queries, Results);
+		const double HashSeconds = FPlatformTime::Seconds() - HashStartSeconds;
+		const int32 HashHits = Results.Hits.Num();
+
+		int32 OverlapHits = 0;
+		const double OverlapStartSeconds = FPlatformTime::Seconds();
+		for (const FMechSurvivalAreaQuery& Query : Queries)
+		{
+			World->OverlapMultiByChannel(Overlaps, Query.Origin, FQuat::Identity, ECC_WorldDynamic, Sphere, QueryParams);
+			OverlapHits += Overlaps.Num();
+		}
+		const double OverlapSeconds = FPlatformTime::Seconds() - OverlapStartSeconds;
+
+		const double HashMicroseconds = HashSeconds * 1000000.0 / NumQueries;
+		const double OverlapMicroseconds = OverlapSeconds * 1000000.0 / NumQueries;
+		UE_LOG(LogMechSpatialHash, Log, TEXT("%d entities, %d queries: hash %.3f us per query, %d hits; overlap %.3f us per query, %d hits; %.1fx"),
+			NumEntities, NumQueries, HashMicroseconds, HashHits, OverlapMicroseconds, OverlapHits, OverlapSeconds / FMath::Max(HashSeconds, 1e-9));
+
+		const FString Line = FString::Printf(TEXT("%s,%d,%d,%.3f,%.3f,%d,%d\n"), *FDateTime::Now().ToString(), NumEntities, NumQueries, HashMicroseconds, OverlapMicroseconds, HashHits, OverlapHits);
+		FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+		for (USphereComponent* Entity : Entities)
+		{
+			UnregisterEntity(Entity);
+		}
+		Holder->Destroy();
+	}
+}
+
+void UMechSurvivalSpatialHash::DumpStats() const
+{
+	const int32 Queries = FMath::Max(Stats.Queries, 1);
+	UE_LOG(LogMechSpatialHash, Log, TEXT("%d entities, %d of them actors, in %d cells of %.0f; largest radius %.0f"),
+		GetNumEntities(), ComponentHandles.Num(), CellHeads.Num(), CellSize, MaxEntityRadius);
+	UE_LOG(LogMechSpatialHash, Log, TEXT("%d area queries, %.2f us and %.1f hits on average; %d explosions; %d cell changes"),
+		Stats.Queries, Stats.QuerySeconds * 1000000.0 / Queries, (double)Stats.Hits / Queries, Stats.Explosions, Stats.CellChanges);
+}
@@ -0,0 +1,252 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalSpatialHash.generated.h"
+
+class APawn;
+class ULevel;
+class UPrimitiveComponent;
+
+/** An area to look for entities in: a sphere, or the part of it inside a cone when HalfAngleDegrees is under 180 */
+struct FMechSurvivalAreaQuery
+{
+	FVector Origin = FVector::ZeroVector;
+	float Radius = 0.f;
+	/** Axis of the cone, unit length */
+	FVector Direction = FVector::ForwardVector;
+	float HalfAngleDegrees = 180.f;
+};
+
+/** An entity an area query found */
+struct FMechSurvivalAreaHit
+{
+	/** Component of an actor entity; null for a horde mech */
+	UPrimitiveComponent* Component = nullptr;
+
+	/** Horde mech, valid until the horde steps again; INDEX_NONE for an actor entity */
+	int32 MechIndex = INDEX_NONE;
+
+	/** Point of the entity closest to the query origin */
+	FVector Location = FVector::ZeroVector;
+
+	/** From the query origin to Location; 0 if the origin is inside the entity */
+	float Distance = 0.f;
+};
+
+/**
+ * Results of a batch of area queries. Callers keep one and pass it to every batch, so that once its arrays have grown
+ * to the largest batch querying no longer allocates.
+ */
+struct FMechSurvivalAreaResults
+{
+	/** Hits of all the queries, those of the first query first */
+	TArray<FMechSurvivalAreaHit> Hits;
+
+	/** Where the hits of each query start in Hits; one more entry than there were queries */
+	TArray<int32> Starts;
+
+	/** Hits of one query of the batch */
+	TArrayView<const FMechSurvivalAreaHit> GetHits(int32 QueryIndex) const
+	{
+		return TArrayView<const FMechSurvivalAreaHit>(Hits.GetData() + Starts[QueryIndex], Starts[QueryIndex + 1] - Starts[QueryIndex]);
+	}
+};
+
+/** Counts since the world started, for the dump */
+struct FMechSurvivalSpatialHashStats
+{
+	int32 Queries = 0;
+	int32 Hits = 0;
+	double QuerySeconds = 0.0;
+	int32 Explosions = 0;
+	/** Entities that changed cell when they moved */
+	int32 CellChanges = 0;
+};
+
+/**
+ * Gameplay broadphase of everything that can be damaged: players, props and horde mechs.
+ *
+ * Entities are upright capsules, or spheres, hashed by their centre into square cells of CellSize on the ground plane.
+ * A cell keeps its entities in a list threaded through the entity arrays, so that an entity moving into another cell
+ * is unlinked and relinked in place without allocating, and cells nothing is in take no memory. Actor entities are
+ * components registered with RegisterEntity, e.g. a character's capsule, and the simulating props of every level,
+ * registered as the level is added to the world and dropped as it is removed; they are moved every frame from where
+ * their component is. Horde mechs are added and moved by the horde, which has them in flat arrays anyway.
+ *
+ * Area queries go in batches: each sphere or cone looks at the cells within its radius, grown by the largest entity,
+ * and writes what it touches into the caller's result buffers. Explosions are queued as they happen and resolved in
+ * one batch per frame where the game is authoritative: everything within the radius takes damage falling from full at
+ * the centre to ExplosionEdgeDamageScale at the edge, and simulating bodies are pushed away from it.
+ *
+ * MechSurvival.SpatialHash.Benchmark compares a batch of radius queries against OverlapMultiByChannel over the same
+ * entities, for every count in BenchmarkEntityCounts, and appends the result to Saved/Benchmark/SpatialHash.csv.
+ */
+UCLASS(config=Game)
+class UMechSurvivalSpatialHash : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the spatial hash of the world the context object lives in, if any */
+	static UMechSurvivalSpatialHash* Get(const UObject* WorldContextObject);
+
+	/** Adds a component as an entity; capsules keep their shape, anything else is its bounding sphere */
+	void RegisterEntity(UPrimitiveComponent* Component);
+
+	void UnregisterEntity(UPrimitiveComponent* Component);
+
+	/** Adds a horde mech as an entity; returns its handle */
+	int32 AddMech(int32 MechIndex, const FVector& Location, float Radius, float HalfHeight);
+
+	/** Moves horde mechs, Handles[I] to NewLocations[I] */
+	void MoveMechs(TArrayView<const int32> Handles, TArrayView<const FVector> NewLocations);
+
+	/** Tells the hash that a mech moved to another slot of the horde */
+	void SetMechIndex(int32 Handle, int32 MechIndex);
+
+	/** Removes a horde mech */
+	void RemoveMech(int32 Handle);
+
+	/** Finds the entities in each area; OutResults is emptied first, keeping its memory */
+	void QueryAreas(TArrayView<const FMechSurvivalAreaQuery> Queries, FMechSurvivalAreaResults& OutResults);
+
+	/** Queues an explosion, resolved with the others at the end of the frame; Instigator is the pawn behind it, if known */
+	void QueueExplosion(const FVector& Origin, float Radius, float Damage, AActor* DamageCauser, APawn* Instigator = nullptr);
+
+	/** Number of entities, actors and mechs */
+	int32 GetNumEntities() const { return Locations.Num() - FreeHandles.Num(); }
+
+	float GetCellSize() const { return CellSize; }
+
+	const FMechSurvivalSpatialHashStats& GetStats() const { return Stats; }
+
+	/**
+	 * Times NumQueries radius queries through the hash and through OverlapMultiByChannel, over every entity count of
+	 * BenchmarkEntityCounts; the entities are sphere components spread over a square far above the arena.
+	 */
+	void RunBenchmark(int32 NumQueries);
+
+	/** Writes the entity counts and query cost to the log */
+	void DumpStats() const;
+
+protected:
+	/** Side of a cell; about the radius of a typical explosion */
+	UPROPERTY(config)
+	float CellSize = 1000.f;
+
+	/** Fraction of an explosion's damage dealt at its edge */
+	UPROPERTY(config)
+	float ExplosionEdgeDamageScale = 0.25f;
+
+	/** Impulse given to a simulating body at the centre of an explosion, falling off like the damage */
+	UPROPERTY(config)
+	float ExplosionImpulse = 200000.f;
+
+	/** Entity counts the benchmark runs at */
+	UPROPERTY(config)
+	TArray<int32> BenchmarkEntityCounts;
+
+	/** Benchmark entities and queries are spread over a square of this half size around BenchmarkCenter */
+	UPROPERTY(config)
+	float BenchmarkExtent = 20000.f;
+
+	UPROPERTY(config)
+	FVector BenchmarkCenter = FVector(0.f, 0.f, 200000.f);
+
+	UPROPERTY(config)
+	float BenchmarkEntityRadius = 50.f;
+
+	UPROPERTY(config)
+	float BenchmarkQueryRadius = 600.f;
+
+private:
+	struct FExplosion
+	{
+		FVector Origin;
+		float Radius;
+		float Damage;
+		TWeakObjectPtr<AActor> DamageCauser;
+		TWeakObjectPtr<APawn> Instigator;
+	};
+
+	/** Takes a free handle or adds one, and links the entity into its cell */
+	int32 AddEntity(const FVector& Location, float Radius, float HalfHeight);
+
+	/** Unlinks an entity and frees its handle */
+	void RemoveEntity(int32 Handle);
+
+	/** Moves an entity, relinking it only if it changed cell */
+	void MoveEntity(int32 Handle, const FVector& Location);
+
+	uint64 GetCellKey(const FVector& Location) const;
+
+	void LinkEntity(int32 Handle);
+	void UnlinkEntity(int32 Handle);
+
+	/** Moves every actor entity to where its component is, dropping those whose component is gone */
+	void UpdateActorEntities();
+
+	/** Damages and pushes what the queued explosions reach */
+	void ResolveExplosions();
+
+	/** Adds or drops the simulating props of a level as it is added to or removed from the world */
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	/** Registers the simulating props of the levels already loaded; those added later are registered as they come */
+	void TrackInitialLevels();
+	void RegisterLevelProps(ULevel* Level);
+
+	/** True once the props of the levels loaded at the start are registered */
+	bool bTrackedInitialLevels = false;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	// Entities, struct-of-arrays indexed by handle; free handles have a negative radius and are in no cell
+	TArray<FVector> Locations;
+	TArray<float> Radii;
+	/** Half length of the capsule's axis; 0 for spheres */
+	TArray<float> AxisHalfLengths;
+	TArray<uint64> EntityCells;
+	TArray<int32> NextInCell;
+	TArray<int32> PrevInCell;
+	TArray<TWeakObjectPtr<UPrimitiveComponent>> Components;
+	TArray<int32> MechIndices;
+	TArray<int32> FreeHandles;
+
+	/** First entity of every cell that has any */
+	TMap<uint64, int32> CellHeads;
+
+	/** Handles of the actor entities, to move them and to unregister them by component */
+	TMap<const UPrimitiveComponent*, int32> ComponentHandles;
+
+	/** Largest radius of any entity so far; queries look this far past their radius for centres */
+	float MaxEntityRadius = 0.f;
+
+	TArray<FExplosion> PendingExplosions;
+
+	/** Reused by every frame's explosions */
+	TArray<FMechSurvivalAreaQuery> ExplosionQueries;
+	FMechSurvivalAreaResults ExplosionResults;
+
+	FMechSurvivalSpatialHashStats Stats;
+};
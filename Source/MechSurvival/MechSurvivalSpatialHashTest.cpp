@@ -0,0 +1,102 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalSpatialHash.h"
+#include "Misc/AutomationTest.h"
+#include "UObject/Package.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMechSurvivalSpatialHashGridTest, "MechSurvival.SpatialHash.Grid", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+namespace MechSurvivalSpatialHashTest
+{
+	/** Mech indices one area query finds, in ascending order */
+	static TArray<int32> QueryMechs(UMechSurvivalSpatialHash* SpatialHash, const FMechSurvivalAreaQuery& Query)
+	{
+		FMechSurvivalAreaResults Results;
+		SpatialHash->QueryAreas(TArrayView<const FMechSurvivalAreaQuery>(&Query, 1), Results);
+
+		TArray<int32> MechIndices;
+		for (const FMechSurvivalAreaHit& Hit : Results.GetHits(0))
+		{
+			MechIndices.Add(Hit.MechIndex);
+		}
+		MechIndices.Sort();
+		return MechIndices;
+	}
+
+	static FMechSurvivalAreaQuery MakeQuery(const FVector& Origin, float Radius, const FVector& Direction = FVector::ForwardVector, float HalfAngleDegrees = 180.f)
+	{
+		FMechSurvivalAreaQuery Query;
+		Query.Origin = Origin;
+		Query.Radius = Radius;
+		Query.Direction = Direction;
+		Query.HalfAngleDegrees = HalfAngleDegrees;
+		return Query;
+	}
+}
+
+bool FMechSurvivalSpatialHashGridTest::RunTest(const FString& Parameters)
+{
+	using namespace MechSurvivalSpatialHashTest;
+
+	// The grid needs no world; without one the hash never ticks, so nothing but the test moves its entities
+	UMechSurvivalSpatialHash* SpatialHash = NewObject<UMechSurvivalSpatialHash>(GetTransientPackage());
+
+	// Everything is laid out in cells, so the test holds whatever the configured cell size
+	const float Cell = SpatialHash->GetCellSize();
+	const float Radius = Cell * 0.05f;
+	const FVector Center(Cell * 0.5f, Cell * 0.5f, 0.f);
+
+	const int32 Near = SpatialHash->AddMech(0, Center, Radius, 0.f);
+	const int32 Far = SpatialHash->AddMech(1, Center + FVector(Cell * 2.f, 0.f, 0.f), Radius, 0.f);
+	TestEqual(TEXT("Entities after adding two mechs"), SpatialHash->GetNumEntities(), 2);
+
+	// Radius: a mech counts once its surface is inside, not only its centre
+	TestTrue(TEXT("Small radius finds the mech at its origin"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 0.1f)) == TArray<int32>({ 0 }));
+	TestTrue(TEXT("Radius reaching the far mech's surface finds both"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 2.f - Radius * 0.5f)) == TArray<int32>({ 0, 1 }));
+	TestTrue(TEXT("Radius short of the far mech's surface finds one"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 2.f - Radius * 1.5f)) == TArray<int32>({ 0 }));
+
+	// Moving inside a cell leaves the cell lists alone
+	const int32 CellChanges = SpatialHash->GetStats().CellChanges;
+	const FVector InSameCell = Center + FVector(Cell * 2.2f, 0.f, 0.f);
+	SpatialHash->MoveMechs(TArrayView<const int32>(&Far, 1), TArrayView<const FVector>(&InSameCell, 1));
+	TestEqual(TEXT("Move within a cell does not relink"), SpatialHash->GetStats().CellChanges, CellChanges);
+	TestTrue(TEXT("Mech found where it moved within its cell"), QueryMechs(SpatialHash, MakeQuery(InSameCell, Cell * 0.1f)) == TArray<int32>({ 1 }));
+
+	// Moving into another cell unlinks it from the old one and links it into the new one
+	const FVector NextToNear = Center + FVector(Cell * 0.3f, 0.f, 0.f);
+	SpatialHash->MoveMechs(TArrayView<const int32>(&Far, 1), TArrayView<const FVector>(&NextToNear, 1));
+	TestEqual(TEXT("Move to another cell relinks"), SpatialHash->GetStats().CellChanges, CellChanges + 1);
+	TestTrue(TEXT("Old cell is empty"), QueryMechs(SpatialHash, MakeQuery(InSameCell, Cell * 0.1f)) == TArray<int32>());
+	TestTrue(TEXT("New cell holds both mechs"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 0.4f)) == TArray<int32>({ 0, 1 }));
+
+	// Negative coordinates hash to cells of their own
+	const FVector Negative = -Center;
+	SpatialHash->MoveMechs(TArrayView<const int32>(&Far, 1), TArrayView<const FVector>(&Negative, 1));
+	TestEqual(TEXT("Move across the origin relinks"), SpatialHash->GetStats().CellChanges, CellChanges + 2);
+	TestTrue(TEXT("Mech found across the origin"), QueryMechs(SpatialHash, MakeQuery(Negative, Cell * 0.1f)) == TArray<int32>({ 1 }));
+	TestTrue(TEXT("Mech gone from the cell it left"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 0.4f)) == TArray<int32>({ 0 }));
+
+	// Cone: the mechs at its origin and on its axis are in, the one behind is out, and one just off the edge is in
+	// only as far as its radius pokes into the cone, which at this distance widens it by asin(1/6), about 9.6 degrees
+	const float Distance = Cell * 0.3f;
+	const FVector AtAngle50 = Center + FRotator(0.f, 50.f, 0.f).Vector() * Distance;
+	const FVector AtAngle60 = Center + FRotator(0.f, 60.f, 0.f).Vector() * Distance;
+	SpatialHash->AddMech(2, Center + FVector(Distance, 0.f, 0.f), Radius, 0.f);
+	SpatialHash->AddMech(3, Center - FVector(Distance, 0.f, 0.f), Radius, 0.f);
+	SpatialHash->AddMech(4, AtAngle50, Radius, 0.f);
+	SpatialHash->AddMech(5, AtAngle60, Radius, 0.f);
+	TestTrue(TEXT("Cone filters by angle"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 0.4f, FVector::ForwardVector, 45.f)) == TArray<int32>({ 0, 2, 4 }));
+	TestTrue(TEXT("Sphere ignores the direction"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 0.4f, FVector::ForwardVector, 180.f)) == TArray<int32>({ 0, 2, 3, 4, 5 }));
+
+	// A removed mech is unlinked and its handle reused
+	SpatialHash->RemoveMech(Near);
+	TestTrue(TEXT("Removed mech is not found"), QueryMechs(SpatialHash, MakeQuery(Center, Cell * 0.4f, FVector::ForwardVector, 45.f)) == TArray<int32>({ 2, 4 }));
+	TestEqual(TEXT("Freed handle is reused"), SpatialHash->AddMech(6, Center, Radius, 0.f), Near);
+
+	SpatialHash->MarkPendingKill();
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
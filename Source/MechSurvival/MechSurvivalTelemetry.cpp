@@ -0,0 +1,466 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalTelemetry.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Templates/Atomic.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechTelemetry, Log, All);
+
+namespace MechSurvivalTelemetry
+{
+	/**
+	 * Ring of one recording thread. That thread is the only one to move Head and the writer the only one to move Tail;
+	 * both count up forever and are masked into the ring.
+	 */
+	struct FThreadBuffer
+	{
+		FThreadBuffer(uint32 Capacity, uint8 InIndex)
+			: Records(MakeUnique<FMechSurvivalTelemetryRecord[]>(Capacity))
+			, Mask(Capacity - 1)
+			, Index(InIndex)
+			, Head(0)
+			, CachedTail(0)
+			, Dropped(0)
+			, Tail(0)
+		{
+		}
+
+		TUniquePtr<FMechSurvivalTelemetryRecord[]> Records;
+		const uint32 Mask;
+		const uint8 Index;
+
+		// Recording thread side
+		TAtomic<uint32> Head;
+		/** Tail as the recording thread last read it; the shared one is only read when the ring looks full */
+		uint32 CachedTail;
+		TAtomic<uint32> Dropped;
+
+		/** Keeps the writer's side off the recording thread's cache line */
+		uint8 Padding[PLATFORM_CACHE_LINE_SIZE];
+
+		// Writer side
+		TAtomic<uint32> Tail;
+	};
+
+	/** Guards Buffers; taken once per recording thread, and by the writer once per flush */
+	static FCriticalSection BuffersLock;
+
+	/** Every ring made so far. They are never freed, as their threads keep pointing at them from one session to the next. */
+	static TArray<FThreadBuffer*> Buffers;
+
+	static TAtomic<bool> bRecording(false);
+
+	/** Size of rings made from now on */
+	static uint32 RingCapacity = 16384;
+
+	static thread_local FThreadBuffer* ThreadBuffer = nullptr;
+
+	static FThreadBuffer* CreateThreadBuffer()
+	{
+		FScopeLock Lock(&BuffersLock);
+		FThreadBuffer* Buffer = new FThreadBuffer(RingCapacity, (uint8)FMath::Min(Buffers.Num(), (int32)MAX_uint8));
+		Buffers.Add(Buffer);
+		return Buffer;
+	}
+
+	static uint32 GetDroppedRecords()
+	{
+		FScopeLock Lock(&BuffersLock);
+		uint32 Dropped = 0;
+		for (const FThreadBuffer* Buffer : Buffers)
+		{
+			Dropped += Buffer->Dropped.Load(EMemoryOrder::Relaxed);
+		}
+		return Dropped;
+	}
+}
+
+/** Empties the rings into the chunk files of one session, every flush interval and once more when stopped */
+class FMechSurvivalTelemetryWriter : public FRunnable
+{
+public:
+	FMechSurvivalTelemetryWriter(const FString& InBasePath, int32 InRecordsPerChunk, float FlushInterval)
+		: BasePath(InBasePath)
+		, RecordsPerChunk((uint32)FMath::Max(InRecordsPerChunk, 1))
+		, FlushIntervalMs((uint32)FMath::Max(FMath::RoundToInt(FlushInterval * 1000.f), 1))
+		, StartCycles(FPlatformTime::Cycles64())
+		, WakeEvent(FPlatformProcess::GetSynchEventFromPool())
+		, bStopping(false)
+	{
+	}
+
+	virtual ~FMechSurvivalTelemetryWriter()
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	}
+
+	// FRunnable interface
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			WakeEvent->Wait(FlushIntervalMs);
+			Drain();
+		}
+
+		// Whatever was recorded up to the stop
+		Drain();
+		File.Reset();
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+		WakeEvent->Trigger();
+	}
+	// End of FRunnable interface
+
+	/** Writes out every ring on the calling thread, without waiting for the interval */
+	void Drain()
+	{
+		using namespace MechSurvivalTelemetry;
+
+		FScopeLock DrainScope(&DrainLock);
+
+		TArray<FThreadBuffer*, TInlineAllocator<32>> Snapshot;
+		{
+			FScopeLock BuffersScope(&BuffersLock);
+			Snapshot.Append(Buffers);
+		}
+
+		for (FThreadBuffer* Buffer : Snapshot)
+		{
+			const uint32 Head = Buffer->Head.Load();
+			uint32 Next = Buffer->Tail.Load(EMemoryOrder::Relaxed);
+			while (Next != Head)
+			{
+				if ((!File.IsValid() || RecordsInChunk >= RecordsPerChunk) && !OpenChunk())
+				{
+					Buffer->Dropped += Head - Next;
+					Next = Head;
+					break;
+				}
+
+				// Straight from the ring, up to its end or the end of the chunk
+				const uint32 Start = Next & Buffer->Mask;
+				const uint32 Count = FMath::Min3(Head - Next, Buffer->Mask + 1 - Start, RecordsPerChunk - RecordsInChunk);
+				File->Write(reinterpret_cast<const uint8*>(&Buffer->Records[Start]), Count * sizeof(FMechSurvivalTelemetryRecord));
+				RecordsInChunk += Count;
+				RecordsWritten += Count;
+				Next += Count;
+			}
+			Buffer->Tail.Store(Next);
+		}
+
+		if (File.IsValid())
+		{
+			File->Flush();
+		}
+	}
+
+	uint64 GetRecordsWritten() const { return RecordsWritten.Load(EMemoryOrder::Relaxed); }
+	int32 GetNumChunks() const { return NumChunks.Load(EMemoryOrder::Relaxed); }
+
+private:
+	bool OpenChunk()
+	{
+		File.Reset();
+
+		const FString Path = FString::Printf(TEXT("%s_%04d.mstel"), *BasePath, NumChunks.Load(EMemoryOrder::Relaxed));
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Path));
+		File.Reset(PlatformFile.OpenWrite(*Path));
+		if (!File.IsValid())
+		{
+			UE_LOG(LogMechTelemetry, Error, TEXT("Could not open %s; telemetry is dropped"), *Path);
+			return false;
+		}
+
+		FMechSurvivalTelemetryFileHeader Header;
+		Header.Magic = MechSurvivalTelemetry::Magic;
+		Header.Version = MechSurvivalTelemetry::Version;
+		Header.RecordSize = sizeof(FMechSurvivalTelemetryRecord);
+		Header.Chunk = (uint32)NumChunks.Load(EMemoryOrder::Relaxed);
+		Header.SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+		Header.StartCycles = StartCycles;
+		File->Write(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+
+		++NumChunks;
+		RecordsInChunk = 0;
+		return true;
+	}
+
+	const FString BasePath;
+	const uint32 RecordsPerChunk;
+	const uint32 FlushIntervalMs;
+	const uint64 StartCycles;
+
+	FEvent* WakeEvent;
+	TAtomic<bool> bStopping;
+
+	/** Drain runs on the writer thread, and on the game thread for the benchmark */
+	FCriticalSection DrainLock;
+
+	TUniquePtr<IFileHandle> File;
+	uint32 RecordsInChunk = 0;
+	TAtomic<int32> NumChunks { 0 };
+	TAtomic<uint64> RecordsWritten { 0 };
+};
+
+static FAutoConsoleCommandWithWorldAndArgs GStartTelemetryCmd(
+	TEXT("MechSurvival.Telemetry.Start"),
+	TEXT("Starts recording telemetry to Saved/Telemetry/<Session>_<chunk>.mstel; no session name uses the date and time"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UMechSurvivalTelemetry* Telemetry = UMechSurvivalTelemetry::Get(World))
+		{
+			Telemetry->StartSession(Args.Num() > 0 ? Args[0] : FString());
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GStopTelemetryCmd(
+	TEXT("MechSurvival.Telemetry.Stop"),
+	TEXT("Writes out the telemetry still buffered and closes the session"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (UMechSurvivalTelemetry* Telemetry = UMechSurvivalTelemetry::Get(World))
+		{
+			Telemetry->StopSession();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GDumpTelemetryCmd(
+	TEXT("MechSurvival.Telemetry.Dump"),
+	TEXT("Logs the telemetry session, records written and records dropped"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalTelemetry* Telemetry = UMechSurvivalTelemetry::Get(World))
+		{
+			Telemetry->DumpStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GBenchmarkTelemetryCmd(
+	TEXT("MechSurvival.Telemetry.Benchmark"),
+	TEXT("Records <Events> telemetry events in a tight loop and logs the cost of one, default 1000000"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UMechSurvivalTelemetry* Telemetry = UMechSurvivalTelemetry::Get(World))
+		{
+			Telemetry->RunBenchmark(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000000);
+		}
+	}));
+
+void UMechSurvivalTelemetry::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	MechSurvivalTelemetry::RingCapacity = FMath::RoundUpToPowerOfTwo((uint32)FMath::Max(BufferRecords, 256));
+
+	FString CommandLineSession;
+	if (FParse::Value(FCommandLine::Get(), TEXT("MechTelemetry="), CommandLineSession) || FParse::Param(FCommandLine::Get(), TEXT("MechTelemetry")))
+	{
+		StartSession(CommandLineSession);
+	}
+}
+
+void UMechSurvivalTelemetry::Deinitialize()
+{
+	StopSession();
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalTelemetry* UMechSurvivalTelemetry::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	const UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+	return GameInstance ? GameInstance->GetSubsystem<UMechSurvivalTelemetry>() : nullptr;
+}
+
+void UMechSurvivalTelemetry::Record(EMechSurvivalTelemetryEvent Type, const FVector& Location, float Value)
+{
+	using namespace MechSurvivalTelemetry;
+
+	if (!bRecording.Load(EMemoryOrder::Relaxed))
+	{
+		return;
+	}
+
+	FThreadBuffer* Buffer = ThreadBuffer;
+	if (Buffer == nullptr)
+	{
+		Buffer = ThreadBuffer = CreateThreadBuffer();
+	}
+
+	const uint32 Head = Buffer->Head.Load(EMemoryOrder::Relaxed);
+	if (Head - Buffer->CachedTail > Buffer->Mask)
+	{
+		Buffer->CachedTail = Buffer->Tail.Load();
+		if (Head - Buffer->CachedTail > Buffer->Mask)
+		{
+			++Buffer->Dropped;
+			return;
+		}
+	}
+
+	FMechSurvivalTelemetryRecord& Slot = Buffer->Records[Head & Buffer->Mask];
+	Slot.Cycles = FPlatformTime::Cycles64();
+	Slot.Frame = (uint32)GFrameCounter;
+	Slot.Type = Type;
+	Slot.Thread = Buffer->Index;
+	Slot.Reserved = 0;
+	Slot.Location = Location;
+	Slot.Value = Value;
+
+	// Publishes the record to the writer
+	Buffer->Head.Store(Head + 1);
+}
+
+bool UMechSurvivalTelemetry::IsRecording()
+{
+	return MechSurvivalTelemetry::bRecording.Load(EMemoryOrder::Relaxed);
+}
+
+void UMechSurvivalTelemetry::StartSession(const FString& InSessionName)
+{
+	using namespace MechSurvivalTelemetry;
+
+	StopSession();
+
+	if (!FPlatformProcess::SupportsMultithreading())
+	{
+		UE_LOG(LogMechTelemetry, Warning, TEXT("Telemetry needs a writer thread, which this platform does not have"));
+		return;
+	}
+
+	SessionName = InSessionName.IsEmpty() ? FDateTime::Now().ToString(TEXT("%Y%m%d-%H%M%S")) : InSessionName;
+
+	// Whatever was left in the rings belongs to no session
+	{
+		FScopeLock Lock(&BuffersLock);
+		for (FThreadBuffer* Buffer : Buffers)
+		{
+			Buffer->Tail.Store(Buffer->Head.Load());
+			Buffer->Dropped.Store(0);
+		}
+	}
+
+	Writer = new FMechSurvivalTelemetryWriter(FPaths::ProjectSavedDir() / TEXT("Telemetry") / SessionName, RecordsPerChunk, FlushInterval);
+	WriterThread = FRunnableThread::Create(Writer, TEXT("MechSurvivalTelemetryWriter"), 0, TPri_BelowNormal);
+	if (WriterThread == nullptr)
+	{
+		UE_LOG(LogMechTelemetry, Error, TEXT("Could not start the telemetry writer thread"));
+		delete Writer;
+		Writer = nullptr;
+		return;
+	}
+
+	bRecording = true;
+	UE_LOG(LogMechTelemetry, Log, TEXT("Recording telemetry session %s"), *SessionName);
+}
+
+void UMechSurvivalTelemetry::StopSession()
+{
+	if (Writer == nullptr)
+	{
+		return;
+	}
+
+	MechSurvivalTelemetry::bRecording = false;
+
+	// Stops the writer, which writes out what is left, and waits for it
+	WriterThread->Kill(true);
+	delete WriterThread;
+	WriterThread = nullptr;
+
+	DumpStats();
+
+	delete Writer;
+	Writer = nullptr;
+}
+
+double UMechSurvivalTelemetry::RunBenchmark(int32 NumEvents)
+{
+	NumEvents = FMath::Max(NumEvents, 1);
+
+	const bool bOwnSession = Writer == nullptr;
+	if (bOwnSession)
+	{
+		StartSession(TEXT("Benchmark"));
+	}
+	if (Writer == nullptr)
+	{
+		return 0.0;
+	}
+
+	// Batches fit in an emptied ring, so nothing is dropped and only Record is timed
+	const int32 BatchSize = (int32)MechSurvivalTelemetry::RingCapacity / 2;
+	const uint32 DroppedBefore = MechSurvivalTelemetry::GetDroppedRecords();
+	double Seconds = 0.0;
+	Writer->Drain();
+	for (int32 Done = 0; Done < NumEvents; )
+	{
+		const int32 Count = FMath::Min(BatchSize, NumEvents - Done);
+		const double StartSeconds = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			Record(EMechSurvivalTelemetryEvent::Hit, FVector((float)Index, 0.f, 0.f), 1.f);
+		}
+		Seconds += FPlatformTime::Seconds() - StartSeconds;
+		Done += Count;
+
+		Writer->Drain();
+	}
+
+	const double NanosecondsPerEvent = Seconds * 1e9 / NumEvents;
+	const uint32 Dropped = MechSurvivalTelemetry::GetDroppedRecords() - DroppedBefore;
+	UE_LOG(LogMechTelemetry, Log, TEXT("Recorded %d events in %.3f ms, %.1f ns per event, %u dropped"), NumEvents, Seconds * 1000.0, NanosecondsPerEvent, Dropped);
+
+	// One file for all runs, so the recorder's cost can be followed over time
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmark") / TEXT("Telemetry.csv");
+	if (!FPaths::FileExists(ReportPath))
+	{
+		FFileHelper::SaveStringToFile(FString(TEXT("Time,Events,NanosecondsPerEvent,Dropped\n")), *ReportPath);
+	}
+	const FString Line = FString::Printf(TEXT("%s,%d,%.2f,%u\n"), *FDateTime::Now().ToString(), NumEvents, NanosecondsPerEvent, Dropped);
+	FFileHelper::SaveStringToFile(Line, *ReportPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+	if (bOwnSession)
+	{
+		StopSession();
+	}
+	return NanosecondsPerEvent;
+}
+
+void UMechSurvivalTelemetry::DumpStats() const
+{
+	int32 NumThreads = 0;
+	{
+		FScopeLock Lock(&MechSurvivalTelemetry::BuffersLock);
+		NumThreads = MechSurvivalTelemetry::Buffers.Num();
+	}
+
+	if (Writer == nullptr)
+	{
+		UE_LOG(LogMechTelemetry, Log, TEXT("No telemetry session; %d threads have recorded so far"), NumThreads);
+		return;
+	}
+
+	const uint64 Records = Writer->GetRecordsWritten();
+	UE_LOG(LogMechTelemetry, Log, TEXT("Session %s: %llu records written in %d chunks, %.1f MB, %u dropped, %d recording threads"),
+		*SessionName, Records, Writer->GetNumChunks(), Records * sizeof(FMechSurvivalTelemetryRecord) / (1024.0 * 1024.0),
+		MechSurvivalTelemetry::GetDroppedRecords(), NumThreads);
+}
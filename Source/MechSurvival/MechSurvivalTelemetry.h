@@ -0,0 +1,132 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "MechSurvivalTelemetry.generated.h"
+
+namespace MechSurvivalTelemetry
+{
+	/** "MSTL", at the start of every telemetry file */
+	static const uint32 Magic = 0x4C54534D;
+	/** Bumped whenever the header or the records change */
+	static const uint32 Version = 1;
+}
+
+/** What a telemetry record describes; stored as a byte, append only */
+enum class EMechSurvivalTelemetryEvent : uint8
+{
+	/** A batch of rounds left a muzzle; Value is the number of pellets */
+	Shot,
+	/** Something took damage; Value is the damage */
+	Hit,
+	/** A physics body was pushed; Value is the impulse */
+	Impulse,
+	/** A mech was killed; Value is the damage of the killing hit */
+	Death,
+
+	Num
+};
+
+/** One event, as it is buffered and as it is stored in a telemetry file */
+struct FMechSurvivalTelemetryRecord
+{
+	/** FPlatformTime::Cycles64 when it was recorded */
+	uint64 Cycles;
+	/** Low bits of the engine frame counter */
+	uint32 Frame;
+	EMechSurvivalTelemetryEvent Type;
+	/** Recording thread, in the order threads first recorded */
+	uint8 Thread;
+	uint16 Reserved;
+	FVector Location;
+	float Value;
+};
+
+static_assert(sizeof(FMechSurvivalTelemetryRecord) == 32, "The telemetry file format relies on the record size; bump MechSurvivalTelemetry::Version when changing it");
+
+/** Start of every telemetry file, followed by records up to the end of the file */
+struct FMechSurvivalTelemetryFileHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 RecordSize;
+	/** Position of the file in its session, from 0 */
+	uint32 Chunk;
+	/** For turning record cycles into seconds */
+	double SecondsPerCycle;
+	/** Cycles when the session started */
+	uint64 StartCycles;
+};
+
+static_assert(sizeof(FMechSurvivalTelemetryFileHeader) == 32, "The telemetry file format relies on the header size");
+
+/**
+ * Binary recorder of every shot, hit, impulse and death, for analysing long sessions afterwards.
+ *
+ * Record copies a fixed size record into a ring buffer owned by the calling thread; it takes no lock and does not
+ * allocate, so it is cheap enough for the hottest gameplay paths. A writer thread empties the rings every
+ * FlushInterval seconds into Saved/Telemetry/<session>_<chunk>.mstel, starting a new file every RecordsPerChunk
+ * records. A ring that fills up before the writer empties it drops records and counts them.
+ *
+ * A session starts with -MechTelemetry[=<session>] or MechSurvival.Telemetry.Start, and ends with
+ * MechSurvival.Telemetry.Stop or the game. MechSurvival.Telemetry.Benchmark measures the cost of Record.
+ * The files are turned into CSV by the MechSurvivalTelemetry commandlet.
+ */
+UCLASS(config=Game)
+class UMechSurvivalTelemetry : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	/** Returns the telemetry of the game instance the context object belongs to, if any */
+	static UMechSurvivalTelemetry* Get(const UObject* WorldContextObject);
+
+	/** Records an event if a session is running; safe from any thread */
+	static void Record(EMechSurvivalTelemetryEvent Type, const FVector& Location, float Value);
+
+	/** True while a session is running */
+	static bool IsRecording();
+
+	/** Starts writing a session; a running session is stopped first. An empty name uses the date and time. */
+	void StartSession(const FString& InSessionName);
+
+	/** Writes out what is still buffered and closes the session */
+	void StopSession();
+
+	/**
+	 * Records NumEvents events as fast as possible into the calling thread's ring, emptying it between batches
+	 * without timing that, and logs the average cost of one Record.
+	 * @returns nanoseconds per event.
+	 */
+	double RunBenchmark(int32 NumEvents);
+
+	/** Writes the session, record counts and drops to the log */
+	void DumpStats() const;
+
+protected:
+	/** Records each thread's ring holds; rounded up to a power of two */
+	UPROPERTY(config)
+	int32 BufferRecords = 16384;
+
+	/** Records per file before the next chunk is started */
+	UPROPERTY(config)
+	int32 RecordsPerChunk = 1048576;
+
+	/** Seconds between two flushes of the writer thread */
+	UPROPERTY(config)
+	float FlushInterval = 0.1f;
+
+private:
+	/** Writer of the running session and the thread it runs on; both null between sessions */
+	class FMechSurvivalTelemetryWriter* Writer = nullptr;
+	FRunnableThread* WriterThread = nullptr;
+
+	FString SessionName;
+};
@@ -0,0 +1,142 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalTelemetryCommandlet.h"
+#include "MechSurvivalTelemetry.h"
+#include "Algo/StableSort.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechTelemetryCommandlet, Log, All);
+
+namespace MechSurvivalTelemetryCommandlet
+{
+	static const TCHAR* EventNames[] = { TEXT("Shot"), TEXT("Hit"), TEXT("Impulse"), TEXT("Death") };
+	static_assert(UE_ARRAY_COUNT(EventNames) == (int32)EMechSurvivalTelemetryEvent::Num, "Every telemetry event needs a name");
+
+	/** Written as UTF-8 without a byte order mark */
+	static void WriteLine(FArchive& Csv, const FString& Line)
+	{
+		const FTCHARToUTF8 Utf8(*Line);
+		Csv.Serialize(const_cast<ANSICHAR*>(Utf8.Get()), Utf8.Length());
+	}
+}
+
+UMechSurvivalTelemetryCommandlet::UMechSurvivalTelemetryCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMechSurvivalTelemetryCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> SwitchParams;
+	ParseCommandLine(*Params, Tokens, Switches, SwitchParams);
+
+	if (Tokens.Num() == 0)
+	{
+		UE_LOG(LogMechTelemetryCommandlet, Error, TEXT("Usage: -run=MechSurvivalTelemetry <session or .mstel file> [-out=<file.csv>]"));
+		return 1;
+	}
+
+	// A session name stands for all of its chunks
+	TArray<FString> Files;
+	FString CsvPath;
+	if (FPaths::GetExtension(Tokens[0]) == TEXT("mstel"))
+	{
+		Files.Add(Tokens[0]);
+		CsvPath = FPaths::ChangeExtension(Tokens[0], TEXT("csv"));
+	}
+	else
+	{
+		const FString Directory = FPaths::ProjectSavedDir() / TEXT("Telemetry");
+		IFileManager::Get().FindFiles(Files, *(Directory / Tokens[0] + TEXT("_*.mstel")), true, false);
+		Files.Sort();
+		for (FString& File : Files)
+		{
+			File = Directory / File;
+		}
+		CsvPath = Directory / Tokens[0] + TEXT(".csv");
+	}
+	if (const FString* Out = SwitchParams.Find(TEXT("out")))
+	{
+		CsvPath = *Out;
+	}
+
+	if (Files.Num() == 0)
+	{
+		UE_LOG(LogMechTelemetryCommandlet, Error, TEXT("No telemetry files for %s"), *Tokens[0]);
+		return 1;
+	}
+
+	TUniquePtr<FArchive> Csv(IFileManager::Get().CreateFileWriter(*CsvPath));
+	if (!Csv.IsValid())
+	{
+		UE_LOG(LogMechTelemetryCommandlet, Error, TEXT("Could not write %s"), *CsvPath);
+		return 1;
+	}
+	MechSurvivalTelemetryCommandlet::WriteLine(*Csv, TEXT("Seconds,Frame,Thread,Event,X,Y,Z,Value\n"));
+
+	int64 NumRecords = 0;
+	for (const FString& File : Files)
+	{
+		const int32 NumConverted = ConvertChunk(File, *Csv);
+		if (NumConverted == INDEX_NONE)
+		{
+			return 1;
+		}
+		NumRecords += NumConverted;
+	}
+
+	Csv->Close();
+	UE_LOG(LogMechTelemetryCommandlet, Display, TEXT("Converted %lld records from %d files to %s"), NumRecords, Files.Num(), *CsvPath);
+	return 0;
+}
+
+int32 UMechSurvivalTelemetryCommandlet::ConvertChunk(const FString& Path, FArchive& Csv)
+{
+	TUniquePtr<IMappedFileHandle> MappedFile(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path));
+	TUniquePtr<IMappedFileRegion> Region(MappedFile.IsValid() ? MappedFile->MapRegion() : nullptr);
+	if (!Region.IsValid() || Region->GetMappedSize() < (int64)sizeof(FMechSurvivalTelemetryFileHeader))
+	{
+		UE_LOG(LogMechTelemetryCommandlet, Error, TEXT("Could not map %s"), *Path);
+		return INDEX_NONE;
+	}
+
+	const uint8* Data = Region->GetMappedPtr();
+	const FMechSurvivalTelemetryFileHeader& Header = *reinterpret_cast<const FMechSurvivalTelemetryFileHeader*>(Data);
+	if (Header.Magic != MechSurvivalTelemetry::Magic || Header.Version != MechSurvivalTelemetry::Version || Header.RecordSize != sizeof(FMechSurvivalTelemetryRecord))
+	{
+		UE_LOG(LogMechTelemetryCommandlet, Error, TEXT("%s is not a telemetry file of this version"), *Path);
+		return INDEX_NONE;
+	}
+
+	// A session cut short may end in part of a record
+	const int32 NumRecords = (int32)((Region->GetMappedSize() - sizeof(Header)) / sizeof(FMechSurvivalTelemetryRecord));
+	const FMechSurvivalTelemetryRecord* Records = reinterpret_cast<const FMechSurvivalTelemetryRecord*>(Data + sizeof(Header));
+
+	TArray<int32> Order;
+	Order.SetNumUninitialized(NumRecords);
+	for (int32 Index = 0; Index < NumRecords; ++Index)
+	{
+		Order[Index] = Index;
+	}
+	Algo::StableSortBy(Order, [Records](int32 Index) { return Records[Index].Cycles; });
+
+	for (int32 Index : Order)
+	{
+		const FMechSurvivalTelemetryRecord& Record = Records[Index];
+		const double Seconds = (double)(int64)(Record.Cycles - Header.StartCycles) * Header.SecondsPerCycle;
+		const TCHAR* EventName = (int32)Record.Type < (int32)EMechSurvivalTelemetryEvent::Num ? MechSurvivalTelemetryCommandlet::EventNames[(int32)Record.Type] : TEXT("Unknown");
+		MechSurvivalTelemetryCommandlet::WriteLine(Csv, FString::Printf(TEXT("%.6f,%u,%u,%s,%.1f,%.1f,%.1f,%.3f\n"),
+			Seconds, Record.Frame, (uint32)Record.Thread, EventName, Record.Location.X, Record.Location.Y, Record.Location.Z, Record.Value));
+	}
+
+	UE_LOG(LogMechTelemetryCommandlet, Display, TEXT("%s: %d records"), *Path, NumRecords);
+	return NumRecords;
+}
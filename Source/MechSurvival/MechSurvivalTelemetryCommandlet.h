@@ -0,0 +1,31 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MechSurvivalTelemetryCommandlet.generated.h"
+
+/**
+ * Converts telemetry files to CSV, offline.
+ *   UE4Editor-Cmd MechSurvival -run=MechSurvivalTelemetry <session or .mstel file> [-out=<file.csv>]
+ * A session name converts every chunk of Saved/Telemetry/<session>_*.mstel, in order, into one CSV next to them.
+ * Each chunk is mapped into memory rather than read, and its records are sorted by time, as each thread's records
+ * reach the file in batches. Times are seconds since the session started.
+ */
+UCLASS()
+class UMechSurvivalTelemetryCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMechSurvivalTelemetryCommandlet();
+
+	// UCommandlet interface
+	virtual int32 Main(const FString& Params) override;
+	// End of UCommandlet interface
+
+private:
+	/** Appends the records of one chunk to the CSV; returns the number converted, or INDEX_NONE if the file is not telemetry */
+	static int32 ConvertChunk(const FString& Path, FArchive& Csv);
+};
@@ -0,0 +1,289 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalVRInput.h"
+#include "MechSurvival.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "Features/IModularFeatures.h"
+#include "Framework/Application/IInputProcessor.h"
+#include "Framework/Application/SlateApplication.h"
+#include "GameFramework/InputSettings.h"
+#include "GameFramework/WorldSettings.h"
+#include "GenericPlatform/GenericApplicationMessageHandler.h"
+#include "HAL/IConsoleManager.h"
+#include "IMotionController.h"
+#include "Misc/CommandLine.h"
+#include "MotionControllerComponent.h"
+#include "XRMotionControllerBase.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechVRInput, Log, All);
+
+namespace MechSurvivalVRInput
+{
+	static const FName FireAction(TEXT("Fire"));
+
+	/** A stamp this old belongs to a press the game never handled, e.g. one that went to a menu */
+	static const double MaxTriggerAgeSeconds = 1.0;
+}
+
+static FAutoConsoleCommandWithWorld GDumpVRInputCmd(
+	TEXT("MechSurvival.VR.Dump"),
+	TEXT("Logs the input to spawn latency of motion controller shots and how far their aim was corrected"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalVRInput* VRInput = UMechSurvivalVRInput::Get(World))
+		{
+			VRInput->DumpStats();
+		}
+	}));
+
+/** Stamps the presses of the keys bound to Fire as Slate receives them, before the game gets to them */
+class FMechSurvivalTriggerInputProcessor : public IInputProcessor
+{
+public:
+	explicit FMechSurvivalTriggerInputProcessor(UMechSurvivalVRInput* InOwner)
+		: Owner(InOwner)
+	{
+		TArray<FInputActionKeyMapping> Mappings;
+		GetDefault<UInputSettings>()->GetActionMappingByName(MechSurvivalVRInput::FireAction, Mappings);
+		for (const FInputActionKeyMapping& Mapping : Mappings)
+		{
+			FireKeys.Add(Mapping.Key);
+		}
+	}
+
+	// IInputProcessor interface
+	virtual void Tick(const float DeltaTime, FSlateApplication& SlateApp, TSharedRef<ICursor> Cursor) override
+	{
+	}
+
+	virtual bool HandleKeyDownEvent(FSlateApplication& SlateApp, const FKeyEvent& InKeyEvent) override
+	{
+		if (!InKeyEvent.IsRepeat() && FireKeys.Contains(InKeyEvent.GetKey()))
+		{
+			Owner->OnTriggerPressed(FPlatformTime::Seconds());
+		}
+		return false;
+	}
+
+	virtual bool HandleMouseButtonDownEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent) override
+	{
+		if (FireKeys.Contains(MouseEvent.GetEffectingButton()))
+		{
+			Owner->OnTriggerPressed(FPlatformTime::Seconds());
+		}
+		return false;
+	}
+	// End of IInputProcessor interface
+
+private:
+	UMechSurvivalVRInput* Owner;
+	TSet<FKey> FireKeys;
+};
+
+/** Right hand controller of player 0, sweeping from side to side in front of the head */
+class FMechSurvivalSimulatedMotionController : public FXRMotionControllerBase
+{
+public:
+	FMechSurvivalSimulatedMotionController(float InSweepDegrees, float InSweepHz)
+		: SweepDegrees(InSweepDegrees)
+		, SweepHz(InSweepHz)
+	{
+	}
+
+	// IMotionController interface
+	virtual FName GetMotionControllerDeviceTypeName() const override
+	{
+		static const FName DeviceTypeName(TEXT("MechSurvivalSimulated"));
+		return DeviceTypeName;
+	}
+
+	virtual bool GetControllerOrientationAndPosition(const int32 ControllerIndex, const EControllerHand DeviceHand, FRotator& OutOrientation, FVector& OutPosition, float WorldToMetersScale) const override
+	{
+		if (ControllerIndex != 0 || DeviceHand != EControllerHand::Right)
+		{
+			return false;
+		}
+
+		// Follows real time, so that a pose taken a frame late is measurably off
+		const double Cycles = SweepHz * FPlatformTime::Seconds();
+		const float Phase = 2.f * PI * (float)(Cycles - FMath::FloorToDouble(Cycles));
+		OutOrientation = FRotator(0.f, SweepDegrees * FMath::Sin(Phase), 0.f);
+		OutPosition = FVector(0.4f, 0.2f, -0.1f) * WorldToMetersScale;
+		return true;
+	}
+
+	virtual ETrackingStatus GetControllerTrackingStatus(const int32 ControllerIndex, const EControllerHand DeviceHand) const override
+	{
+		return ControllerIndex == 0 && DeviceHand == EControllerHand::Right ? ETrackingStatus::Tracked : ETrackingStatus::NotTracked;
+	}
+	// End of IMotionController interface
+
+private:
+	float SweepDegrees;
+	float SweepHz;
+};
+
+void UMechSurvivalVRInput::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	// Dedicated servers and commandlets have no Slate and no triggers
+	if (FSlateApplication::IsInitialized())
+	{
+		InputProcessor = MakeShared<FMechSurvivalTriggerInputProcessor>(this);
+		FSlateApplication::Get().RegisterInputPreProcessor(InputProcessor);
+	}
+
+	if (IsSimulatingMotionController())
+	{
+		SimulatedController = MakeShared<FMechSurvivalSimulatedMotionController>(SimulatedSweepDegrees, SimulatedSweepHz);
+		IModularFeatures::Get().RegisterModularFeature(IMotionController::GetModularFeatureName(), SimulatedController.Get());
+		NextSimulatedTriggerSeconds = FPlatformTime::Seconds() + SimulatedTriggerInterval;
+
+		UE_LOG(LogMechVRInput, Log, TEXT("Simulated motion controller, trigger pulled every %.2f s%s"),
+			SimulatedTriggerInterval, InputProcessor.IsValid() ? TEXT("") : TEXT("; no Slate, so the trigger is never pulled"));
+	}
+}
+
+void UMechSurvivalVRInput::Deinitialize()
+{
+	if (InputProcessor.IsValid() && FSlateApplication::IsInitialized())
+	{
+		FSlateApplication::Get().UnregisterInputPreProcessor(InputProcessor);
+	}
+	InputProcessor.Reset();
+
+	if (SimulatedController.IsValid())
+	{
+		IModularFeatures::Get().UnregisterModularFeature(IMotionController::GetModularFeatureName(), SimulatedController.Get());
+		SimulatedController.Reset();
+	}
+
+	if (Stats.Shots > 0)
+	{
+		DumpStats();
+	}
+
+	Super::Deinitialize();
+}
+
+UMechSurvivalVRInput* UMechSurvivalVRInput::Get(const UObject* WorldContextObject)
+{
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	const UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+	return GameInstance ? GameInstance->GetSubsystem<UMechSurvivalVRInput>() : nullptr;
+}
+
+bool UMechSurvivalVRInput::IsSimulatingMotionController()
+{
+	return FParse::Param(FCommandLine::Get(), TEXT("MechSimulateMotionController"));
+}
+
+ETickableTickType UMechSurvivalVRInput::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UMechSurvivalVRInput::IsTickable() const
+{
+	return SimulatedController.IsValid() && FSlateApplication::IsInitialized();
+}
+
+TStatId UMechSurvivalVRInput::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMechSurvivalVRInput, STATGROUP_Tickables);
+}
+
+void UMechSurvivalVRInput::Tick(float DeltaTime)
+{
+	// Through Slate like a real controller's trigger, so the pull is stamped and bound the same way
+	FSlateApplication& SlateApp = FSlateApplication::Get();
+	if (bSimulatedTriggerDown)
+	{
+		SlateApp.OnControllerButtonReleased(FGamepadKeyNames::MotionController_Right_Trigger, 0, false);
+		bSimulatedTriggerDown = false;
+		return;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (Now >= NextSimulatedTriggerSeconds)
+	{
+		SlateApp.OnControllerButtonPressed(FGamepadKeyNames::MotionController_Right_Trigger, 0, false);
+		bSimulatedTriggerDown = true;
+		NextSimulatedTriggerSeconds = Now + FMath::Max(SimulatedTriggerInterval, 0.f);
+	}
+}
+
+bool UMechSurvivalVRInput::PollControllerTransform(const UMotionControllerComponent* Controller, FTransform& OutControllerToWorld)
+{
+	const UWorld* World = Controller ? Controller->GetWorld() : nullptr;
+	if (World == nullptr)
+	{
+		return false;
+	}
+
+	// The same devices, in the same order, as the component polls in its tick
+	const AWorldSettings* WorldSettings = World->GetWorldSettings(false, false);
+	const float WorldToMeters = WorldSettings ? WorldSettings->WorldToMeters : 100.f;
+	const TArray<IMotionController*> Devices = IModularFeatures::Get().GetModularFeatureImplementations<IMotionController>(IMotionController::GetModularFeatureName());
+
+	FRotator Orientation;
+	FVector Position;
+	bool bTracked = false;
+	for (const IMotionController* Device : Devices)
+	{
+		if (Device != nullptr && Device->GetControllerOrientationAndPosition(Controller->PlayerIndex, Controller->MotionSource, Orientation, Position, WorldToMeters))
+		{
+			bTracked = true;
+			break;
+		}
+	}
+	if (!bTracked)
+	{
+		return false;
+	}
+
+	// The pose is relative to what the component is attached to, the pawn's tracking origin
+	const USceneComponent* Parent = Controller->GetAttachParent();
+	const FTransform ParentToWorld = Parent ? Parent->GetSocketTransform(Controller->GetAttachSocketName()) : FTransform::Identity;
+	OutControllerToWorld = FTransform(Orientation, Position, Controller->GetRelativeScale3D()) * ParentToWorld;
+	return true;
+}
+
+void UMechSurvivalVRInput::OnTriggerPressed(double Seconds)
+{
+	LastTriggerSeconds = Seconds;
+}
+
+double UMechSurvivalVRInput::ConsumeTriggerSeconds()
+{
+	const double Seconds = LastTriggerSeconds;
+	LastTriggerSeconds = -1.0;
+	return Seconds >= 0.0 && FPlatformTime::Seconds() - Seconds <= MechSurvivalVRInput::MaxTriggerAgeSeconds ? Seconds : -1.0;
+}
+
+void UMechSurvivalVRInput::RecordShot(double InputToSpawnSeconds, float BackdateSeconds, bool bFreshPose, float CorrectionDegrees)
+{
+	++Stats.Shots;
+	Stats.TotalInputToSpawnSeconds += InputToSpawnSeconds;
+	Stats.MaxInputToSpawnSeconds = FMath::Max(Stats.MaxInputToSpawnSeconds, InputToSpawnSeconds);
+	Stats.TotalBackdateSeconds += BackdateSeconds;
+	if (bFreshPose)
+	{
+		++Stats.FreshPoses;
+		Stats.TotalCorrectionDegrees += CorrectionDegrees;
+	}
+
+	MECHSURVIVAL_SET_LEVEL(VRInputToSpawnMicroseconds, (uint32)(InputToSpawnSeconds * 1000000.0));
+}
+
+void UMechSurvivalVRInput::DumpStats() const
+{
+	const int32 Shots = FMath::Max(Stats.Shots, 1);
+	UE_LOG(LogMechVRInput, Log, TEXT("%d motion controller shots: input to spawn %.2f ms on average, %.2f ms at worst; rounds dated back %.2f ms on average"),
+		Stats.Shots, Stats.TotalInputToSpawnSeconds * 1000.0 / Shots, Stats.MaxInputToSpawnSeconds * 1000.0, Stats.TotalBackdateSeconds * 1000.0 / Shots);
+	UE_LOG(LogMechVRInput, Log, TEXT("%d aimed with a fresh controller pose, %.2f degrees from the component's muzzle on average%s"),
+		Stats.FreshPoses, Stats.FreshPoses > 0 ? Stats.TotalCorrectionDegrees / Stats.FreshPoses : 0.0,
+		SimulatedController.IsValid() ? TEXT("; simulated controller") : TEXT(""));
+}
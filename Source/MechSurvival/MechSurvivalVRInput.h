@@ -0,0 +1,117 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Tickable.h"
+#include "MechSurvivalVRInput.generated.h"
+
+class UMotionControllerComponent;
+
+/** Counts since the game started, for the dump */
+struct FMechSurvivalVRFireStats
+{
+	/** Trigger pulls that fired from a motion controller */
+	int32 Shots = 0;
+	/** Of those, the ones aimed with a pose polled at fire time rather than the component's */
+	int32 FreshPoses = 0;
+	double TotalInputToSpawnSeconds = 0.0;
+	double MaxInputToSpawnSeconds = 0.0;
+	double TotalBackdateSeconds = 0.0;
+	/** Angle between the component's muzzle and the fresh one */
+	double TotalCorrectionDegrees = 0.0;
+};
+
+/**
+ * Low latency firing for motion controllers.
+ *
+ * The motion controller components move in their own tick, so by the time a trigger pull is handled the muzzle they
+ * carry is a frame old, and the pull itself happened earlier still, when the platform delivered it. An input
+ * preprocessor stamps every press of a key bound to Fire with the time Slate received it. A VR character consumes
+ * that time when the trigger goes down and aims its first round with the controller pose polled from the device right
+ * then; the round is moved along its path by how long it would have been flying since the stamp, up to
+ * MaxBackdateSeconds, and a client's fire request is dated back as well. Deterministic runs are not back-dated.
+ *
+ * Time from the stamp to the round's spawn is kept per shot and shown by the VR Input To Spawn stat and
+ * MechSurvival.VR.Dump. Started with -MechSimulateMotionController, the game gets a simulated right hand controller
+ * that sweeps from side to side and pulls its trigger every SimulatedTriggerInterval seconds through the platform input
+ * path, and characters use motion controllers; that measures the whole path without a headset, including with -nullrhi.
+ */
+UCLASS(config=Game)
+class UMechSurvivalVRInput : public UGameInstanceSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// USubsystem interface
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	// End of USubsystem interface
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	/** Returns the VR input of the game the context object lives in, if any */
+	static UMechSurvivalVRInput* Get(const UObject* WorldContextObject);
+
+	/** True if this run was started with the simulated motion controller */
+	static bool IsSimulatingMotionController();
+
+	/**
+	 * Polls the device behind a motion controller component for its pose now, rather than the one the component took
+	 * in its last tick. Returns false if no device tracks it.
+	 */
+	static bool PollControllerTransform(const UMotionControllerComponent* Controller, FTransform& OutControllerToWorld);
+
+	/** Platform time of the last Fire press not consumed yet, or a negative value if there is none; consumes it */
+	double ConsumeTriggerSeconds();
+
+	/** How far back a round may be dated */
+	float GetMaxBackdateSeconds() const { return MaxBackdateSeconds; }
+
+	/** Keeps the latency of a round fired from a motion controller */
+	void RecordShot(double InputToSpawnSeconds, float BackdateSeconds, bool bFreshPose, float CorrectionDegrees);
+
+	const FMechSurvivalVRFireStats& GetStats() const { return Stats; }
+
+	/** Writes the input to spawn latency and the pose corrections to the log */
+	void DumpStats() const;
+
+protected:
+	UPROPERTY(config)
+	float MaxBackdateSeconds = 0.05f;
+
+	/** Seconds between two trigger pulls of the simulated controller */
+	UPROPERTY(config)
+	float SimulatedTriggerInterval = 0.5f;
+
+	/** How far the simulated controller sweeps to each side, in degrees */
+	UPROPERTY(config)
+	float SimulatedSweepDegrees = 30.f;
+
+	/** Sweeps of the simulated controller per second */
+	UPROPERTY(config)
+	float SimulatedSweepHz = 1.f;
+
+private:
+	friend class FMechSurvivalTriggerInputProcessor;
+
+	/** Called by the input preprocessor for every press of a Fire key */
+	void OnTriggerPressed(double Seconds);
+
+	TSharedPtr<class FMechSurvivalTriggerInputProcessor> InputProcessor;
+	TSharedPtr<class FMechSurvivalSimulatedMotionController> SimulatedController;
+
+	double LastTriggerSeconds = -1.0;
+
+	/** Platform time the simulated trigger is next pulled at */
+	double NextSimulatedTriggerSeconds = 0.0;
+	bool bSimulatedTriggerDown = false;
+
+	FMechSurvivalVRFireStats Stats;
+};
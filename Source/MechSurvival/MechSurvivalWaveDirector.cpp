@@ -0,0 +1,676 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalWaveDirector.h"
+#include "MechSurvival.h"
+#include "MechSurvivalBenchmark.h"
+#include "MechSurvivalDeterminism.h"
+#include "MechSurvivalGameMode.h"
+#include "MechSurvivalHorde.h"
+#include "Engine/World.h"
+#include "GameFramework/PawnMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CommandLine.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWaveDirector, Log, All);
+
+namespace MechSurvivalWaveDirector
+{
+	static UMechSurvivalWaveDirector* Get(UWorld* World)
+	{
+		const AMechSurvivalGameMode* GameMode = World ? World->GetAuthGameMode<AMechSurvivalGameMode>() : nullptr;
+		return GameMode ? GameMode->GetWaveDirector() : nullptr;
+	}
+}
+
+static FAutoConsoleCommandWithWorld GStartWavesCmd(
+	TEXT("MechSurvival.Waves.Start"),
+	TEXT("Starts the intermission before the first wave"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (UMechSurvivalWaveDirector* Director = MechSurvivalWaveDirector::Get(World))
+		{
+			Director->StartWaves();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GSkipWaveCmd(
+	TEXT("MechSurvival.Waves.Skip"),
+	TEXT("Moves on to the next wave right away"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (UMechSurvivalWaveDirector* Director = MechSurvivalWaveDirector::Get(World))
+		{
+			Director->SkipWave();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GDumpWavesCmd(
+	TEXT("MechSurvival.Waves.Dump"),
+	TEXT("Logs the current wave and how long its spawning took"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalWaveDirector* Director = MechSurvivalWaveDirector::Get(World))
+		{
+			Director->DumpStats();
+		}
+	}));
+
+UMechSurvivalWaveDirector::UMechSurvivalWaveDirector()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = true;
+}
+
+void UMechSurvivalWaveDirector::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// The table is small, so it is usually in well before the first wave is started
+	RequestWaveTable();
+
+	// Benchmark and stress runs bring their own load
+	const bool bMeasuring = UMechSurvivalBenchmark::IsBenchmarkRun() || FParse::Param(FCommandLine::Get(), TEXT("MechRepStress"));
+	if (bAutoStart && !bMeasuring)
+	{
+		StartWaves();
+	}
+}
+
+void UMechSurvivalWaveDirector::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (LoadHandle.IsValid())
+	{
+		LoadHandle->CancelHandle();
+		LoadHandle.Reset();
+	}
+	if (TableHandle.IsValid())
+	{
+		TableHandle->CancelHandle();
+		TableHandle.Reset();
+	}
+	bStartPending = false;
+
+	SpawnQueue.Empty();
+	PrewarmedActors.Empty();
+	RequiredActors.Empty();
+	Phase = EMechSurvivalWavePhase::Idle;
+
+	Super::EndPlay(EndPlayReason);
+}
+
+const TArray<FMechSurvivalWaveDefinition>& UMechSurvivalWaveDirector::GetWaves() const
+{
+	return TableWaves.Num() > 0 ? TableWaves : Waves;
+}
+
+void UMechSurvivalWaveDirector::StartWaves()
+{
+	RequestWaveTable();
+	if (IsWaveTableLoading())
+	{
+		// The first intermission starts once the table is in, see OnWaveTableLoaded
+		bStartPending = true;
+		return;
+	}
+	BeginIntermission(0);
+}
+
+void UMechSurvivalWaveDirector::RequestWaveTable()
+{
+	if (!IsWaveTableLoading() || TableHandle.IsValid())
+	{
+		return;
+	}
+
+	// The table is only rows of numbers and soft references; the heavy assets are loaded per wave
+	UE_LOG(LogWaveDirector, Log, TEXT("Loading wave table %s"), *WaveTable.ToString());
+	TableHandle = StreamableManager.RequestAsyncLoad(WaveTable.ToSoftObjectPath(), FStreamableDelegate::CreateUObject(this, &UMechSurvivalWaveDirector::OnWaveTableLoaded));
+
+	// The waves must start on the same tick every run
+	if (TableHandle.IsValid() && UMechSurvivalDeterminism::IsDeterministicRun())
+	{
+		TableHandle->WaitUntilComplete();
+	}
+	if (!TableHandle.IsValid() || TableHandle->HasLoadCompleted())
+	{
+		OnWaveTableLoaded();
+	}
+}
+
+void UMechSurvivalWaveDirector::OnWaveTableLoaded()
+{
+	if (bWaveTableLoaded)
+	{
+		return;
+	}
+	bWaveTableLoaded = true;
+
+	const UDataTable* Table = WaveTable.Get();
+	if (Table != nullptr && Table->GetRowStruct() != nullptr && Table->GetRowStruct()->IsChildOf(FMechSurvivalWaveDefinition::StaticStruct()))
+	{
+		TArray<FMechSurvivalWaveDefinition*> Rows;
+		Table->GetAllRows(TEXT("MechSurvivalWaveDirector"), Rows);
+		for (const FMechSurvivalWaveDefinition* Row : Rows)
+		{
+			TableWaves.Add(*Row);
+		}
+	}
+	else
+	{
+		UE_LOG(LogWaveDirector, Warning, TEXT("Wave table %s missing or not made of FMechSurvivalWaveDefinition rows, using the ini waves"), *WaveTable.ToString());
+	}
+
+	if (bStartPending)
+	{
+		bStartPending = false;
+		BeginIntermission(0);
+	}
+}
+
+void UMechSurvivalWaveDirector::SkipWave()
+{
+	switch (Phase)
+	{
+	case EMechSurvivalWavePhase::Idle:
+		if (!bStartPending)
+		{
+			StartWaves();
+		}
+		break;
+	case EMechSurvivalWavePhase::Intermission:
+		// Still waits for the assets
+		PhaseTime = BIG_NUMBER;
+		break;
+	default:
+		SpawnQueue.Reset();
+		PendingMechs = 0;
+		BeginIntermission(WaveIndex + 1);
+		break;
+	}
+}
+
+void UMechSurvivalWaveDirector::DumpStats() const
+{
+	const UEnum* PhaseEnum = StaticEnum<EMechSurvivalWavePhase>();
+	UE_LOG(LogWaveDirector, Log, TEXT("Wave %d/%d, %s for %.1fs; %d mechs and %d actors queued; last spawn latency %.1f ms, last frame spent %.3f ms of %.3f ms, %d budget overruns"),
+		WaveIndex + 1, GetWaves().Num(), *PhaseEnum->GetNameStringByValue((int64)Phase), PhaseTime, PendingMechs, SpawnQueue.Num(),
+		LastSpawnLatencyMs, LastFrameSpawnMs, SpawnBudgetMs, BudgetOverruns);
+}
+
+void UMechSurvivalWaveDirector::SerializeWave(FArchive& Ar)
+{
+	if (!Ar.IsLoading())
+	{
+		uint8 SavedPhase = (uint8)Phase;
+		Ar << WaveIndex << SavedPhase << PhaseTime << PendingMechs;
+
+		// Classes by path, so that another run can load them again
+		int32 NumQueued = SpawnQueue.Num();
+		Ar << NumQueued;
+		for (FPendingSpawn& Pending : SpawnQueue)
+		{
+			FString ClassPath = GetPathNameSafe(Pending.ActorClass);
+			Ar << ClassPath << Pending.Remaining << Pending.bRequiredForClear;
+		}
+
+		TArray<AActor*, TInlineAllocator<64>> AliveActors;
+		for (const TWeakObjectPtr<AActor>& Actor : RequiredActors)
+		{
+			if (Actor.IsValid() && !Actor->IsPendingKillPending())
+			{
+				AliveActors.Add(Actor.Get());
+			}
+		}
+		int32 NumAlive = AliveActors.Num();
+		Ar << NumAlive;
+		for (AActor* Actor : AliveActors)
+		{
+			FString ClassPath = Actor->GetClass()->GetPathName();
+			FTransform Transform = Actor->GetActorTransform();
+			Ar << ClassPath << Transform;
+		}
+		return;
+	}
+
+	int32 SavedWaveIndex = 0;
+	uint8 SavedPhase = 0;
+	float SavedPhaseTime = 0.f;
+	int32 SavedPendingMechs = 0;
+	Ar << SavedWaveIndex << SavedPhase << SavedPhaseTime << SavedPendingMechs;
+
+	TArray<FPendingSpawn> SavedQueue;
+	int32 NumQueued = 0;
+	Ar << NumQueued;
+	for (int32 Index = 0; Index < NumQueued && !Ar.IsError(); ++Index)
+	{
+		FString ClassPath;
+		FPendingSpawn Pending;
+		Ar << ClassPath << Pending.Remaining << Pending.bRequiredForClear;
+		Pending.ActorClass = FSoftClassPath(ClassPath).TryLoadClass<AActor>();
+		if (Pending.ActorClass != nullptr)
+		{
+			SavedQueue.Add(Pending);
+		}
+	}
+
+	TArray<TPair<UClass*, FTransform>> SavedActors;
+	int32 NumAlive = 0;
+	Ar << NumAlive;
+	for (int32 Index = 0; Index < NumAlive && !Ar.IsError(); ++Index)
+	{
+		FString ClassPath;
+		FTransform Transform;
+		Ar << ClassPath << Transform;
+		if (UClass* ActorClass = FSoftClassPath(ClassPath).TryLoadClass<AActor>())
+		{
+			SavedActors.Emplace(ActorClass, Transform);
+		}
+	}
+
+	if (Ar.IsError() || SavedPhase > (uint8)EMechSurvivalWavePhase::Active)
+	{
+		UE_LOG(LogWaveDirector, Warning, TEXT("Saved wave is damaged, not restored"));
+		return;
+	}
+
+	// The saved wave replaces the current one, along with whatever the current one spawned
+	for (const TWeakObjectPtr<AActor>& Actor : RequiredActors)
+	{
+		if (Actor.IsValid())
+		{
+			Actor->Destroy();
+		}
+	}
+	RequiredActors.Reset();
+
+	SpawnQueue.Reset();
+	PendingMechs = 0;
+	bStartPending = false;
+	if ((EMechSurvivalWavePhase)SavedPhase == EMechSurvivalWavePhase::Idle)
+	{
+		LoadHandle.Reset();
+		WaveIndex = SavedWaveIndex;
+		Phase = EMechSurvivalWavePhase::Idle;
+		return;
+	}
+
+	// A restore stalls for its assets anyway, so the table is waited for here rather than in the background
+	RequestWaveTable();
+	if (TableHandle.IsValid())
+	{
+		TableHandle->WaitUntilComplete();
+	}
+	OnWaveTableLoaded();
+
+	// Loads and pre-warms the wave's classes as if it were coming up
+	BeginIntermission(SavedWaveIndex);
+	if (Phase == EMechSurvivalWavePhase::Idle)
+	{
+		return;
+	}
+	PhaseTime = SavedPhaseTime;
+	if ((EMechSurvivalWavePhase)SavedPhase == EMechSurvivalWavePhase::Intermission)
+	{
+		return;
+	}
+
+	// The wave was under way; whatever it had spawned and still waits for comes back where it was
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	for (const TPair<UClass*, FTransform>& Saved : SavedActors)
+	{
+		if (AActor* Actor = GetWorld()->SpawnActor<AActor>(Saved.Key, Saved.Value, SpawnParams))
+		{
+			RequiredActors.Add(Actor);
+		}
+	}
+
+	SpawnQueue = MoveTemp(SavedQueue);
+	PendingMechs = SavedPendingMechs;
+	Phase = (EMechSurvivalWavePhase)SavedPhase;
+	WaveStartTime = FPlatformTime::Seconds();
+	UE_LOG(LogWaveDirector, Log, TEXT("Wave %d restored with %d actors, %d mechs and %d actor types still to spawn"), WaveIndex + 1, RequiredActors.Num(), PendingMechs, SpawnQueue.Num());
+}
+
+void UMechSurvivalWaveDirector::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	MECHSURVIVAL_LLM_SCOPE(Waves);
+
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	const TArray<FMechSurvivalWaveDefinition>& AllWaves = GetWaves();
+	if (Phase == EMechSurvivalWavePhase::Idle || !AllWaves.IsValidIndex(WaveIndex))
+	{
+		return;
+	}
+
+	const FMechSurvivalWaveDefinition& Wave = AllWaves[WaveIndex];
+	const double Deadline = FPlatformTime::Seconds() + SpawnBudgetMs / 1000.0;
+	PhaseTime += DeltaTime;
+
+	switch (Phase)
+	{
+	case EMechSurvivalWavePhase::Intermission:
+		PrewarmStep(Deadline);
+		if (PhaseTime >= Wave.IntermissionSeconds && bAssetsLoaded)
+		{
+			BeginWave();
+		}
+		break;
+
+	case EMechSurvivalWavePhase::Spawning:
+		SpawnStep(Deadline);
+		if (PendingMechs == 0 && SpawnQueue.Num() == 0)
+		{
+			UE_LOG(LogWaveDirector, Log, TEXT("Wave %d spawned in %.1f ms"), WaveIndex + 1, LastSpawnLatencyMs);
+			Phase = EMechSurvivalWavePhase::Active;
+		}
+		break;
+
+	case EMechSurvivalWavePhase::Active:
+		if (IsWaveCleared() || (Wave.MaxSeconds > 0.f && PhaseTime >= Wave.MaxSeconds))
+		{
+			BeginIntermission(WaveIndex + 1);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void UMechSurvivalWaveDirector::BeginIntermission(int32 NewWaveIndex)
+{
+	const TArray<FMechSurvivalWaveDefinition>& AllWaves = GetWaves();
+	WaveIndex = NewWaveIndex;
+	PhaseTime = 0.f;
+	RequiredActors.Reset();
+
+	if (!AllWaves.IsValidIndex(WaveIndex))
+	{
+		UE_LOG(LogWaveDirector, Log, TEXT("All %d waves done"), AllWaves.Num());
+		Phase = EMechSurvivalWavePhase::Idle;
+		LoadHandle.Reset();
+		return;
+	}
+
+	const FMechSurvivalWaveDefinition& Wave = AllWaves[WaveIndex];
+	UE_LOG(LogWaveDirector, Log, TEXT("Wave %d/%d in %.1fs: %d mechs, %d actor types"), WaveIndex + 1, AllWaves.Num(), Wave.IntermissionSeconds, Wave.Mechs, Wave.Actors.Num());
+	Phase = EMechSurvivalWavePhase::Intermission;
+
+	// Room for the mechs up front, so that the horde does not reallocate in the middle of the wave
+	if (UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this))
+	{
+		Horde->ReserveMechs(Wave.Mechs);
+	}
+
+	TArray<FSoftObjectPath> AssetPaths;
+	for (const FMechSurvivalWaveActorSpawn& Spawn : Wave.Actors)
+	{
+		if (!Spawn.ActorClass.IsNull())
+		{
+			AssetPaths.AddUnique(Spawn.ActorClass.ToSoftObjectPath());
+		}
+	}
+
+	bAssetsLoaded = false;
+	LoadHandle.Reset();
+	if (AssetPaths.Num() > 0)
+	{
+		LoadHandle = StreamableManager.RequestAsyncLoad(AssetPaths, FStreamableDelegate::CreateUObject(this, &UMechSurvivalWaveDirector::OnWaveAssetsLoaded));
+
+		// The wave must start on the same tick every run
+		if (LoadHandle.IsValid() && UMechSurvivalDeterminism::IsDeterministicRun())
+		{
+			LoadHandle->WaitUntilComplete();
+		}
+	}
+	if (!LoadHandle.IsValid() || LoadHandle->HasLoadCompleted())
+	{
+		OnWaveAssetsLoaded();
+	}
+}
+
+void UMechSurvivalWaveDirector::OnWaveAssetsLoaded()
+{
+	bAssetsLoaded = true;
+}
+
+void UMechSurvivalWaveDirector::BeginWave()
+{
+	const FMechSurvivalWaveDefinition& Wave = GetWaves()[WaveIndex];
+
+	SpawnQueue.Reset();
+	for (const FMechSurvivalWaveActorSpawn& Spawn : Wave.Actors)
+	{
+		UClass* ActorClass = Spawn.ActorClass.Get();
+		if (ActorClass == nullptr)
+		{
+			UE_LOG(LogWaveDirector, Warning, TEXT("Wave %d: actor class %s did not load"), WaveIndex + 1, *Spawn.ActorClass.ToString());
+			continue;
+		}
+
+		FPendingSpawn& Pending = SpawnQueue.AddDefaulted_GetRef();
+		Pending.ActorClass = ActorClass;
+		Pending.Remaining = Spawn.Count;
+		Pending.bRequiredForClear = Spawn.bRequiredForClear;
+	}
+	PendingMechs = Wave.Mechs;
+
+	Phase = EMechSurvivalWavePhase::Spawning;
+	PhaseTime = 0.f;
+	WaveStartTime = FPlatformTime::Seconds();
+}
+
+void UMechSurvivalWaveDirector::PrewarmStep(double Deadline)
+{
+	if (!bAssetsLoaded)
+	{
+		return;
+	}
+
+	for (const FMechSurvivalWaveActorSpawn& Spawn : GetWaves()[WaveIndex].Actors)
+	{
+		UClass* ActorClass = Spawn.ActorClass.Get();
+		if (ActorClass == nullptr)
+		{
+			continue;
+		}
+
+		TArray<AActor*>& Prewarmed = PrewarmedActors.FindOrAdd(ActorClass).Actors;
+		Prewarmed.RemoveAllSwap([](const AActor* Actor) { return !IsValid(Actor); });
+		while (Prewarmed.Num() < Spawn.Count)
+		{
+			if (FPlatformTime::Seconds() >= Deadline)
+			{
+				return;
+			}
+
+			AActor* Actor = SpawnHidden(ActorClass);
+			if (Actor == nullptr)
+			{
+				break;
+			}
+			Prewarmed.Add(Actor);
+		}
+	}
+}
+
+void UMechSurvivalWaveDirector::SpawnStep(double Deadline)
+{
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(WaveSpawn);
+
+	const FMechSurvivalWaveDefinition& Wave = GetWaves()[WaveIndex];
+	UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this);
+	const double StartTime = FPlatformTime::Seconds();
+	int32 Spawned = 0;
+
+	// Checked before each item rather than after, so every frame makes progress even with a tiny budget
+	while ((PendingMechs > 0 || SpawnQueue.Num() > 0) && (Spawned == 0 || FPlatformTime::Seconds() < Deadline))
+	{
+		if (PendingMechs > 0)
+		{
+			const int32 Batch = FMath::Min(FMath::Max(MechBatchSize, 1), PendingMechs);
+			const int32 Added = Horde ? Horde->SpawnMechs(Batch, GetPlayersCenter(), Wave.SpawnMinRadius, Wave.SpawnMaxRadius) : 0;
+			// A full horde drops the rest of the mechs rather than stalling the wave
+			PendingMechs = Added > 0 ? PendingMechs - Batch : 0;
+			Spawned += Added;
+			continue;
+		}
+
+		FPendingSpawn& Pending = SpawnQueue.Last();
+		FMechSurvivalPrewarmedActors* Prewarmed = PrewarmedActors.Find(Pending.ActorClass);
+		AActor* Actor = nullptr;
+		while (Actor == nullptr && Prewarmed != nullptr && Prewarmed->Actors.Num() > 0)
+		{
+			Actor = Prewarmed->Actors.Pop(false);
+			Actor = IsValid(Actor) ? Actor : nullptr;
+		}
+		if (Actor == nullptr)
+		{
+			Actor = SpawnHidden(Pending.ActorClass);
+		}
+		if (Actor != nullptr)
+		{
+			ActivateActor(Actor, FindSpawnLocation(Wave));
+			if (Pending.bRequiredForClear)
+			{
+				RequiredActors.Add(Actor);
+			}
+			++Spawned;
+		}
+
+		if (--Pending.Remaining <= 0)
+		{
+			SpawnQueue.Pop(false);
+		}
+	}
+
+	const double EndTime = FPlatformTime::Seconds();
+	LastFrameSpawnMs = (EndTime - StartTime) * 1000.0;
+	LastSpawnLatencyMs = (EndTime - WaveStartTime) * 1000.0;
+
+	MECHSURVIVAL_INC_COUNTER(WaveSpawns, Spawned);
+	MECHSURVIVAL_SET_LEVEL(WaveSpawnLatencyMs, FMath::RoundToInt(LastSpawnLatencyMs));
+	if (EndTime > Deadline)
+	{
+		++BudgetOverruns;
+		MECHSURVIVAL_INC_COUNTER(WaveBudgetOverruns, 1);
+	}
+}
+
+bool UMechSurvivalWaveDirector::IsWaveCleared() const
+{
+	const UMechSurvivalHorde* Horde = UMechSurvivalHorde::Get(this);
+	if (PendingMechs > 0 || SpawnQueue.Num() > 0 || (Horde != nullptr && Horde->GetNumMechs() > 0))
+	{
+		return false;
+	}
+
+	for (const TWeakObjectPtr<AActor>& Actor : RequiredActors)
+	{
+		if (Actor.IsValid() && !Actor->IsPendingKillPending())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+FVector UMechSurvivalWaveDirector::FindSpawnLocation(const FMechSurvivalWaveDefinition& Wave) const
+{
+	const float Angle = FMath::FRandRange(0.f, 2.f * PI);
+	const float Distance = FMath::Sqrt(FMath::Lerp(FMath::Square(Wave.SpawnMinRadius), FMath::Square(Wave.SpawnMaxRadius), FMath::FRand()));
+	FVector Location = GetPlayersCenter() + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * Distance;
+
+	FHitResult Hit;
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MechSurvivalWaveSpawn), false);
+	if (GetWorld()->LineTraceSingleByObjectType(Hit, Location + FVector(0.f, 0.f, 2000.f), Location - FVector(0.f, 0.f, 10000.f), FCollisionObjectQueryParams(ECC_WorldStatic), QueryParams))
+	{
+		Location = Hit.Location;
+	}
+	return Location;
+}
+
+FVector UMechSurvivalWaveDirector::GetPlayersCenter() const
+{
+	UWorld* World = GetWorld();
+
+	FVector Sum = FVector::ZeroVector;
+	int32 NumPlayers = 0;
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr)
+		{
+			Sum += PlayerController->GetPawn()->GetActorLocation();
+			++NumPlayers;
+		}
+	}
+	if (NumPlayers > 0)
+	{
+		return Sum / NumPlayers;
+	}
+
+	AGameModeBase* GameMode = World->GetAuthGameMode();
+	const AActor* PlayerStart = GameMode ? GameMode->FindPlayerStart(nullptr) : nullptr;
+	return PlayerStart ? PlayerStart->GetActorLocation() : FVector::ZeroVector;
+}
+
+AActor* UMechSurvivalWaveDirector::SpawnHidden(UClass* ActorClass)
+{
+	// Deferred, so that a pawn does not get its AI controller while it is parked; ActivateActor gives it one
+	const FTransform SpawnTransform(GetPlayersCenter());
+	AActor* Actor = GetWorld()->SpawnActorDeferred<AActor>(ActorClass, SpawnTransform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (Actor == nullptr)
+	{
+		return nullptr;
+	}
+	if (APawn* Pawn = Cast<APawn>(Actor))
+	{
+		Pawn->AutoPossessAI = EAutoPossessAI::Disabled;
+	}
+	Actor->FinishSpawning(SpawnTransform);
+	if (Actor->IsPendingKill())
+	{
+		return nullptr;
+	}
+
+	Actor->SetActorHiddenInGame(true);
+	Actor->SetActorEnableCollision(false);
+	Actor->SetActorTickEnabled(false);
+	if (const APawn* Pawn = Cast<APawn>(Actor))
+	{
+		if (UPawnMovementComponent* Movement = Pawn->GetMovementComponent())
+		{
+			Movement->Deactivate();
+		}
+	}
+
+	return Actor;
+}
+
+void UMechSurvivalWaveDirector::ActivateActor(AActor* Actor, const FVector& Location)
+{
+	// TeleportTo nudges pawns out of whatever they would spawn inside
+	Actor->TeleportTo(Location + FVector(0.f, 0.f, Actor->GetSimpleCollisionHalfHeight()), FRotator(0.f, FMath::FRandRange(0.f, 360.f), 0.f));
+	Actor->SetActorHiddenInGame(false);
+	Actor->SetActorEnableCollision(true);
+	Actor->SetActorTickEnabled(true);
+
+	if (APawn* Pawn = Cast<APawn>(Actor))
+	{
+		if (UPawnMovementComponent* Movement = Pawn->GetMovementComponent())
+		{
+			Movement->Activate(true);
+		}
+		// Parked pawns had auto possession turned off; the class decides whether a spawned one gets a controller
+		const EAutoPossessAI AutoPossessAI = Pawn->GetClass()->GetDefaultObject<APawn>()->AutoPossessAI;
+		Pawn->AutoPossessAI = AutoPossessAI;
+		if (Pawn->GetController() == nullptr && (AutoPossessAI == EAutoPossessAI::Spawned || AutoPossessAI == EAutoPossessAI::PlacedInWorldOrSpawned))
+		{
+			Pawn->SpawnDefaultController();
+		}
+	}
+}
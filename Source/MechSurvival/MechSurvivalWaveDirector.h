@@ -0,0 +1,228 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Engine/DataTable.h"
+#include "Engine/StreamableManager.h"
+#include "MechSurvivalWaveDirector.generated.h"
+
+class UDataTable;
+
+/** Actors of one class spawned by a wave, e.g. enemies or pickups */
+USTRUCT(BlueprintType)
+struct FMechSurvivalWaveActorSpawn
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category=Wave)
+	TSoftClassPtr<AActor> ActorClass;
+
+	UPROPERTY(EditAnywhere, Category=Wave)
+	int32 Count = 0;
+
+	/** Pawns have to be killed before the wave counts as cleared; other actors, such as pickups, do not */
+	UPROPERTY(EditAnywhere, Category=Wave)
+	bool bRequiredForClear = true;
+};
+
+/** One wave; a row of the wave table, or an entry of the ini fallback */
+USTRUCT(BlueprintType)
+struct FMechSurvivalWaveDefinition : public FTableRowBase
+{
+	GENERATED_BODY()
+
+	/** Horde mechs in the wave */
+	UPROPERTY(EditAnywhere, Category=Wave)
+	int32 Mechs = 0;
+
+	/** Actors in the wave */
+	UPROPERTY(EditAnywhere, Category=Wave)
+	TArray<FMechSurvivalWaveActorSpawn> Actors;
+
+	/** Seconds of quiet before the wave; its assets are loaded and its actors pre-warmed meanwhile */
+	UPROPERTY(EditAnywhere, Category=Wave)
+	float IntermissionSeconds = 10.f;
+
+	/** The wave spawns on a ring between these distances from the players */
+	UPROPERTY(EditAnywhere, Category=Wave)
+	float SpawnMinRadius = 3000.f;
+
+	UPROPERTY(EditAnywhere, Category=Wave)
+	float SpawnMaxRadius = 8000.f;
+
+	/** The next wave starts after this long even if this one is not cleared; 0 waits for the clear */
+	UPROPERTY(EditAnywhere, Category=Wave)
+	float MaxSeconds = 0.f;
+};
+
+/** Hidden actors of one class spawned ahead of a wave */
+USTRUCT()
+struct FMechSurvivalPrewarmedActors
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<AActor*> Actors;
+};
+
+/** Where the director is between two waves */
+UENUM()
+enum class EMechSurvivalWavePhase : uint8
+{
+	/** Not started, or out of waves */
+	Idle,
+	/** Loading and pre-warming the next wave */
+	Intermission,
+	/** Working through the spawn queue of the current wave */
+	Spawning,
+	/** Everything spawned, waiting for the clear */
+	Active
+};
+
+/**
+ * Runs the waves of a match on the server.
+ * Waves come from WaveTable, or from the Waves ini list when no table is set. The table is loaded in the background
+ * from BeginPlay, and waves started before it is in wait for it. During the intermission before a wave its actor
+ * classes are loaded through the streamable manager and as many actors as the wave needs are spawned hidden, pawns
+ * without their AI controller, ahead of time. Once the wave starts, its mechs and actors are queued and released a few at a time, never spending
+ * more than SpawnBudgetMs of a frame on it, so a big wave costs a few frames of spawning instead of one long hitch.
+ */
+UCLASS(config=Game)
+class UMechSurvivalWaveDirector : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UMechSurvivalWaveDirector();
+
+	// UActorComponent interface
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	// End of UActorComponent interface
+
+	/** Starts the intermission before the first wave */
+	void StartWaves();
+
+	/** Ends the current wave or intermission right away and moves on to the next wave */
+	void SkipWave();
+
+	/** Writes the phase, wave and spawn timing to the log */
+	void DumpStats() const;
+
+	/**
+	 * Saves the phase of the current wave, what is left to spawn of it and the actors its clear waits for, or picks
+	 * the wave up from there when loading. Its mechs are saved with the horde.
+	 */
+	void SerializeWave(FArchive& Ar);
+
+	/** Index of the current or upcoming wave */
+	int32 GetWaveIndex() const { return WaveIndex; }
+
+	EMechSurvivalWavePhase GetPhase() const { return Phase; }
+
+protected:
+	/** Wave table, rows of FMechSurvivalWaveDefinition played in row order */
+	UPROPERTY(config, EditAnywhere, Category=Waves)
+	TSoftObjectPtr<UDataTable> WaveTable;
+
+	/** Waves played when WaveTable is not set */
+	UPROPERTY(config, EditAnywhere, Category=Waves)
+	TArray<FMechSurvivalWaveDefinition> Waves;
+
+	/** Starts the first wave when play begins; benchmark and stress runs never start waves on their own */
+	UPROPERTY(config, EditAnywhere, Category=Waves)
+	bool bAutoStart = true;
+
+	/** Milliseconds of a frame that spawning may use; the item that crosses the line is still finished */
+	UPROPERTY(config, EditAnywhere, Category=Waves)
+	float SpawnBudgetMs = 2.f;
+
+	/** Mechs are handed to the horde in batches of this size, since one mech costs far less than one actor */
+	UPROPERTY(config, EditAnywhere, Category=Waves)
+	int32 MechBatchSize = 64;
+
+private:
+	/** Loaded wave definitions, from the table or the ini */
+	const TArray<FMechSurvivalWaveDefinition>& GetWaves() const;
+
+	/** Starts loading WaveTable, once */
+	void RequestWaveTable();
+
+	/** Copies the rows of WaveTable into TableWaves, and starts the waves if they were waiting for it */
+	void OnWaveTableLoaded();
+
+	/** True while the waves wait for WaveTable */
+	bool IsWaveTableLoading() const { return !WaveTable.IsNull() && !bWaveTableLoaded; }
+
+	void BeginIntermission(int32 NewWaveIndex);
+	void BeginWave();
+
+	/** Spends what is left of the frame budget on pre-warming actors for the upcoming wave */
+	void PrewarmStep(double Deadline);
+
+	/** Spends the frame budget on the spawn queue */
+	void SpawnStep(double Deadline);
+
+	/** True once every mech and every actor required for the clear is gone */
+	bool IsWaveCleared() const;
+
+	/** Picks a spot on the spawn ring and drops it onto the ground */
+	FVector FindSpawnLocation(const FMechSurvivalWaveDefinition& Wave) const;
+
+	/** Average location of the players' pawns, or the player start when nobody has one */
+	FVector GetPlayersCenter() const;
+
+	/** Spawns an actor that sits hidden, without collision, movement or AI controller, until it is activated */
+	AActor* SpawnHidden(UClass* ActorClass);
+	void ActivateActor(AActor* Actor, const FVector& Location);
+
+	void OnWaveAssetsLoaded();
+
+	/** Still to spawn for the current wave */
+	struct FPendingSpawn
+	{
+		UClass* ActorClass = nullptr;
+		int32 Remaining = 0;
+		bool bRequiredForClear = true;
+	};
+
+	TArray<FPendingSpawn> SpawnQueue;
+	int32 PendingMechs = 0;
+
+	/** Waves from the table, copied out once it is loaded */
+	TArray<FMechSurvivalWaveDefinition> TableWaves;
+
+	FStreamableManager StreamableManager;
+
+	/** Keeps the classes of the upcoming wave loaded */
+	TSharedPtr<FStreamableHandle> LoadHandle;
+
+	/** Keeps WaveTable loaded */
+	TSharedPtr<FStreamableHandle> TableHandle;
+
+	/** Pre-warmed, hidden actors by class */
+	UPROPERTY(Transient)
+	TMap<UClass*, FMechSurvivalPrewarmedActors> PrewarmedActors;
+
+	/** Actors of the current wave the clear waits for */
+	TArray<TWeakObjectPtr<AActor>> RequiredActors;
+
+	EMechSurvivalWavePhase Phase = EMechSurvivalWavePhase::Idle;
+	int32 WaveIndex = 0;
+	float PhaseTime = 0.f;
+	bool bAssetsLoaded = false;
+	bool bWaveTableLoaded = false;
+
+	/** StartWaves was called while WaveTable was still loading */
+	bool bStartPending = false;
+
+	/** Wall time the current wave started and its spawn queue was filled */
+	double WaveStartTime = 0.0;
+
+	double LastSpawnLatencyMs = 0.0;
+	double LastFrameSpawnMs = 0.0;
+	int32 BudgetOverruns = 0;
+};
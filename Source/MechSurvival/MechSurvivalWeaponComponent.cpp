@@ -0,0 +1,323 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalWeaponComponent.h"
+#include "MechSurvival.h"
+#include "MechSurvivalAssetPreloader.h"
+#include "MechSurvivalCharacter.h"
+#include "MechSurvivalProjectile.h"
+#include "MechSurvivalProjectilePool.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMechWeapon, Log, All);
+
+/** Weapon of the first player's pawn, for the console commands */
+static UMechSurvivalWeaponComponent* GetFirstPlayerWeapon(UWorld* World)
+{
+	const APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+	const AMechSurvivalCharacter* Character = PlayerController ? Cast<AMechSurvivalCharacter>(PlayerController->GetPawn()) : nullptr;
+	return Character ? Character->GetWeaponComponent() : nullptr;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GEquipWeaponCmd(
+	TEXT("MechSurvival.Weapon.Equip"),
+	TEXT("Equips the ini preset <Name> on the first player's pawn, in this world only; no name goes back to the default weapon"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		UMechSurvivalWeaponComponent* WeaponComponent = GetFirstPlayerWeapon(World);
+		if (WeaponComponent == nullptr)
+		{
+			return;
+		}
+
+		if (Args.Num() == 0)
+		{
+			WeaponComponent->EquipDefault();
+		}
+		else if (!WeaponComponent->EquipPreset(FName(*Args[0])))
+		{
+			UE_LOG(LogMechWeapon, Warning, TEXT("No weapon preset named %s"), *Args[0]);
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld GDumpWeaponCmd(
+	TEXT("MechSurvival.Weapon.Dump"),
+	TEXT("Logs the first player's weapon and what firing it costs"),
+	FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+	{
+		if (const UMechSurvivalWeaponComponent* WeaponComponent = GetFirstPlayerWeapon(World))
+		{
+			WeaponComponent->DumpStats();
+		}
+	}));
+
+UMechSurvivalWeaponComponent::UMechSurvivalWeaponComponent()
+{
+	// Only ticks while rounds are owed or the trigger is held
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	Weapon = nullptr;
+}
+
+void UMechSurvivalWeaponComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	EquipDefault();
+}
+
+void UMechSurvivalWeaponComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	UpdateTrigger();
+
+	if (!bTriggerHeld && PendingRounds == 0)
+	{
+		SetComponentTickEnabled(false);
+	}
+}
+
+void UMechSurvivalWeaponComponent::StartFire()
+{
+	if (Weapon == nullptr)
+	{
+		return;
+	}
+
+	bTriggerHeld = true;
+
+	const FMechSurvivalWeaponStats& Stats = Weapon->Stats;
+	if (Stats.TriggerMode == EMechSurvivalTriggerMode::SemiAuto)
+	{
+		// A pull during the cooldown goes off as soon as the cooldown is over
+		PendingRounds = FMath::Max(PendingRounds, 1);
+	}
+	else if (Stats.TriggerMode == EMechSurvivalTriggerMode::Burst && PendingRounds == 0)
+	{
+		PendingRounds = FMath::Max(1, Stats.BurstCount);
+	}
+
+	SetComponentTickEnabled(true);
+
+	// The first round leaves in the frame of the press, not the next one
+	UpdateTrigger();
+}
+
+void UMechSurvivalWeaponComponent::StopFire()
+{
+	bTriggerHeld = false;
+}
+
+void UMechSurvivalWeaponComponent::UpdateTrigger()
+{
+	UWorld* World = GetWorld();
+	if (Weapon == nullptr || World == nullptr)
+	{
+		PendingRounds = 0;
+		return;
+	}
+
+	const FMechSurvivalWeaponStats& Stats = Weapon->Stats;
+	const bool bAutoFiring = bTriggerHeld && Stats.TriggerMode == EMechSurvivalTriggerMode::FullAuto;
+	const float Now = World->GetTimeSeconds();
+	const float Interval = Stats.GetFireInterval();
+
+	// Time spent not firing is not saved up for later
+	if (NextFireTime < Now - Interval)
+	{
+		NextFireTime = Now;
+	}
+
+	int32 Rounds = 0;
+	while ((PendingRounds > 0 || bAutoFiring) && NextFireTime <= Now && Rounds < MaxRoundsPerFrame)
+	{
+		++Rounds;
+		PendingRounds = FMath::Max(0, PendingRounds - 1);
+		NextFireTime += Interval;
+
+		// Without a fire rate, holding the trigger fires once per frame
+		if (Interval <= 0.f && PendingRounds == 0)
+		{
+			break;
+		}
+	}
+
+	if (Rounds > 0)
+	{
+		FireRounds(Rounds);
+	}
+}
+
+void UMechSurvivalWeaponComponent::FireRounds(int32 Rounds)
+{
+	AMechSurvivalCharacter* Character = Cast<AMechSurvivalCharacter>(GetOwner());
+	if (Character == nullptr)
+	{
+		return;
+	}
+
+	MECHSURVIVAL_SCOPE_CYCLE_COUNTER(WeaponFire);
+
+	const double StartTime = FPlatformTime::Seconds();
+	const int32 Pellets = Character->FireWeapon(Weapon, Rounds);
+	if (Pellets == 0)
+	{
+		return;
+	}
+
+	FireStats.Seconds += FPlatformTime::Seconds() - StartTime;
+	++FireStats.Batches;
+	FireStats.Rounds += Rounds;
+	FireStats.Pellets += Pellets;
+
+	// The first round of any weapon stops the startup report's clock
+	if (FireStats.Batches == 1)
+	{
+		if (UMechSurvivalAssetPreloader* Preloader = UMechSurvivalAssetPreloader::Get(this))
+		{
+			Preloader->NotifyShotFired();
+		}
+	}
+
+	MECHSURVIVAL_INC_COUNTER(WeaponRounds, Rounds);
+	MECHSURVIVAL_INC_COUNTER(WeaponPellets, Pellets);
+}
+
+void UMechSurvivalWeaponComponent::Equip(UMechSurvivalWeaponData* NewWeapon)
+{
+	Weapon = NewWeapon;
+	PendingRounds = 0;
+	ServerRounds = 1.f + ServerRoundAllowance;
+	ServerRoundsTime = GetWorld() ? GetWorld()->GetTimeSeconds() : 0.f;
+
+	if (Weapon == nullptr)
+	{
+		return;
+	}
+
+	const TSoftClassPtr<AMechSurvivalProjectile>& ProjectileClass = Weapon->Stats.ProjectileClass;
+	UMechSurvivalAssetPreloader* Preloader = UMechSurvivalAssetPreloader::Get(this);
+	if (ProjectileClass.IsPending() && Preloader != nullptr)
+	{
+		TArray<FSoftObjectPath> Assets;
+		Assets.Add(ProjectileClass.ToSoftObjectPath());
+		LoadHandle = Preloader->RequestAsyncLoad(Assets, FStreamableDelegate::CreateUObject(this, &UMechSurvivalWeaponComponent::OnWeaponLoaded), GetNameSafe(Weapon));
+	}
+	else
+	{
+		OnWeaponLoaded();
+	}
+}
+
+bool UMechSurvivalWeaponComponent::EquipPreset(FName PresetName)
+{
+	const FMechSurvivalWeaponStats* Preset = Presets.FindByPredicate([PresetName](const FMechSurvivalWeaponStats& Candidate) { return Candidate.Name == PresetName; });
+	if (PresetName.IsNone() || Preset == nullptr)
+	{
+		return false;
+	}
+
+	Equip(UMechSurvivalWeaponData::FindOrCreatePreset(*Preset));
+	return true;
+}
+
+UMechSurvivalWeaponData* UMechSurvivalWeaponComponent::FindPresetWeapon(FName PresetName)
+{
+	const TArray<FMechSurvivalWeaponStats>& DefaultPresets = GetDefault<UMechSurvivalWeaponComponent>()->Presets;
+	const FMechSurvivalWeaponStats* Preset = DefaultPresets.FindByPredicate([PresetName](const FMechSurvivalWeaponStats& Candidate) { return Candidate.Name == PresetName; });
+	return !PresetName.IsNone() && Preset != nullptr ? UMechSurvivalWeaponData::FindOrCreatePreset(*Preset) : nullptr;
+}
+
+void UMechSurvivalWeaponComponent::EquipDefault()
+{
+	if (DefaultWeapon.IsNull())
+	{
+		if (!EquipPreset(DefaultPreset))
+		{
+			UE_LOG(LogMechWeapon, Warning, TEXT("%s: no default weapon, and no weapon preset named %s"), *GetNameSafe(GetOwner()), *DefaultPreset.ToString());
+		}
+		return;
+	}
+
+	if (UMechSurvivalWeaponData* LoadedWeapon = DefaultWeapon.Get())
+	{
+		Equip(LoadedWeapon);
+		return;
+	}
+
+	UMechSurvivalAssetPreloader* Preloader = UMechSurvivalAssetPreloader::Get(this);
+	if (Preloader == nullptr)
+	{
+		UE_LOG(LogMechWeapon, Log, TEXT("Loading weapon %s"), *DefaultWeapon.ToString());
+		Equip(DefaultWeapon.LoadSynchronous());
+		return;
+	}
+
+	TArray<FSoftObjectPath> Assets;
+	GetPreloadAssets(Assets);
+	TWeakObjectPtr<UMechSurvivalWeaponComponent> WeakThis(this);
+	LoadHandle = Preloader->RequestAsyncLoad(Assets, FStreamableDelegate::CreateLambda([WeakThis]()
+	{
+		if (UMechSurvivalWeaponComponent* This = WeakThis.Get())
+		{
+			This->Equip(This->DefaultWeapon.Get());
+		}
+	}), DefaultWeapon.ToString());
+}
+
+void UMechSurvivalWeaponComponent::OnWeaponLoaded()
+{
+	// Fill the pool for the weapon's own projectile now rather than on the first shots
+	UClass* ProjectileClass = Weapon ? Weapon->Stats.ProjectileClass.Get() : nullptr;
+	UMechSurvivalProjectilePool* ProjectilePool = UMechSurvivalProjectilePool::Get(this);
+	if (ProjectileClass != nullptr && ProjectilePool != nullptr)
+	{
+		ProjectilePool->Prewarm(ProjectileClass);
+	}
+}
+
+bool UMechSurvivalWeaponComponent::ConsumeServerRound()
+{
+	UWorld* World = GetWorld();
+	if (Weapon == nullptr || World == nullptr)
+	{
+		return false;
+	}
+
+	const float Interval = Weapon->Stats.GetFireInterval();
+	if (Interval <= 0.f)
+	{
+		return true;
+	}
+
+	const float Now = World->GetTimeSeconds();
+	ServerRounds = FMath::Min(1.f + ServerRoundAllowance, ServerRounds + (Now - ServerRoundsTime) / Interval);
+	ServerRoundsTime = Now;
+
+	if (ServerRounds < 1.f)
+	{
+		return false;
+	}
+	ServerRounds -= 1.f;
+	return true;
+}
+
+void UMechSurvivalWeaponComponent::GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const
+{
+	OutAssets.Add(DefaultWeapon.ToSoftObjectPath());
+}
+
+void UMechSurvivalWeaponComponent::DumpStats() const
+{
+	const FMechSurvivalWeaponStats* Stats = Weapon ? &Weapon->Stats : nullptr;
+	UE_LOG(LogMechWeapon, Log, TEXT("%s: %s, %s at %.0f RPM, %d pellet(s)"),
+		*GetNameSafe(GetOwner()), *GetNameSafe(Weapon), Stats ? *StaticEnum<EMechSurvivalTriggerMode>()->GetNameStringByValue((int64)Stats->TriggerMode) : TEXT("-"),
+		Stats ? Stats->RoundsPerMinute : 0.f, Stats ? Stats->Pellets : 0);
+	UE_LOG(LogMechWeapon, Log, TEXT("%d rounds in %d frames, %d pellets; %.1f us per round, %.2f us per pellet"),
+		FireStats.Rounds, FireStats.Batches, FireStats.Pellets,
+		FireStats.Rounds > 0 ? FireStats.Seconds * 1000000.0 / FireStats.Rounds : 0.0,
+		FireStats.Pellets > 0 ? FireStats.Seconds * 1000000.0 / FireStats.Pellets : 0.0);
+}
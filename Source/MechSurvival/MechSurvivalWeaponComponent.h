@@ -0,0 +1,132 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "MechSurvivalWeaponData.h"
+#include "MechSurvivalWeaponComponent.generated.h"
+
+struct FStreamableHandle;
+
+/** Running counters of a weapon component, cumulative since it was created */
+struct FMechSurvivalWeaponFireStats
+{
+	/** Frames that fired at least one round */
+	int32 Batches = 0;
+	int32 Rounds = 0;
+	int32 Pellets = 0;
+	/** Wall time spent firing, from working out the muzzle to the last pellet being in flight */
+	double Seconds = 0.0;
+
+	FMechSurvivalWeaponFireStats& operator+=(const FMechSurvivalWeaponFireStats& Other)
+	{
+		Batches += Other.Batches;
+		Rounds += Other.Rounds;
+		Pellets += Other.Pellets;
+		Seconds += Other.Seconds;
+		return *this;
+	}
+};
+
+/**
+ * Trigger of a character's weapon.
+ * Turns trigger presses and releases into rounds according to the equipped weapon's trigger mode and fire rate.
+ * Every round due in a frame, and every pellet of those rounds, is handed to the character in one call, which
+ * launches them all through one pool or ballistics batch; a 12 pellet shotgun or a 1200 RPM minigun costs one
+ * launch per frame rather than one per projectile.
+ * Weapons come from weapon data assets, or from the Presets ini list by name.
+ */
+UCLASS(config=Game, ClassGroup=MechSurvival)
+class UMechSurvivalWeaponComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UMechSurvivalWeaponComponent();
+
+	// UActorComponent interface
+	virtual void BeginPlay() override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	// End of UActorComponent interface
+
+	void StartFire();
+	void StopFire();
+
+	/** Switches to a weapon; its projectile class is loaded in the background if needed */
+	void Equip(UMechSurvivalWeaponData* NewWeapon);
+
+	/** Switches to the ini preset of that name; returns false if there is none */
+	bool EquipPreset(FName PresetName);
+
+	/** Returns the weapon of the ini preset of that name, as every machine with the same ini has it; null if there is none */
+	static UMechSurvivalWeaponData* FindPresetWeapon(FName PresetName);
+
+	/** Switches back to DefaultWeapon, or DefaultPreset when no weapon asset is set */
+	void EquipDefault();
+
+	/**
+	 * Takes one round off the server's allowance for this weapon; server only.
+	 * Clients may fire no faster than the weapon does, give or take network jitter.
+	 */
+	bool ConsumeServerRound();
+
+	/** Adds the assets the component refers to softly, for the startup preload */
+	void GetPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const;
+
+	/** Writes the weapon and its firing cost to the log */
+	void DumpStats() const;
+
+	UMechSurvivalWeaponData* GetWeapon() const { return Weapon; }
+
+	const FMechSurvivalWeaponFireStats& GetFireStats() const { return FireStats; }
+
+protected:
+	/** Weapon equipped when play begins */
+	UPROPERTY(config, EditDefaultsOnly, Category=Weapon)
+	TSoftObjectPtr<UMechSurvivalWeaponData> DefaultWeapon;
+
+	/** Preset equipped when play begins if DefaultWeapon is not set */
+	UPROPERTY(config, EditDefaultsOnly, Category=Weapon)
+	FName DefaultPreset;
+
+	/** Weapons defined in the ini, equipped by name */
+	UPROPERTY(config)
+	TArray<FMechSurvivalWeaponStats> Presets;
+
+	/** Most rounds fired in one frame, so that a long hitch does not end in a wall of rounds */
+	UPROPERTY(config)
+	int32 MaxRoundsPerFrame = 8;
+
+	/** Rounds a client may be ahead of the weapon's fire rate before the server drops its rounds */
+	UPROPERTY(config)
+	float ServerRoundAllowance = 2.f;
+
+private:
+	/** Fires every round due by now */
+	void UpdateTrigger();
+
+	void FireRounds(int32 Rounds);
+
+	void OnWeaponLoaded();
+
+	UPROPERTY(Transient)
+	UMechSurvivalWeaponData* Weapon;
+
+	/** Keeps the default weapon or the equipped weapon's projectile class loaded */
+	TSharedPtr<FStreamableHandle> LoadHandle;
+
+	bool bTriggerHeld = false;
+
+	/** Rounds owed to single pulls and bursts */
+	int32 PendingRounds = 0;
+
+	/** World time the next round may go */
+	float NextFireTime = 0.f;
+
+	/** Rounds the server lets the client fire right now, refilled at the weapon's fire rate */
+	float ServerRounds = 0.f;
+	float ServerRoundsTime = 0.f;
+
+	FMechSurvivalWeaponFireStats FireStats;
+};
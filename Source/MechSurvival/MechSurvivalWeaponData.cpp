@@ -0,0 +1,28 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "MechSurvivalWeaponData.h"
+#include "MechSurvivalProjectile.h"
+#include "UObject/Package.h"
+
+/** Primary asset type weapons are registered under in the asset manager settings */
+static const FName WeaponAssetType(TEXT("MechSurvivalWeapon"));
+
+FPrimaryAssetId UMechSurvivalWeaponData::GetPrimaryAssetId() const
+{
+	return FPrimaryAssetId(WeaponAssetType, GetFName());
+}
+
+UMechSurvivalWeaponData* UMechSurvivalWeaponData::FindOrCreatePreset(const FMechSurvivalWeaponStats& Preset)
+{
+	const FString ObjectName = FString::Printf(TEXT("MechSurvivalWeaponPreset_%s"), *Preset.Name.ToString());
+
+	UMechSurvivalWeaponData* Weapon = FindObject<UMechSurvivalWeaponData>(GetTransientPackage(), *ObjectName);
+	if (Weapon == nullptr)
+	{
+		// Rounds in flight and the ballistic parameter table refer to it, so it lives as long as the process
+		Weapon = NewObject<UMechSurvivalWeaponData>(GetTransientPackage(), *ObjectName);
+		Weapon->AddToRoot();
+	}
+	Weapon->Stats = Preset;
+	return Weapon;
+}
@@ -0,0 +1,141 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "Math/RandomStream.h"
+#include "MechSurvivalWeaponData.generated.h"
+
+class AMechSurvivalProjectile;
+
+/** What holding the trigger does */
+UENUM()
+enum class EMechSurvivalTriggerMode : uint8
+{
+	/** One round per pull */
+	SemiAuto,
+	/** Rounds for as long as the trigger is held */
+	FullAuto,
+	/** BurstCount rounds per pull */
+	Burst
+};
+
+/** Everything that makes one weapon differ from another; shared by weapon data assets and the ini presets */
+USTRUCT(BlueprintType)
+struct FMechSurvivalWeaponStats
+{
+	GENERATED_BODY()
+
+	/** Name the weapon is equipped by from the ini presets and the benchmark */
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	FName Name;
+
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	EMechSurvivalTriggerMode TriggerMode = EMechSurvivalTriggerMode::SemiAuto;
+
+	/** Fastest the weapon fires in any mode, including within a burst */
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	float RoundsPerMinute = 600.f;
+
+	/** Rounds per pull in Burst mode */
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	int32 BurstCount = 3;
+
+	/** Projectiles per round, e.g. 12 for a shotgun */
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	int32 Pellets = 1;
+
+	/** Half-angle of the cone pellets are scattered in, in degrees */
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	float SpreadDegrees = 0.f;
+
+	/** Muzzle offset from the gun, in camera space */
+	UPROPERTY(EditAnywhere, Category=Weapon)
+	FVector MuzzleOffset = FVector(100.f, 0.f, 10.f);
+
+	/** Projectile fired; supplies the mesh and collision. The character's projectile class is used when not set */
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	TSoftClassPtr<AMechSurvivalProjectile> ProjectileClass;
+
+	// The flight and damage of the rounds, in place of the projectile class defaults
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float InitialSpeed = 3000.f;
+
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float MaxSpeed = 3000.f;
+
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float GravityScale = 1.f;
+
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	bool bShouldBounce = true;
+
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float Bounciness = 0.6f;
+
+	/** Seconds a round flies; 0 flies until it hits something */
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float LifeSpan = 3.f;
+
+	/** Damage per pellet */
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float Damage = 20.f;
+
+	/** Radius a pellet explodes over where it hits, damaging everything within it; 0 only damages what it hits */
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	float ExplosionRadius = 0.f;
+
+	/** Seconds between two rounds */
+	float GetFireInterval() const { return RoundsPerMinute > 0.f ? 60.f / RoundsPerMinute : 0.f; }
+
+	/**
+	 * Adds the launch direction of every pellet of one round.
+	 * The scatter only depends on Seed, so whoever knows the aim and the seed gets the same pellets.
+	 */
+	template<typename AllocatorType>
+	void AddPelletRotations(const FRotator& Aim, int32 Seed, TArray<FRotator, AllocatorType>& OutRotations) const
+	{
+		const int32 NumPellets = FMath::Max(1, Pellets);
+		if (SpreadDegrees <= 0.f)
+		{
+			for (int32 Pellet = 0; Pellet < NumPellets; ++Pellet)
+			{
+				OutRotations.Add(Aim);
+			}
+			return;
+		}
+
+		const FRandomStream Stream(Seed);
+		const FVector Direction = Aim.Vector();
+		const float HalfAngle = FMath::DegreesToRadians(SpreadDegrees);
+		for (int32 Pellet = 0; Pellet < NumPellets; ++Pellet)
+		{
+			OutRotations.Add(Stream.VRandCone(Direction, HalfAngle).Rotation());
+		}
+	}
+};
+
+/**
+ * A weapon, for the weapon component to equip.
+ * Weapons are primary assets of type MechSurvivalWeapon, so the asset manager can find and cook them by type.
+ */
+UCLASS(BlueprintType)
+class UMechSurvivalWeaponData : public UPrimaryDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditDefaultsOnly, Category=Weapon, meta=(ShowOnlyInnerProperties))
+	FMechSurvivalWeaponStats Stats;
+
+	// UObject interface
+	virtual FPrimaryAssetId GetPrimaryAssetId() const override;
+	// End of UObject interface
+
+	/**
+	 * Returns the weapon for an ini preset, creating it the first time.
+	 * Presets are not assets, so their shots reach clients by name, see UMechSurvivalWeaponComponent::FindPresetWeapon.
+	 */
+	static UMechSurvivalWeaponData* FindOrCreatePreset(const FMechSurvivalWeaponStats& Preset);
+};